@@ -35,15 +35,18 @@ class PlaceDataCollection (object):
         # position should be parameter
         self.pos = pos
         # other tensors required to build ops
-        self.node_size_x = torch.from_numpy(placedb.node_size_x).to(device)
-        self.node_size_y = torch.from_numpy(placedb.node_size_y).to(device)
+        # node-indexed tensors are copied from placedb, as they may be permuted during global placement
+        self.node_size_x = torch.tensor(placedb.node_size_x, device=device)
+        self.node_size_y = torch.tensor(placedb.node_size_y, device=device)
 
         self.pin_offset_x = torch.tensor(placedb.pin_offset_x, dtype=self.pos[0].dtype, device=device)
         self.pin_offset_y = torch.tensor(placedb.pin_offset_y, dtype=self.pos[0].dtype, device=device)
 
-        self.pin2node_map = torch.from_numpy(placedb.pin2node_map).to(device)
-        self.flat_node2pin_map = torch.from_numpy(placedb.flat_node2pin_map).to(device)
-        self.flat_node2pin_start_map = torch.from_numpy(placedb.flat_node2pin_start_map).to(device)
+        self.pin2node_map = torch.tensor(placedb.pin2node_map, device=device)
+        self.flat_node2pin_map = torch.tensor(placedb.flat_node2pin_map, device=device)
+        self.flat_node2pin_start_map = torch.tensor(placedb.flat_node2pin_start_map, device=device)
+        # original index of the node stored at each position, identity unless cells are spatially sorted
+        self.node_order = torch.arange(placedb.num_nodes, dtype=torch.int64, device=device)
 
         self.pin2net_map = torch.from_numpy(placedb.pin2net_map).to(device)
         self.flat_net2pin_map = torch.from_numpy(placedb.flat_net2pin_map).to(device)
@@ -102,6 +105,7 @@ class PlaceOpCollection (object):
         self.pin_pos_op = None
         self.move_boundary_op = None
         self.hpwl_op = None
+        self.incremental_hpwl_op = None
         self.rmst_wl_op = None
         self.density_overflow_op = None
         self.greedy_legalize_op = None
@@ -113,6 +117,8 @@ class PlaceOpCollection (object):
         self.precondition_op = None
         self.noise_op = None
         self.draw_place_op = None
+        self.spatial_sort_op = None
+        self.restore_node_order_op = None
 
 class BasicPlace (nn.Module):
     """
@@ -172,19 +178,18 @@ class BasicPlace (nn.Module):
         self.op_collections.move_boundary_op = self.build_move_boundary(params, placedb, self.data_collections, self.device)
         # hpwl and density overflow ops for evaluation
         self.op_collections.hpwl_op = self.build_hpwl(params, placedb, self.data_collections, self.op_collections.pin_pos_op, self.device)
+        # hpwl that only recomputes the nets of moved cells, for legalization and detailed placement on CPU
+        self.op_collections.incremental_hpwl_op = self.build_incremental_hpwl(params, placedb, self.data_collections, self.device)
         # rectilinear minimum steiner tree wirelength from flute
-        # can only be called once
-        #self.op_collections.rmst_wl_op = self.build_rmst_wl(params, placedb, self.op_collections.pin_pos_op, torch.device("cpu"))
+        self.op_collections.rmst_wl_op = self.build_rmst_wl(params, placedb, self.op_collections.pin_pos_op, torch.device("cpu"))
         #self.op_collections.density_overflow_op = self.build_density_overflow(params, placedb, self.data_collections, self.device)
         self.op_collections.density_overflow_op = self.build_electric_overflow(params, placedb, self.data_collections, self.device)
         # legalization
         self.op_collections.greedy_legalize_op = self.build_greedy_legalization(params, placedb, self.data_collections, self.device)
         # draw placement
         self.op_collections.draw_place_op = self.build_draw_placement(params, placedb)
-
-        # flag for rmst_wl_op
-        # can only read once
-        self.read_lut_flag = True
+        # spatial sorting of cells for memory locality in global placement
+        self.op_collections.spatial_sort_op, self.op_collections.restore_node_order_op = self.build_spatial_sort(params, placedb, self.data_collections, self.device)
 
         #print("build BasicPlace ops takes %.2f seconds" % (time.time()-tt))
 
@@ -254,6 +259,30 @@ class BasicPlace (nn.Module):
 
         return build_wirelength_op
 
+    def build_incremental_hpwl(self, params, placedb, data_collections, device):
+        """
+        @brief compute half-perimeter wirelength from cell locations, keeping the bounding box of each net between calls,
+        so that only the nets of moved cells are recomputed; None on DCU
+        @param params parameters
+        @param placedb placement database
+        @param data_collections a collection of all data and variables required for constructing the ops
+        @param device cpu or dcu
+        """
+        if params.gpu:
+            return None
+        return hpwl.IncrementalHPWL(
+            flat_netpin=data_collections.flat_net2pin_map,
+            netpin_start=data_collections.flat_net2pin_start_map,
+            pin2net_map=data_collections.pin2net_map,
+            pin2node_map=data_collections.pin2node_map,
+            pin_offset_x=data_collections.pin_offset_x,
+            pin_offset_y=data_collections.pin_offset_y,
+            flat_node2pin=data_collections.flat_node2pin_map,
+            flat_node2pin_start=data_collections.flat_node2pin_start_map,
+            net_mask=data_collections.net_mask_all,
+            num_threads=params.num_threads
+        )
+
     def build_rmst_wl(self, params, placedb, pin_pos_op, device):
         """
         @brief compute rectilinear minimum spanning tree wirelength with flute
@@ -273,15 +302,15 @@ class BasicPlace (nn.Module):
             netpin_start=torch.from_numpy(placedb.flat_net2pin_start_map).to(device),
             ignore_net_degree=params.ignore_net_degree,
             POWVFILE=POWVFILE,
-            POSTFILE=POSTFILE
+            POSTFILE=POSTFILE,
+            num_threads=params.num_threads,
+            cache_topology=True
         )
 
         # wirelength for position
         def build_wirelength_op(pos):
             pin_pos = pin_pos_op(pos)
-            wls = wirelength_for_pin_op(pin_pos.clone().cpu(), self.read_lut_flag)
-            self.read_lut_flag = False
-            return wls
+            return wirelength_for_pin_op(pin_pos.clone().cpu())
 
         return build_wirelength_op
 
@@ -303,6 +332,7 @@ class BasicPlace (nn.Module):
             num_terminals=placedb.num_terminals,
             num_filler_nodes=0,
             algorithm='by-node',
+            deterministic_flag=params.deterministic_flag,
             num_threads=params.num_threads
         )
 
@@ -324,6 +354,7 @@ class BasicPlace (nn.Module):
             num_terminals=placedb.num_terminals,
             num_filler_nodes=0,
             padding=0,
+            deterministic_flag=params.deterministic_flag,
             num_threads=params.num_threads
         )
 
@@ -353,6 +384,94 @@ class BasicPlace (nn.Module):
         """
         return draw_place.DrawPlace(placedb)
 
+    def build_spatial_sort(self, params, placedb, data_collections, device):
+        """
+        @brief sort movable cells and filler cells by the Morton key of the bins they are in,
+        so that cells close in the layout are also close in memory for the density map scatter and the field gather.
+        Fixed cells keep their indices.
+        Cell locations, cell sizes, pin-to-cell maps and any other given tensors indexed by cells are permuted in place,
+        and data_collections.node_order records the original index of each cell.
+        @param params parameters
+        @param placedb placement database
+        @param data_collections a collection of all data and variables required for constructing the ops
+        @param device cpu or dcu
+        """
+        num_nodes = placedb.num_nodes
+
+        def spread_bits(v):
+            # move the lower 16 bits of v to the even bit positions
+            v = v & 0x0000ffff
+            v = (v | (v << 8)) & 0x00ff00ff
+            v = (v | (v << 4)) & 0x0f0f0f0f
+            v = (v | (v << 2)) & 0x33333333
+            v = (v | (v << 1)) & 0x55555555
+            return v
+
+        def permute_op(pos, new2old, node_tensors):
+            """
+            @param new2old the node to be stored at each position, in the current order
+            @param node_tensors tensors of length #nodes, or #nodes*2 for x followed by y
+            """
+            with torch.no_grad():
+                index = torch.from_numpy(new2old).to(device)
+                index2 = torch.cat([index, index+num_nodes])
+                visited = set()
+                for tensor in [pos, data_collections.node_size_x, data_collections.node_size_y, data_collections.node_order] + list(node_tensors):
+                    # the same storage may be referred by several optimizer states
+                    if tensor is None or tensor.data_ptr() in visited:
+                        continue
+                    visited.add(tensor.data_ptr())
+                    data = tensor.data
+                    data.copy_(data.index_select(0, index if data.numel() == num_nodes else index2))
+
+                # pins keep their indices, but are attached to new indices of their cells
+                old2new = np.empty_like(new2old)
+                old2new[new2old] = np.arange(num_nodes)
+                pin2node_map = data_collections.pin2node_map.cpu().numpy()
+                data_collections.pin2node_map.copy_(torch.from_numpy(old2new[pin2node_map].astype(pin2node_map.dtype)))
+                # rebuild the node-to-pin map in CSR format in the new order of physical cells
+                flat_node2pin_map = data_collections.flat_node2pin_map.cpu().numpy()
+                flat_node2pin_start_map = data_collections.flat_node2pin_start_map.cpu().numpy()
+                physical_new2old = new2old[:placedb.num_physical_nodes]
+                node_num_pins = np.diff(flat_node2pin_start_map)[physical_new2old]
+                new_start_map = np.zeros_like(flat_node2pin_start_map)
+                np.cumsum(node_num_pins, out=new_start_map[1:])
+                pin_index = np.repeat(flat_node2pin_start_map[physical_new2old]-new_start_map[:-1], node_num_pins) + np.arange(len(flat_node2pin_map))
+                data_collections.flat_node2pin_map.copy_(torch.from_numpy(flat_node2pin_map[pin_index]))
+                data_collections.flat_node2pin_start_map.copy_(torch.from_numpy(new_start_map))
+
+        def spatial_sort_op(pos, num_bins_x, num_bins_y, node_tensors):
+            """
+            @param pos locations of cells
+            @param num_bins_x number of bins in horizontal direction
+            @param num_bins_y number of bins in vertical direction
+            @param node_tensors other tensors indexed by cells to be permuted, e.g., optimizer states
+            """
+            bin_size_x = (placedb.xh-placedb.xl) / num_bins_x
+            bin_size_y = (placedb.yh-placedb.yl) / num_bins_y
+            cur_pos = pos.data.cpu().numpy()
+            center_x = cur_pos[:num_nodes] + data_collections.node_size_x.cpu().numpy()/2
+            center_y = cur_pos[num_nodes:] + data_collections.node_size_y.cpu().numpy()/2
+            bin_x = np.clip(np.floor((center_x-placedb.xl) / bin_size_x), 0, num_bins_x-1).astype(np.int64)
+            bin_y = np.clip(np.floor((center_y-placedb.yl) / bin_size_y), 0, num_bins_y-1).astype(np.int64)
+            key = spread_bits(bin_x) | (spread_bits(bin_y) << 1)
+
+            # stable sort keeps cells in the same bin in their current order
+            new2old = np.arange(num_nodes)
+            new2old[:placedb.num_movable_nodes] = np.argsort(key[:placedb.num_movable_nodes], kind='stable')
+            new2old[placedb.num_physical_nodes:] = placedb.num_physical_nodes + np.argsort(key[placedb.num_physical_nodes:], kind='stable')
+            permute_op(pos, new2old, node_tensors)
+
+        def restore_node_order_op(pos, node_tensors=()):
+            """
+            @brief undo all the permutations, so that cells are stored in the order of placedb again
+            @param pos locations of cells
+            @param node_tensors other tensors indexed by cells to be permuted
+            """
+            permute_op(pos, np.argsort(data_collections.node_order.cpu().numpy()), node_tensors)
+
+        return spatial_sort_op, restore_node_order_op
+
     def validate(self, placedb, pos, iteration):
         """
         @brief validate placement
@@ -107,6 +107,13 @@ class NonLinearPlace (BasicPlace.BasicPlace):
 
                     t0 = time.time()
 
+                    # cells drift away from their neighbors in memory, sort them by bins again
+                    if params.gp_spatial_sort_interval > 0 and step > 0 and step % params.gp_spatial_sort_interval == 0:
+                        t1 = time.time()
+                        self.op_collections.spatial_sort_op(model.data_collections.pos[0], model.num_bins_x, model.num_bins_y,
+                                self.node_states(optimizer) + [model.num_pins_in_nodes, model.node_areas])
+                        print("[I] spatial sorting takes %.3f ms" % ((time.time()-t1)*1000))
+
                     # move any out-of-bound cell back to placement region
                     self.op_collections.move_boundary_op(model.data_collections.pos[0])
 
@@ -118,6 +125,10 @@ class NonLinearPlace (BasicPlace.BasicPlace):
                     #t1 = time.time()
                     cur_metric.evaluate(placedb, eval_ops, model.data_collections.pos[0])
                     #print("evaluation %.3f ms" % ((time.time()-t1)*1000))
+                    # start with coarse bins and refine them as overflow drops in adaptive mode
+                    density_bins_refined = model.refine_density_bins(params, placedb, cur_metric.overflow)
+                    if density_bins_refined:
+                        print("[I] density bins refined to %dx%d, density_weight = %.6E" % (model.num_bins_x, model.num_bins_y, model.density_weight.data))
                     #t2 = time.time()
                     # update density weight
                     # gradually reduce gamma to tradeoff smoothness and accuracy
@@ -134,8 +145,8 @@ class NonLinearPlace (BasicPlace.BasicPlace):
                     elif optimizer_name.lower() != "nesterov":
                         assert 0, "unsupported optimizer %s" % (optimizer_name)
 
-                    # stopping criteria
-                    if iteration > 100 and ((cur_metric.overflow < params.stop_overflow and cur_metric.hpwl > metrics[-2].hpwl) or cur_metric.max_density < 1.0):
+                    # stopping criteria, only with the final bins that have been optimized for at least one step
+                    if not density_bins_refined and model.final_density_bins() and iteration > 100 and ((cur_metric.overflow < params.stop_overflow and cur_metric.hpwl > metrics[-2].hpwl) or cur_metric.max_density < 1.0):
                         print("[D] stopping criteria: %d > 100 and (( %g < 0.1 and %g > %g ) or %g < 1.0)" % (iteration, cur_metric.overflow, cur_metric.hpwl, metrics[-2].hpwl, cur_metric.max_density))
                         break
 
@@ -147,6 +158,9 @@ class NonLinearPlace (BasicPlace.BasicPlace):
                     # plot placement
                     if params.plot_flag and iteration % 100 == 0:
                         cur_pos = self.pos[0].data.clone().cpu().numpy()
+                        # plot with cells in the order of placedb
+                        node_order = self.data_collections.node_order.cpu().numpy()
+                        cur_pos[np.concatenate([node_order, node_order+placedb.num_nodes])] = cur_pos.copy()
                         self.plot(params, placedb, iteration, cur_pos)
 
                     t3 = time.time()
@@ -159,11 +173,23 @@ class NonLinearPlace (BasicPlace.BasicPlace):
 
                 print("[I] optimizer %s takes %.3f seconds" % (optimizer_name, time.time()-tt))
 
+            # later steps and results expect cells in the order of placedb
+            if params.gp_spatial_sort_interval > 0:
+                self.op_collections.restore_node_order_op(self.pos[0])
+
         # legalization
         if params.legalize_flag:
             tt = time.time()
+            incremental_hpwl_op = self.op_collections.incremental_hpwl_op
+            if incremental_hpwl_op is not None:
+                # cells may have been permuted in global placement, so all nets are computed again
+                hpwl = incremental_hpwl_op.reset(self.pos[0].data)
             self.pos[0].data.copy_(self.op_collections.greedy_legalize_op(self.pos[0]))
             print("[I] legalization takes %.3f seconds" % (time.time()-tt))
+            if incremental_hpwl_op is not None:
+                # only the nets of cells moved by legalization are recomputed
+                legal_hpwl = incremental_hpwl_op(self.pos[0].data)
+                print("[I] legalization changes HPWL from %.6E to %.6E (%+.3f%%)" % (hpwl, legal_hpwl, incremental_hpwl_op.delta*100/hpwl))
 
         # detailed placement
         if params.detailed_place_flag:
@@ -178,3 +204,27 @@ class NonLinearPlace (BasicPlace.BasicPlace):
         if params.plot_flag:
             self.plot(params, placedb, iteration, cur_pos)
         return metrics
+
+    def node_states(self, optimizer):
+        """
+        @brief collect the states of an optimizer indexed by cells, e.g., gradients, momentum, previous solutions.
+        They must be permuted together with cell locations.
+        @param optimizer optimizer
+        """
+        num_elements = self.pos[0].numel()
+        states = []
+        def collect(value):
+            if isinstance(value, (list, tuple)):
+                for v in value:
+                    collect(v)
+            elif isinstance(value, dict):
+                for v in value.values():
+                    collect(v)
+            elif torch.is_tensor(value) and value.numel() == num_elements:
+                states.append(value)
+        for group in optimizer.param_groups:
+            collect(group)
+            for p in group['params']:
+                collect(p.grad)
+        collect(list(optimizer.state.values()))
+        return states
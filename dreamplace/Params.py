@@ -41,6 +41,11 @@ class Params:
         self.RePlAce_LOWER_PCOF = 0.95
         self.RePlAce_UPPER_PCOF = 1.05
         self.num_threads = 8
+        self.gp_spatial_sort_interval = 0 # re-sort cells by the bins they are in every some iterations of global placement, 0 to disable
+        self.spectral_density_energy = False # compute density energy from spectral coefficients in every iteration, instead of a dummy zero
+        self.gp_adaptive_bins = 0 # initial number of bins in each direction of a global placement stage, doubled as overflow drops until the bins of the stage, 0 to disable
+        self.gp_adaptive_bins_overflow_ratio = 0.5 # double the bins when overflow drops to this ratio of the overflow at the last change of bins
+        self.deterministic_flag = False # accumulate density maps in fixed point on CPU, so density maps, but not wirelength, are the same with any number of threads
 
     def printWelcome(self):
         """
@@ -84,6 +89,11 @@ RePlAce_ref_hpwl [default %g]     | reference HPWL used in RePlAce for updating
 RePlAce_LOWER_PCOF [default %g]     | lower bound ratio used in RePlAce for updating density weight 
 RePlAce_UPPER_PCOF [default %g]     | upper bound ratio used in RePlAce for updating density weight 
 num_threads [default %d]            | number of CPU threads
+gp_spatial_sort_interval [default %d] | re-sort cells by the bins they are in every some iterations of global placement, 0 to disable
+spectral_density_energy [default %s] | compute density energy from spectral coefficients in every iteration, instead of a dummy zero
+gp_adaptive_bins [default %d]         | initial number of bins in each direction of a global placement stage, doubled as overflow drops until the bins of the stage, 0 to disable
+gp_adaptive_bins_overflow_ratio [default %g] | double the bins when overflow drops to this ratio of the overflow at the last change of bins
+deterministic_flag [default %d]        | accumulate density maps in fixed point on CPU, so density maps, but not wirelength, are the same with any number of threads
         """ % (self.gpu,
                 self.num_bins_x,
                 self.num_bins_y,
@@ -106,7 +116,12 @@ num_threads [default %d]            | number of CPU threads
                 self.RePlAce_ref_hpwl,
                 self.RePlAce_LOWER_PCOF,
                 self.RePlAce_UPPER_PCOF,
-                self.num_threads
+                self.num_threads,
+                self.gp_spatial_sort_interval,
+                self.spectral_density_energy,
+                self.gp_adaptive_bins,
+                self.gp_adaptive_bins_overflow_ratio,
+                self.deterministic_flag
                 )
         print(content)
 
@@ -140,6 +155,11 @@ num_threads [default %d]            | number of CPU threads
         data['RePlAce_LOWER_PCOF'] = self.RePlAce_LOWER_PCOF
         data['RePlAce_UPPER_PCOF'] = self.RePlAce_UPPER_PCOF
         data['num_threads'] = self.num_threads
+        data['gp_spatial_sort_interval'] = self.gp_spatial_sort_interval
+        data['spectral_density_energy'] = self.spectral_density_energy
+        data['gp_adaptive_bins'] = self.gp_adaptive_bins
+        data['gp_adaptive_bins_overflow_ratio'] = self.gp_adaptive_bins_overflow_ratio
+        data['deterministic_flag'] = self.deterministic_flag
         return data
 
     def fromJson(self, data):
@@ -171,6 +191,11 @@ num_threads [default %d]            | number of CPU threads
         if 'RePlAce_LOWER_PCOF' in data: self.RePlAce_LOWER_PCOF = data['RePlAce_LOWER_PCOF']
         if 'RePlAce_UPPER_PCOF' in data: self.RePlAce_UPPER_PCOF = data['RePlAce_UPPER_PCOF']
         if 'num_threads' in data: self.num_threads = data['num_threads']
+        if 'gp_spatial_sort_interval' in data: self.gp_spatial_sort_interval = data['gp_spatial_sort_interval']
+        if 'spectral_density_energy' in data: self.spectral_density_energy = data['spectral_density_energy']
+        if 'gp_adaptive_bins' in data: self.gp_adaptive_bins = data['gp_adaptive_bins']
+        if 'gp_adaptive_bins_overflow_ratio' in data: self.gp_adaptive_bins_overflow_ratio = data['gp_adaptive_bins_overflow_ratio']
+        if 'deterministic_flag' in data: self.deterministic_flag = data['deterministic_flag']
 
     def dump(self, filename):
         """
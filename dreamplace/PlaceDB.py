@@ -53,6 +53,9 @@ class PlaceDB (object):
         self.pin2node_map = None # 1D array, contain parent node id of each pin
         self.pin2net_map = None # 1D array, contain parent net id of each pin
 
+        self.node_old2new_map = None # 1D array, node id of each node in the order of input files
+        self.net_old2new_map = None # 1D array, net id of each net in the order of input files
+
         self.rows = None # NumRows x 4 array, stores xl, yl, xh, yh of each row
 
         self.xl = None
@@ -494,6 +497,8 @@ class PlaceDB (object):
         self.flat_node2pin_start_map = np.array(db.flat_node2pin_start_map, dtype=np.int32)
         self.pin2node_map = np.array(db.pin2node_map, dtype=np.int32)
         self.pin2net_map = np.array(db.pin2net_map, dtype=np.int32)
+        self.node_old2new_map = np.array(db.node_old2new_map, dtype=np.int32)
+        self.net_old2new_map = np.array(db.net_old2new_map, dtype=np.int32)
         self.rows = np.array(db.rows, dtype=self.dtype)
         self.xl = float(db.xl)
         self.yl = float(db.yl)
@@ -776,7 +781,9 @@ class PlaceDB (object):
         content = "UCLA pl 1.0\n"
         str_node_names = np.array(self.node_names).astype(str)
         str_node_orient = np.array(self.node_orient).astype(str)
-        for i in range(self.num_physical_nodes):
+        # nodes are renumbered at loading, write them in the order of input files
+        node_order = self.node_old2new_map if self.node_old2new_map is not None else range(self.num_physical_nodes)
+        for i in node_order:
             content += "\n%s %g %g : %s" % (
                     str_node_names[i],
                     self.node_x[i]/params.scale_factor,
@@ -802,11 +809,16 @@ class PlaceDB (object):
         content += "\nNumPins : %d" % (len(self.pin2net_map))
         content += "\n"
 
-        for net_id in range(len(self.net2pin_map)):
+        str_node_names = np.array(self.node_names).astype(str)
+        str_net_names = np.array(self.net_names).astype(str)
+        str_pin_direct = np.array(self.pin_direct).astype(str)
+        # nets are renumbered at loading, write them in the order of input files
+        net_order = self.net_old2new_map if self.net_old2new_map is not None else range(len(self.net2pin_map))
+        for net_id in net_order:
             pins = self.net2pin_map[net_id]
-            content += "\nNetDegree : %d %s" % (len(pins), self.net_names[net_id])
+            content += "\nNetDegree : %d %s" % (len(pins), str_net_names[net_id])
             for pin_id in pins:
-                content += "\n\t%s %s : %d %d" % (self.node_names[self.pin2node_map[pin_id]], self.pin_direct[pin_id], self.pin_offset_x[pin_id]/params.scale_factor, self.pin_offset_y[pin_id]/params.scale_factor)
+                content += "\n\t%s %s : %d %d" % (str_node_names[self.pin2node_map[pin_id]], str_pin_direct[pin_id], self.pin_offset_x[pin_id]/params.scale_factor, self.pin_offset_y[pin_id]/params.scale_factor)
 
         with open(net_file, "w") as f:
             f.write(content)
@@ -49,8 +49,20 @@ class PlaceObj(nn.Module):
         self.density_weight = torch.tensor([density_weight], dtype=self.data_collections.pos[0].dtype, device=self.data_collections.pos[0].device)
         self.gamma = torch.tensor(10*self.base_gamma(params, placedb), dtype=self.data_collections.pos[0].dtype, device=self.data_collections.pos[0].device)
 
+        # bins of the density model, which start coarse and are doubled as overflow drops in adaptive mode
+        self.final_num_bins_x = global_place_params["num_bins_x"]
+        self.final_num_bins_y = global_place_params["num_bins_y"]
+        if params.gp_adaptive_bins > 0:
+            self.num_bins_x = min(params.gp_adaptive_bins, self.final_num_bins_x)
+            self.num_bins_y = min(params.gp_adaptive_bins, self.final_num_bins_y)
+        else:
+            self.num_bins_x = self.final_num_bins_x
+            self.num_bins_y = self.final_num_bins_y
+        # overflow when the bins are changed last time
+        self.density_bins_overflow = None
+
         # compute weighted average wirelength from position
-        name = "%dx%d bins" % (global_place_params["num_bins_x"], global_place_params["num_bins_y"])
+        name = "%dx%d bins" % (self.num_bins_x, self.num_bins_y)
         if global_place_params["wirelength"] == "weighted_average":
             self.op_collections.wirelength_op, self.op_collections.update_gamma_op = self.build_weighted_average_wl(params, placedb, self.data_collections, self.op_collections.pin_pos_op)
         elif global_place_params["wirelength"] == "logsumexp":
@@ -58,7 +70,8 @@ class PlaceObj(nn.Module):
         else:
             assert 0, "unknown wirelength model %s" % (global_place_params["wirelength"])
         #self.op_collections.density_op = self.build_density_potential(params, placedb, self.data_collections, global_place_params["num_bins_x"], global_place_params["num_bins_y"], padding=1, name)
-        self.op_collections.density_op = self.build_electric_potential(params, placedb, self.data_collections, global_place_params["num_bins_x"], global_place_params["num_bins_y"], padding=0, name=name)
+        self.op_collections.density_op = self.build_electric_potential(params, placedb, self.data_collections, self.num_bins_x, self.num_bins_y, padding=0, name=name)
+        self.share_density_map(placedb)
         self.op_collections.update_density_weight_op = self.build_update_density_weight(params, placedb)
         self.op_collections.precondition_op = self.build_precondition(params, placedb, self.data_collections)
         self.op_collections.noise_op = self.build_noise(params, placedb, self.data_collections)
@@ -157,13 +170,18 @@ class PlaceObj(nn.Module):
                 net_mask=data_collections.net_mask_ignore_large_degrees,
                 pin_mask=data_collections.pin_mask_ignore_fixed_macros,
                 gamma=self.gamma,
-                algorithm='atomic',
-                num_threads=params.num_threads
+                algorithm='atomic' if params.gpu else 'net-by-net',
+                num_threads=params.num_threads,
+                pin2node_map=data_collections.pin2node_map,
+                pin_offset_x=data_collections.pin_offset_x,
+                pin_offset_y=data_collections.pin_offset_y,
+                flat_node2pin=data_collections.flat_node2pin_map,
+                flat_node2pin_start=data_collections.flat_node2pin_start_map
                 )
 
-        # wirelength for position
+        # wirelength for position, pin locations are computed inside the op
         def build_wirelength_op(pos):
-            return wirelength_for_pin_op(pin_pos_op(pos))
+            return wirelength_for_pin_op(pos)
 
         # update gamma
         base_gamma = self.base_gamma(params, placedb)
@@ -190,14 +208,18 @@ class PlaceObj(nn.Module):
                 pin2net_map=data_collections.pin2net_map,
                 net_mask=data_collections.net_mask_ignore_large_degrees,
                 gamma=torch.tensor(gamma, dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device),
-                algorithm='atomic',
-                num_threads=params.num_threads
+                algorithm='atomic' if params.gpu else 'net-by-net',
+                num_threads=params.num_threads,
+                pin2node_map=data_collections.pin2node_map,
+                pin_offset_x=data_collections.pin_offset_x,
+                pin_offset_y=data_collections.pin_offset_y,
+                flat_node2pin=data_collections.flat_node2pin_map,
+                flat_node2pin_start=data_collections.flat_node2pin_start_map
                 )
 
-        # wirelength for position
+        # wirelength for position, pin locations are computed inside the op
         def build_wirelength_op(pos):
-            pin_pos = pin_pos_op(pos)
-            return wirelength_for_pin_op(pin_pos)
+            return wirelength_for_pin_op(pos)
 
         # update gamma
         base_gamma = self.base_gamma(params, placedb)
@@ -236,39 +258,8 @@ class PlaceObj(nn.Module):
         if local_num_bins_y < max_num_bins:
             print("[W] local_num_bins_y (%d) < max_num_bins (%d)" % (local_num_bins_y, max_num_bins))
 
-        node_size_x = placedb.node_size_x
-        node_size_y = placedb.node_size_y
-
-        # coefficients
-        ax = (4 / (node_size_x + 2*bin_size_x) / (node_size_x + 4*bin_size_x)).astype(placedb.dtype).reshape([placedb.num_nodes, 1])
-        bx = (2 / bin_size_x / (node_size_x + 4*bin_size_x)).astype(placedb.dtype).reshape([placedb.num_nodes, 1])
-        ay = (4 / (node_size_y + 2*bin_size_y) / (node_size_y + 4*bin_size_y)).astype(placedb.dtype).reshape([placedb.num_nodes, 1])
-        by = (2 / bin_size_y / (node_size_y + 4*bin_size_y)).astype(placedb.dtype).reshape([placedb.num_nodes, 1])
-
-        # bell shape overlap function
-        def npfx1(dist):
-            # ax will be broadcast from num_nodes*1 to num_nodes*num_bins_x
-            return 1.0-ax.reshape([placedb.num_nodes, 1])*np.square(dist)
-        def npfx2(dist):
-            # bx will be broadcast from num_nodes*1 to num_nodes*num_bins_x
-            return bx.reshape([placedb.num_nodes, 1])*np.square(dist-node_size_x/2-2*bin_size_x).reshape([placedb.num_nodes, 1])
-        def npfy1(dist):
-            # ay will be broadcast from num_nodes*1 to num_nodes*num_bins_y
-            return 1.0-ay.reshape([placedb.num_nodes, 1])*np.square(dist)
-        def npfy2(dist):
-            # by will be broadcast from num_nodes*1 to num_nodes*num_bins_y
-            return by.reshape([placedb.num_nodes, 1])*np.square(dist-node_size_y/2-2*bin_size_y).reshape([placedb.num_nodes, 1])
-        # should not use integral, but sum; basically sample 5 distances, -2wb, -wb, 0, wb, 2wb; the sum does not change much when shifting cells
-        integral_potential_x = npfx1(0) + 2*npfx1(bin_size_x) + 2*npfx2(2*bin_size_x)
-        cx = (node_size_x.reshape([placedb.num_nodes, 1]) / integral_potential_x).reshape([placedb.num_nodes, 1])
-        # should not use integral, but sum; basically sample 5 distances, -2wb, -wb, 0, wb, 2wb; the sum does not change much when shifting cells
-        integral_potential_y = npfy1(0) + 2*npfy1(bin_size_y) + 2*npfy2(2*bin_size_y)
-        cy = (node_size_y.reshape([placedb.num_nodes, 1]) / integral_potential_y).reshape([placedb.num_nodes, 1])
-
         return density_potential.DensityPotential(
                 node_size_x=data_collections.node_size_x, node_size_y=data_collections.node_size_y,
-                ax=torch.tensor(ax.ravel(), dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device), bx=torch.tensor(bx.ravel(), dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device), cx=torch.tensor(cx.ravel(), dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device),
-                ay=torch.tensor(ay.ravel(), dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device), by=torch.tensor(by.ravel(), dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device), cy=torch.tensor(cy.ravel(), dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device),
                 bin_center_x=data_collections.bin_center_x_padded(padding), bin_center_y=data_collections.bin_center_y_padded(padding),
                 target_density=params.target_density,
                 num_movable_nodes=placedb.num_movable_nodes,
@@ -312,9 +303,17 @@ class PlaceObj(nn.Module):
         if local_num_bins_y < max_num_bins:
             print("[W] local_num_bins_y (%d) < max_num_bins (%d)" % (local_num_bins_y, max_num_bins))
 
+        if num_bins_x == placedb.num_bins_x and num_bins_y == placedb.num_bins_y:
+            bin_center_x = data_collections.bin_center_x_padded(placedb, padding)
+            bin_center_y = data_collections.bin_center_y_padded(placedb, padding)
+        else:
+            # bins different from those of placedb, e.g., coarse bins in adaptive mode
+            bin_center_x = torch.from_numpy(placedb.bin_centers(xl, xh, bin_size_x)).to(data_collections.pos[0].device)
+            bin_center_y = torch.from_numpy(placedb.bin_centers(yl, yh, bin_size_y)).to(data_collections.pos[0].device)
+
         return electric_potential.ElectricPotential(
                 node_size_x=data_collections.node_size_x, node_size_y=data_collections.node_size_y,
-                bin_center_x=data_collections.bin_center_x_padded(placedb, padding), bin_center_y=data_collections.bin_center_y_padded(placedb, padding),
+                bin_center_x=bin_center_x, bin_center_y=bin_center_y,
                 target_density=params.target_density,
                 xl=xl, yl=yl, xh=xh, yh=yh,
                 bin_size_x=bin_size_x, bin_size_y=bin_size_y,
@@ -323,9 +322,26 @@ class PlaceObj(nn.Module):
                 num_filler_nodes=placedb.num_filler_nodes,
                 padding=padding,
                 fast_mode=True,
+                spectral_energy=params.spectral_density_energy,
+                deterministic_flag=params.deterministic_flag,
                 num_threads=params.num_threads
                 )
 
+    def share_density_map(self, placedb):
+        """
+        @brief let the overflow metric reuse the density map of the electric potential,
+        if both are on the bins of placedb without padding, so cells are scattered once per location
+        @param placedb placement database
+        """
+        overflow_op = self.op_collections.density_overflow_op
+        if not hasattr(overflow_op, "density_map_source"):
+            return
+        density_op = self.op_collections.density_op
+        if self.num_bins_x == placedb.num_bins_x and self.num_bins_y == placedb.num_bins_y and density_op.padding == 0 and overflow_op.padding == 0:
+            overflow_op.density_map_source = density_op
+        else:
+            overflow_op.density_map_source = None
+
     def initialize_density_weight(self, params, placedb):
         """
         @brief compute initial density weight
@@ -348,6 +364,52 @@ class PlaceObj(nn.Module):
 
         return self.density_weight
 
+    def final_density_bins(self):
+        """
+        @brief whether the density model reaches the bins of current global placement stage
+        """
+        return self.num_bins_x >= self.final_num_bins_x and self.num_bins_y >= self.final_num_bins_y
+
+    def refine_density_bins(self, params, placedb, overflow):
+        """
+        @brief double the bins of the density model in adaptive mode,
+        when overflow drops to a ratio of the overflow at the last change of bins, or below the stopping overflow.
+        The electric field is expressed in units of bins, so the density weight is rescaled
+        to keep the norm of the density gradient, and the optimization continues smoothly.
+        @param params parameters
+        @param placedb placement database
+        @param overflow overflow evaluated in current step
+        @return whether the bins are refined
+        """
+        if self.final_density_bins():
+            return False
+        overflow = float(overflow)
+        if self.density_bins_overflow is None:
+            self.density_bins_overflow = overflow
+            return False
+        if overflow > max(params.stop_overflow, self.density_bins_overflow*params.gp_adaptive_bins_overflow_ratio):
+            return False
+
+        pos = self.data_collections.pos[0]
+        density_grad_norm = self.density_grad_norm(pos)
+        self.num_bins_x = min(self.num_bins_x*2, self.final_num_bins_x)
+        self.num_bins_y = min(self.num_bins_y*2, self.final_num_bins_y)
+        name = "%dx%d bins" % (self.num_bins_x, self.num_bins_y)
+        self.op_collections.density_op = self.build_electric_potential(params, placedb, self.data_collections, self.num_bins_x, self.num_bins_y, padding=0, name=name)
+        self.share_density_map(placedb)
+        if not torch.eq(self.density_weight, 0.0):
+            self.density_weight.mul_(density_grad_norm / self.density_grad_norm(pos))
+        self.density_bins_overflow = overflow
+        return True
+
+    def density_grad_norm(self, pos):
+        """
+        @brief L1 norm of the density gradient, without touching the gradient of cell locations
+        @param pos locations of cells
+        """
+        density = self.op_collections.density_op(pos)
+        return autograd.grad(density, pos)[0].norm(p=1).data
+
     def build_update_density_weight(self, params, placedb):
         """
         @brief update density weight
@@ -415,14 +477,15 @@ class PlaceObj(nn.Module):
         @param placedb placement database
         @param data_collections a collection of data and variables required for constructing ops
         """
-        num_pins_in_nodes = np.zeros(placedb.num_nodes)
-        for  i in range(placedb.num_physical_nodes):
-            num_pins_in_nodes[i] = len(placedb.node2pin_map[i])
-        num_pins_in_nodes = torch.tensor(num_pins_in_nodes, dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device)
-        node_areas = torch.tensor(placedb.node_size_x*placedb.node_size_y, dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device)
+        # built from data_collections to follow the current order of cells,
+        # kept as members so that spatial sorting can permute them
+        node2pin_start_map = data_collections.flat_node2pin_start_map
+        self.num_pins_in_nodes = torch.zeros(placedb.num_nodes, dtype=data_collections.pos[0].dtype, device=data_collections.pos[0].device)
+        self.num_pins_in_nodes[:placedb.num_physical_nodes] = (node2pin_start_map[1:]-node2pin_start_map[:-1]).to(self.num_pins_in_nodes.dtype)
+        self.node_areas = (data_collections.node_size_x*data_collections.node_size_y).to(data_collections.pos[0].dtype)
 
         def precondition_op(grad):
-            precond = num_pins_in_nodes + self.density_weight*node_areas
+            precond = self.num_pins_in_nodes + self.density_weight*self.node_areas
             precond.clamp_(min=1.0)
             grad[0:placedb.num_nodes].div_(precond)
             grad[placedb.num_nodes:placedb.num_nodes*2].div_(precond)
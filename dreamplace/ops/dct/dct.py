@@ -19,6 +19,46 @@ except:
 
 import dreamplace.ops.dct.discrete_spectral_transform as discrete_spectral_transform
 
+class DXT2Plan(object):
+    """
+    @brief 2D real-to-real transforms on CPU with a plan of cosine tables and buffers,
+    created once and only recreated if the size or type of the input changes.
+    Each call returns a new output tensor, so results of earlier calls are kept.
+    """
+    def __init__(self, num_threads=None):
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
+        self.plan = None
+        self.size = None
+        self.dtype = None
+    @staticmethod
+    def supports(x):
+        """
+        @brief whether the plan runs Lee's butterflies for x, i.e., x is on CPU with sizes of powers of 2;
+        other sizes go to the FFT-based transforms instead of the dense fallback of the plan
+        @param x input map
+        """
+        def is_power_of_2(n):
+            return n > 0 and (n & (n - 1)) == 0
+        return not x.is_cuda and is_power_of_2(x.size(-2)) and is_power_of_2(x.size(-1))
+    def __call__(self, transform, x):
+        """
+        @param transform name of the transform, dct2 | idct2 | idcct2 | idcst2 | idsct2
+        @param x input map
+        """
+        x = x.contiguous()
+        if self.plan is None or self.size != x.size() or self.dtype != x.dtype:
+            self.plan = dct_cpp.DctPlan(x.view([-1, x.size(-1)]), self.num_threads)
+            self.size = x.size()
+            self.dtype = x.dtype
+        out = torch.empty_like(x)
+        getattr(self.plan, transform)(x.view([-1, x.size(-1)]), out.view([-1, x.size(-1)]))
+        return out
+
+class DXT2PlanFunction(Function):
+    @staticmethod
+    def forward(ctx, x, plan, transform):
+        return plan(transform, x)
+
 def dct(x, expk, algorithm):
     """compute discrete cosine transformation, DCT II, using N-FFT or 2N-FFT
     yk = \sum_{n=0}^{N-1} x_n cos(pi/N*n*(k+1/2))
@@ -114,17 +154,26 @@ class DCT2Function(Function):
         return dct2(x, expk0, expk1, algorithm)
 
 class DCT2(nn.Module):
+    """
+    @param algorithm N | 2N | plan, where plan runs real-to-real transforms with a cached DXT2Plan on CPU
+    for sizes of powers of 2, and N otherwise
+    """
     def __init__(self, expk0=None, expk1=None, algorithm='N'):
         super(DCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
         self.algorithm = algorithm
+        self.plan = None
     def forward(self, x):
+        if self.algorithm == 'plan' and DXT2Plan.supports(x):
+            if self.plan is None:
+                self.plan = DXT2Plan()
+            return DXT2PlanFunction.apply(x, self.plan, 'dct2')
         if self.expk0 is None or self.expk0.size(-2) != x.size(-2):
             self.expk0 = discrete_spectral_transform.get_expk(x.size(-2), dtype=x.dtype, device=x.device)
         if self.expk1 is None or self.expk1.size(-2) != x.size(-1):
             self.expk1 = discrete_spectral_transform.get_expk(x.size(-1), dtype=x.dtype, device=x.device)
-        return DCT2Function.apply(x, self.expk0, self.expk1, self.algorithm)
+        return DCT2Function.apply(x, self.expk0, self.expk1, 'N' if self.algorithm == 'plan' else self.algorithm)
 
 def idct2(x, expk0, expk1, algorithm='N'):
     """compute 2D inverse discrete cosine transformation, using N-FFT or 2N-FFT
@@ -149,17 +198,26 @@ class IDCT2Function(Function):
         return idct2(x, expk0, expk1, algorithm)
 
 class IDCT2(nn.Module):
+    """
+    @param algorithm N | 2N | plan, where plan runs real-to-real transforms with a cached DXT2Plan on CPU
+    for sizes of powers of 2, and N otherwise
+    """
     def __init__(self, expk0=None, expk1=None, algorithm='N'):
         super(IDCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
         self.algorithm = algorithm
+        self.plan = None
     def forward(self, x):
+        if self.algorithm == 'plan' and DXT2Plan.supports(x):
+            if self.plan is None:
+                self.plan = DXT2Plan()
+            return DXT2PlanFunction.apply(x, self.plan, 'idct2')
         if self.expk0 is None or self.expk0.size(-2) != x.size(-2):
             self.expk0 = discrete_spectral_transform.get_expk(x.size(-2), dtype=x.dtype, device=x.device)
         if self.expk1 is None or self.expk1.size(-2) != x.size(-1):
             self.expk1 = discrete_spectral_transform.get_expk(x.size(-1), dtype=x.dtype, device=x.device)
-        return IDCT2Function.apply(x, self.expk0, self.expk1, self.algorithm)
+        return IDCT2Function.apply(x, self.expk0, self.expk1, 'N' if self.algorithm == 'plan' else self.algorithm)
 
 def dst(x, expk):
     """compute discrete sine transformation
@@ -279,11 +337,21 @@ class IDCCT2Function(Function):
         return idcct2(x, expk0, expk1)
 
 class IDCCT2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    """
+    @param algorithm N | plan, where plan runs real-to-real transforms with a cached DXT2Plan on CPU
+    for sizes of powers of 2, and N otherwise
+    """
+    def __init__(self, expk0=None, expk1=None, algorithm='N'):
         super(IDCCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.algorithm = algorithm
+        self.plan = None
     def forward(self, x):
+        if self.algorithm == 'plan' and DXT2Plan.supports(x):
+            if self.plan is None:
+                self.plan = DXT2Plan()
+            return DXT2PlanFunction.apply(x, self.plan, 'idcct2')
         if self.expk0 is None or self.expk0.size(-2) != x.size(-2):
             self.expk0 = discrete_spectral_transform.get_expk(x.size(-2), dtype=x.dtype, device=x.device)
         if self.expk1 is None or self.expk1.size(-2) != x.size(-1):
@@ -306,11 +374,21 @@ class IDCST2Function(Function):
         return idcst2(x, expk0, expk1)
 
 class IDCST2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    """
+    @param algorithm N | plan, where plan runs real-to-real transforms with a cached DXT2Plan on CPU
+    for sizes of powers of 2, and N otherwise
+    """
+    def __init__(self, expk0=None, expk1=None, algorithm='N'):
         super(IDCST2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.algorithm = algorithm
+        self.plan = None
     def forward(self, x):
+        if self.algorithm == 'plan' and DXT2Plan.supports(x):
+            if self.plan is None:
+                self.plan = DXT2Plan()
+            return DXT2PlanFunction.apply(x, self.plan, 'idcst2')
         if self.expk0 is None or self.expk0.size(-2) != x.size(-2):
             self.expk0 = discrete_spectral_transform.get_expk(x.size(-2), dtype=x.dtype, device=x.device)
         if self.expk1 is None or self.expk1.size(-2) != x.size(-1):
@@ -333,11 +411,21 @@ class IDSCT2Function(Function):
         return idsct2(x, expk0, expk1)
 
 class IDSCT2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    """
+    @param algorithm N | plan, where plan runs real-to-real transforms with a cached DXT2Plan on CPU
+    for sizes of powers of 2, and N otherwise
+    """
+    def __init__(self, expk0=None, expk1=None, algorithm='N'):
         super(IDSCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.algorithm = algorithm
+        self.plan = None
     def forward(self, x):
+        if self.algorithm == 'plan' and DXT2Plan.supports(x):
+            if self.plan is None:
+                self.plan = DXT2Plan()
+            return DXT2PlanFunction.apply(x, self.plan, 'idsct2')
         if self.expk0 is None or self.expk0.size(-2) != x.size(-2):
             self.expk0 = discrete_spectral_transform.get_expk(x.size(-2), dtype=x.dtype, device=x.device)
         if self.expk1 is None or self.expk1.size(-2) != x.size(-1):
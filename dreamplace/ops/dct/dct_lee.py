@@ -16,25 +16,27 @@ try:
 except:
     pass 
 
-def dct(x, expk, buf, out):
+def dct(x, expk, buf, out, num_threads):
     """compute discrete cosine transformation, DCT II 
     yk = \sum_{n=0}^{N-1} x_n cos(pi/N*n*(k+1/2))
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.dct(x.view([-1, x.size(-1)]), expk, buf, out)
     else:
-        dct_cpp.dct(x.view([-1, x.size(-1)]), expk, buf, out)
+        dct_cpp.dct(x.view([-1, x.size(-1)]), expk, buf, out, num_threads)
     return out.view(x.size())  
 
 class DCTFunction(Function):
     @staticmethod
-    def forward(ctx, x, expk, buf, out):
-        return dct(x, expk, buf, out)
+    def forward(ctx, x, expk, buf, out, num_threads):
+        return dct(x, expk, buf, out, num_threads)
 
 class DCT(nn.Module):
-    def __init__(self, expk=None):
+    def __init__(self, expk=None, num_threads=None):
         super(DCT, self).__init__()
         self.expk = expk
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None
         self.out = None
     def forward(self, x): 
@@ -47,28 +49,30 @@ class DCT(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return DCTFunction.apply(x, self.expk, self.buf, self.out)
+        return DCTFunction.apply(x, self.expk, self.buf, self.out, self.num_threads)
 
-def idct(x, expk, buf, out):
+def idct(x, expk, buf, out, num_threads):
     """Compute inverse discrete cosine transformation, which is also the DCT III
     yk = Re { 1/2*x0 + \sum_{n=1}^{N-1} xn exp(j*pi/(2N)*n*(2k+1)) }
     The actual yk will be scaled by 2 to match other python implementation
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idct(x.view([-1, x.size(-1)]), expk, buf, out)
     else:
-        dct_cpp.idct(x.view([-1, x.size(-1)]), expk, buf, out)
+        dct_cpp.idct(x.view([-1, x.size(-1)]), expk, buf, out, num_threads)
     return out.view(x.size())  
 
 class IDCTFunction(Function):
     @staticmethod
-    def forward(ctx, x, expk, buf, out):
-        return idct(x, expk, buf, out)
+    def forward(ctx, x, expk, buf, out, num_threads):
+        return idct(x, expk, buf, out, num_threads)
 
 class IDCT(nn.Module):
-    def __init__(self, expk=None):
+    def __init__(self, expk=None, num_threads=None):
         super(IDCT, self).__init__()
         self.expk = expk
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None
         self.out = None
     def forward(self, x): 
@@ -81,27 +85,29 @@ class IDCT(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDCTFunction.apply(x, self.expk, self.buf, self.out)
+        return IDCTFunction.apply(x, self.expk, self.buf, self.out, self.num_threads)
 
-def dct2(x, expk0, expk1, buf, out):
+def dct2(x, expk0, expk1, buf, out, num_threads):
     """compute 2D discrete cosine transformation
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.dct2(x, expk0, expk1, buf, out)
     else:
-        dct_cpp.dct2(x, expk0, expk1, buf, out)
+        dct_cpp.dct2(x, expk0, expk1, buf, out, num_threads)
     return out
 
 class DCT2Function(Function):
     @staticmethod
-    def forward(ctx, x, expk0, expk1, buf, out):
-        return dct2(x, expk0, expk1, buf, out)
+    def forward(ctx, x, expk0, expk1, buf, out, num_threads):
+        return dct2(x, expk0, expk1, buf, out, num_threads)
 
 class DCT2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    def __init__(self, expk0=None, expk1=None, num_threads=None):
         super(DCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None
         self.out = None
     def forward(self, x): 
@@ -120,27 +126,29 @@ class DCT2(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return DCT2Function.apply(x, self.expk0, self.expk1, self.buf, self.out)
+        return DCT2Function.apply(x, self.expk0, self.expk1, self.buf, self.out, self.num_threads)
 
-def idct2(x, expk0, expk1, buf, out):
+def idct2(x, expk0, expk1, buf, out, num_threads):
     """compute 2D inverse discrete cosine transformation
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idct2(x, expk0, expk1, buf, out)
     else:
-        dct_cpp.idct2(x, expk0, expk1, buf, out)
+        dct_cpp.idct2(x, expk0, expk1, buf, out, num_threads)
     return out
 
 class IDCT2Function(Function):
     @staticmethod
-    def forward(ctx, x, expk0, expk1, buf, out):
-        return idct2(x, expk0, expk1, buf, out)
+    def forward(ctx, x, expk0, expk1, buf, out, num_threads):
+        return idct2(x, expk0, expk1, buf, out, num_threads)
 
 class IDCT2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    def __init__(self, expk0=None, expk1=None, num_threads=None):
         super(IDCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None
         self.out = None
     def forward(self, x): 
@@ -159,27 +167,29 @@ class IDCT2(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDCT2Function.apply(x, self.expk0, self.expk1, self.buf, self.out)
+        return IDCT2Function.apply(x, self.expk0, self.expk1, self.buf, self.out, self.num_threads)
 
-def dst(x, expk, buf, out):
+def dst(x, expk, buf, out, num_threads):
     """compute discrete sine transformation
     yk = \sum_{n=0}^{N-1} x_n cos(pi/N*(n+1/2)*(k+1))
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.dst(x.view([-1, x.size(-1)]), expk, buf, out)
     else:
-        dct_cpp.dst(x.view([-1, x.size(-1)]), expk, buf, out)
+        dct_cpp.dst(x.view([-1, x.size(-1)]), expk, buf, out, num_threads)
     return out.view(x.size())  
 
 class DSTFunction(Function):
     @staticmethod
-    def forward(ctx, x, expk, buf, out):
-        return dst(x, expk, buf, out)
+    def forward(ctx, x, expk, buf, out, num_threads):
+        return dst(x, expk, buf, out, num_threads)
 
 class DST(nn.Module):
-    def __init__(self, expk=None):
+    def __init__(self, expk=None, num_threads=None):
         super(DST, self).__init__()
         self.expk = expk
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None 
         self.out = None
     def forward(self, x): 
@@ -192,28 +202,30 @@ class DST(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return DSTFunction.apply(x, self.expk, self.buf, self.out)
+        return DSTFunction.apply(x, self.expk, self.buf, self.out, self.num_threads)
 
-def idst(x, expk, buf, out):
+def idst(x, expk, buf, out, num_threads):
     """Compute inverse discrete sine transformation, which is also the DST III
     yk = Im { (-1)^k*x_{N-1}/2 + \sum_{n=0}^{N-2} xn exp(j*pi/(2N)*(n+1)*(2k+1)) }
     The actual yk will be scaled by 2 to match other python implementation
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idst(x.view([-1, x.size(-1)]), expk, buf, out)
     else:
-        dct_cpp.idst(x.view([-1, x.size(-1)]), expk, buf, out)
+        dct_cpp.idst(x.view([-1, x.size(-1)]), expk, buf, out, num_threads)
     return out.view(x.size())  
 
 class IDSTFunction(Function):
     @staticmethod
-    def forward(ctx, x, expk, buf, out):
-        return idst(x, expk, buf, out)
+    def forward(ctx, x, expk, buf, out, num_threads):
+        return idst(x, expk, buf, out, num_threads)
 
 class IDST(nn.Module):
-    def __init__(self, expk=None):
+    def __init__(self, expk=None, num_threads=None):
         super(IDST, self).__init__()
         self.expk = expk
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None
         self.out = None
     def forward(self, x): 
@@ -226,17 +238,18 @@ class IDST(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDSTFunction.apply(x, self.expk, self.buf, self.out)
+        return IDSTFunction.apply(x, self.expk, self.buf, self.out, self.num_threads)
 
-def idxct(x, expk, buf, out):
+def idxct(x, expk, buf, out, num_threads):
     """compute inverse discrete cosine transformation
     This is different from ordinary formulation for IDCT III
     yk = Re { \sum_{n=0}^{N-1} xn exp(j*pi/(2N)*n*(2k+1)) }
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idxct(x.view([-1, x.size(-1)]), expk, buf, out)
     else:
-        dct_cpp.idxct(x.view([-1, x.size(-1)]), expk, buf, out)
+        dct_cpp.idxct(x.view([-1, x.size(-1)]), expk, buf, out, num_threads)
     #output = IDCTFunction.forward(ctx, x, expk)
     #output.add_(x[..., 0].unsqueeze(-1)).mul_(0.5)
     ##output.mul_(0.5).add_(x[..., 0].unsqueeze(-1).mul(0.5))
@@ -244,13 +257,14 @@ def idxct(x, expk, buf, out):
 
 class IDXCTFunction(Function):
     @staticmethod
-    def forward(ctx, x, expk, buf, out):
-        return idxct(x, expk, buf, out)
+    def forward(ctx, x, expk, buf, out, num_threads):
+        return idxct(x, expk, buf, out, num_threads)
 
 class IDXCT(nn.Module):
-    def __init__(self, expk=None):
+    def __init__(self, expk=None, num_threads=None):
         super(IDXCT, self).__init__()
         self.expk = expk
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None
         self.out = None
     def forward(self, x): 
@@ -263,28 +277,30 @@ class IDXCT(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDXCTFunction.apply(x, self.expk, self.buf, self.out)
+        return IDXCTFunction.apply(x, self.expk, self.buf, self.out, self.num_threads)
 
-def idxst(x, expk, buf, out):
+def idxst(x, expk, buf, out, num_threads):
     """compute inverse discrete sine transformation
     This is different from ordinary formulation for IDCT III
     yk = Im { \sum_{n=0}^{N-1} xn exp(j*pi/(2N)*n*(2k+1)) }
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idxst(x.view([-1, x.size(-1)]), expk, buf, out)
     else:
-        dct_cpp.idxst(x.view([-1, x.size(-1)]), expk, buf, out)
+        dct_cpp.idxst(x.view([-1, x.size(-1)]), expk, buf, out, num_threads)
     return out.view(x.size())  
 
 class IDXSTFunction(Function):
     @staticmethod
-    def forward(ctx, x, expk, buf, out):
-        return idxst(x, expk, buf, out)
+    def forward(ctx, x, expk, buf, out, num_threads):
+        return idxst(x, expk, buf, out, num_threads)
 
 class IDXST(nn.Module):
-    def __init__(self, expk=None):
+    def __init__(self, expk=None, num_threads=None):
         super(IDXST, self).__init__()
         self.expk = expk
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf = None
         self.out = None
     def forward(self, x): 
@@ -297,28 +313,30 @@ class IDXST(nn.Module):
         if self.out is None or self.out.size() != x.size():
             self.buf = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDXSTFunction.apply(x, self.expk, self.buf, self.out)
+        return IDXSTFunction.apply(x, self.expk, self.buf, self.out, self.num_threads)
 
-def idcct2(x, expk0, expk1, buf0, buf1, out):
+def idcct2(x, expk0, expk1, buf0, buf1, out, num_threads):
     """compute inverse discrete cosine-sine transformation
     This is equivalent to idcct(idcct(x)^T)^T
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idcct2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out)
     else:
-        dct_cpp.idcct2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out)
+        dct_cpp.idcct2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out, num_threads)
     return out.view(x.size())  
 
 class IDCCT2Function(Function):
     @staticmethod
-    def forward(ctx, x, expk0, expk1, buf0, buf1, out):
-        return idcct2(x, expk0, expk1, buf0, buf1, out)
+    def forward(ctx, x, expk0, expk1, buf0, buf1, out, num_threads):
+        return idcct2(x, expk0, expk1, buf0, buf1, out, num_threads)
 
 class IDCCT2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    def __init__(self, expk0=None, expk1=None, num_threads=None):
         super(IDCCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf0 = None
         self.buf1 = None
         self.out = None
@@ -339,28 +357,30 @@ class IDCCT2(nn.Module):
             self.buf0 = torch.empty_like(x)
             self.buf1 = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDCCT2Function.apply(x, self.expk0, self.expk1, self.buf0, self.buf1, self.out)
+        return IDCCT2Function.apply(x, self.expk0, self.expk1, self.buf0, self.buf1, self.out, self.num_threads)
 
-def idcst2(x, expk0, expk1, buf0, buf1, out):
+def idcst2(x, expk0, expk1, buf0, buf1, out, num_threads):
     """compute inverse discrete cosine-sine transformation
     This is equivalent to idxct(idxst(x)^T)^T
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idcst2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out)
     else:
-        dct_cpp.idcst2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out)
+        dct_cpp.idcst2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out, num_threads)
     return out.view(x.size())  
 
 class IDCST2Function(Function):
     @staticmethod
-    def forward(ctx, x, expk0, expk1, buf0, buf1, out):
-        return idcst2(x, expk0, expk1, buf0, buf1, out)
+    def forward(ctx, x, expk0, expk1, buf0, buf1, out, num_threads):
+        return idcst2(x, expk0, expk1, buf0, buf1, out, num_threads)
 
 class IDCST2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    def __init__(self, expk0=None, expk1=None, num_threads=None):
         super(IDCST2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf0 = None
         self.buf1 = None
         self.out = None
@@ -381,28 +401,30 @@ class IDCST2(nn.Module):
             self.buf0 = torch.empty_like(x)
             self.buf1 = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDCST2Function.apply(x, self.expk0, self.expk1, self.buf0, self.buf1, self.out)
+        return IDCST2Function.apply(x, self.expk0, self.expk1, self.buf0, self.buf1, self.out, self.num_threads)
 
-def idsct2(x, expk0, expk1, buf0, buf1, out):
+def idsct2(x, expk0, expk1, buf0, buf1, out, num_threads):
     """compute inverse discrete cosine-sine transformation
     This is equivalent to idxst(idxct(x)^T)^T
+    @param num_threads number of threads on CPU
     """
     if x.is_cuda:
         dct_hip.idsct2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out)
     else:
-        dct_cpp.idsct2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out)
+        dct_cpp.idsct2(x.view([-1, x.size(-1)]), expk0, expk1, buf0, buf1, out, num_threads)
     return out.view(x.size())  
 
 class IDSCT2Function(Function):
     @staticmethod
-    def forward(ctx, x, expk0, expk1, buf0, buf1, out):
-        return idsct2(x, expk0, expk1, buf0, buf1, out)
+    def forward(ctx, x, expk0, expk1, buf0, buf1, out, num_threads):
+        return idsct2(x, expk0, expk1, buf0, buf1, out, num_threads)
 
 class IDSCT2(nn.Module):
-    def __init__(self, expk0=None, expk1=None):
+    def __init__(self, expk0=None, expk1=None, num_threads=None):
         super(IDSCT2, self).__init__()
         self.expk0 = expk0
         self.expk1 = expk1
+        self.num_threads = torch.get_num_threads() if num_threads is None else num_threads
         self.buf0 = None
         self.buf1 = None
         self.out = None
@@ -423,5 +445,5 @@ class IDSCT2(nn.Module):
             self.buf0 = torch.empty_like(x)
             self.buf1 = torch.empty_like(x)
             self.out = torch.empty_like(x)
-        return IDSCT2Function.apply(x, self.expk0, self.expk1, self.buf0, self.buf1, self.out)
+        return IDSCT2Function.apply(x, self.expk0, self.expk1, self.buf0, self.buf1, self.out, self.num_threads)
 
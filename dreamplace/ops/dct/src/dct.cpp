@@ -4,6 +4,7 @@
  * @date   10 2024
  */
 #include "dct.h"
+#include "dct_plan.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -405,4 +406,15 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
   m.def("idct_2N", &DREAMPLACE_NAMESPACE::idct_2N_forward, "IDCT forward");
   m.def("dct2_2N", &DREAMPLACE_NAMESPACE::dct2_2N_forward, "DCT2 forward");
   m.def("idct2_2N", &DREAMPLACE_NAMESPACE::idct2_2N_forward, "IDCT2 forward");
+
+  pybind11::class_<DREAMPLACE_NAMESPACE::DctPlan>(m, "DctPlan")
+      .def(pybind11::init<at::Tensor, int>())
+      .def("dct2", &DREAMPLACE_NAMESPACE::DctPlan::dct2, "DCT2 forward with the plan")
+      .def("idct2", &DREAMPLACE_NAMESPACE::DctPlan::idct2, "IDCT2 forward with the plan")
+      .def("idcct2", &DREAMPLACE_NAMESPACE::DctPlan::idcct2, "IDCCT2 forward with the plan")
+      .def("idcst2", &DREAMPLACE_NAMESPACE::DctPlan::idcst2, "IDCST2 forward with the plan")
+      .def("idsct2", &DREAMPLACE_NAMESPACE::DctPlan::idsct2, "IDSCT2 forward with the plan")
+      .def("num_rows", &DREAMPLACE_NAMESPACE::DctPlan::num_rows, "Number of rows of the plan")
+      .def("num_cols", &DREAMPLACE_NAMESPACE::DctPlan::num_cols, "Number of columns of the plan")
+      ;
 }
@@ -37,7 +37,8 @@ void dct_lee_forward(
         at::Tensor x,
         at::Tensor cos,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     CHECK_CPU(x);
@@ -52,10 +53,10 @@ void dct_lee_forward(
             lee::dct(
                     x.data<scalar_t>(),
                     out.data<scalar_t>(),
-                    buf.data<scalar_t>(),
                     cos.data<scalar_t>(),
                     M,
-                    N
+                    N,
+                    num_threads
                     );
             });
 
@@ -66,7 +67,8 @@ void idct_lee_forward(
         at::Tensor x,
         at::Tensor cos,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     CHECK_CPU(x);
@@ -81,10 +83,10 @@ void idct_lee_forward(
             lee::idct(
                     x.data<scalar_t>(),
                     out.data<scalar_t>(),
-                    buf.data<scalar_t>(),
                     cos.data<scalar_t>(),
                     M,
-                    N
+                    N,
+                    num_threads
                     );
             });
 
@@ -95,7 +97,8 @@ void dst_lee_forward(
         at::Tensor x,
         at::Tensor expk,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     auto N = x.size(-1);
@@ -110,7 +113,7 @@ void dst_lee_forward(
                     N
                     );
 
-            dct_lee_forward(buf, expk, buf, out);
+            dct_lee_forward(buf, expk, buf, out, num_threads);
             //std::cout << "y\n" << y << "\n";
 
             computeFlip<scalar_t>(
@@ -128,7 +131,8 @@ void idst_lee_forward(
         at::Tensor x,
         at::Tensor expk,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     auto N = x.size(-1);
@@ -143,7 +147,7 @@ void idst_lee_forward(
                     buf.data<scalar_t>()
                     );
 
-            idct_lee_forward(buf, expk, buf, out);
+            idct_lee_forward(buf, expk, buf, out, num_threads);
             //std::cout << "y\n" << y << "\n";
 
             negateOddEntries<scalar_t>(
@@ -160,7 +164,8 @@ void dct2_lee_forward(
         at::Tensor cos0,
         at::Tensor cos1,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     CHECK_CPU(x);
@@ -170,26 +175,27 @@ void dct2_lee_forward(
     CHECK_CPU(cos1);
     CHECK_CONTIGUOUS(cos1);
 
-    // 1D DCT to columns
-
-    //std::cout << "x\n" << x << "\n";
     auto N = x.size(-1);
     auto M = x.numel()/N;
 
     out.resize_({M, N});
     buf.resize_({M, N});
 
-    dct_lee_forward(x, cos1, out, buf);
-
-    // 1D DCT to rows
-    out.resize_({N, M});
-    out.copy_(buf.transpose(-2, -1));
-    buf.resize_({N, M});
-
-    dct_lee_forward(out, cos0, out, buf);
+    // batches of rows along both dimensions, with the transposes between passes done on the fly
+    AT_DISPATCH_FLOATING_TYPES(x.type(), "dct2_lee_forward", [&] {
+            lee::dct2(
+                    x.data<scalar_t>(),
+                    out.data<scalar_t>(),
+                    buf.data<scalar_t>(),
+                    cos0.data<scalar_t>(),
+                    cos1.data<scalar_t>(),
+                    M,
+                    N,
+                    num_threads
+                    );
+            });
 
-    out.resize_({M, N});
-    out.copy_(buf.transpose_(-2, -1));
+    out.mul_(4.0/(M*N));
 }
 
 void idct2_lee_forward(
@@ -197,7 +203,8 @@ void idct2_lee_forward(
         at::Tensor cos0,
         at::Tensor cos1,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     CHECK_CPU(x);
@@ -207,40 +214,42 @@ void idct2_lee_forward(
     CHECK_CPU(cos1);
     CHECK_CONTIGUOUS(cos1);
 
-    // 1D DCT to columns
-
-    //std::cout << "x\n" << x << "\n";
     auto N = x.size(-1);
     auto M = x.numel()/N;
 
     out.resize_({M, N});
     buf.resize_({M, N});
 
-    idct_lee_forward(x, cos1, out, buf);
-
-    // 1D DCT to rows
-    out.resize_({N, M});
-    out.copy_(buf.transpose(-2, -1));
-    buf.resize_({N, M});
-
-    idct_lee_forward(out, cos0, out, buf);
+    // batches of rows along both dimensions, with the transposes between passes done on the fly
+    AT_DISPATCH_FLOATING_TYPES(x.type(), "idct2_lee_forward", [&] {
+            lee::idct2(
+                    x.data<scalar_t>(),
+                    out.data<scalar_t>(),
+                    buf.data<scalar_t>(),
+                    cos0.data<scalar_t>(),
+                    cos1.data<scalar_t>(),
+                    M,
+                    N,
+                    num_threads
+                    );
+            });
 
-    out.resize_({M, N});
-    out.copy_(buf.transpose(-2, -1));
+    out.mul_(4);
 }
 
 void idxct_lee_forward(
         at::Tensor x,
         at::Tensor cos,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     auto N = x.size(-1);
     auto M = x.numel()/N;
 
     AT_DISPATCH_FLOATING_TYPES(x.type(), "idxct_lee_forward", [&] {
-            idct_lee_forward(x, cos, buf, out);
+            idct_lee_forward(x, cos, buf, out, num_threads);
 
             //std::cout << __func__ << " z\n" << z << "\n";
 
@@ -257,7 +266,8 @@ void idxst_lee_forward(
         at::Tensor x,
         at::Tensor cos,
         at::Tensor buf,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     auto N = x.size(-1);
@@ -272,7 +282,7 @@ void idxst_lee_forward(
                     buf.data<scalar_t>()
                     );
 
-            idct_lee_forward(buf, cos, buf, out);
+            idct_lee_forward(buf, cos, buf, out, num_threads);
             out.mul_(0.5);
             //std::cout << "y\n" << y << "\n";
 
@@ -291,7 +301,8 @@ void idcct2_lee_forward(
         at::Tensor cos1,
         at::Tensor buf0,
         at::Tensor buf1,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     CHECK_CPU(x);
@@ -308,7 +319,7 @@ void idcct2_lee_forward(
 
     // idxct for rows
 
-    idxct_lee_forward(x, cos1, buf0, out);
+    idxct_lee_forward(x, cos1, buf0, out, num_threads);
 
     // idxct for columns
 
@@ -317,7 +328,7 @@ void idcct2_lee_forward(
     buf1.resize_({N, M});
     out.resize_({N, M});
 
-    idxct_lee_forward(buf0, cos0, out, buf1);
+    idxct_lee_forward(buf0, cos0, out, buf1, num_threads);
 
     out.resize_({M, N});
     out.copy_(buf1.transpose(-2, -1));
@@ -329,7 +340,8 @@ void idcst2_lee_forward(
         at::Tensor cos1,
         at::Tensor buf0,
         at::Tensor buf1,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     CHECK_CPU(x);
@@ -346,7 +358,7 @@ void idcst2_lee_forward(
 
     // idxst for rows
 
-    idxst_lee_forward(x, cos1, buf0, out);
+    idxst_lee_forward(x, cos1, buf0, out, num_threads);
 
     // idxct for columns
 
@@ -355,7 +367,7 @@ void idcst2_lee_forward(
     buf1.resize_({N, M});
     out.resize_({N, M});
 
-    idxct_lee_forward(buf0, cos0, out, buf1);
+    idxct_lee_forward(buf0, cos0, out, buf1, num_threads);
 
     out.resize_({M, N});
     out.copy_(buf1.transpose(-2, -1));
@@ -367,7 +379,8 @@ void idsct2_lee_forward(
         at::Tensor cos1,
         at::Tensor buf0,
         at::Tensor buf1,
-        at::Tensor out
+        at::Tensor out,
+        int num_threads
         )
 {
     CHECK_CPU(x);
@@ -384,7 +397,7 @@ void idsct2_lee_forward(
 
     // idxst for rows
 
-    idxct_lee_forward(x, cos1, buf0, out);
+    idxct_lee_forward(x, cos1, buf0, out, num_threads);
 
     // idxct for columns
 
@@ -393,7 +406,7 @@ void idsct2_lee_forward(
     buf1.resize_({N, M});
     out.resize_({N, M});
 
-    idxst_lee_forward(buf0, cos0, out, buf1);
+    idxst_lee_forward(buf0, cos0, out, buf1, num_threads);
 
     out.resize_({M, N});
     out.copy_(buf1.transpose(-2, -1));
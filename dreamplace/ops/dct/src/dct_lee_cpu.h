@@ -9,7 +9,9 @@
 
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include <stdexcept>
+#include <omp.h>
 #include "utility/src/Msg.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
@@ -28,9 +30,9 @@ inline bool isPowerOf2(T val)
 
 /// Transpose a row-major matrix with M rows and N columns using block transpose method
 template <typename TValue, typename TIndex = unsigned>
-inline void transpose(const TValue *in, TValue *out, TIndex M, TIndex N, TIndex blockSize = 16)
+inline void transpose(const TValue *in, TValue *out, TIndex M, TIndex N, int num_threads, TIndex blockSize = 16)
 {
-    //#pragma omp parallel for collapse(2) schedule(static)
+    #pragma omp parallel for collapse(2) schedule(static) num_threads(num_threads)
     for (TIndex j = 0; j < N; j += blockSize)
     {
         for (TIndex i = 0; i < M; i += blockSize)
@@ -283,38 +285,349 @@ inline void idct(TValue *vec, TValue *out, TValue* buf, const TValue *cos, TInde
     }
 }
 
-/// Compute batch dct
+/// Number of sequences transformed together by the batched transforms.
+/// A batch of 16 doubles or floats fills two or one cache lines, and several vector registers.
+constexpr unsigned BATCH_SIZE = 16;
+
+/// Batched version of 'dct' on L sequences stored as structure of arrays,
+/// i.e., entry n of sequence l is vec[n * L + l], so that each butterfly runs across the L sequences in the innermost loop.
+/// The result is written back to 'vec'.
+///
+/// @param  vec   N * L sequences to be transformed
+/// @param  buf   N * L helping buffer
+/// @param  cos   length N - 1, stores cosine values precomputed by function 'precompute_dct_cos'
+/// @param  N     length of each sequence, must be power of 2
+/// @tparam L     number of sequences, a constant so that the innermost loops are unrolled and vectorized
+template <typename TValue, typename TIndex = unsigned, TIndex L = BATCH_SIZE>
+inline void dctBatch(TValue *vec, TValue *buf, const TValue *cos, TIndex N)
+{
+    TValue *curr = vec;
+    TValue *next = buf;
+
+    TIndex len = N;
+    TIndex halfLen = len / 2;
+
+    TIndex cosOffset = 0;
+    while (halfLen)
+    {
+        TIndex offset = 0;
+        TIndex steps = N / len;
+        for (TIndex k = 0; k < steps; ++k)
+        {
+            for (TIndex i = 0; i < halfLen; ++i)
+            {
+                const TValue *a = curr + (offset + i) * L;
+                const TValue *b = curr + (offset + len - i - 1) * L;
+                TValue *sum = next + (offset + i) * L;
+                TValue *diff = next + (offset + halfLen + i) * L;
+                TValue c = cos[cosOffset + i];
+                #pragma omp simd
+                for (TIndex l = 0; l < L; ++l)
+                {
+                    sum[l] = a[l] + b[l];
+                    diff[l] = (a[l] - b[l]) * c;
+                }
+            }
+            offset += len;
+        }
+        std::swap(curr, next);
+        cosOffset += halfLen;
+        len = halfLen;
+        halfLen /= 2;
+    }
+
+    len = 4;
+    halfLen = 2;
+    while (halfLen < N)
+    {
+        TIndex offset = 0;
+        TIndex steps = N / len;
+        for (TIndex k = 0; k < steps; ++k)
+        {
+            for (TIndex i = 0; i < halfLen - 1; ++i)
+            {
+                const TValue *a = curr + (offset + i) * L;
+                const TValue *b = curr + (offset + halfLen + i) * L;
+                TValue *even = next + (offset + i * 2) * L;
+                TValue *odd = even + L;
+                #pragma omp simd
+                for (TIndex l = 0; l < L; ++l)
+                {
+                    even[l] = a[l];
+                    odd[l] = b[l] + b[l + L];
+                }
+            }
+            std::copy(curr + (offset + halfLen - 1) * L, curr + (offset + halfLen) * L, next + (offset + len - 2) * L);
+            std::copy(curr + (offset + len - 1) * L, curr + (offset + len) * L, next + (offset + len - 1) * L);
+            offset += len;
+        }
+        std::swap(curr, next);
+        halfLen = len;
+        len *= 2;
+    }
+
+    if (curr != vec)
+    {
+        std::copy(curr, curr + N * L, vec);
+    }
+}
+
+/// Batched version of 'idct' on L sequences stored as structure of arrays,
+/// i.e., entry n of sequence l is vec[n * L + l], so that each butterfly runs across the L sequences in the innermost loop.
+/// The result is written back to 'vec'.
+///
+/// @param  vec   N * L sequences to be transformed
+/// @param  buf   N * L helping buffer
+/// @param  cos   length N - 1, stores cosine values precomputed by function 'precompute_idct_cos'
+/// @param  N     length of each sequence, must be power of 2
+/// @tparam L     number of sequences, a constant so that the innermost loops are unrolled and vectorized
+template <typename TValue, typename TIndex = unsigned, TIndex L = BATCH_SIZE>
+inline void idctBatch(TValue *vec, TValue *buf, const TValue *cos, TIndex N)
+{
+    TValue *curr = vec;
+    TValue *next = buf;
+
+    for (TIndex l = 0; l < L; ++l)
+    {
+        curr[l] /= 2;
+    }
+
+    TIndex len = N;
+    TIndex halfLen = len / 2;
+
+    while (halfLen)
+    {
+        TIndex offset = 0;
+        TIndex steps = N / len;
+        for (TIndex k = 0; k < steps; ++k)
+        {
+            std::copy(curr + offset * L, curr + (offset + 1) * L, next + offset * L);
+            std::copy(curr + (offset + 1) * L, curr + (offset + 2) * L, next + (offset + halfLen) * L);
+            for (TIndex i = 1; i < halfLen; ++i)
+            {
+                const TValue *a = curr + (offset + i * 2 - 1) * L;
+                TValue *even = next + (offset + i) * L;
+                TValue *odd = next + (offset + halfLen + i) * L;
+                #pragma omp simd
+                for (TIndex l = 0; l < L; ++l)
+                {
+                    even[l] = a[l + L];
+                    odd[l] = a[l] + a[l + 2 * L];
+                }
+            }
+            offset += len;
+        }
+        std::swap(curr, next);
+        len = halfLen;
+        halfLen /= 2;
+    }
+
+    len = 2;
+    halfLen = 1;
+    TIndex cosOffset = 0;
+    while (halfLen < N)
+    {
+        TIndex offset = 0;
+        TIndex steps = N / len;
+        for (TIndex k = 0; k < steps; ++k)
+        {
+            for (TIndex i = 0; i < halfLen; ++i)
+            {
+                const TValue *g = curr + (offset + i) * L;
+                const TValue *h = curr + (offset + halfLen + i) * L;
+                TValue *lo = next + (offset + i) * L;
+                TValue *hi = next + (offset + len - 1 - i) * L;
+                TValue c = cos[cosOffset + i];
+                #pragma omp simd
+                for (TIndex l = 0; l < L; ++l)
+                {
+                    TValue hc = h[l] * c;
+                    lo[l] = g[l] + hc;
+                    hi[l] = g[l] - hc;
+                }
+            }
+            offset += len;
+        }
+        std::swap(curr, next);
+        cosOffset += halfLen;
+        halfLen = len;
+        len *= 2;
+    }
+
+    if (curr != vec)
+    {
+        std::copy(curr, curr + N * L, vec);
+    }
+}
+
+/// Transform the rows of a row-major matrix with M rows and N columns, and write the result transposed as N rows and M columns.
+/// Batches of BATCH_SIZE rows are transformed in parallel, and a partial batch at the end is padded with zeros.
+/// Loading a batch into structure of arrays and storing it back to the transposed matrix are both cache-blocked transposes,
+/// so the transpose between the passes of a 2D transform comes with no extra pass over the matrix.
+///
+/// @param  mtx        size M * N row-major matrix to be transformed
+/// @param  out        size N * M row-major matrix for the transposed result, different from mtx
+/// @param  cos        cosine values precomputed for N-point transforms
+/// @param  transform  dctBatch, idctBatch, or any callable with the same arguments
+/// @param  num_threads  number of threads
+template <typename TValue, typename TIndex, typename TTransform>
+inline void transformRowsTransposed(const TValue *mtx, TValue *out, const TValue *cos, TIndex M, TIndex N, TTransform transform, int num_threads)
+{
+    #pragma omp parallel num_threads(num_threads)
+    {
+        const TIndex L = BATCH_SIZE;
+        std::vector<TValue> batch (2 * N * L, 0);
+        #pragma omp for schedule(static)
+        for (TIndex r = 0; r < M; r += L)
+        {
+            TIndex num_rows = std::min<TIndex>(L, M - r);
+            TValue *vec = batch.data();
+            for (TIndex l = 0; l < num_rows; ++l)
+            {
+                const TValue *row = mtx + (r + l) * N;
+                for (TIndex n = 0; n < N; ++n)
+                {
+                    vec[n * L + l] = row[n];
+                }
+            }
+            for (TIndex l = num_rows; l < L; ++l)
+            {
+                for (TIndex n = 0; n < N; ++n)
+                {
+                    vec[n * L + l] = 0;
+                }
+            }
+            transform(vec, vec + N * L, cos, N);
+            for (TIndex n = 0; n < N; ++n)
+            {
+                std::copy(vec + n * L, vec + n * L + num_rows, out + n * M + r);
+            }
+        }
+    }
+}
+
+/// Transform the rows of a row-major matrix with M rows and N columns in place of the rows of the result.
+/// Batches of BATCH_SIZE rows are transformed in parallel like 'transformRowsTransposed', with a partial batch at the end padded with zeros.
+///
+/// @param  mtx        size M * N row-major matrix to be transformed
+/// @param  out        size M * N row-major matrix for the result, may be the same as mtx
+/// @param  cos        cosine values precomputed for N-point transforms
+/// @param  transform  dctBatch, idctBatch, or any callable with the same arguments
+/// @param  num_threads  number of threads
+template <typename TValue, typename TIndex, typename TTransform>
+inline void transformRows(const TValue *mtx, TValue *out, const TValue *cos, TIndex M, TIndex N, TTransform transform, int num_threads)
+{
+    #pragma omp parallel num_threads(num_threads)
+    {
+        const TIndex L = BATCH_SIZE;
+        std::vector<TValue> batch (2 * N * L, 0);
+        #pragma omp for schedule(static)
+        for (TIndex r = 0; r < M; r += L)
+        {
+            TIndex num_rows = std::min<TIndex>(L, M - r);
+            TValue *vec = batch.data();
+            for (TIndex l = 0; l < num_rows; ++l)
+            {
+                const TValue *row = mtx + (r + l) * N;
+                for (TIndex n = 0; n < N; ++n)
+                {
+                    vec[n * L + l] = row[n];
+                }
+            }
+            for (TIndex l = num_rows; l < L; ++l)
+            {
+                for (TIndex n = 0; n < N; ++n)
+                {
+                    vec[n * L + l] = 0;
+                }
+            }
+            transform(vec, vec + N * L, cos, N);
+            for (TIndex l = 0; l < num_rows; ++l)
+            {
+                TValue *row = out + (r + l) * N;
+                for (TIndex n = 0; n < N; ++n)
+                {
+                    row[n] = vec[n * L + l];
+                }
+            }
+        }
+    }
+}
+
+/// Compute batch dct, which applies 'dct' to each row
 /// @param  mtx   size M * N row-major matrix to be transformed
-/// @param  temp  length 3 * M * N helping buffer, first 2 * M * N is for dct, the last M * N is for matrix transpose
-/// @param  cosM  length M - 1, stores cosine values precomputed by function 'precompute_dct_cos' for M-point dct
-/// @param  cosN  length N - 1, stores cosine values precomputed by function 'precompute_dct_cos' for N-point dct
+/// @param  out   size M * N row-major matrix for the result, may be the same as mtx
+/// @param  cos   length N - 1, stores cosine values precomputed by function 'precompute_dct_cos' for N-point dct
 /// @param  M     number of rows
-/// @param  N     number of columns
+/// @param  N     number of columns, must be power of 2
+/// @param  num_threads  number of threads
 template <typename TValue, typename TIndex = unsigned>
-inline void dct(TValue *mtx, TValue *out, TValue* buf, const TValue *cos, TIndex M, TIndex N)
+inline void dct(const TValue *mtx, TValue *out, const TValue *cos, TIndex M, TIndex N, int num_threads)
 {
-    //#pragma omp parallel for schedule(static)
-    for (TIndex i = 0; i < M; ++i)
+    // check here, as exceptions cannot leave the parallel loop
+    if (! isPowerOf2<TIndex>(N))
     {
-        dct<TValue, TIndex>(mtx + i * N, out + i * N, buf + i*N, cos, N);
+        throw std::domain_error("Input length is not power of 2.");
     }
+    transformRows<TValue, TIndex>(mtx, out, cos, M, N, dctBatch<TValue, TIndex>, num_threads);
 }
 
-/// Compute batch idct
+/// Compute batch idct, which applies 'idct' to each row
 /// @param  mtx   size M * N row-major matrix to be transformed
-/// @param  temp  length 3 * M * N helping buffer, first 2 * M * N is for dct, the last M * N is for matrix transpose
+/// @param  out   size M * N row-major matrix for the result, may be the same as mtx
+/// @param  cos   length N - 1, stores cosine values precomputed by function 'precompute_idct_cos' for N-point idct
+/// @param  M     number of rows
+/// @param  N     number of columns, must be power of 2
+/// @param  num_threads  number of threads
+template <typename TValue, typename TIndex = unsigned>
+inline void idct(const TValue *mtx, TValue *out, const TValue *cos, TIndex M, TIndex N, int num_threads)
+{
+    // check here, as exceptions cannot leave the parallel loop
+    if (! isPowerOf2<TIndex>(N))
+    {
+        throw std::domain_error("Input length is not power of 2.");
+    }
+    transformRows<TValue, TIndex>(mtx, out, cos, M, N, idctBatch<TValue, TIndex>, num_threads);
+}
+
+/// Compute 2D dct, y[u][v] = sum_i sum_j x[i][j] cos((i + 0.5) * u * PI / M) cos((j + 0.5) * v * PI / N)
+/// @param  mtx   size M * N row-major matrix to be transformed
+/// @param  out   size M * N row-major matrix for the result, may be the same as mtx
+/// @param  buf   size M * N helping buffer, different from mtx and out
 /// @param  cosM  length M - 1, stores cosine values precomputed by function 'precompute_dct_cos' for M-point dct
 /// @param  cosN  length N - 1, stores cosine values precomputed by function 'precompute_dct_cos' for N-point dct
-/// @param  M     number of rows
-/// @param  N     number of columns
+/// @param  M     number of rows, must be power of 2
+/// @param  N     number of columns, must be power of 2
+/// @param  num_threads  number of threads
+template <typename TValue, typename TIndex = unsigned>
+inline void dct2(const TValue *mtx, TValue *out, TValue *buf, const TValue *cosM, const TValue *cosN, TIndex M, TIndex N, int num_threads)
+{
+    if (! isPowerOf2<TIndex>(M) || ! isPowerOf2<TIndex>(N))
+    {
+        throw std::domain_error("Input length is not power of 2.");
+    }
+    transformRowsTransposed<TValue, TIndex>(mtx, buf, cosN, M, N, dctBatch<TValue, TIndex>, num_threads);
+    transformRowsTransposed<TValue, TIndex>(buf, out, cosM, N, M, dctBatch<TValue, TIndex>, num_threads);
+}
+
+/// Compute 2D idct, which applies 'idct' to both dimensions
+/// @param  mtx   size M * N row-major matrix to be transformed
+/// @param  out   size M * N row-major matrix for the result, may be the same as mtx
+/// @param  buf   size M * N helping buffer, different from mtx and out
+/// @param  cosM  length M - 1, stores cosine values precomputed by function 'precompute_idct_cos' for M-point idct
+/// @param  cosN  length N - 1, stores cosine values precomputed by function 'precompute_idct_cos' for N-point idct
+/// @param  M     number of rows, must be power of 2
+/// @param  N     number of columns, must be power of 2
+/// @param  num_threads  number of threads
 template <typename TValue, typename TIndex = unsigned>
-inline void idct(TValue *mtx, TValue *out, TValue* buf, const TValue *cos, TIndex M, TIndex N)
+inline void idct2(const TValue *mtx, TValue *out, TValue *buf, const TValue *cosM, const TValue *cosN, TIndex M, TIndex N, int num_threads)
 {
-    //#pragma omp parallel for schedule(static)
-    for (TIndex i = 0; i < M; ++i)
+    if (! isPowerOf2<TIndex>(M) || ! isPowerOf2<TIndex>(N))
     {
-        idct<TValue, TIndex>(mtx + i * N, out + i * N, buf + i*N, cos, N);
+        throw std::domain_error("Input length is not power of 2.");
     }
+    transformRowsTransposed<TValue, TIndex>(mtx, buf, cosN, M, N, idctBatch<TValue, TIndex>, num_threads);
+    transformRowsTransposed<TValue, TIndex>(buf, out, cosM, N, M, idctBatch<TValue, TIndex>, num_threads);
 }
 
 } // End of namespace lee
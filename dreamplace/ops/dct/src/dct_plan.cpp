@@ -0,0 +1,83 @@
+/**
+ * @file   dct_plan.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  2D real-to-real transforms on CPU with cosine tables and buffers created once per map size and type
+ */
+#include "dct.h"
+#include "dct_plan.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+DctPlan::DctPlan(at::Tensor x, int num_threads)
+    : m_num_rows(x.numel()/x.size(-1))
+    , m_num_cols(x.size(-1))
+    , m_num_threads(num_threads)
+{
+    CHECK_CPU(x);
+
+    auto options = x.options();
+    m_cos_x = at::empty({spectralCosineTableSize(m_num_rows)}, options);
+    m_cos_y = at::empty({spectralCosineTableSize(m_num_cols)}, options);
+    AT_DISPATCH_FLOATING_TYPES(x.type(), "precomputeSpectralCosineTable", [&] {
+            precomputeSpectralCosineTable<scalar_t>(m_num_rows, m_cos_x.data<scalar_t>());
+            precomputeSpectralCosineTable<scalar_t>(m_num_cols, m_cos_y.data<scalar_t>());
+            });
+    m_work = at::empty({m_num_rows, m_num_cols}, options);
+    m_scratch = at::empty({2, m_num_rows, m_num_cols}, options);
+}
+
+at::Tensor DctPlan::transform(SpectralTransformKind kind_x, SpectralTransformKind kind_y, at::Tensor x, at::Tensor out, double scale)
+{
+    CHECK_CPU(x);
+    CHECK_CONTIGUOUS(x);
+    CHECK_CPU(out);
+    CHECK_CONTIGUOUS(out);
+    AT_ASSERTM(x.numel() == m_num_rows*m_num_cols && x.size(-1) == m_num_cols, "x must have the sizes of the plan");
+    AT_ASSERTM(out.numel() == x.numel(), "out must have the same size as x");
+    AT_ASSERTM(x.scalar_type() == m_work.scalar_type() && out.scalar_type() == m_work.scalar_type(), "x and out must have the type of the plan");
+
+    AT_DISPATCH_FLOATING_TYPES(x.type(), "transformSpectralMap", [&] {
+            transformSpectralMap<scalar_t>(
+                    kind_x, kind_y,
+                    x.data<scalar_t>(), out.data<scalar_t>(),
+                    m_work.data<scalar_t>(), m_scratch.data<scalar_t>(),
+                    m_cos_x.data<scalar_t>(), m_cos_y.data<scalar_t>(),
+                    m_num_rows, m_num_cols,
+                    m_num_threads
+                    );
+            });
+    if (scale != 1)
+    {
+        out.mul_(scale);
+    }
+
+    return out;
+}
+
+at::Tensor DctPlan::dct2(at::Tensor x, at::Tensor out)
+{
+    return transform(kSpectralDct, kSpectralDct, x, out, 4.0/(m_num_rows*m_num_cols));
+}
+
+at::Tensor DctPlan::idct2(at::Tensor x, at::Tensor out)
+{
+    return transform(kSpectralIdct, kSpectralIdct, x, out, 1);
+}
+
+at::Tensor DctPlan::idcct2(at::Tensor x, at::Tensor out)
+{
+    return transform(kSpectralIdxct, kSpectralIdxct, x, out, 1);
+}
+
+at::Tensor DctPlan::idcst2(at::Tensor x, at::Tensor out)
+{
+    return transform(kSpectralIdxct, kSpectralIdxst, x, out, 1);
+}
+
+at::Tensor DctPlan::idsct2(at::Tensor x, at::Tensor out)
+{
+    return transform(kSpectralIdxst, kSpectralIdxct, x, out, 1);
+}
+
+DREAMPLACE_END_NAMESPACE
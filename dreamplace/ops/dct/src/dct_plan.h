@@ -0,0 +1,63 @@
+/**
+ * @file   dct_plan.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  2D real-to-real transforms on CPU with cosine tables and buffers created once per map size and type
+ */
+#ifndef DREAMPLACE_DCT_PLAN_H
+#define DREAMPLACE_DCT_PLAN_H
+
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+#include "dct/src/dct_plan_cpu.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Plan of 2D transforms for maps of M rows and N columns of one type.
+/// The transforms run Lee's real-valued butterflies with the cosine tables precomputed here,
+/// or dense cosine products if a size is not a power of 2,
+/// so there is no complex FFT, no reordering or twiddle multiplication around it,
+/// and no allocation or planning per call.
+/// The scaling of each transform matches its counterpart in dct_cpp.
+class DctPlan
+{
+    public:
+        /// @param x map of M rows and N columns, only its sizes and type are used
+        /// @param num_threads number of threads
+        DctPlan(at::Tensor x, int num_threads);
+
+        /// @brief 2D DCT, the same as dct2
+        /// @param x input map
+        /// @param out output map of the same size, may be the same as x
+        /// @return out
+        at::Tensor dct2(at::Tensor x, at::Tensor out);
+        /// @brief 2D inverse DCT, the same as idct2
+        at::Tensor idct2(at::Tensor x, at::Tensor out);
+        /// @brief inverse cosine transforms along both dimensions, the same as idcct2
+        at::Tensor idcct2(at::Tensor x, at::Tensor out);
+        /// @brief inverse cosine transform along columns and sine transform along rows, the same as idcst2
+        at::Tensor idcst2(at::Tensor x, at::Tensor out);
+        /// @brief inverse sine transform along columns and cosine transform along rows, the same as idsct2
+        at::Tensor idsct2(at::Tensor x, at::Tensor out);
+
+        /// @return number of rows
+        int num_rows() const {return m_num_rows;}
+        /// @return number of columns
+        int num_cols() const {return m_num_cols;}
+
+    protected:
+        /// @brief apply the transforms of given kinds along columns and rows, and scale the result
+        at::Tensor transform(SpectralTransformKind kind_x, SpectralTransformKind kind_y, at::Tensor x, at::Tensor out, double scale);
+
+        int m_num_rows;
+        int m_num_cols;
+        int m_num_threads;
+        at::Tensor m_cos_x; ///< cosine table of the transforms along columns
+        at::Tensor m_cos_y; ///< cosine table of the transforms along rows
+        at::Tensor m_work; ///< map between the passes of a 2D transform
+        at::Tensor m_scratch; ///< two maps of per-row buffers for one-dimensional transforms
+};
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ * @file   dct_plan_cpu.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Real-to-real one-dimensional and two-dimensional transforms with precomputed cosine tables
+ */
+
+#ifndef DREAMPLACE_DCT_PLAN_CPU_H
+#define DREAMPLACE_DCT_PLAN_CPU_H
+
+#include <algorithm>
+#include <cmath>
+#include "dct/src/dct_lee_cpu.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief One-dimensional transforms, for k, u = 0..n-1
+enum SpectralTransformKind
+{
+    kSpectralDct, ///< y_k = sum_i x_i cos(pi*k*(2i+1)/(2n))
+    kSpectralIdct, ///< y_u = x_0 + 2*sum_{k>0} x_k cos(pi*k*(2u+1)/(2n)), the scaling of dct.idct
+    kSpectralIdxct, ///< y_u = sum_k x_k cos(pi*k*(2u+1)/(2n))
+    kSpectralIdxst ///< y_u = sum_k x_k sin(pi*k*(2u+1)/(2n))
+};
+
+/// @brief Number of entries in the cosine table of length-n transforms.
+/// Lee's algorithm needs n-1 cosines for DCT and n-1 for IDCT if n is a power of 2,
+/// otherwise the transforms are dense products with all n*n cosines.
+inline int spectralCosineTableSize(int n)
+{
+    return (lee::isPowerOf2<int>(n))? 2*n : n*n;
+}
+
+template <typename T>
+void precomputeSpectralCosineTable(int n, T* table)
+{
+    if (lee::isPowerOf2<int>(n))
+    {
+        lee::precompute_dct_cos<T, int>(table, n);
+        lee::precompute_idct_cos<T, int>(table+n, n);
+    }
+    else
+    {
+        for (int k = 0; k < n; ++k)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                table[k*n+i] = std::cos(lee::PI*k*(2*i+1)/(2*n));
+            }
+        }
+    }
+}
+
+/// @brief Apply a one-dimensional transform to each row of a row-major matrix
+/// @param x input of num_rows by n
+/// @param y output of num_rows by n, different from x
+/// @param scratch buffer of 2*num_rows*n
+/// @param table cosine table from precomputeSpectralCosineTable
+template <typename T>
+void transformSpectralRows(SpectralTransformKind kind, T* x, T* y, T* scratch, const T* table, int num_rows, int n, int num_threads)
+{
+    bool lee_flag = lee::isPowerOf2<int>(n);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int r = 0; r < num_rows; ++r)
+    {
+        T* xr = x+(long)r*n;
+        T* yr = y+(long)r*n;
+        T* buf = scratch+(long)r*2*n;
+        T* flip = buf+n;
+        switch (kind)
+        {
+            case kSpectralDct:
+                if (lee_flag)
+                {
+                    lee::dct<T, int>(xr, yr, buf, table, n);
+                }
+                else
+                {
+                    for (int k = 0; k < n; ++k)
+                    {
+                        T sum = 0;
+                        for (int i = 0; i < n; ++i)
+                        {
+                            sum += xr[i]*table[k*n+i];
+                        }
+                        yr[k] = sum;
+                    }
+                }
+                break;
+            case kSpectralIdct:
+            case kSpectralIdxct:
+                if (lee_flag)
+                {
+                    // Lee's IDCT halves the first entry
+                    lee::idct<T, int>(xr, yr, buf, table+n, n);
+                    if (kind == kSpectralIdct)
+                    {
+                        for (int u = 0; u < n; ++u)
+                        {
+                            yr[u] *= 2;
+                        }
+                    }
+                    else
+                    {
+                        for (int u = 0; u < n; ++u)
+                        {
+                            yr[u] += xr[0]/2;
+                        }
+                    }
+                }
+                else
+                {
+                    for (int u = 0; u < n; ++u)
+                    {
+                        T sum = 0;
+                        for (int k = 0; k < n; ++k)
+                        {
+                            sum += xr[k]*table[k*n+u];
+                        }
+                        yr[u] = (kind == kSpectralIdct)? sum*2-xr[0] : sum;
+                    }
+                }
+                break;
+            default:
+                // sin(pi*k*(2u+1)/(2n)) = (-1)^u cos(pi*(n-k)*(2u+1)/(2n)),
+                // so it is a cosine transform of the flipped input with the first entry zero
+                flip[0] = 0;
+                for (int k = 1; k < n; ++k)
+                {
+                    flip[k] = xr[n-k];
+                }
+                if (lee_flag)
+                {
+                    lee::idct<T, int>(flip, yr, buf, table+n, n);
+                }
+                else
+                {
+                    for (int u = 0; u < n; ++u)
+                    {
+                        T sum = 0;
+                        for (int k = 1; k < n; ++k)
+                        {
+                            sum += flip[k]*table[k*n+u];
+                        }
+                        yr[u] = sum;
+                    }
+                }
+                lee::negateOddEntries<T, int>(yr, n);
+                break;
+        }
+    }
+}
+
+/// @brief Transpose a row-major matrix of num_rows by num_cols with blocks of rows in parallel
+template <typename T>
+void transposeSpectralMap(const T* in, T* out, int num_rows, int num_cols, int num_threads)
+{
+    const int block_size = 16;
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int ib = 0; ib < num_rows; ib += block_size)
+    {
+        int ie = std::min(ib+block_size, num_rows);
+        for (int jb = 0; jb < num_cols; jb += block_size)
+        {
+            int je = std::min(jb+block_size, num_cols);
+            for (int j = jb; j < je; ++j)
+            {
+                for (int i = ib; i < ie; ++i)
+                {
+                    out[(long)j*num_rows+i] = in[(long)i*num_cols+j];
+                }
+            }
+        }
+    }
+}
+
+/// @brief One-dimensional transform of a batch of lee::BATCH_SIZE sequences in structure of arrays,
+/// with entry i of every sequence optionally scaled by scale[i] before the transform
+template <typename T>
+struct SpectralBatchTransform
+{
+    SpectralTransformKind kind;
+    const T* scale; ///< length n, or nullptr for no scaling
+
+    /// @param vec n by lee::BATCH_SIZE entries, transformed in place
+    /// @param buf buffer of the same size
+    /// @param table cosine table from precomputeSpectralCosineTable, n must be a power of 2
+    void operator()(T* vec, T* buf, const T* table, int n) const
+    {
+        const int L = lee::BATCH_SIZE;
+        if (scale)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                for (int l = 0; l < L; ++l)
+                {
+                    vec[i*L+l] *= scale[i];
+                }
+            }
+        }
+        switch (kind)
+        {
+            case kSpectralDct:
+                lee::dctBatch<T, int>(vec, buf, table, n);
+                break;
+            case kSpectralIdct:
+                lee::idctBatch<T, int>(vec, buf, table+n, n);
+                for (int i = 0; i < n*L; ++i)
+                {
+                    vec[i] *= 2;
+                }
+                break;
+            case kSpectralIdxct:
+                {
+                    // Lee's IDCT halves the first entry
+                    T half_first[L];
+                    for (int l = 0; l < L; ++l)
+                    {
+                        half_first[l] = vec[l]/2;
+                    }
+                    lee::idctBatch<T, int>(vec, buf, table+n, n);
+                    for (int i = 0; i < n; ++i)
+                    {
+                        for (int l = 0; l < L; ++l)
+                        {
+                            vec[i*L+l] += half_first[l];
+                        }
+                    }
+                }
+                break;
+            default:
+                // the same flip as transformSpectralRows, done in place
+                for (int l = 0; l < L; ++l)
+                {
+                    vec[l] = 0;
+                }
+                for (int k = 1; k < n-k; ++k)
+                {
+                    for (int l = 0; l < L; ++l)
+                    {
+                        std::swap(vec[k*L+l], vec[(n-k)*L+l]);
+                    }
+                }
+                lee::idctBatch<T, int>(vec, buf, table+n, n);
+                for (int u = 1; u < n; u += 2)
+                {
+                    for (int l = 0; l < L; ++l)
+                    {
+                        vec[u*L+l] = -vec[u*L+l];
+                    }
+                }
+                break;
+        }
+    }
+};
+
+/// @brief Apply a one-dimensional transform to each row of a row-major matrix of num_rows by n,
+/// and write the result transposed as n by num_rows.
+/// Rows go through lee::transformRowsTransposed in batches, so n must be a power of 2.
+/// @param scale entry i of every row is scaled by scale[i] before the transform, nullptr for no scaling
+/// @param out different from x
+template <typename T>
+void transformSpectralRowsTransposed(SpectralTransformKind kind, const T* scale, const T* x, T* out, const T* table, int num_rows, int n, int num_threads)
+{
+    SpectralBatchTransform<T> transform = {kind, scale};
+    lee::transformRowsTransposed<T, int>(x, out, table, num_rows, n, transform, num_threads);
+}
+
+/// @brief Apply one-dimensional transforms along both dimensions of a num_bins_x by num_bins_y map.
+/// out may be the same as in, but work must be different from both.
+/// If both sizes are powers of 2, the rows are transformed in batches with the transposes on the fly,
+/// otherwise row by row with explicit transposes.
+template <typename T>
+void transformSpectralMap(
+        SpectralTransformKind kind_x, SpectralTransformKind kind_y,
+        T* in, T* out, T* work, T* scratch,
+        const T* cos_x, const T* cos_y,
+        int num_bins_x, int num_bins_y,
+        int num_threads
+        )
+{
+    if (lee::isPowerOf2<int>(num_bins_x) && lee::isPowerOf2<int>(num_bins_y))
+    {
+        transformSpectralRowsTransposed<T>(kind_y, nullptr, in, work, cos_y, num_bins_x, num_bins_y, num_threads);
+        transformSpectralRowsTransposed<T>(kind_x, nullptr, work, out, cos_x, num_bins_y, num_bins_x, num_threads);
+        return;
+    }
+    transformSpectralRows<T>(kind_y, in, work, scratch, cos_y, num_bins_x, num_bins_y, num_threads);
+    transposeSpectralMap<T>(work, out, num_bins_x, num_bins_y, num_threads);
+    transformSpectralRows<T>(kind_x, out, work, scratch, cos_x, num_bins_y, num_bins_x, num_threads);
+    transposeSpectralMap<T>(work, out, num_bins_y, num_bins_x, num_threads);
+}
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
@@ -50,7 +50,9 @@ class DensityOverflowFunction(Function):
           num_movable_nodes,
           num_filler_nodes,
           algorithm,
-          num_threads
+          deterministic_flag,
+          num_threads,
+          scatter_buffer
           ):
         if pos.is_cuda:
             if algorithm == 'threadmap':
@@ -107,7 +109,9 @@ class DensityOverflowFunction(Function):
                     bin_size_y,
                     num_movable_nodes,
                     num_filler_nodes,
-                    num_threads
+                    deterministic_flag,
+                    num_threads,
+                    scatter_buffer
                     )
         #print("overflow initial_density_map")
         #print(initial_density_map/(bin_size_x*bin_size_y))
@@ -115,7 +119,7 @@ class DensityOverflowFunction(Function):
         #print(output[1]/(bin_size_x*bin_size_y))
         #plot(output[1].clone().div(bin_size_x*bin_size_y).cpu().numpy(), 'density_map')
         # output consists of (overflow, density_map, max_density)
-        return output[0], output[2]
+        return output
 
 class DensityOverflow(object):
     """
@@ -123,7 +127,7 @@ class DensityOverflow(object):
     The density map for fixed cells is pre-computed.
     Each call will only compute the density map for movable cells.
     """
-    def __init__(self, node_size_x, node_size_y, bin_center_x, bin_center_y, target_density, xl, yl, xh, yh, bin_size_x, bin_size_y, num_movable_nodes, num_terminals, num_filler_nodes, algorithm='by-node', num_threads=8):
+    def __init__(self, node_size_x, node_size_y, bin_center_x, bin_center_y, target_density, xl, yl, xh, yh, bin_size_x, bin_size_y, num_movable_nodes, num_terminals, num_filler_nodes, algorithm='by-node', deterministic_flag=False, num_threads=8):
         """
         @brief initialization
         @param node_size_x cell width array consisting of movable cells, fixed cells, and filler cells in order
@@ -141,6 +145,8 @@ class DensityOverflow(object):
         @param num_terminals number of fixed cells
         @param num_filler_nodes number of filler cells
         @param algorithm must be by-node | threadmap
+        @param deterministic_flag if true, the density map is accumulated in fixed point on CPU,
+        so the density map is the same bit for bit with any number of threads
         """
         super(DensityOverflow, self).__init__()
         self.node_size_x = node_size_x
@@ -181,7 +187,13 @@ class DensityOverflow(object):
             self.thread2bin_x_map = None
             self.thread2bin_y_map = None
         self.initial_density_map = None
+        # density map and overflow of the last forward or update
+        self.density_map = None
+        self.overflow = None
+        self.deterministic_flag = deterministic_flag
         self.num_threads = num_threads
+        # buffer of private density maps on CPU, reused across evaluations
+        self.scatter_buffer = torch.empty(0, dtype=torch.int64)
     def forward(self, pos):
         """
         @brief API
@@ -227,11 +239,12 @@ class DensityOverflow(object):
                         self.bin_size_y,
                         self.num_movable_nodes,
                         self.num_terminals,
+                        self.deterministic_flag,
                         self.num_threads
                         )
             #plot(self.initial_density_map.clone().div(self.bin_size_x*self.bin_size_y).cpu().numpy(), 'initial_density_map')
 
-        return DensityOverflowFunction.forward(
+        self.overflow, self.density_map, max_density = DensityOverflowFunction.forward(
                 pos,
                 node_size_x=self.node_size_x,
                 node_size_y=self.node_size_y,
@@ -251,8 +264,51 @@ class DensityOverflow(object):
                 num_movable_nodes=self.num_movable_nodes,
                 num_filler_nodes=self.num_filler_nodes,
                 algorithm=self.algorithm,
-                num_threads=self.num_threads
+                deterministic_flag=self.deterministic_flag,
+                num_threads=self.num_threads,
+                scatter_buffer=self.scatter_buffer
                 )
+        return self.overflow, max_density
+
+    def update(self, moved_nodes, old_pos, new_pos):
+        """
+        @brief move some cells on the density map of the last forward or update, only on CPU.
+        Only the old and new footprints of the moved cells are visited,
+        so the cost scales with the number of moved cells instead of all cells.
+        Rounding errors build up over many updates, so call forward now and then to start over.
+        With deterministic_flag, the changes are accumulated in the fixed point of forward,
+        so the map does not depend on the number of threads; it still differs from a full forward by rounding.
+        @param moved_nodes indices of moved cells, a tensor of int64, must be movable cells or fillers
+        @param old_pos locations of moved cells before moving, x locations and then y locations
+        @param new_pos locations of moved cells after moving, in the same layout as old_pos
+        @return overflow after moving; the maximum density is not kept as it needs a pass over all bins
+        """
+        assert self.density_map is not None, "forward must be called before update"
+        assert not old_pos.is_cuda, "incremental update is only implemented on CPU"
+        num_nodes = self.node_size_x.numel()
+        assert bool(((moved_nodes >= 0) & (moved_nodes < num_nodes)
+            & ((moved_nodes < self.num_movable_nodes) | (moved_nodes >= num_nodes - self.num_filler_nodes))).all()), \
+            "moved_nodes must be movable cells or fillers"
+        delta = density_overflow_cpp.update_density_map(
+                self.density_map,
+                old_pos.contiguous().view(-1),
+                new_pos.contiguous().view(-1),
+                self.node_size_x[moved_nodes],
+                self.node_size_y[moved_nodes],
+                self.bin_center_x,
+                self.bin_center_y,
+                self.target_density,
+                self.xl,
+                self.yl,
+                self.xh,
+                self.yh,
+                self.bin_size_x,
+                self.bin_size_y,
+                self.deterministic_flag,
+                self.num_threads
+                )
+        self.overflow = self.overflow + delta[0]
+        return self.overflow
 
 def plot(density_map, name):
     """
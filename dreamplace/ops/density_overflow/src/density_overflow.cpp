@@ -6,6 +6,7 @@
  */
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
+#include "utility/src/density_scatter_tensor.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -25,7 +26,9 @@ DREAMPLACE_BEGIN_NAMESPACE
 /// @param yh top boundary
 /// @param bin_size_x bin width
 /// @param bin_size_y bin height
+/// @param deterministic_flag whether to accumulate areas in fixed point, so the map does not depend on the number of threads
 /// @param num_threads number of threads
+/// @param scatter_buffer buffer of the private maps kept by the op
 /// @param density_map_tensor 2D density map in column-major to write
 template <typename T>
 int computeDensityOverflowMapLauncher(
@@ -36,6 +39,34 @@ int computeDensityOverflowMapLauncher(
         const int num_bins_x, const int num_bins_y,
         const T xl, const T yl, const T xh, const T yh,
         const T bin_size_x, const T bin_size_y,
+        bool deterministic_flag,
+        const int num_threads,
+        DensityScatterTensorBuffer& scatter_buffer,
+        T* density_map_tensor
+        );
+
+/// @brief move cells on a density overflow map
+/// @param old_x_tensor x locations of moved cells before moving
+/// @param old_y_tensor y locations of moved cells before moving
+/// @param new_x_tensor x locations of moved cells after moving
+/// @param new_y_tensor y locations of moved cells after moving
+/// @param node_size_x_tensor width array of moved cells
+/// @param node_size_y_tensor height array of moved cells
+/// @param num_nodes number of moved cells
+/// @param target_area target area of a bin
+/// @return change of the total overflow
+template <typename T>
+T updateDensityOverflowMapLauncher(
+        const T* old_x_tensor, const T* old_y_tensor,
+        const T* new_x_tensor, const T* new_y_tensor,
+        const T* node_size_x_tensor, const T* node_size_y_tensor,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        const T target_area,
+        bool deterministic_flag,
         const int num_threads,
         T* density_map_tensor
         );
@@ -60,6 +91,9 @@ int computeDensityOverflowMapLauncher(
 /// @param bin_size_y bin height
 /// @param num_movable_nodes number of movable cells
 /// @param num_filler_nodes number of filler cells
+/// @param deterministic_flag whether to accumulate areas in fixed point, so results do not depend on the number of threads
+/// @param num_threads number of threads
+/// @param scatter_buffer int64 buffer of the private maps kept by the op across calls, resized when needed
 /// @return density overflow map, total density overflow, maximum density
 std::vector<at::Tensor> density_overflow_forward(
         at::Tensor pos,
@@ -77,16 +111,20 @@ std::vector<at::Tensor> density_overflow_forward(
         double bin_size_y,
         int num_movable_nodes,
         int num_filler_nodes,
-        int num_threads
+        bool deterministic_flag,
+        int num_threads,
+        at::Tensor scatter_buffer
         )
 {
     CHECK_FLAT(pos);
     CHECK_EVEN(pos);
     CHECK_CONTIGUOUS(pos);
+    checkDensityScatterBuffer(scatter_buffer);
 
     int num_bins_x = int(ceil((xh-xl)/bin_size_x));
     int num_bins_y = int(ceil((yh-yl)/bin_size_y));
     at::Tensor density_map = initial_density_map.clone();
+    DensityScatterTensorBuffer buffer = {scatter_buffer};
     double density_area = target_density*bin_size_x*bin_size_y;
 
     AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeDensityOverflowMapLauncher", [&] {
@@ -98,7 +136,9 @@ std::vector<at::Tensor> density_overflow_forward(
                     num_bins_x, num_bins_y,
                     xl, yl, xh, yh,
                     bin_size_x, bin_size_y,
+                    deterministic_flag,
                     num_threads,
+                    buffer,
                     density_map.data<scalar_t>()
                     );
             });
@@ -113,7 +153,9 @@ std::vector<at::Tensor> density_overflow_forward(
                         num_bins_x, num_bins_y,
                         xl, yl, xh, yh,
                         bin_size_x, bin_size_y,
+                        deterministic_flag,
                         num_threads,
+                        buffer,
                         density_map.data<scalar_t>()
                         );
                 });
@@ -140,6 +182,7 @@ std::vector<at::Tensor> density_overflow_forward(
 /// @param bin_size_y bin height
 /// @param num_movable_nodes number of movable cells
 /// @param num_terminals number of fixed cells
+/// @param deterministic_flag whether to accumulate areas in fixed point, so the map does not depend on the number of threads
 /// @return a density map for fixed cells
 at::Tensor fixed_density_overflow_map(
         at::Tensor pos,
@@ -155,6 +198,7 @@ at::Tensor fixed_density_overflow_map(
         double bin_size_y,
         int num_movable_nodes,
         int num_terminals,
+        bool deterministic_flag,
         int num_threads
         )
 {
@@ -165,6 +209,8 @@ at::Tensor fixed_density_overflow_map(
     int num_bins_x = int(ceil((xh-xl)/bin_size_x));
     int num_bins_y = int(ceil((yh-yl)/bin_size_y));
     at::Tensor density_map = at::zeros({num_bins_x, num_bins_y}, pos.options());
+    // fixed cells are scattered once, so the buffer is not kept
+    DensityScatterTensorBuffer buffer = {at::empty({0}, pos.options().dtype(at::kLong))};
 
     if (num_terminals)
     {
@@ -178,7 +224,9 @@ at::Tensor fixed_density_overflow_map(
                         num_bins_x, num_bins_y,
                         xl, yl, xh, yh,
                         bin_size_x, bin_size_y,
+                        deterministic_flag,
                         num_threads,
+                        buffer,
                         density_map.data<scalar_t>()
                         );
                 });
@@ -187,39 +235,150 @@ at::Tensor fixed_density_overflow_map(
     return density_map;
 }
 
-template <typename T>
-int computeDensityOverflowMapLauncher(
-        const T* x_tensor, const T* y_tensor,
-        const T* node_size_x_tensor, const T* node_size_y_tensor,
-        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
-        const int num_nodes,
-        const int num_bins_x, const int num_bins_y,
-        const T xl, const T yl, const T xh, const T yh,
-        const T bin_size_x, const T bin_size_y,
-        int num_threads,
-        T* density_map_tensor
+/// @brief Move cells on the density map of a previous forward, which is updated in place.
+/// Only the bins touched by the moved cells are visited, so the cost does not depend on the total number of cells.
+/// @param density_map density map not normalized by bin area, e.g., output of forward
+/// @param old_pos locations of moved cells before moving, array of x locations and then y locations
+/// @param new_pos locations of moved cells after moving, in the same layout as old_pos
+/// @param node_size_x cell width array of moved cells
+/// @param node_size_y cell height array of moved cells
+/// @param bin_center_x bin center x locations
+/// @param bin_center_y bin center y locations
+/// @param target_density target density
+/// @param xl left boundary
+/// @param yl bottom boundary
+/// @param xh right boundary
+/// @param yh top boundary
+/// @param bin_size_x bin width
+/// @param bin_size_y bin height
+/// @param deterministic_flag whether to accumulate the changes in fixed point, so the map does not depend on the number of threads
+/// @return change of the total density overflow
+at::Tensor update_density_overflow_map(
+        at::Tensor density_map,
+        at::Tensor old_pos,
+        at::Tensor new_pos,
+        at::Tensor node_size_x,
+        at::Tensor node_size_y,
+        at::Tensor bin_center_x,
+        at::Tensor bin_center_y,
+        double target_density,
+        double xl,
+        double yl,
+        double xh,
+        double yh,
+        double bin_size_x,
+        double bin_size_y,
+        bool deterministic_flag,
+        int num_threads
         )
 {
-    // density_map_tensor should be initialized outside
+    CHECK_FLAT(old_pos);
+    CHECK_EVEN(old_pos);
+    CHECK_CONTIGUOUS(old_pos);
+    CHECK_FLAT(new_pos);
+    CHECK_CONTIGUOUS(new_pos);
+    CHECK_CONTIGUOUS(density_map);
+    AT_ASSERTM(old_pos.numel() == new_pos.numel(), "old_pos and new_pos must have the same number of elements");
+
+    int num_bins_x = int(ceil((xh-xl)/bin_size_x));
+    int num_bins_y = int(ceil((yh-yl)/bin_size_y));
+    int num_nodes = old_pos.numel()/2;
+    double overflow = 0;
+
+    AT_DISPATCH_FLOATING_TYPES(old_pos.type(), "updateDensityOverflowMapLauncher", [&] {
+            overflow = updateDensityOverflowMapLauncher<scalar_t>(
+                    old_pos.data<scalar_t>(), old_pos.data<scalar_t>()+num_nodes,
+                    new_pos.data<scalar_t>(), new_pos.data<scalar_t>()+num_nodes,
+                    node_size_x.data<scalar_t>(), node_size_y.data<scalar_t>(),
+                    bin_center_x.data<scalar_t>(), bin_center_y.data<scalar_t>(),
+                    num_nodes,
+                    num_bins_x, num_bins_y,
+                    xl, yl, xh, yh,
+                    bin_size_x, bin_size_y,
+                    target_density*bin_size_x*bin_size_y,
+                    deterministic_flag,
+                    num_threads,
+                    density_map.data<scalar_t>()
+                    );
+            });
+
+    return at::full({1}, overflow, density_map.options());
+}
+
+/// @brief Bins and overlaps of cells for the density overflow map
+template <typename T>
+struct DensityOverflowCells
+{
+    const T* x_tensor;
+    const T* y_tensor;
+    const T* node_size_x_tensor;
+    const T* node_size_y_tensor;
+    const T* bin_center_x_tensor;
+    const T* bin_center_y_tensor;
+    int num_bins_x;
+    int num_bins_y;
+    T xl;
+    T yl;
+    T bin_size_x;
+    T bin_size_y;
 
     // density overflow function
-    auto computeDensityOverflowFunc = [](T x, T node_size, T bin_center, T bin_size){
+    static T computeDensityOverflowFunc(T x, T node_size, T bin_center, T bin_size)
+    {
         return std::max(T(0.0), std::min(x+node_size, bin_center+bin_size/2) - std::max(x, bin_center-bin_size/2));
-    };
-#pragma omp parallel for num_threads(num_threads)
-    for (int i = 0; i < num_nodes; ++i)
+    }
+
+    void binRange(int i, int& bin_index_xl, int& bin_index_xh, int& bin_index_yl, int& bin_index_yh) const
     {
         // x direction
-        int bin_index_xl = int((x_tensor[i]-xl)/bin_size_x);
-        int bin_index_xh = int(ceil((x_tensor[i]-xl+node_size_x_tensor[i])/bin_size_x))+1; // exclusive
+        bin_index_xl = int((x_tensor[i]-xl)/bin_size_x);
+        bin_index_xh = int(ceil((x_tensor[i]-xl+node_size_x_tensor[i])/bin_size_x))+1; // exclusive
         bin_index_xl = std::max(bin_index_xl, 0);
         bin_index_xh = std::min(bin_index_xh, num_bins_x);
 
         // y direction
-        int bin_index_yl = int((y_tensor[i]-yl-2*bin_size_y)/bin_size_y);
-        int bin_index_yh = int(ceil((y_tensor[i]-yl+node_size_y_tensor[i]+2*bin_size_y)/bin_size_y))+1; // exclusive
+        bin_index_yl = int((y_tensor[i]-yl-2*bin_size_y)/bin_size_y);
+        bin_index_yh = int(ceil((y_tensor[i]-yl+node_size_y_tensor[i]+2*bin_size_y)/bin_size_y))+1; // exclusive
         bin_index_yl = std::max(bin_index_yl, 0);
         bin_index_yh = std::min(bin_index_yh, num_bins_y);
+    }
+
+    /// @brief cells touching many bins go through a difference array
+    bool large(int i) const
+    {
+        int bin_index_xl;
+        int bin_index_xh;
+        int bin_index_yl;
+        int bin_index_yh;
+        binRange(i, bin_index_xl, bin_index_xh, bin_index_yl, bin_index_yh);
+        return (long)(bin_index_xh-bin_index_xl)*(bin_index_yh-bin_index_yl) > kDensityDifferenceMinBins;
+    }
+
+    void binRangeX(int i, int& bin_index_xl, int& bin_index_xh) const
+    {
+        int bin_index_yl;
+        int bin_index_yh;
+        binRange(i, bin_index_xl, bin_index_xh, bin_index_yl, bin_index_yh);
+        // large cells touch no bins in scatter
+        if ((long)(bin_index_xh-bin_index_xl)*(bin_index_yh-bin_index_yl) > kDensityDifferenceMinBins)
+        {
+            bin_index_xh = bin_index_xl;
+        }
+    }
+
+    template <bool Atomic, typename DensityMap>
+    void scatter(int i, DensityMap density_map_tensor) const
+    {
+        int bin_index_xl;
+        int bin_index_xh;
+        int bin_index_yl;
+        int bin_index_yh;
+        binRange(i, bin_index_xl, bin_index_xh, bin_index_yl, bin_index_yh);
+        // large cells are added by scatterLargeCells
+        if ((long)(bin_index_xh-bin_index_xl)*(bin_index_yh-bin_index_yl) > kDensityDifferenceMinBins)
+        {
+            return;
+        }
 
         for (int k = bin_index_xl; k < bin_index_xh; ++k)
         {
@@ -230,20 +389,104 @@ int computeDensityOverflowMapLauncher(
                 //printf("px[%d, %d] = %g, py[%d, %d] = %g\n", k, h, px, k, h, py);
 
                 // still area
-                T& density = density_map_tensor[k*num_bins_y+h];
-#pragma omp atomic
-                density += px*py;
+                addDensity<Atomic>(density_map_tensor, (long)k*num_bins_y+h, px*py);
             }
         }
     }
 
+    void runs(int i, std::vector<DensityRun<T> >& runs_x, std::vector<DensityRun<T> >& runs_y) const
+    {
+        const DensityOverflowCells& f = *this;
+        T x = x_tensor[i];
+        T y = y_tensor[i];
+        T node_size_x = node_size_x_tensor[i];
+        T node_size_y = node_size_y_tensor[i];
+        int bin_index_xl;
+        int bin_index_xh;
+        int bin_index_yl;
+        int bin_index_yh;
+        binRange(i, bin_index_xl, bin_index_xh, bin_index_yl, bin_index_yh);
+        computeDensityRuns(
+                [&](int k) {return computeDensityOverflowFunc(x, node_size_x, f.bin_center_x_tensor[k], f.bin_size_x);},
+                [&](int k) {return x <= f.bin_center_x_tensor[k]-f.bin_size_x/2 && f.bin_center_x_tensor[k]+f.bin_size_x/2 <= x+node_size_x;},
+                bin_index_xl, bin_index_xh, bin_size_x, runs_x);
+        computeDensityRuns(
+                [&](int h) {return computeDensityOverflowFunc(y, node_size_y, f.bin_center_y_tensor[h], f.bin_size_y);},
+                [&](int h) {return y <= f.bin_center_y_tensor[h]-f.bin_size_y/2 && f.bin_center_y_tensor[h]+f.bin_size_y/2 <= y+node_size_y;},
+                bin_index_yl, bin_index_yh, bin_size_y, runs_y);
+    }
+};
+
+template <typename T>
+int computeDensityOverflowMapLauncher(
+        const T* x_tensor, const T* y_tensor,
+        const T* node_size_x_tensor, const T* node_size_y_tensor,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        bool deterministic_flag,
+        int num_threads,
+        DensityScatterTensorBuffer& scatter_buffer,
+        T* density_map_tensor
+        )
+{
+    // density_map_tensor should be initialized outside
+    DensityOverflowCells<T> f = {
+        x_tensor, y_tensor,
+        node_size_x_tensor, node_size_y_tensor,
+        bin_center_x_tensor, bin_center_y_tensor,
+        num_bins_x, num_bins_y,
+        xl, yl,
+        bin_size_x, bin_size_y
+    };
+
+    // atomic additions, private maps or stripes of bins, according to the numbers of cells and bins
+    scatterDensityMap(f, num_nodes, num_bins_x, num_bins_y, deterministic_flag, num_threads, kDensityScatterAuto, scatter_buffer, density_map_tensor);
+
+    // macros only cost a few updates of a difference array
+    scatterLargeCells(f, num_nodes, num_bins_x, num_bins_y, num_threads, density_map_tensor);
+
     return 0;
 }
 
+template <typename T>
+T updateDensityOverflowMapLauncher(
+        const T* old_x_tensor, const T* old_y_tensor,
+        const T* new_x_tensor, const T* new_y_tensor,
+        const T* node_size_x_tensor, const T* node_size_y_tensor,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        const T target_area,
+        bool deterministic_flag,
+        const int num_threads,
+        T* density_map_tensor
+        )
+{
+    DensityOverflowCells<T> old_f = {
+        old_x_tensor, old_y_tensor,
+        node_size_x_tensor, node_size_y_tensor,
+        bin_center_x_tensor, bin_center_y_tensor,
+        num_bins_x, num_bins_y,
+        xl, yl,
+        bin_size_x, bin_size_y
+    };
+    DensityOverflowCells<T> new_f = old_f;
+    new_f.x_tensor = new_x_tensor;
+    new_f.y_tensor = new_y_tensor;
+
+    return updateDensityMap(old_f, new_f, num_nodes, num_bins_x, num_bins_y, target_area, deterministic_flag, num_threads, NULL, density_map_tensor);
+}
+
 DREAMPLACE_END_NAMESPACE
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
   m.def("forward", &DREAMPLACE_NAMESPACE::density_overflow_forward, "DensityOverflow forward");
   //m.def("backward", &DREAMPLACE_NAMESPACE::density_overflow_backward, "DensityOverflow backward");
   m.def("fixed_density_map", &DREAMPLACE_NAMESPACE::fixed_density_overflow_map, "DensityOverflow Map for Fixed Cells");
+  m.def("update_density_map", &DREAMPLACE_NAMESPACE::update_density_overflow_map, "DensityOverflow Map Update for Moved Cells");
 }
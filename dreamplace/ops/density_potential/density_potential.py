@@ -179,8 +179,6 @@ class DensityPotential(nn.Module):
     """
     def __init__(self,
             node_size_x, node_size_y,
-            ax, bx, cx,
-            ay, by, cy,
             bin_center_x, bin_center_y,
             target_density,
             xl, yl, xh, yh,
@@ -197,12 +195,6 @@ class DensityPotential(nn.Module):
         @brief initialization
         @param node_size_x cell width array consisting of movable cells, fixed cells, and filler cells in order
         @param node_size_y cell height array consisting of movable cells, fixed cells, and filler cells in order
-        @param ax
-        @param bx
-        @param cx
-        @param ay
-        @param by
-        @param cy see the a, b, c defined in NTUPlace3
         @param bin_center_x bin center x locations
         @param bin_center_y bin center y locations
         @param target_density target density
@@ -222,12 +214,6 @@ class DensityPotential(nn.Module):
         super(DensityPotential, self).__init__()
         self.node_size_x = node_size_x
         self.node_size_y = node_size_y
-        self.ax = ax
-        self.bx = bx
-        self.cx = cx
-        self.ay = ay
-        self.by = by
-        self.cy = cy
         self.bin_center_x = bin_center_x
         self.bin_center_y = bin_center_y
         self.target_density = target_density
@@ -259,7 +245,25 @@ class DensityPotential(nn.Module):
         # initial density_map due to fixed cells
         self.initial_density_map = None
 
+    def coefficients(self):
+        """
+        @brief compute the a, b, c defined in NTUPlace3 for each cell.
+        They are derived from the current cell sizes, so they follow any permutation of cells, e.g., by spatial sorting.
+        @return ax, bx, cx, ay, by, cy
+        """
+        def compute(node_size, bin_size):
+            a = 4 / (node_size + 2*bin_size) / (node_size + 4*bin_size)
+            b = 2 / bin_size / (node_size + 4*bin_size)
+            # should not use integral, but sum; basically sample 5 distances, -2wb, -wb, 0, wb, 2wb; the sum does not change much when shifting cells
+            integral_potential = 1 + 2*(1-a*bin_size*bin_size) + 2*b*(node_size/2)*(node_size/2)
+            c = node_size / integral_potential
+            return a, b, c
+        ax, bx, cx = compute(self.node_size_x, self.bin_size_x)
+        ay, by, cy = compute(self.node_size_y, self.bin_size_y)
+        return ax, bx, cx, ay, by, cy
+
     def forward(self, pos):
+        ax, bx, cx, ay, by, cy = self.coefficients()
         if self.initial_density_map is None:
             if self.num_terminals == 0:
                 num_impacted_bins_x = 0
@@ -271,8 +275,8 @@ class DensityPotential(nn.Module):
                 self.initial_density_map = density_potential_hip.fixed_density_map(
                         pos.view(pos.numel()),
                         self.node_size_x, self.node_size_y,
-                        self.ax, self.bx, self.cx,
-                        self.ay, self.by, self.cy,
+                        ax, bx, cx,
+                        ay, by, cy,
                         self.bin_center_x, self.bin_center_y,
                         self.xl, self.yl, self.xh, self.yh,
                         self.bin_size_x, self.bin_size_y,
@@ -288,8 +292,8 @@ class DensityPotential(nn.Module):
                 self.initial_density_map = density_potential_cpp.fixed_density_map(
                         pos.view(pos.numel()),
                         self.node_size_x, self.node_size_y,
-                        self.ax, self.bx, self.cx,
-                        self.ay, self.by, self.cy,
+                        ax, bx, cx,
+                        ay, by, cy,
                         self.bin_center_x, self.bin_center_y,
                         self.xl, self.yl, self.xh, self.yh,
                         self.bin_size_x, self.bin_size_y,
@@ -327,8 +331,8 @@ class DensityPotential(nn.Module):
         return DensityPotentialFunction.apply(
                 pos,
                 self.node_size_x, self.node_size_y,
-                self.ax, self.bx, self.cx,
-                self.ay, self.by, self.cy,
+                ax, bx, cx,
+                ay, by, cy,
                 self.bin_center_x,
                 self.bin_center_y,
                 self.initial_density_map,
@@ -27,7 +27,7 @@ import matplotlib.pyplot as plt
 
 
 class ElectricOverflowFunction(Function):
-    """compute density overflow.
+    """compute density map for density overflow.
     """
 
     @staticmethod
@@ -50,7 +50,10 @@ class ElectricOverflowFunction(Function):
             num_movable_impacted_bins_y,
             num_filler_impacted_bins_x,
             num_filler_impacted_bins_y,
-            num_threads
+            uniform_filler_size,
+            deterministic_flag,
+            num_threads,
+            scatter_buffer
     ):
 
         if pos.is_cuda:
@@ -92,20 +95,34 @@ class ElectricOverflowFunction(Function):
                 num_movable_impacted_bins_y,
                 num_filler_impacted_bins_x,
                 num_filler_impacted_bins_y,
-                num_threads
+                uniform_filler_size,
+                deterministic_flag,
+                num_threads,
+                -1,  # choose the scattering mode by the problem size
+                scatter_buffer
             )
 
-        bin_area = bin_size_x * bin_size_y
-        density_map = output.view([num_bins_x, num_bins_y])
-        density_cost = (density_map - target_density * bin_area).clamp_(min=0.0).sum()
-
         # torch.set_printoptions(precision=10)
         # print("initial_density_map")
         # print(initial_density_map/bin_area)
         # print("density_map")
         # print(density_map/bin_area)
 
-        return density_cost, density_map.max() / bin_area
+        return output.view([num_bins_x, num_bins_y])
+
+
+def density_overflow(density_map, target_density, bin_size_x, bin_size_y):
+    """
+    @brief overflow and maximum density of a density map
+    @param density_map density map not normalized by bin area
+    @param target_density target density
+    @param bin_size_x bin width
+    @param bin_size_y bin height
+    """
+    bin_area = bin_size_x * bin_size_y
+    density_cost = (density_map - target_density * bin_area).clamp_(min=0.0).sum()
+
+    return density_cost, density_map.max() / bin_area
 
 
 class ElectricOverflow(nn.Module):
@@ -119,6 +136,7 @@ class ElectricOverflow(nn.Module):
                  num_terminals,
                  num_filler_nodes,
                  padding,
+                 deterministic_flag=False,
                  num_threads=8
                  ):
         super(ElectricOverflow, self).__init__()
@@ -157,6 +175,10 @@ class ElectricOverflow(nn.Module):
         else:
             self.num_filler_impacted_bins_x = 0
             self.num_filler_impacted_bins_y = 0
+        # fillers of the same size go through specialized kernels on CPU
+        self.uniform_filler_size = bool(num_filler_nodes) \
+            and bool((node_size_x[-num_filler_nodes:] == node_size_x[-num_filler_nodes]).all()) \
+            and bool((node_size_y[-num_filler_nodes:] == node_size_y[-num_filler_nodes]).all())
         if self.padding > 0:
             self.padding_mask = torch.ones(self.num_bins_x, self.num_bins_y, dtype=torch.uint8,
                                            device=node_size_x.device)
@@ -166,12 +188,84 @@ class ElectricOverflow(nn.Module):
             self.padding_mask = torch.zeros(self.num_bins_x, self.num_bins_y, dtype=torch.uint8,
                                             device=node_size_x.device)
 
+        # fixed-point density map independent of the number of threads on CPU
+        self.deterministic_flag = deterministic_flag
         self.num_threads = num_threads
+        # buffer of private density maps on CPU, reused across evaluations
+        self.scatter_buffer = torch.empty(0, dtype=torch.int64)
 
         # initial density_map due to fixed cells
         self.initial_density_map = None
+        # an op on the same bins with movable_density_map(pos), e.g., ElectricPotential,
+        # whose density map of the same cell locations is reused instead of scattering cells again
+        self.density_map_source = None
+        # density map and overflow of the last forward or update
+        self.density_map = None
+        self.density_map_shared = False
+        # fillers are only in the map scattered by this op
+        self.density_map_num_filler_nodes = 0
+        self.overflow = None
 
     def forward(self, pos):
+        density_map = None
+        if self.density_map_source is not None:
+            density_map = self.density_map_source.movable_density_map(pos)
+        self.density_map_shared = density_map is not None
+        self.density_map_num_filler_nodes = 0 if self.density_map_shared else self.num_filler_nodes
+        if density_map is None:
+            density_map = self.compute_density_map(pos)
+
+        self.density_map = density_map
+        self.overflow, max_density = density_overflow(density_map, self.target_density, self.bin_size_x, self.bin_size_y)
+        return self.overflow, max_density
+
+    def update(self, moved_nodes, old_pos, new_pos):
+        """
+        @brief move some cells on the density map of the last forward or update, only on CPU.
+        Only the old and new footprints of the moved cells are visited,
+        so the cost scales with the number of moved cells instead of all cells.
+        Rounding errors build up over many updates, so call forward now and then to start over.
+        With deterministic_flag, the changes are accumulated in the fixed point of forward,
+        so the map does not depend on the number of threads; it still differs from a full forward by rounding.
+        Padding bins stay at the target density like in forward.
+        @param moved_nodes indices of moved cells, a tensor of int64, must be movable cells or fillers in the map
+        @param old_pos locations of moved cells before moving, x locations and then y locations
+        @param new_pos locations of moved cells after moving, in the same layout as old_pos
+        @return overflow after moving; the maximum density is not kept as it needs a pass over all bins
+        """
+        assert self.density_map is not None, "forward must be called before update"
+        assert not old_pos.is_cuda, "incremental update is only implemented on CPU"
+        num_nodes = self.node_size_x.numel()
+        assert bool(((moved_nodes >= 0) & (moved_nodes < num_nodes)
+            & ((moved_nodes < self.num_movable_nodes) | (moved_nodes >= num_nodes - self.density_map_num_filler_nodes))).all()), \
+            "moved_nodes must be movable cells or fillers"
+        # the map borrowed from density_map_source belongs to its op
+        if self.density_map_shared:
+            self.density_map = self.density_map.clone()
+            self.density_map_shared = False
+        delta = electric_potential_cpp.update_density_map(
+            self.density_map,
+            old_pos.contiguous().view(-1),
+            new_pos.contiguous().view(-1),
+            self.node_size_x[moved_nodes], self.node_size_y[moved_nodes],
+            self.bin_center_x, self.bin_center_y,
+            self.target_density,
+            self.xl, self.yl, self.xh, self.yh,
+            self.bin_size_x, self.bin_size_y,
+            self.num_bins_x, self.num_bins_y,
+            self.padding,
+            self.padding_mask,
+            self.deterministic_flag,
+            self.num_threads
+        )
+        self.overflow = self.overflow + delta[0]
+        return self.overflow
+
+    def compute_density_map(self, pos):
+        """
+        @brief density map of fixed and movable cells by scattering all of them
+        @param pos cell locations
+        """
         if self.initial_density_map is None:
             if self.num_terminals == 0:
                 num_fixed_impacted_bins_x = 0
@@ -210,6 +304,7 @@ class ElectricOverflow(nn.Module):
                     self.num_bins_y,
                     num_fixed_impacted_bins_x,
                     num_fixed_impacted_bins_y,
+                    self.deterministic_flag,
                     self.num_threads
                 )
                 # plot(0, self.initial_density_map.clone().div(self.bin_size_x*self.bin_size_y).cpu().numpy(), self.padding, 'summary/initial_potential_map')
@@ -234,6 +329,9 @@ class ElectricOverflow(nn.Module):
             self.num_movable_impacted_bins_y,
             self.num_filler_impacted_bins_x,
             self.num_filler_impacted_bins_y,
-            self.num_threads
+            self.uniform_filler_size,
+            self.deterministic_flag,
+            self.num_threads,
+            self.scatter_buffer
         )
 
@@ -69,7 +69,11 @@ class ElectricPotentialFunction(Function):
             wu_by_wu2_plus_wv2_2X=None,  # 2*wu/(wu^2 + wv^2)
             wv_by_wu2_plus_wv2_2X=None,  # 2*wv/(wu^2 + wv^2)
             fast_mode=True,  # fast mode will discard some computation
-            num_threads=8
+            spectral_energy=False,  # energy from auv without the potential map
+            uniform_filler_size=False,  # all fillers have the same size
+            deterministic_flag=False,  # fixed-point density map independent of the number of threads
+            num_threads=8,
+            scatter_buffer=None  # int64 buffer of density scattering on CPU kept across evaluations
     ):
 
         if pos.is_cuda:
@@ -111,7 +115,11 @@ class ElectricPotentialFunction(Function):
                 num_movable_impacted_bins_y,
                 num_filler_impacted_bins_x,
                 num_filler_impacted_bins_y,
-                num_threads
+                uniform_filler_size,
+                deterministic_flag,
+                num_threads,
+                -1,  # choose the scattering mode by the problem size
+                torch.empty(0, dtype=torch.int64) if scatter_buffer is None else scatter_buffer
             )
 
             # output consists of (density_cost, density_map, max_density)
@@ -136,6 +144,7 @@ class ElectricPotentialFunction(Function):
         ctx.num_filler_impacted_bins_x = num_filler_impacted_bins_x
         ctx.num_filler_impacted_bins_y = num_filler_impacted_bins_y
         ctx.pos = pos
+        ctx.uniform_filler_size = uniform_filler_size
         ctx.num_threads = num_threads
         density_map = output.view([ctx.num_bins_x, ctx.num_bins_y])
         # density_map = torch.ones([ctx.num_bins_x, ctx.num_bins_y], dtype=pos.dtype, device=pos.device)
@@ -180,7 +189,12 @@ class ElectricPotentialFunction(Function):
         # energy = \sum q*phi
         # it takes around 80% of the computation time
         # so I will not always evaluate it
-        if fast_mode:  # dummy for invoking backward propagation
+        if spectral_energy:
+            # \sum q*phi by the orthogonality of cosines,
+            # where the first row and column of auv are halved
+            auv_by_wu2_plus_wv2_auv = auv.pow(2).mul_(inv_wu2_plus_wv2_2X)
+            energy = (auv_by_wu2_plus_wv2_auv.sum() + auv_by_wu2_plus_wv2_auv[0, :].sum() + auv_by_wu2_plus_wv2_auv[:, 0].sum()).mul_(M * N / 2).view([1])
+        elif fast_mode:  # dummy for invoking backward propagation
             energy = torch.zeros(1, dtype=pos.dtype, device=pos.device)
         else:
             # compute potential phi
@@ -245,6 +259,7 @@ class ElectricPotentialFunction(Function):
                 ctx.num_bins_x, ctx.num_bins_y,
                 ctx.num_movable_impacted_bins_x, ctx.num_movable_impacted_bins_y,
                 ctx.num_filler_impacted_bins_x, ctx.num_filler_impacted_bins_y,
+                ctx.uniform_filler_size,
                 ctx.field_map_x.view([-1]), ctx.field_map_y.view([-1]),
                 ctx.pos,
                 ctx.node_size_x, ctx.node_size_y,
@@ -282,9 +297,26 @@ class ElectricPotentialFunction(Function):
             None, None, None, None, \
             None, None, None, None, \
             None, None, None, None, \
+            None, None, None, None, \
             None, None, None
 
 
+class ElectricPotentialEngineFunction(Function):
+    """
+    @brief compute electric potential on CPU with a native engine,
+    which keeps the density map, field maps and transform tables across iterations.
+    """
+
+    @staticmethod
+    def forward(ctx, pos, engine):
+        ctx.engine = engine
+        return engine.forward(pos.view(pos.numel()))
+
+    @staticmethod
+    def backward(ctx, grad_pos):
+        return ctx.engine.backward(grad_pos), None
+
+
 class ElectricPotential(nn.Module):
     """
     @brief Compute electric potential according to e-place
@@ -301,6 +333,8 @@ class ElectricPotential(nn.Module):
                  num_filler_nodes,
                  padding,
                  fast_mode=False,
+                 spectral_energy=False,
+                 deterministic_flag=False,
                  num_threads=8
                  ):
         """
@@ -323,6 +357,10 @@ class ElectricPotential(nn.Module):
         @param num_filler_nodes number of filler cells
         @param padding bin padding to boundary of placement region
         @param fast_mode if true, only gradient is computed, while objective computation is skipped
+        @param spectral_energy if true, objective is computed from the spectral coefficients of the density map in any mode,
+        which is much cheaper than the potential map
+        @param deterministic_flag if true, the density map is accumulated in fixed point on CPU,
+        so the density map is the same bit for bit with any number of threads
         """
         super(ElectricPotential, self).__init__()
         self.node_size_x = node_size_x
@@ -360,6 +398,10 @@ class ElectricPotential(nn.Module):
         else:
             self.num_filler_impacted_bins_x = 0
             self.num_filler_impacted_bins_y = 0
+        # fillers of the same size go through specialized kernels on CPU
+        self.uniform_filler_size = bool(num_filler_nodes) \
+            and bool((node_size_x[-num_filler_nodes:] == node_size_x[-num_filler_nodes]).all()) \
+            and bool((node_size_y[-num_filler_nodes:] == node_size_y[-num_filler_nodes]).all())
         if self.padding > 0:
             self.padding_mask = torch.ones(self.num_bins_x, self.num_bins_y, dtype=torch.uint8,
                                            device=node_size_x.device)
@@ -378,10 +420,21 @@ class ElectricPotential(nn.Module):
         self.inv_wu2_plus_wv2_2X = None
         self.wu_by_wu2_plus_wv2_2X = None
         self.wv_by_wu2_plus_wv2_2X = None
+        # frequencies of rows and columns for the native engine on CPU
+        self.wu = None
+        self.wv = None
 
         # whether really evaluate potential_map and energy or use dummy
         self.fast_mode = fast_mode
+        self.spectral_energy = spectral_energy
+        self.deterministic_flag = deterministic_flag
         self.num_threads = num_threads
+        # buffer of private density maps on CPU, reused across evaluations
+        self.scatter_buffer = torch.empty(0, dtype=torch.int64)
+        # native engine on CPU, created at the first forward
+        self.engine = None
+        # cell locations of the last forward of the engine, to tell whether its density map can be reused
+        self.engine_pos = None
 
     def forward(self, pos):
         if self.initial_density_map is None:
@@ -422,6 +475,7 @@ class ElectricPotential(nn.Module):
                     self.num_bins_y,
                     num_fixed_impacted_bins_x,
                     num_fixed_impacted_bins_y,
+                    self.deterministic_flag,
                     self.num_threads
                 )
                 # plot(0, self.initial_density_map.clone().div(self.bin_size_x*self.bin_size_y).cpu().numpy(), self.padding, 'summary/initial_potential_map')
@@ -445,6 +499,40 @@ class ElectricPotential(nn.Module):
             self.inv_wu2_plus_wv2_2X[0, 0] = 0.0
             self.wu_by_wu2_plus_wv2_2X = wu.mul(self.inv_wu2_plus_wv2_2X)
             self.wv_by_wu2_plus_wv2_2X = wv.mul(self.inv_wu2_plus_wv2_2X)
+            self.wu = wu.view(M)
+            self.wv = wv.view(N)
+
+        if not pos.is_cuda:
+            if self.engine is None:
+                self.engine = electric_potential_cpp.ElectricPotentialEngine(
+                    self.node_size_x, self.node_size_y,
+                    self.bin_center_x, self.bin_center_y,
+                    self.initial_density_map,
+                    self.target_density,
+                    self.xl, self.yl, self.xh, self.yh,
+                    self.bin_size_x, self.bin_size_y,
+                    self.num_movable_nodes, self.num_filler_nodes,
+                    self.padding,
+                    self.padding_mask,
+                    self.num_bins_x,
+                    self.num_bins_y,
+                    self.num_movable_impacted_bins_x,
+                    self.num_movable_impacted_bins_y,
+                    self.num_filler_impacted_bins_x,
+                    self.num_filler_impacted_bins_y,
+                    self.inv_wu2_plus_wv2_2X,
+                    self.wu, self.wv,
+                    self.fast_mode,
+                    self.spectral_energy,
+                    self.uniform_filler_size,
+                    self.deterministic_flag,
+                    self.num_threads
+                )
+            if self.engine_pos is None:
+                self.engine_pos = pos.data.clone()
+            else:
+                self.engine_pos.copy_(pos.data)
+            return ElectricPotentialEngineFunction.apply(pos, self.engine)
 
         return ElectricPotentialFunction.apply(
             pos,
@@ -467,9 +555,25 @@ class ElectricPotential(nn.Module):
             self.expk_M, self.expk_N,
             self.inv_wu2_plus_wv2_2X,
             self.wu_by_wu2_plus_wv2_2X, self.wv_by_wu2_plus_wv2_2X,
-            self.fast_mode
+            self.fast_mode,
+            self.spectral_energy,
+            self.uniform_filler_size,
+            self.deterministic_flag,
+            self.num_threads,
+            self.scatter_buffer
         )
 
+    def movable_density_map(self, pos):
+        """
+        @brief density map of fixed and movable cells from the last forward, without fillers and padding.
+        It is only available from the native engine on CPU, and only if the last forward has the same cell locations.
+        @param pos cell locations
+        @return density map of num_bins_x by num_bins_y not normalized by bin area, or None if not available
+        """
+        if self.engine is None or self.engine_pos is None or not torch.equal(self.engine_pos, pos.data):
+            return None
+        return self.engine.movable_density_map()
+
 
 def plot(plot_count, density_map, padding, name):
     """
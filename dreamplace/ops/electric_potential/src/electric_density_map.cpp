@@ -6,6 +6,9 @@
  */
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
+#include "utility/src/density_scatter_tensor.h"
+#include "electric_potential/src/electric_potential_engine.h"
+#include "electric_potential/src/electric_field.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -13,6 +16,8 @@ DREAMPLACE_BEGIN_NAMESPACE
 
 /// @brief The triangular density model from e-place.
 /// The impact of a cell to bins is extended to two neighboring bins
+/// @param scatter_mode a DensityScatterMode, kDensityScatterAuto to choose one from the numbers of cells and bins
+/// @param scatter_buffer buffer of the private maps kept by the op
 template <typename T>
 int computeTriangleDensityMapLauncher(
         const T* x_tensor, const T* y_tensor,
@@ -22,7 +27,47 @@ int computeTriangleDensityMapLauncher(
         const int num_bins_x, const int num_bins_y,
         const T xl, const T yl, const T xh, const T yh,
         const T bin_size_x, const T bin_size_y,
+        bool deterministic_flag,
         const int num_threads,
+        const int scatter_mode,
+        DensityScatterTensorBuffer& scatter_buffer,
+        T* density_map_tensor
+        );
+
+/// @brief The triangular density model specialized for filler cells of the same size.
+/// The stretched size, the number of impacted bins and the area ratio are the same for all of them.
+template <typename T>
+int computeFillerTriangleDensityMapLauncher(
+        const T* x_tensor, const T* y_tensor,
+        const T filler_size_x, const T filler_size_y,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        bool deterministic_flag,
+        const int num_threads,
+        const int scatter_mode,
+        DensityScatterTensorBuffer& scatter_buffer,
+        T* density_map_tensor
+        );
+
+/// @brief Move cells of the triangular density model on a density map.
+/// @return change of the total overflow of the map
+template <typename T>
+T updateTriangleDensityMapLauncher(
+        const T* old_x_tensor, const T* old_y_tensor,
+        const T* new_x_tensor, const T* new_y_tensor,
+        const T* node_size_x_tensor, const T* node_size_y_tensor,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        const T target_area,
+        bool deterministic_flag,
+        const int num_threads,
+        const unsigned char* padding_mask,
         T* density_map_tensor
         );
 
@@ -38,7 +83,10 @@ int computeExactDensityMapLauncher(
         const T xl, const T yl, const T xh, const T yh,
         const T bin_size_x, const T bin_size_y,
         bool fixed_node_flag,
+        bool deterministic_flag,
         const int num_threads,
+        const int scatter_mode,
+        DensityScatterTensorBuffer& scatter_buffer,
         T* density_map_tensor
         );
 
@@ -70,7 +118,14 @@ int computeExactDensityMapLauncher(
 /// @param num_movable_impacted_bins_y number of impacted bins for any movable cell in y direction
 /// @param num_filler_impacted_bins_x number of impacted bins for any filler cell in x direction
 /// @param num_filler_impacted_bins_y number of impacted bins for any filler cell in y direction
-at::Tensor density_map(
+/// @param uniform_filler_size whether all filler cells have the same size, which enables a specialized kernel
+/// @param deterministic_flag whether to accumulate areas in fixed point, so the map does not depend on the number of threads
+/// @param num_threads number of threads
+/// @param scatter_mode a DensityScatterMode, -1 to choose one from the numbers of cells and bins
+/// @param scatter_buffer int64 buffer of the private maps kept by the op across calls, resized when needed
+/// @param density_map output density map, the same size as initial_density_map
+/// @param movable_density_map if defined, receives the density map of fixed and movable cells, before fillers and padding are added
+void compute_density_map(
         at::Tensor pos,
         at::Tensor node_size_x, at::Tensor node_size_y,
         at::Tensor bin_center_x,
@@ -90,15 +145,24 @@ at::Tensor density_map(
         int num_bins_x, int num_bins_y,
         int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
         int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
-        int num_threads
+        bool uniform_filler_size,
+        bool deterministic_flag,
+        int num_threads,
+        int scatter_mode,
+        at::Tensor scatter_buffer,
+        at::Tensor density_map,
+        at::Tensor movable_density_map
         )
 {
     CHECK_FLAT(pos);
     CHECK_EVEN(pos);
     CHECK_CONTIGUOUS(pos);
+    checkDensityScatterBuffer(scatter_buffer);
+    AT_ASSERTM(scatter_mode >= kDensityScatterAuto && scatter_mode <= kDensityScatterStripes, "invalid scatter_mode");
 
-    at::Tensor density_map = initial_density_map.clone();
+    density_map.copy_(initial_density_map);
     int num_nodes = pos.numel()/2;
+    DensityScatterTensorBuffer buffer = {scatter_buffer};
 
     // Call the hip kernel launcher
     AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeTriangleDensityMapLauncher", [&] {
@@ -111,12 +175,40 @@ at::Tensor density_map(
                     xl, yl, xh, yh,
                     bin_size_x, bin_size_y,
                     //false,
+                    deterministic_flag,
                     num_threads,
+                    scatter_mode,
+                    buffer,
                     density_map.data<scalar_t>()
                     );
             });
 
-    if (num_filler_nodes)
+    // the overflow metric excludes fillers
+    if (movable_density_map.defined())
+    {
+        movable_density_map.copy_(density_map);
+    }
+
+    if (num_filler_nodes && uniform_filler_size)
+    {
+        AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeFillerTriangleDensityMapLauncher", [&] {
+                computeFillerTriangleDensityMapLauncher<scalar_t>(
+                        pos.data<scalar_t>()+num_nodes-num_filler_nodes, pos.data<scalar_t>()+num_nodes*2-num_filler_nodes,
+                        node_size_x.data<scalar_t>()[num_nodes-num_filler_nodes], node_size_y.data<scalar_t>()[num_nodes-num_filler_nodes],
+                        bin_center_x.data<scalar_t>(), bin_center_y.data<scalar_t>(),
+                        num_filler_nodes,
+                        num_bins_x, num_bins_y,
+                        xl, yl, xh, yh,
+                        bin_size_x, bin_size_y,
+                        deterministic_flag,
+                        num_threads,
+                        scatter_mode,
+                        buffer,
+                        density_map.data<scalar_t>()
+                        );
+                });
+    }
+    else if (num_filler_nodes)
     {
         AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeTriangleDensityMapLauncher", [&] {
                 computeTriangleDensityMapLauncher<scalar_t>(
@@ -128,7 +220,10 @@ at::Tensor density_map(
                         xl, yl, xh, yh,
                         bin_size_x, bin_size_y,
                         //false,
+                        deterministic_flag,
                         num_threads,
+                        scatter_mode,
+                        buffer,
                         density_map.data<scalar_t>()
                         );
                 });
@@ -139,16 +234,17 @@ at::Tensor density_map(
     {
         density_map.masked_fill_(padding_mask, at::Scalar(target_density*bin_size_x*bin_size_y));
     }
-
-    return density_map;
 }
 
-/// @brief Compute density map for fixed cells
-at::Tensor fixed_density_map(
+/// @brief compute density map for movable and filler cells into a new tensor,
+/// see compute_density_map for the parameters
+at::Tensor density_map(
         at::Tensor pos,
         at::Tensor node_size_x, at::Tensor node_size_y,
         at::Tensor bin_center_x,
         at::Tensor bin_center_y,
+        at::Tensor initial_density_map,
+        double target_density,
         double xl,
         double yl,
         double xh,
@@ -156,40 +252,236 @@ at::Tensor fixed_density_map(
         double bin_size_x,
         double bin_size_y,
         int num_movable_nodes,
-        int num_terminals,
+        int num_filler_nodes,
+        int padding,
+        at::Tensor padding_mask,
         int num_bins_x, int num_bins_y,
-        int num_fixed_impacted_bins_x, int num_fixed_impacted_bins_y,
+        int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
+        int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+        bool uniform_filler_size,
+        bool deterministic_flag,
+        int num_threads,
+        int scatter_mode,
+        at::Tensor scatter_buffer
+        )
+{
+    at::Tensor density_map = at::empty_like(initial_density_map);
+    compute_density_map(
+            pos,
+            node_size_x, node_size_y,
+            bin_center_x,
+            bin_center_y,
+            initial_density_map,
+            target_density,
+            xl,
+            yl,
+            xh,
+            yh,
+            bin_size_x,
+            bin_size_y,
+            num_movable_nodes,
+            num_filler_nodes,
+            padding,
+            padding_mask,
+            num_bins_x, num_bins_y,
+            num_movable_impacted_bins_x, num_movable_impacted_bins_y,
+            num_filler_impacted_bins_x, num_filler_impacted_bins_y,
+            uniform_filler_size,
+            deterministic_flag,
+            num_threads,
+            scatter_mode,
+            scatter_buffer,
+            density_map,
+            at::Tensor()
+            );
+    return density_map;
+}
+
+/// @brief Move cells on a density map of movable cells, e.g., the one of the overflow metric, which is updated in place.
+/// The old footprints are removed and the new ones are added,
+/// so the cost scales with the number of moved cells instead of all cells.
+/// Fillers are handled like movable cells, and padding bins stay at the target density.
+/// @param density_map density map not normalized by bin area
+/// @param old_pos locations of moved cells before moving, array of x locations and then y locations
+/// @param new_pos locations of moved cells after moving, in the same layout as old_pos
+/// @param node_size_x cell width array of moved cells
+/// @param node_size_y cell height array of moved cells
+/// @param bin_center_x bin center x locations
+/// @param bin_center_y bin center y locations
+/// @param target_density target density
+/// @param xl left boundary
+/// @param yl bottom boundary
+/// @param xh right boundary
+/// @param yh top boundary
+/// @param bin_size_x bin width
+/// @param bin_size_y bin height
+/// @param num_bins_x number of bins in horizontal bins
+/// @param num_bins_y number of bins in vertical bins
+/// @param padding bin padding to boundary of placement region
+/// @param padding_mask padding mask with 0 and 1 to indicate padding bins with padding regions to be 1
+/// @param deterministic_flag whether to accumulate the changes in fixed point, so the map does not depend on the number of threads
+/// @param num_threads number of threads
+/// @return change of the total density overflow
+at::Tensor update_density_map(
+        at::Tensor density_map,
+        at::Tensor old_pos,
+        at::Tensor new_pos,
+        at::Tensor node_size_x, at::Tensor node_size_y,
+        at::Tensor bin_center_x,
+        at::Tensor bin_center_y,
+        double target_density,
+        double xl,
+        double yl,
+        double xh,
+        double yh,
+        double bin_size_x,
+        double bin_size_y,
+        int num_bins_x, int num_bins_y,
+        int padding,
+        at::Tensor padding_mask,
+        bool deterministic_flag,
         int num_threads
         )
+{
+    CHECK_FLAT(old_pos);
+    CHECK_EVEN(old_pos);
+    CHECK_CONTIGUOUS(old_pos);
+    CHECK_FLAT(new_pos);
+    CHECK_CONTIGUOUS(new_pos);
+    CHECK_CONTIGUOUS(density_map);
+    AT_ASSERTM(old_pos.numel() == new_pos.numel(), "old_pos and new_pos must have the same number of elements");
+    if (padding > 0)
+    {
+        CHECK_CONTIGUOUS(padding_mask);
+        AT_ASSERTM(padding_mask.numel() == density_map.numel(), "padding_mask must have the size of density_map");
+    }
+
+    int num_nodes = old_pos.numel()/2;
+    double overflow = 0;
+
+    AT_DISPATCH_FLOATING_TYPES(old_pos.type(), "updateTriangleDensityMapLauncher", [&] {
+            overflow = updateTriangleDensityMapLauncher<scalar_t>(
+                    old_pos.data<scalar_t>(), old_pos.data<scalar_t>()+num_nodes,
+                    new_pos.data<scalar_t>(), new_pos.data<scalar_t>()+num_nodes,
+                    node_size_x.data<scalar_t>(), node_size_y.data<scalar_t>(),
+                    bin_center_x.data<scalar_t>(), bin_center_y.data<scalar_t>(),
+                    num_nodes,
+                    num_bins_x, num_bins_y,
+                    xl, yl, xh, yh,
+                    bin_size_x, bin_size_y,
+                    target_density*bin_size_x*bin_size_y,
+                    deterministic_flag,
+                    num_threads,
+                    (padding > 0)? padding_mask.data<unsigned char>() : NULL,
+                    density_map.data<scalar_t>()
+                    );
+            });
+
+    return at::full({1}, overflow, density_map.options());
+}
+
+/// @brief Compute density map of cells [node_begin, node_end) with the exact overlap model,
+/// where cells touching many bins, e.g., macros, go through a difference array
+/// @param fixed_node_flag if false, cells out of the region are counted in the bins at the boundary
+/// @param scatter_mode DensityScatterMode, kDensityScatterAuto to choose by the numbers of cells and bins
+/// @param scatter_buffer int64 buffer for private maps, resized if needed
+at::Tensor exact_density_map(
+        at::Tensor pos,
+        at::Tensor node_size_x, at::Tensor node_size_y,
+        at::Tensor bin_center_x,
+        at::Tensor bin_center_y,
+        double xl,
+        double yl,
+        double xh,
+        double yh,
+        double bin_size_x,
+        double bin_size_y,
+        int node_begin,
+        int node_end,
+        int num_bins_x, int num_bins_y,
+        bool fixed_node_flag,
+        bool deterministic_flag,
+        int num_threads,
+        int scatter_mode,
+        at::Tensor scatter_buffer
+        )
 {
     CHECK_FLAT(pos);
     CHECK_EVEN(pos);
     CHECK_CONTIGUOUS(pos);
+    checkDensityScatterBuffer(scatter_buffer);
+
+    int num_nodes = pos.numel()/2;
+    AT_ASSERTM(node_begin >= 0 && node_begin <= node_end && node_end <= num_nodes, "cells must be in [0, number of cells)");
+    AT_ASSERTM(scatter_mode >= kDensityScatterAuto && scatter_mode <= kDensityScatterStripes, "invalid scatter_mode");
 
     at::Tensor density_map = at::zeros({num_bins_x, num_bins_y}, pos.type());
+    DensityScatterTensorBuffer buffer = {scatter_buffer};
 
-    int num_nodes = pos.numel()/2;
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeExactDensityMapLauncher", [&] {
+            computeExactDensityMapLauncher<scalar_t>(
+                    pos.data<scalar_t>()+node_begin, pos.data<scalar_t>()+num_nodes+node_begin,
+                    node_size_x.data<scalar_t>()+node_begin, node_size_y.data<scalar_t>()+node_begin,
+                    bin_center_x.data<scalar_t>(), bin_center_y.data<scalar_t>(),
+                    node_end-node_begin,
+                    num_bins_x, num_bins_y,
+                    xl, yl, xh, yh,
+                    bin_size_x, bin_size_y,
+                    fixed_node_flag,
+                    deterministic_flag,
+                    num_threads,
+                    scatter_mode,
+                    buffer,
+                    density_map.data<scalar_t>()
+                    );
+            });
 
-    // Call the hip kernel launcher
+    return density_map;
+}
+
+/// @brief Compute density map for fixed cells
+at::Tensor fixed_density_map(
+        at::Tensor pos,
+        at::Tensor node_size_x, at::Tensor node_size_y,
+        at::Tensor bin_center_x,
+        at::Tensor bin_center_y,
+        double xl,
+        double yl,
+        double xh,
+        double yh,
+        double bin_size_x,
+        double bin_size_y,
+        int num_movable_nodes,
+        int num_terminals,
+        int num_bins_x, int num_bins_y,
+        int num_fixed_impacted_bins_x, int num_fixed_impacted_bins_y,
+        bool deterministic_flag,
+        int num_threads
+        )
+{
     if (num_terminals && num_fixed_impacted_bins_x && num_fixed_impacted_bins_y)
     {
-        AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeExactDensityMapLauncher", [&] {
-                computeExactDensityMapLauncher<scalar_t>(
-                        pos.data<scalar_t>()+num_movable_nodes, pos.data<scalar_t>()+num_nodes+num_movable_nodes,
-                        node_size_x.data<scalar_t>()+num_movable_nodes, node_size_y.data<scalar_t>()+num_movable_nodes,
-                        bin_center_x.data<scalar_t>(), bin_center_y.data<scalar_t>(),
-                        num_terminals,
-                        num_bins_x, num_bins_y,
-                        xl, yl, xh, yh,
-                        bin_size_x, bin_size_y,
-                        true,
-                        num_threads,
-                        density_map.data<scalar_t>()
-                        );
-                });
+        // fixed cells are scattered once, so the buffer is not kept
+        return exact_density_map(
+                pos,
+                node_size_x, node_size_y,
+                bin_center_x, bin_center_y,
+                xl, yl, xh, yh,
+                bin_size_x, bin_size_y,
+                num_movable_nodes, num_movable_nodes+num_terminals,
+                num_bins_x, num_bins_y,
+                true,
+                deterministic_flag,
+                num_threads,
+                kDensityScatterAuto,
+                at::empty({0}, pos.options().dtype(at::kLong))
+                );
     }
 
-    return density_map;
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    return at::zeros({num_bins_x, num_bins_y}, pos.type());
 }
 
 /// @brief Compute electric force for movable and filler cells
@@ -200,6 +492,7 @@ at::Tensor fixed_density_map(
 /// @param num_movable_impacted_bins_y number of impacted bins for any movable cell in y direction
 /// @param num_filler_impacted_bins_x number of impacted bins for any filler cell in x direction
 /// @param num_filler_impacted_bins_y number of impacted bins for any filler cell in y direction
+/// @param uniform_filler_size whether all filler cells have the same size, which enables a specialized kernel
 /// @param field_map_x electric field map in x direction
 /// @param field_map_y electric field map in y direction
 /// @param pos cell locations. The array consists of all x locations and then y locations.
@@ -220,6 +513,7 @@ at::Tensor electric_force(
         int num_bins_x, int num_bins_y,
         int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
         int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+        bool uniform_filler_size,
         at::Tensor field_map_x, at::Tensor field_map_y,
         at::Tensor pos,
         at::Tensor node_size_x, at::Tensor node_size_y,
@@ -231,89 +525,195 @@ at::Tensor electric_force(
         int num_threads
         );
 
-template <typename T>
-int computeTriangleDensityMapLauncher(
-        const T* x_tensor, const T* y_tensor,
-        const T* node_size_x_tensor, const T* node_size_y_tensor,
-        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
-        const int num_nodes,
-        const int num_bins_x, const int num_bins_y,
-        const T xl, const T yl, const T xh, const T yh,
-        const T bin_size_x, const T bin_size_y,
-        const int num_threads,
-        T* density_map_tensor
+/// @brief Add the separable areas px[j]*py[l]*ratio of a window of WindowSize by WindowSize bins to a density map.
+/// The products of a row are computed together, and bins out of the map are skipped.
+template <typename T, int WindowSize, bool Atomic, typename DensityMap>
+inline void scatterDensityWindow(
+        const T* px, const T* py, T ratio,
+        int bin_index_xl, int bin_index_yl,
+        int num_bins_x, int num_bins_y,
+        DensityMap density_map_tensor
         )
 {
-    // density_map_tensor should be initialized outside
+    int num_window_bins_x = std::min(int(WindowSize), num_bins_x-bin_index_xl);
+    int num_window_bins_y = std::min(int(WindowSize), num_bins_y-bin_index_yl);
+    for (int j = 0; j < num_window_bins_x; ++j)
+    {
+        T area[WindowSize];
+#pragma omp simd
+        for (int l = 0; l < WindowSize; ++l)
+        {
+            area[l] = px[j]*py[l]*ratio;
+        }
+        long row = (long)(bin_index_xl+j)*num_bins_y+bin_index_yl;
+        for (int l = 0; l < num_window_bins_y; ++l)
+        {
+            addDensity<Atomic>(density_map_tensor, row+l, area[l]);
+        }
+    }
+}
+
+/// @brief Cell areas of the triangular density model.
+/// A cell is stretched to sqrt(2) times of the bin size in both directions, keeping its area,
+/// so it touches at most 3 bins in each direction from the bin containing its lower left corner,
+/// and the overlaps are computed once per direction for a fixed 3x3 window.
+template <typename T>
+struct TriangleDensity
+{
+    enum { kWindowSize = 3 }; ///< number of bins touched in each direction
+
+    const T* x_tensor;
+    const T* y_tensor;
+    const T* node_size_x_tensor;
+    const T* node_size_y_tensor;
+    const T* bin_center_x_tensor;
+    const T* bin_center_y_tensor;
+    int num_bins_x;
+    int num_bins_y;
+    T xl;
+    T yl;
+    T bin_size_x;
+    T bin_size_y;
 
-    // density function
     // extend a cell to have impact between (cb-wb, cb+wb)
-    auto computeDensityFunc = [](T x, T node_size, T bin_center, T bin_size){
+    static T computeDensityFunc(T x, T node_size, T bin_center, T bin_size)
+    {
         return std::max(T(0.0), std::min(x+node_size, bin_center+bin_size/2) - std::max(x, bin_center-bin_size/2));
-    };
-#pragma omp parallel for num_threads(num_threads)
-    for (int i = 0; i < num_nodes; ++i)
+    }
+
+    /// @brief overlap of a stretched shape starting at x with bins from bin_index_l, zero for bins out of range
+    static void computeWindow(T x, T node_size, const T* bin_center_tensor, T bin_size, int bin_index_l, int num_bins, T* p)
+    {
+        for (int j = 0; j < kWindowSize; ++j)
+        {
+            int k = bin_index_l+j;
+            p[j] = (k < num_bins)? computeDensityFunc(x, node_size, bin_center_tensor[k], bin_size) : T(0);
+        }
+    }
+
+    void binRangeX(int i, int& bin_index_xl, int& bin_index_xh) const
     {
-        // x direction
         // stretch node size to bin size
         T node_size_x = bin_size_x*SQRT2;
         T node_x = x_tensor[i]+node_size_x_tensor[i]/2-node_size_x/2;
-        int bin_index_xl = int((node_x-xl)/bin_size_x);
-        int bin_index_xh = int(ceil((node_x+node_size_x-xl)/bin_size_x))+1; // exclusive
-        bin_index_xl = std::max(bin_index_xl, 0);
-        bin_index_xh = std::min(bin_index_xh, num_bins_x);
+        bin_index_xl = std::max(int((node_x-xl)/bin_size_x), 0);
+        bin_index_xh = std::min(bin_index_xl+kWindowSize, num_bins_x); // exclusive
+    }
 
-        // y direction
+    void binRange(int i, int& bin_index_xl, int& bin_index_xh, int& bin_index_yl, int& bin_index_yh) const
+    {
+        binRangeX(i, bin_index_xl, bin_index_xh);
+        T node_size_y = bin_size_y*SQRT2;
+        T node_y = y_tensor[i]+node_size_y_tensor[i]/2-node_size_y/2;
+        bin_index_yl = std::max(int((node_y-yl)/bin_size_y), 0);
+        bin_index_yh = std::min(bin_index_yl+kWindowSize, num_bins_y); // exclusive
+    }
+
+    /// @brief cells touch at most kWindowSize bins in each direction, so none is large and runs are never needed
+    bool large(int i) const
+    {
+        return false;
+    }
+
+    void runs(int i, std::vector<DensityRun<T> >& runs_x, std::vector<DensityRun<T> >& runs_y) const
+    {
+    }
+
+    template <bool Atomic, typename DensityMap>
+    void scatter(int i, DensityMap density_map_tensor) const
+    {
         // stretch node size to bin size
+        T node_size_x = bin_size_x*SQRT2;
         T node_size_y = bin_size_y*SQRT2;
+        T node_x = x_tensor[i]+node_size_x_tensor[i]/2-node_size_x/2;
         T node_y = y_tensor[i]+node_size_y_tensor[i]/2-node_size_y/2;
-        int bin_index_yl = int((node_y-yl)/bin_size_y);
-        int bin_index_yh = int(ceil((node_y+node_size_y-yl)/bin_size_y))+1; // exclusive
-        bin_index_yl = std::max(bin_index_yl, 0);
-        bin_index_yh = std::min(bin_index_yh, num_bins_y);
+        int bin_index_xl = std::max(int((node_x-xl)/bin_size_x), 0);
+        int bin_index_yl = std::max(int((node_y-yl)/bin_size_y), 0);
 
-        for (int k = bin_index_xl; k < bin_index_xh; ++k)
-        {
-            T px = computeDensityFunc(node_x, node_size_x, bin_center_x_tensor[k], bin_size_x);
-            for (int h = bin_index_yl; h < bin_index_yh; ++h)
-            {
-                // stretch node size to bin size
-                T node_size_y = bin_size_y*SQRT2;
-                T py = computeDensityFunc(node_y, node_size_y, bin_center_y_tensor[h], bin_size_y);
-                //printf("node %d@(%g, %g) size (%g, %g): px[%d, %d] = %g, py[%d, %d] = %g\n", i, x_tensor[i], y_tensor[i], node_size_x_tensor[i], node_size_y_tensor[i], k, h, px, k, h, py);
+        T px[kWindowSize];
+        T py[kWindowSize];
+        computeWindow(node_x, node_size_x, bin_center_x_tensor, bin_size_x, bin_index_xl, num_bins_x, px);
+        computeWindow(node_y, node_size_y, bin_center_y_tensor, bin_size_y, bin_index_yl, num_bins_y, py);
 
-                // scale the total area back to node area
-                T area = px*py*(node_size_x_tensor[i]*node_size_y_tensor[i]/(bin_size_x*bin_size_y*2));
-                // still area
-                T& density = density_map_tensor[k*num_bins_y+h];
-#pragma omp atomic
-                density += area;
-            }
-        }
+        // scale the total area back to node area
+        T ratio = node_size_x_tensor[i]*node_size_y_tensor[i]/(bin_size_x*bin_size_y*2);
+        scatterDensityWindow<T, kWindowSize, Atomic>(px, py, ratio, bin_index_xl, bin_index_yl, num_bins_x, num_bins_y, density_map_tensor);
     }
+};
 
-    return 0;
-}
+/// @brief Cell areas of the triangular density model for filler cells of the same size.
+/// The window is the same as TriangleDensity, and the area ratio is a constant.
+template <typename T>
+struct FillerTriangleDensity
+{
+    enum { kWindowSize = TriangleDensity<T>::kWindowSize }; ///< number of bins touched in each direction
+
+    const T* x_tensor;
+    const T* y_tensor;
+    const T* bin_center_x_tensor;
+    const T* bin_center_y_tensor;
+    int num_bins_x;
+    int num_bins_y;
+    T xl;
+    T yl;
+    T bin_size_x;
+    T bin_size_y;
+    T filler_size_x;
+    T filler_size_y;
+    T ratio; ///< scale the total area back to filler area
+
+    void binRangeX(int i, int& bin_index_xl, int& bin_index_xh) const
+    {
+        T node_x = x_tensor[i]+filler_size_x/2-bin_size_x*SQRT2/2;
+        bin_index_xl = std::max(int((node_x-xl)/bin_size_x), 0);
+        bin_index_xh = std::min(bin_index_xl+kWindowSize, num_bins_x);
+    }
+
+    template <bool Atomic, typename DensityMap>
+    void scatter(int i, DensityMap density_map_tensor) const
+    {
+        // stretch node size to bin size
+        T node_size_x = bin_size_x*SQRT2;
+        T node_size_y = bin_size_y*SQRT2;
+        T node_x = x_tensor[i]+filler_size_x/2-node_size_x/2;
+        T node_y = y_tensor[i]+filler_size_y/2-node_size_y/2;
+        int bin_index_xl = std::max(int((node_x-xl)/bin_size_x), 0);
+        int bin_index_yl = std::max(int((node_y-yl)/bin_size_y), 0);
+
+        T px[kWindowSize];
+        T py[kWindowSize];
+        TriangleDensity<T>::computeWindow(node_x, node_size_x, bin_center_x_tensor, bin_size_x, bin_index_xl, num_bins_x, px);
+        TriangleDensity<T>::computeWindow(node_y, node_size_y, bin_center_y_tensor, bin_size_y, bin_index_yl, num_bins_y, py);
+
+        scatterDensityWindow<T, kWindowSize, Atomic>(px, py, ratio, bin_index_xl, bin_index_yl, num_bins_x, num_bins_y, density_map_tensor);
+    }
+};
 
+/// @brief Cell areas of the exact density model.
+/// Cells touching many bins, e.g., macros, are skipped by scatter,
+/// and added through a difference array by scatterLargeCells instead.
 template <typename T>
-int computeExactDensityMapLauncher(
-        const T* x_tensor, const T* y_tensor,
-        const T* node_size_x_tensor, const T* node_size_y_tensor,
-        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
-        const int num_nodes,
-        const int num_bins_x, const int num_bins_y,
-        const T xl, const T yl, const T xh, const T yh,
-        const T bin_size_x, const T bin_size_y,
-        bool fixed_node_flag,
-        const int num_threads,
-        T* density_map_tensor
-        )
+struct ExactDensity
 {
-    // density_map_tensor should be initialized outside
+    const T* x_tensor;
+    const T* y_tensor;
+    const T* node_size_x_tensor;
+    const T* node_size_y_tensor;
+    const T* bin_center_x_tensor;
+    const T* bin_center_y_tensor;
+    int num_bins_x;
+    int num_bins_y;
+    T xl;
+    T yl;
+    T xh;
+    T yh;
+    T bin_size_x;
+    T bin_size_y;
+    bool fixed_node_flag;
 
-    // density function
     // extend a cell to have impact between (cb-wb, cb+wb)
-    auto computeDensityFunc = [](T x, T node_size, T bin_center, T bin_size, T l, T h, bool flag){
+    static T computeDensityFunc(T x, T node_size, T bin_center, T bin_size, T l, T h, bool flag)
+    {
         T bin_xl = bin_center-bin_size/2;
         T bin_xh = bin_center+bin_size/2;
         if (!flag) // only for movable nodes
@@ -329,21 +729,57 @@ int computeExactDensityMapLauncher(
             }
         }
         return std::max(T(0.0), std::min(x+node_size, bin_xh) - std::max(x, bin_xl));
-    };
-#pragma omp parallel for num_threads(num_threads)
-    for (int i = 0; i < num_nodes; ++i)
+    }
+
+    /// @brief whether a bin is fully covered by a cell, and not extended at the boundary
+    static bool computeFullFunc(T x, T node_size, T bin_center, T bin_size, T l, T h, bool flag)
+    {
+        T bin_xl = bin_center-bin_size/2;
+        T bin_xh = bin_center+bin_size/2;
+        return (flag || (bin_xl > l && bin_xh < h)) && x <= bin_xl && bin_xh <= x+node_size;
+    }
+
+    static void computeBinRange(T x, T node_size, T l, T bin_size, int num_bins, int& bin_index_l, int& bin_index_h)
+    {
+        bin_index_l = int((x-l)/bin_size);
+        bin_index_h = int(ceil((x-l+node_size)/bin_size))+1; // exclusive
+        bin_index_l = std::max(bin_index_l, 0);
+        bin_index_h = std::min(bin_index_h, num_bins);
+    }
+
+    bool large(int i) const
+    {
+        int bin_index_xl;
+        int bin_index_xh;
+        int bin_index_yl;
+        int bin_index_yh;
+        computeBinRange(x_tensor[i], node_size_x_tensor[i], xl, bin_size_x, num_bins_x, bin_index_xl, bin_index_xh);
+        computeBinRange(y_tensor[i], node_size_y_tensor[i], yl, bin_size_y, num_bins_y, bin_index_yl, bin_index_yh);
+        return (long)(bin_index_xh-bin_index_xl)*(bin_index_yh-bin_index_yl) > kDensityDifferenceMinBins;
+    }
+
+    void binRangeX(int i, int& bin_index_xl, int& bin_index_xh) const
+    {
+        computeBinRange(x_tensor[i], node_size_x_tensor[i], xl, bin_size_x, num_bins_x, bin_index_xl, bin_index_xh);
+        // large cells touch no bins in scatter
+        if (large(i))
+        {
+            bin_index_xh = bin_index_xl;
+        }
+    }
+
+    template <bool Atomic, typename DensityMap>
+    void scatter(int i, DensityMap density_map_tensor) const
     {
         // x direction
-        int bin_index_xl = int((x_tensor[i]-xl)/bin_size_x);
-        int bin_index_xh = int(ceil((x_tensor[i]-xl+node_size_x_tensor[i])/bin_size_x))+1; // exclusive
-        bin_index_xl = std::max(bin_index_xl, 0);
-        bin_index_xh = std::min(bin_index_xh, num_bins_x);
+        int bin_index_xl;
+        int bin_index_xh;
+        binRangeX(i, bin_index_xl, bin_index_xh);
 
         // y direction
-        int bin_index_yl = int((y_tensor[i]-yl)/bin_size_y);
-        int bin_index_yh = int(ceil((y_tensor[i]-yl+node_size_y_tensor[i])/bin_size_y))+1; // exclusive
-        bin_index_yl = std::max(bin_index_yl, 0);
-        bin_index_yh = std::min(bin_index_yh, num_bins_y);
+        int bin_index_yl;
+        int bin_index_yh;
+        computeBinRange(y_tensor[i], node_size_y_tensor[i], yl, bin_size_y, num_bins_y, bin_index_yl, bin_index_yh);
 
         for (int k = bin_index_xl; k < bin_index_xh; ++k)
         {
@@ -354,13 +790,159 @@ int computeExactDensityMapLauncher(
                 //printf("px[%d, %d] = %g, py[%d, %d] = %g\n", k, h, px, k, h, py);
 
                 // still area
-                T& density = density_map_tensor[k*num_bins_y+h];
-#pragma omp atomic
-                density += px*py;
+                addDensity<Atomic>(density_map_tensor, (long)k*num_bins_y+h, px*py);
             }
         }
     }
 
+    void runs(int i, std::vector<DensityRun<T> >& runs_x, std::vector<DensityRun<T> >& runs_y) const
+    {
+        const ExactDensity& f = *this;
+        T x = x_tensor[i];
+        T y = y_tensor[i];
+        T node_size_x = node_size_x_tensor[i];
+        T node_size_y = node_size_y_tensor[i];
+        int bin_index_l;
+        int bin_index_h;
+        computeBinRange(x, node_size_x, xl, bin_size_x, num_bins_x, bin_index_l, bin_index_h);
+        computeDensityRuns(
+                [&](int k) {return computeDensityFunc(x, node_size_x, f.bin_center_x_tensor[k], f.bin_size_x, f.xl, f.xh, f.fixed_node_flag);},
+                [&](int k) {return computeFullFunc(x, node_size_x, f.bin_center_x_tensor[k], f.bin_size_x, f.xl, f.xh, f.fixed_node_flag);},
+                bin_index_l, bin_index_h, bin_size_x, runs_x);
+        computeBinRange(y, node_size_y, yl, bin_size_y, num_bins_y, bin_index_l, bin_index_h);
+        computeDensityRuns(
+                [&](int h) {return computeDensityFunc(y, node_size_y, f.bin_center_y_tensor[h], f.bin_size_y, f.yl, f.yh, f.fixed_node_flag);},
+                [&](int h) {return computeFullFunc(y, node_size_y, f.bin_center_y_tensor[h], f.bin_size_y, f.yl, f.yh, f.fixed_node_flag);},
+                bin_index_l, bin_index_h, bin_size_y, runs_y);
+    }
+};
+
+template <typename T>
+int computeTriangleDensityMapLauncher(
+        const T* x_tensor, const T* y_tensor,
+        const T* node_size_x_tensor, const T* node_size_y_tensor,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        bool deterministic_flag,
+        const int num_threads,
+        const int scatter_mode,
+        DensityScatterTensorBuffer& scatter_buffer,
+        T* density_map_tensor
+        )
+{
+    // density_map_tensor should be initialized outside
+    TriangleDensity<T> f = {
+        x_tensor, y_tensor,
+        node_size_x_tensor, node_size_y_tensor,
+        bin_center_x_tensor, bin_center_y_tensor,
+        num_bins_x, num_bins_y,
+        xl, yl,
+        bin_size_x, bin_size_y
+    };
+    // atomic additions, private maps or stripes of bins, according to the numbers of cells and bins
+    scatterDensityMap(f, num_nodes, num_bins_x, num_bins_y, deterministic_flag, num_threads, scatter_mode, scatter_buffer, density_map_tensor);
+
+    return 0;
+}
+
+template <typename T>
+int computeFillerTriangleDensityMapLauncher(
+        const T* x_tensor, const T* y_tensor,
+        const T filler_size_x, const T filler_size_y,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        bool deterministic_flag,
+        const int num_threads,
+        const int scatter_mode,
+        DensityScatterTensorBuffer& scatter_buffer,
+        T* density_map_tensor
+        )
+{
+    // density_map_tensor should be initialized outside
+    FillerTriangleDensity<T> f = {
+        x_tensor, y_tensor,
+        bin_center_x_tensor, bin_center_y_tensor,
+        num_bins_x, num_bins_y,
+        xl, yl,
+        bin_size_x, bin_size_y,
+        filler_size_x, filler_size_y,
+        filler_size_x*filler_size_y/(bin_size_x*bin_size_y*2)
+    };
+    scatterDensityMap(f, num_nodes, num_bins_x, num_bins_y, deterministic_flag, num_threads, scatter_mode, scatter_buffer, density_map_tensor);
+
+    return 0;
+}
+
+template <typename T>
+T updateTriangleDensityMapLauncher(
+        const T* old_x_tensor, const T* old_y_tensor,
+        const T* new_x_tensor, const T* new_y_tensor,
+        const T* node_size_x_tensor, const T* node_size_y_tensor,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        const T target_area,
+        bool deterministic_flag,
+        const int num_threads,
+        const unsigned char* padding_mask,
+        T* density_map_tensor
+        )
+{
+    TriangleDensity<T> old_f = {
+        old_x_tensor, old_y_tensor,
+        node_size_x_tensor, node_size_y_tensor,
+        bin_center_x_tensor, bin_center_y_tensor,
+        num_bins_x, num_bins_y,
+        xl, yl,
+        bin_size_x, bin_size_y
+    };
+    TriangleDensity<T> new_f = old_f;
+    new_f.x_tensor = new_x_tensor;
+    new_f.y_tensor = new_y_tensor;
+
+    return updateDensityMap(old_f, new_f, num_nodes, num_bins_x, num_bins_y, target_area, deterministic_flag, num_threads, padding_mask, density_map_tensor);
+}
+
+template <typename T>
+int computeExactDensityMapLauncher(
+        const T* x_tensor, const T* y_tensor,
+        const T* node_size_x_tensor, const T* node_size_y_tensor,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        const int num_nodes,
+        const int num_bins_x, const int num_bins_y,
+        const T xl, const T yl, const T xh, const T yh,
+        const T bin_size_x, const T bin_size_y,
+        bool fixed_node_flag,
+        bool deterministic_flag,
+        const int num_threads,
+        const int scatter_mode,
+        DensityScatterTensorBuffer& scatter_buffer,
+        T* density_map_tensor
+        )
+{
+    // density_map_tensor should be initialized outside
+    ExactDensity<T> f = {
+        x_tensor, y_tensor,
+        node_size_x_tensor, node_size_y_tensor,
+        bin_center_x_tensor, bin_center_y_tensor,
+        num_bins_x, num_bins_y,
+        xl, yl, xh, yh,
+        bin_size_x, bin_size_y,
+        fixed_node_flag
+    };
+    // atomic additions, private maps or stripes of bins, according to the numbers of cells and bins
+    scatterDensityMap(f, num_nodes, num_bins_x, num_bins_y, deterministic_flag, num_threads, scatter_mode, scatter_buffer, density_map_tensor);
+    // macros through a difference array
+    scatterLargeCells(f, num_nodes, num_bins_x, num_bins_y, num_threads, density_map_tensor);
+
     return 0;
 }
 
@@ -369,5 +951,24 @@ DREAMPLACE_END_NAMESPACE
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
   m.def("density_map", &DREAMPLACE_NAMESPACE::density_map, "ElectricPotential Density Map");
   m.def("fixed_density_map", &DREAMPLACE_NAMESPACE::fixed_density_map, "ElectricPotential Density Map for Fixed Cells");
+  m.def("exact_density_map", &DREAMPLACE_NAMESPACE::exact_density_map, "ElectricPotential Exact Density Map of a Range of Cells");
+  m.def("update_density_map", &DREAMPLACE_NAMESPACE::update_density_map, "ElectricPotential Density Map Update for Moved Cells");
   m.def("electric_force", &DREAMPLACE_NAMESPACE::electric_force, "ElectricPotential Electric Force");
+  pybind11::class_<DREAMPLACE_NAMESPACE::ElectricFieldPlan>(m, "ElectricFieldPlan")
+      .def(pybind11::init<at::Tensor, int>())
+      .def("forward", &DREAMPLACE_NAMESPACE::ElectricFieldPlan::forward, "ElectricPotential Electric Field and Potential with the plan")
+      .def("num_bins_x", &DREAMPLACE_NAMESPACE::ElectricFieldPlan::num_bins_x, "Number of bins in x direction of the plan")
+      .def("num_bins_y", &DREAMPLACE_NAMESPACE::ElectricFieldPlan::num_bins_y, "Number of bins in y direction of the plan")
+      ;
+  pybind11::class_<DREAMPLACE_NAMESPACE::ElectricPotentialEngine>(m, "ElectricPotentialEngine")
+      .def(pybind11::init<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor, double, double, double, double, double, double, double, int, int, int, at::Tensor, int, int, int, int, int, int, at::Tensor, at::Tensor, at::Tensor, bool, bool, bool, bool, int>())
+      .def("forward", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::forward, "Compute density map, electric field and energy")
+      .def("backward", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::backward, "Compute gradient from electric force")
+      .def("density_map", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::density_map, "Density map of the previous forward")
+      .def("movable_density_map", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::movable_density_map, "Density map of fixed and movable cells of the previous forward")
+      .def("auv", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::auv, "Spectral coefficients of the previous forward")
+      .def("field_map_x", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::field_map_x, "Electric field in x direction of the previous forward")
+      .def("field_map_y", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::field_map_y, "Electric field in y direction of the previous forward")
+      .def("potential_map", &DREAMPLACE_NAMESPACE::ElectricPotentialEngine::potential_map, "Potential map of the previous forward")
+      ;
 }
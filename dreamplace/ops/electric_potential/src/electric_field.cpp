@@ -0,0 +1,291 @@
+/**
+ * @file   electric_field.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Electric field and potential from a density map on CPU, with the inverse transforms sharing passes
+ */
+#include <omp.h>
+#include <vector>
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+#include "dct/src/dct_plan_cpu.h"
+#include "electric_potential/src/electric_field.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+#define CHECK_CPU(x) AT_ASSERTM(!x.is_cuda(), #x "must be a tensor on CPU")
+#define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x "must be contiguous")
+
+/// @brief Energy from the spectral coefficients without the potential map.
+/// The density map is the inverse transform of auv, so by the orthogonality of cosines
+/// sum_pq potential_pq*density_pq = num_bins/2 * sum_uv inv_wu2_plus_wv2_2X_uv*auv_uv^2/(c_u*c_v),
+/// where c_0 = 1/2 and c_k = 1 otherwise.
+template <typename T>
+T computeSpectralEnergy(const T* auv, const T* inv_wu2_plus_wv2_2X, int num_bins_x, int num_bins_y, int num_threads)
+{
+    // rows are summed up in order, so the energy does not depend on the number of threads
+    std::vector<T> row_energies (num_bins_x);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int u = 0; u < num_bins_x; ++u)
+    {
+        const T* auv_row = auv+(long)u*num_bins_y;
+        const T* inv_row = inv_wu2_plus_wv2_2X+(long)u*num_bins_y;
+        T row_energy = inv_row[0]*auv_row[0]*auv_row[0]*2;
+        for (int v = 1; v < num_bins_y; ++v)
+        {
+            row_energy += inv_row[v]*auv_row[v]*auv_row[v];
+        }
+        row_energies[u] = (u)? row_energy : row_energy*2;
+    }
+    T energy = 0;
+    for (int u = 0; u < num_bins_x; ++u)
+    {
+        energy += row_energies[u];
+    }
+    return energy*num_bins_x*num_bins_y/2;
+}
+
+/// @brief Spectral coefficients, electric field and potential from a density map normalized by bin area.
+///
+/// With coef = auv*2/(wu^2+wv^2), the maps are
+/// field_map_x = idsct2(coef*wu/2), field_map_y = idcst2(coef*wv/2), potential_map = idcct2(coef).
+/// The frequency weights are separable, wu only depends on the row and wv only on the column,
+/// so scaling by wu commutes with the transforms along rows and scaling by wv with those along columns.
+/// The cosine transform along rows is then shared by field_map_x and potential_map,
+/// and the scaling is folded into the batches of the transforms instead of scaled copies of auv.
+/// This takes 5 one-dimensional passes instead of 6 with the potential, and 4 without it.
+///
+/// @param work buffer of num_bins_x by num_bins_y
+/// @param scratch buffer of 2 by num_bins_x by num_bins_y
+/// @param wu frequencies of rows, length num_bins_x
+/// @param wv frequencies of columns, length num_bins_y
+/// @param potential_map nullptr to skip the potential
+/// @param spectral_energy if true, energy is computed from the spectral coefficients
+/// @return energy, the sum of potential times density, zero if neither potential_map nor spectral_energy is given
+template <typename T>
+T computeElectricFieldLauncher(
+        T* density_map, T* auv,
+        T* field_map_x, T* field_map_y, T* potential_map,
+        T* work, T* scratch,
+        const T* cos_x, const T* cos_y,
+        const T* inv_wu2_plus_wv2_2X, const T* wu, const T* wv,
+        int num_bins_x, int num_bins_y,
+        bool spectral_energy,
+        int num_threads
+        )
+{
+    int num_bins = num_bins_x*num_bins_y;
+
+    // auv = dct2(density_map) with the scaling of dct.dct2,
+    // and the first row and column halved
+    transformSpectralMap<T>(kSpectralDct, kSpectralDct, density_map, auv, work, scratch, cos_x, cos_y, num_bins_x, num_bins_y, num_threads);
+    T scale = T(4)/num_bins;
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int u = 0; u < num_bins_x; ++u)
+    {
+        T row_scale = (u)? scale : scale/2;
+        T* row = auv+(long)u*num_bins_y;
+        row[0] *= row_scale/2;
+        for (int v = 1; v < num_bins_y; ++v)
+        {
+            row[v] *= row_scale;
+        }
+    }
+
+    if (lee::isPowerOf2<int>(num_bins_x) && lee::isPowerOf2<int>(num_bins_y))
+    {
+        // coef goes to field_map_y, which is not written until the last pass
+        T* coef = field_map_y;
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+        for (int i = 0; i < num_bins; ++i)
+        {
+            coef[i] = auv[i]*inv_wu2_plus_wv2_2X[i]*2;
+        }
+        std::vector<T> half_wu (num_bins_x);
+        std::vector<T> half_wv (num_bins_y);
+        for (int u = 0; u < num_bins_x; ++u)
+        {
+            half_wu[u] = wu[u]/2;
+        }
+        for (int v = 0; v < num_bins_y; ++v)
+        {
+            half_wv[v] = wv[v]/2;
+        }
+
+        // along columns, transposed to num_bins_y by num_bins_x
+        T* cos_rows = work;
+        T* sin_rows = scratch;
+        transformSpectralRowsTransposed<T>(kSpectralIdxct, nullptr, coef, cos_rows, cos_y, num_bins_x, num_bins_y, num_threads);
+        transformSpectralRowsTransposed<T>(kSpectralIdxst, half_wv.data(), coef, sin_rows, cos_y, num_bins_x, num_bins_y, num_threads);
+        // along rows, transposed back
+        transformSpectralRowsTransposed<T>(kSpectralIdxst, half_wu.data(), cos_rows, field_map_x, cos_x, num_bins_y, num_bins_x, num_threads);
+        if (potential_map)
+        {
+            transformSpectralRowsTransposed<T>(kSpectralIdxct, nullptr, cos_rows, potential_map, cos_x, num_bins_y, num_bins_x, num_threads);
+        }
+        transformSpectralRowsTransposed<T>(kSpectralIdxct, nullptr, sin_rows, field_map_y, cos_x, num_bins_y, num_bins_x, num_threads);
+    }
+    else
+    {
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+        for (int u = 0; u < num_bins_x; ++u)
+        {
+            for (int v = 0; v < num_bins_y; ++v)
+            {
+                long i = (long)u*num_bins_y+v;
+                T coef = auv[i]*inv_wu2_plus_wv2_2X[i];
+                field_map_x[i] = coef*wu[u];
+                field_map_y[i] = coef*wv[v];
+                if (potential_map)
+                {
+                    potential_map[i] = coef*2;
+                }
+            }
+        }
+        transformSpectralMap<T>(kSpectralIdxst, kSpectralIdxct, field_map_x, field_map_x, work, scratch, cos_x, cos_y, num_bins_x, num_bins_y, num_threads);
+        transformSpectralMap<T>(kSpectralIdxct, kSpectralIdxst, field_map_y, field_map_y, work, scratch, cos_x, cos_y, num_bins_x, num_bins_y, num_threads);
+        if (potential_map)
+        {
+            transformSpectralMap<T>(kSpectralIdxct, kSpectralIdxct, potential_map, potential_map, work, scratch, cos_x, cos_y, num_bins_x, num_bins_y, num_threads);
+        }
+    }
+
+    if (spectral_energy)
+    {
+        return computeSpectralEnergy<T>(auv, inv_wu2_plus_wv2_2X, num_bins_x, num_bins_y, num_threads);
+    }
+    if (!potential_map)
+    {
+        return 0;
+    }
+
+    // rows are summed up in order, so the energy does not depend on the number of threads
+    std::vector<T> row_energies (num_bins_x);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int u = 0; u < num_bins_x; ++u)
+    {
+        const T* potential_row = potential_map+(long)u*num_bins_y;
+        const T* density_row = density_map+(long)u*num_bins_y;
+        T row_energy = 0;
+        for (int v = 0; v < num_bins_y; ++v)
+        {
+            row_energy += potential_row[v]*density_row[v];
+        }
+        row_energies[u] = row_energy;
+    }
+    T energy = 0;
+    for (int u = 0; u < num_bins_x; ++u)
+    {
+        energy += row_energies[u];
+    }
+    return energy;
+}
+
+double compute_electric_field(
+        at::Tensor density_map,
+        at::Tensor inv_wu2_plus_wv2_2X,
+        at::Tensor wu, at::Tensor wv,
+        at::Tensor cos_x, at::Tensor cos_y,
+        at::Tensor work, at::Tensor scratch,
+        at::Tensor auv,
+        at::Tensor field_map_x, at::Tensor field_map_y,
+        at::Tensor potential_map,
+        bool spectral_energy,
+        int num_threads
+        )
+{
+    int num_bins_x = density_map.size(0);
+    int num_bins_y = density_map.size(1);
+
+    double energy = 0;
+    AT_DISPATCH_FLOATING_TYPES(density_map.type(), "computeElectricFieldLauncher", [&] {
+            energy = computeElectricFieldLauncher<scalar_t>(
+                    density_map.data<scalar_t>(), auv.data<scalar_t>(),
+                    field_map_x.data<scalar_t>(), field_map_y.data<scalar_t>(),
+                    (potential_map.defined())? potential_map.data<scalar_t>() : nullptr,
+                    work.data<scalar_t>(), scratch.data<scalar_t>(),
+                    cos_x.data<scalar_t>(), cos_y.data<scalar_t>(),
+                    inv_wu2_plus_wv2_2X.data<scalar_t>(), wu.data<scalar_t>(), wv.data<scalar_t>(),
+                    num_bins_x, num_bins_y,
+                    spectral_energy,
+                    num_threads
+                    );
+            });
+    return energy;
+}
+
+ElectricFieldPlan::ElectricFieldPlan(at::Tensor density_map, int num_threads)
+    : m_num_bins_x(density_map.size(0))
+    , m_num_bins_y(density_map.size(1))
+    , m_num_threads(num_threads)
+{
+    CHECK_CPU(density_map);
+    AT_ASSERTM(density_map.dim() == 2, "density_map must be 2D");
+
+    auto options = density_map.options();
+    m_cos_x = at::empty({spectralCosineTableSize(m_num_bins_x)}, options);
+    m_cos_y = at::empty({spectralCosineTableSize(m_num_bins_y)}, options);
+    AT_DISPATCH_FLOATING_TYPES(density_map.type(), "precomputeSpectralCosineTable", [&] {
+            precomputeSpectralCosineTable<scalar_t>(m_num_bins_x, m_cos_x.data<scalar_t>());
+            precomputeSpectralCosineTable<scalar_t>(m_num_bins_y, m_cos_y.data<scalar_t>());
+            });
+    m_work = at::empty({m_num_bins_x, m_num_bins_y}, options);
+    m_scratch = at::empty({2, m_num_bins_x, m_num_bins_y}, options);
+}
+
+at::Tensor ElectricFieldPlan::forward(
+        at::Tensor density_map,
+        at::Tensor inv_wu2_plus_wv2_2X,
+        at::Tensor wu, at::Tensor wv,
+        at::Tensor auv,
+        at::Tensor field_map_x, at::Tensor field_map_y,
+        at::Tensor potential_map
+        )
+{
+    CHECK_CPU(density_map);
+    CHECK_CONTIGUOUS(density_map);
+    CHECK_CONTIGUOUS(inv_wu2_plus_wv2_2X);
+    CHECK_CONTIGUOUS(wu);
+    CHECK_CONTIGUOUS(wv);
+    CHECK_CONTIGUOUS(auv);
+    CHECK_CONTIGUOUS(field_map_x);
+    CHECK_CONTIGUOUS(field_map_y);
+    AT_ASSERTM(density_map.dim() == 2 && density_map.size(0) == m_num_bins_x && density_map.size(1) == m_num_bins_y,
+            "density_map must have the sizes of the plan");
+    AT_ASSERTM(wu.numel() == m_num_bins_x && wv.numel() == m_num_bins_y, "wu and wv must match the sizes of density_map");
+    AT_ASSERTM(inv_wu2_plus_wv2_2X.numel() == density_map.numel()
+            && auv.numel() == density_map.numel()
+            && field_map_x.numel() == density_map.numel()
+            && field_map_y.numel() == density_map.numel(),
+            "maps must have the size of density_map");
+    AT_ASSERTM(density_map.scalar_type() == m_work.scalar_type(), "density_map must have the type of the plan");
+    AT_ASSERTM(inv_wu2_plus_wv2_2X.scalar_type() == density_map.scalar_type()
+            && wu.scalar_type() == density_map.scalar_type()
+            && wv.scalar_type() == density_map.scalar_type()
+            && auv.scalar_type() == density_map.scalar_type()
+            && field_map_x.scalar_type() == density_map.scalar_type()
+            && field_map_y.scalar_type() == density_map.scalar_type(),
+            "frequency weights and maps must have the type of density_map");
+    if (potential_map.numel())
+    {
+        CHECK_CONTIGUOUS(potential_map);
+        AT_ASSERTM(potential_map.numel() == density_map.numel(), "potential_map must have the size of density_map");
+        AT_ASSERTM(potential_map.scalar_type() == density_map.scalar_type(), "potential_map must have the type of density_map");
+    }
+
+    double energy = compute_electric_field(
+            density_map,
+            inv_wu2_plus_wv2_2X,
+            wu, wv,
+            m_cos_x, m_cos_y,
+            m_work, m_scratch,
+            auv,
+            field_map_x, field_map_y,
+            (potential_map.numel())? potential_map : at::Tensor(),
+            false,
+            m_num_threads
+            );
+    return at::full({1}, energy, density_map.options());
+}
+
+DREAMPLACE_END_NAMESPACE
@@ -0,0 +1,83 @@
+/**
+ * @file   electric_field.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Electric field and potential from a density map on CPU with cosine tables and buffers created once per map size and type
+ */
+#ifndef _DREAMPLACE_ELECTRIC_FIELD_H
+#define _DREAMPLACE_ELECTRIC_FIELD_H
+
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief compute spectral coefficients, electric field and optionally potential into caller-provided maps,
+/// with cosine tables and buffers from the caller
+/// @param cos_x cosine table of num_bins_x from precomputeSpectralCosineTable
+/// @param cos_y cosine table of num_bins_y from precomputeSpectralCosineTable
+/// @param work buffer of num_bins_x by num_bins_y
+/// @param scratch buffer of 2 by num_bins_x by num_bins_y
+/// @param potential_map undefined to skip the potential
+/// @param spectral_energy if true, energy is computed from the spectral coefficients
+/// @return energy, the sum of potential times density, zero if neither the potential nor spectral_energy is asked for
+double compute_electric_field(
+        at::Tensor density_map,
+        at::Tensor inv_wu2_plus_wv2_2X,
+        at::Tensor wu, at::Tensor wv,
+        at::Tensor cos_x, at::Tensor cos_y,
+        at::Tensor work, at::Tensor scratch,
+        at::Tensor auv,
+        at::Tensor field_map_x, at::Tensor field_map_y,
+        at::Tensor potential_map,
+        bool spectral_energy,
+        int num_threads
+        );
+
+/// @brief Plan of electric field and potential for density maps of num_bins_x by num_bins_y of one type.
+/// The cosine tables and buffers of the transforms are created in the constructor
+/// and reused by every call, like DctPlan.
+class ElectricFieldPlan
+{
+    public:
+        /// @param density_map map of num_bins_x by num_bins_y, only its sizes and type are used
+        /// @param num_threads number of threads
+        ElectricFieldPlan(at::Tensor density_map, int num_threads);
+
+        /// @brief compute electric field and optionally potential from a density map
+        /// @param density_map density map of num_bins_x by num_bins_y normalized by bin area
+        /// @param inv_wu2_plus_wv2_2X 2/(wu^2+wv^2) of num_bins_x by num_bins_y
+        /// @param wu frequencies of rows, length num_bins_x
+        /// @param wv frequencies of columns, length num_bins_y, scaled by the aspect ratio of bins
+        /// @param auv output spectral coefficients, with the first row and column halved
+        /// @param field_map_x output electric field in x direction
+        /// @param field_map_y output electric field in y direction
+        /// @param potential_map output potential map, or an empty tensor to skip it
+        /// @return energy, the sum of potential times density, zero if the potential is skipped
+        at::Tensor forward(
+                at::Tensor density_map,
+                at::Tensor inv_wu2_plus_wv2_2X,
+                at::Tensor wu, at::Tensor wv,
+                at::Tensor auv,
+                at::Tensor field_map_x, at::Tensor field_map_y,
+                at::Tensor potential_map
+                );
+
+        /// @return number of bins in x direction
+        int num_bins_x() const {return m_num_bins_x;}
+        /// @return number of bins in y direction
+        int num_bins_y() const {return m_num_bins_y;}
+
+    protected:
+        int m_num_bins_x;
+        int m_num_bins_y;
+        int m_num_threads;
+        at::Tensor m_cos_x; ///< cosine table of the transforms along columns
+        at::Tensor m_cos_y; ///< cosine table of the transforms along rows
+        at::Tensor m_work; ///< map between the passes of a 2D transform
+        at::Tensor m_scratch; ///< two maps of per-row buffers for one-dimensional transforms
+};
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
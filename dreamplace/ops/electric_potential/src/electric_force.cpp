@@ -6,6 +6,7 @@
  */
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
+#include <vector>
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -24,18 +25,51 @@ int computeElectricForceLauncher(
         T* grad_x_tensor, T* grad_y_tensor
         );
 
+/// @brief Electric force on filler cells of the same size.
+/// The stretched size and the area ratio are the same for all fillers,
+/// and a filler touches at most WindowSize bins in each direction,
+/// so the bins are visited with a fixed-size window.
+template <typename T, int WindowSize>
+int computeFillerElectricForceLauncher(
+        int num_bins_x, int num_bins_y,
+        const T* field_map_x_tensor, const T* field_map_y_tensor,
+        const T* x_tensor, const T* y_tensor,
+        T filler_size_x, T filler_size_y,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        T xl, T yl, T xh, T yh,
+        T bin_size_x, T bin_size_y,
+        int num_nodes,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        );
+
+/// @brief Run the filler kernel if the window is small enough, return false otherwise
+template <typename T>
+bool computeFillerElectricForce(
+        int num_bins_x, int num_bins_y,
+        const T* field_map_x_tensor, const T* field_map_y_tensor,
+        const T* x_tensor, const T* y_tensor,
+        T filler_size_x, T filler_size_y,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        T xl, T yl, T xh, T yh,
+        T bin_size_x, T bin_size_y,
+        int num_nodes,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        );
+
 #define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x "must be a flat tensor on CPU")
 #define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x "must have even number of elements")
 #define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x "must be contiguous")
 
 /// @brief compute electric force for movable and filler cells
-/// @param grad_pos input gradient from backward propagation
 /// @param num_bins_x number of bins in horizontal bins
 /// @param num_bins_y number of bins in vertical bins
 /// @param num_movable_impacted_bins_x number of impacted bins for any movable cell in x direction
 /// @param num_movable_impacted_bins_y number of impacted bins for any movable cell in y direction
 /// @param num_filler_impacted_bins_x number of impacted bins for any filler cell in x direction
 /// @param num_filler_impacted_bins_y number of impacted bins for any filler cell in y direction
+/// @param uniform_filler_size whether all filler cells have the same size, which enables a specialized kernel
 /// @param field_map_x electric field map in x direction
 /// @param field_map_y electric field map in y direction
 /// @param pos cell locations. The array consists of all x locations and then y locations.
@@ -51,11 +85,13 @@ int computeElectricForceLauncher(
 /// @param bin_size_y bin height
 /// @param num_movable_nodes number of movable cells
 /// @param num_filler_nodes number of filler cells
-at::Tensor electric_force(
-        at::Tensor grad_pos,
+/// @param num_threads number of threads
+/// @param grad_out output force, the same size as pos; entries of fixed cells are not touched
+void compute_electric_force(
         int num_bins_x, int num_bins_y,
         int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
         int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+        bool uniform_filler_size,
         at::Tensor field_map_x, at::Tensor field_map_y,
         at::Tensor pos,
         at::Tensor node_size_x, at::Tensor node_size_y,
@@ -64,14 +100,14 @@ at::Tensor electric_force(
         double bin_size_x, double bin_size_y,
         int num_movable_nodes,
         int num_filler_nodes,
-        int num_threads
+        int num_threads,
+        at::Tensor grad_out
         )
 {
     CHECK_FLAT(pos);
     CHECK_EVEN(pos);
     CHECK_CONTIGUOUS(pos);
 
-    at::Tensor grad_out = at::zeros_like(pos);
     int num_nodes = pos.numel()/2;
 
     AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeElectricForceLauncher", [&] {
@@ -90,7 +126,25 @@ at::Tensor electric_force(
                     );
             });
 
-    if (num_filler_nodes)
+    bool filler_done = false;
+    if (num_filler_nodes && uniform_filler_size)
+    {
+        AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeFillerElectricForce", [&] {
+                filler_done = computeFillerElectricForce<scalar_t>(
+                        num_bins_x, num_bins_y,
+                        field_map_x.data<scalar_t>(), field_map_y.data<scalar_t>(),
+                        pos.data<scalar_t>()+num_nodes-num_filler_nodes, pos.data<scalar_t>()+num_nodes*2-num_filler_nodes,
+                        node_size_x.data<scalar_t>()[num_nodes-num_filler_nodes], node_size_y.data<scalar_t>()[num_nodes-num_filler_nodes],
+                        bin_center_x.data<scalar_t>(), bin_center_y.data<scalar_t>(),
+                        xl, yl, xh, yh,
+                        bin_size_x, bin_size_y,
+                        num_filler_nodes,
+                        num_threads,
+                        grad_out.data<scalar_t>()+num_nodes-num_filler_nodes, grad_out.data<scalar_t>()+num_nodes*2-num_filler_nodes
+                        );
+                });
+    }
+    if (num_filler_nodes && !filler_done)
     {
         AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeElectricForceLauncher", [&] {
                 computeElectricForceLauncher<scalar_t>(
@@ -108,12 +162,138 @@ at::Tensor electric_force(
                         );
                 });
     }
+}
 
+/// @brief compute electric force for movable and filler cells multiplied by the input gradient,
+/// see compute_electric_force for the other parameters
+/// @param grad_pos input gradient from backward propagation
+at::Tensor electric_force(
+        at::Tensor grad_pos,
+        int num_bins_x, int num_bins_y,
+        int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
+        int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+        bool uniform_filler_size,
+        at::Tensor field_map_x, at::Tensor field_map_y,
+        at::Tensor pos,
+        at::Tensor node_size_x, at::Tensor node_size_y,
+        at::Tensor bin_center_x, at::Tensor bin_center_y,
+        double xl, double yl, double xh, double yh,
+        double bin_size_x, double bin_size_y,
+        int num_movable_nodes,
+        int num_filler_nodes,
+        int num_threads
+        )
+{
+    at::Tensor grad_out = at::zeros_like(pos);
+    compute_electric_force(
+            num_bins_x, num_bins_y,
+            num_movable_impacted_bins_x, num_movable_impacted_bins_y,
+            num_filler_impacted_bins_x, num_filler_impacted_bins_y,
+            uniform_filler_size,
+            field_map_x, field_map_y,
+            pos,
+            node_size_x, node_size_y,
+            bin_center_x, bin_center_y,
+            xl, yl, xh, yh,
+            bin_size_x, bin_size_y,
+            num_movable_nodes,
+            num_filler_nodes,
+            num_threads,
+            grad_out
+            );
     return grad_out.mul_(grad_pos);
 }
 
 #define SQRT2 1.4142135623730950488016887242096980785696718753769480731766797379907324784621
 
+/// @brief Overlap of a stretched cell (x, x+node_size) with a bin
+template <typename T>
+inline T computeForceDensityFunc(T x, T node_size, T bin_center, T bin_size)
+{
+    //return std::max(T(0.0), min(x+node_size, bin_center+bin_size/2) - std::max(x, bin_center-bin_size/2));
+    // Yibo: cannot understand why negative overlap is allowed in RePlAce
+    return std::min(x+node_size, bin_center+bin_size/2) - std::max(x, bin_center-bin_size/2);
+}
+
+/// @brief Bins of a stretched cell (x, x+node_size) in one direction, with exclusive upper bound
+template <typename T>
+inline void computeForceBinRange(T x, T node_size, T l, T bin_size, int num_bins, int& bin_index_l, int& bin_index_h)
+{
+    // Yibo: looks very weird implementation, but this is how RePlAce implements it
+    // the common practice should be floor
+    bin_index_l = std::max(int(round((x-l)/bin_size)), 0);
+    bin_index_h = std::min(int(round((x+node_size-l)/bin_size))+1, num_bins);
+}
+
+/// @brief Separable force of a cell over a window of WindowSize by WindowSize bins.
+/// The overlaps in x and y directions are computed once per cell and the window is contracted with the field maps.
+/// Bins out of the range of the cell get zero weights, and the window is shifted into the map,
+/// so each row of the field maps is read contiguously and the inner loop vectorizes.
+/// The map must have at least WindowSize bins in each direction.
+template <typename T, int WindowSize>
+struct ElectricForceWindow
+{
+    /// @brief overlaps of the window with a cell in one direction
+    /// @param bin_index_l first bin of the cell
+    /// @param bin_index_h last bin of the cell, exclusive
+    /// @param p overlaps of WindowSize bins
+    /// @return first bin of the window
+    static int compute(T x, T node_size, const T* bin_center_tensor, T bin_size, int bin_index_l, int bin_index_h, int num_bins, T* p)
+    {
+        int start = std::min(bin_index_l, num_bins-WindowSize);
+        for (int j = 0; j < WindowSize; ++j)
+        {
+            int k = start+j;
+            p[j] = (k >= bin_index_l && k < bin_index_h)? computeForceDensityFunc(x, node_size, bin_center_tensor[k], bin_size) : T(0);
+        }
+        return start;
+    }
+
+    /// @brief accumulate sum_{j, l} px[j]*py[l]*field_map[start_x+j, start_y+l] for both field maps
+    static void contract(
+            const T* field_map_x_tensor, const T* field_map_y_tensor,
+            int num_bins_y,
+            int start_x, int start_y,
+            const T* px, const T* py,
+            T& gx, T& gy
+            )
+    {
+        for (int j = 0; j < WindowSize; ++j)
+        {
+            const T* field_x = field_map_x_tensor+(long)(start_x+j)*num_bins_y+start_y;
+            const T* field_y = field_map_y_tensor+(long)(start_x+j)*num_bins_y+start_y;
+            T sx = 0;
+            T sy = 0;
+#pragma omp simd reduction(+:sx, sy)
+            for (int l = 0; l < WindowSize; ++l)
+            {
+                sx += py[l]*field_x[l];
+                sy += py[l]*field_y[l];
+            }
+            gx += px[j]*sx;
+            gy += px[j]*sy;
+        }
+    }
+
+    /// @brief force of a cell without the area ratio
+    static void run(
+            const T* field_map_x_tensor, const T* field_map_y_tensor,
+            const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+            int num_bins_x, int num_bins_y,
+            T bin_size_x, T bin_size_y,
+            T node_x, T node_y, T node_size_x, T node_size_y,
+            int bin_index_xl, int bin_index_xh, int bin_index_yl, int bin_index_yh,
+            T& gx, T& gy
+            )
+    {
+        T px[WindowSize];
+        T py[WindowSize];
+        int start_x = compute(node_x, node_size_x, bin_center_x_tensor, bin_size_x, bin_index_xl, bin_index_xh, num_bins_x, px);
+        int start_y = compute(node_y, node_size_y, bin_center_y_tensor, bin_size_y, bin_index_yl, bin_index_yh, num_bins_y, py);
+        contract(field_map_x_tensor, field_map_y_tensor, num_bins_y, start_x, start_y, px, py, gx, gy);
+    }
+};
+
 template <typename T>
 int computeElectricForceLauncher(
         int num_bins_x, int num_bins_y,
@@ -129,62 +309,190 @@ int computeElectricForceLauncher(
         T* grad_x_tensor, T* grad_y_tensor
         )
 {
-    // density_map_tensor should be initialized outside
-
-    auto computeDensityFunc = [](T x, T node_size, T bin_center, T bin_size){
-        //return std::max(T(0.0), min(x+node_size, bin_center+bin_size/2) - std::max(x, bin_center-bin_size/2));
-        // Yibo: cannot understand why negative overlap is allowed in RePlAce
-        return std::min(x+node_size, bin_center+bin_size/2) - std::max(x, bin_center-bin_size/2);
-    };
-#pragma omp parallel for num_threads(num_threads)
-    for (int i = 0; i < num_nodes; ++i)
+    // cells stretched to sqrt(2) times of the bin size touch 2 or 3 bins in each direction,
+    // so most cells go through the specialized windows, and larger cells through the general loops
+    int max_window_size = std::min(num_bins_x, num_bins_y);
+#pragma omp parallel num_threads(num_threads)
     {
-        // stretch node size to bin size
-        T node_size_x = std::max((T)(bin_size_x*SQRT2), node_size_x_tensor[i]);
-        T node_size_y = std::max((T)(bin_size_y*SQRT2), node_size_y_tensor[i]);
-        T node_x = x_tensor[i]+node_size_x_tensor[i]/2-node_size_x/2;
-        T node_y = y_tensor[i]+node_size_y_tensor[i]/2-node_size_y/2;
-        T ratio = (node_size_x_tensor[i]*node_size_y_tensor[i]/(node_size_x*node_size_y));
-
-        // Yibo: looks very weird implementation, but this is how RePlAce implements it
-        // the common practice should be floor
-        int bin_index_xl = round((node_x-xl)/bin_size_x);
-        int bin_index_xh = round(((node_x+node_size_x-xl)/bin_size_x))+1; // exclusive
-        bin_index_xl = std::max(bin_index_xl, 0);
-        bin_index_xh = std::min(bin_index_xh, num_bins_x);
-        //int bin_index_xh = bin_index_xl+num_impacted_bins_x;
-
-        // Yibo: looks very weird implementation, but this is how RePlAce implements it
-        // the common practice should be floor
-        int bin_index_yl = round((node_y-yl)/bin_size_y);
-        int bin_index_yh = round(((node_y+node_size_y-yl)/bin_size_y))+1; // exclusive
-        bin_index_yl = std::max(bin_index_yl, 0);
-        bin_index_yh = std::min(bin_index_yh, num_bins_y);
-        //int bin_index_yh = bin_index_yl+num_impacted_bins_y;
-
-        grad_x_tensor[i] = 0;
-        grad_y_tensor[i] = 0;
-        // update density potential map
-        for (int k = bin_index_xl; k < bin_index_xh; ++k)
+        // overlaps in y direction of a cell larger than the windows
+        std::vector<T> py (num_bins_y);
+#pragma omp for schedule(static)
+        for (int i = 0; i < num_nodes; ++i)
         {
-            T px = computeDensityFunc(node_x, node_size_x, bin_center_x_tensor[k], bin_size_x);
-            for (int h = bin_index_yl; h < bin_index_yh; ++h)
-            {
-                T py = computeDensityFunc(node_y, node_size_y, bin_center_y_tensor[h], bin_size_y);
+            // stretch node size to bin size
+            T node_size_x = std::max((T)(bin_size_x*SQRT2), node_size_x_tensor[i]);
+            T node_size_y = std::max((T)(bin_size_y*SQRT2), node_size_y_tensor[i]);
+            T node_x = x_tensor[i]+node_size_x_tensor[i]/2-node_size_x/2;
+            T node_y = y_tensor[i]+node_size_y_tensor[i]/2-node_size_y/2;
+            T ratio = (node_size_x_tensor[i]*node_size_y_tensor[i]/(node_size_x*node_size_y));
 
-                T area = px*py*ratio;
+            int bin_index_xl;
+            int bin_index_xh;
+            int bin_index_yl;
+            int bin_index_yh;
+            computeForceBinRange(node_x, node_size_x, xl, bin_size_x, num_bins_x, bin_index_xl, bin_index_xh);
+            computeForceBinRange(node_y, node_size_y, yl, bin_size_y, num_bins_y, bin_index_yl, bin_index_yh);
+            int window_size = std::max(bin_index_xh-bin_index_xl, bin_index_yh-bin_index_yl);
 
-                T& gx = grad_x_tensor[i];
-                T& gy = grad_y_tensor[i];
-#pragma omp atomic
-                gx += area*field_map_x_tensor[k*num_bins_y+h];
-#pragma omp atomic
-                gy += area*field_map_y_tensor[k*num_bins_y+h];
+            T gx = 0;
+            T gy = 0;
+#define CALL_FORCE_WINDOW(size) \
+            ElectricForceWindow<T, size>::run( \
+                    field_map_x_tensor, field_map_y_tensor, \
+                    bin_center_x_tensor, bin_center_y_tensor, \
+                    num_bins_x, num_bins_y, \
+                    bin_size_x, bin_size_y, \
+                    node_x, node_y, node_size_x, node_size_y, \
+                    bin_index_xl, bin_index_xh, bin_index_yl, bin_index_yh, \
+                    gx, gy \
+                    )
+            if (window_size <= 2 && max_window_size >= 2)
+            {
+                CALL_FORCE_WINDOW(2);
+            }
+            else if (window_size <= 3 && max_window_size >= 3)
+            {
+                CALL_FORCE_WINDOW(3);
+            }
+            else if (window_size <= 4 && max_window_size >= 4)
+            {
+                CALL_FORCE_WINDOW(4);
+            }
+            else
+            {
+                for (int h = bin_index_yl; h < bin_index_yh; ++h)
+                {
+                    py[h] = computeForceDensityFunc(node_y, node_size_y, bin_center_y_tensor[h], bin_size_y);
+                }
+                for (int k = bin_index_xl; k < bin_index_xh; ++k)
+                {
+                    T px = computeForceDensityFunc(node_x, node_size_x, bin_center_x_tensor[k], bin_size_x);
+                    const T* field_x = field_map_x_tensor+(long)k*num_bins_y;
+                    const T* field_y = field_map_y_tensor+(long)k*num_bins_y;
+                    T sx = 0;
+                    T sy = 0;
+#pragma omp simd reduction(+:sx, sy)
+                    for (int h = bin_index_yl; h < bin_index_yh; ++h)
+                    {
+                        sx += py[h]*field_x[h];
+                        sy += py[h]*field_y[h];
+                    }
+                    gx += px*sx;
+                    gy += px*sy;
+                }
             }
+#undef CALL_FORCE_WINDOW
+            grad_x_tensor[i] = gx*ratio;
+            grad_y_tensor[i] = gy*ratio;
         }
     }
 
     return 0;
 }
 
+template <typename T, int WindowSize>
+int computeFillerElectricForceLauncher(
+        int num_bins_x, int num_bins_y,
+        const T* field_map_x_tensor, const T* field_map_y_tensor,
+        const T* x_tensor, const T* y_tensor,
+        T filler_size_x, T filler_size_y,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        T xl, T yl, T xh, T yh,
+        T bin_size_x, T bin_size_y,
+        int num_nodes,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        )
+{
+    // stretch node size to bin size, the same for all fillers
+    const T node_size_x = std::max((T)(bin_size_x*SQRT2), filler_size_x);
+    const T node_size_y = std::max((T)(bin_size_y*SQRT2), filler_size_y);
+    const T ratio = (filler_size_x*filler_size_y/(node_size_x*node_size_y));
+
+#pragma omp parallel for num_threads(num_threads) schedule(static, 256)
+    for (int i = 0; i < num_nodes; ++i)
+    {
+        T node_x = x_tensor[i]+filler_size_x/2-node_size_x/2;
+        T node_y = y_tensor[i]+filler_size_y/2-node_size_y/2;
+
+        int bin_index_xl;
+        int bin_index_xh;
+        int bin_index_yl;
+        int bin_index_yh;
+        computeForceBinRange(node_x, node_size_x, xl, bin_size_x, num_bins_x, bin_index_xl, bin_index_xh);
+        computeForceBinRange(node_y, node_size_y, yl, bin_size_y, num_bins_y, bin_index_yl, bin_index_yh);
+
+        T gx = 0;
+        T gy = 0;
+        ElectricForceWindow<T, WindowSize>::run(
+                field_map_x_tensor, field_map_y_tensor,
+                bin_center_x_tensor, bin_center_y_tensor,
+                num_bins_x, num_bins_y,
+                bin_size_x, bin_size_y,
+                node_x, node_y, node_size_x, node_size_y,
+                bin_index_xl, bin_index_xh, bin_index_yl, bin_index_yh,
+                gx, gy
+                );
+        grad_x_tensor[i] = gx*ratio;
+        grad_y_tensor[i] = gy*ratio;
+    }
+
+    return 0;
+}
+
+template <typename T>
+bool computeFillerElectricForce(
+        int num_bins_x, int num_bins_y,
+        const T* field_map_x_tensor, const T* field_map_y_tensor,
+        const T* x_tensor, const T* y_tensor,
+        T filler_size_x, T filler_size_y,
+        const T* bin_center_x_tensor, const T* bin_center_y_tensor,
+        T xl, T yl, T xh, T yh,
+        T bin_size_x, T bin_size_y,
+        int num_nodes,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        )
+{
+    // a window from round(l) to round(l+w) has at most floor(w)+2 bins
+    // with a small margin against rounding errors when the stretched size is a multiple of the bin size
+    int window_size_x = int(std::max((T)(bin_size_x*SQRT2), filler_size_x)/bin_size_x+T(1e-6))+2;
+    int window_size_y = int(std::max((T)(bin_size_y*SQRT2), filler_size_y)/bin_size_y+T(1e-6))+2;
+    int window_size = std::max(window_size_x, window_size_y);
+    // the window is shifted into the map, which needs enough bins
+    if (window_size > std::min(num_bins_x, num_bins_y))
+    {
+        return false;
+    }
+
+#define CALL_FILLER_FORCE_LAUNCHER(size) \
+    computeFillerElectricForceLauncher<T, size>( \
+            num_bins_x, num_bins_y, \
+            field_map_x_tensor, field_map_y_tensor, \
+            x_tensor, y_tensor, \
+            filler_size_x, filler_size_y, \
+            bin_center_x_tensor, bin_center_y_tensor, \
+            xl, yl, xh, yh, \
+            bin_size_x, bin_size_y, \
+            num_nodes, \
+            num_threads, \
+            grad_x_tensor, grad_y_tensor \
+            )
+
+    // fillers are usually smaller than bins, so the window is 3x3 in most cases
+    switch (window_size)
+    {
+        case 3:
+            CALL_FILLER_FORCE_LAUNCHER(3);
+            return true;
+        case 4:
+            CALL_FILLER_FORCE_LAUNCHER(4);
+            return true;
+        default:
+            return false;
+    }
+
+#undef CALL_FILLER_FORCE_LAUNCHER
+}
+
 DREAMPLACE_END_NAMESPACE
@@ -0,0 +1,214 @@
+/**
+ * @file   electric_potential_engine.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Electric potential and force on CPU with all intermediate maps allocated once
+ */
+#include "electric_potential/src/electric_potential_engine.h"
+#include "electric_potential/src/electric_field.h"
+#include "utility/src/density_scatter.h"
+#include "dct/src/dct_plan_cpu.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief compute density map for movable and filler cells into density_map, defined in electric_density_map.cpp
+void compute_density_map(
+        at::Tensor pos,
+        at::Tensor node_size_x, at::Tensor node_size_y,
+        at::Tensor bin_center_x,
+        at::Tensor bin_center_y,
+        at::Tensor initial_density_map,
+        double target_density,
+        double xl,
+        double yl,
+        double xh,
+        double yh,
+        double bin_size_x,
+        double bin_size_y,
+        int num_movable_nodes,
+        int num_filler_nodes,
+        int padding,
+        at::Tensor padding_mask,
+        int num_bins_x, int num_bins_y,
+        int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
+        int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+        bool uniform_filler_size,
+        bool deterministic_flag,
+        int num_threads,
+        int scatter_mode,
+        at::Tensor scatter_buffer,
+        at::Tensor density_map,
+        at::Tensor movable_density_map
+        );
+
+/// @brief compute electric force for movable and filler cells into grad_out, defined in electric_force.cpp
+void compute_electric_force(
+        int num_bins_x, int num_bins_y,
+        int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
+        int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+        bool uniform_filler_size,
+        at::Tensor field_map_x, at::Tensor field_map_y,
+        at::Tensor pos,
+        at::Tensor node_size_x, at::Tensor node_size_y,
+        at::Tensor bin_center_x, at::Tensor bin_center_y,
+        double xl, double yl, double xh, double yh,
+        double bin_size_x, double bin_size_y,
+        int num_movable_nodes,
+        int num_filler_nodes,
+        int num_threads,
+        at::Tensor grad_out
+        );
+
+#define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x "must be a flat tensor on CPU")
+#define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x "must have even number of elements")
+#define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x "must be contiguous")
+
+ElectricPotentialEngine::ElectricPotentialEngine(
+        at::Tensor node_size_x, at::Tensor node_size_y,
+        at::Tensor bin_center_x, at::Tensor bin_center_y,
+        at::Tensor initial_density_map,
+        double target_density,
+        double xl, double yl, double xh, double yh,
+        double bin_size_x, double bin_size_y,
+        int num_movable_nodes,
+        int num_filler_nodes,
+        int padding,
+        at::Tensor padding_mask,
+        int num_bins_x, int num_bins_y,
+        int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
+        int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+        at::Tensor inv_wu2_plus_wv2_2X,
+        at::Tensor wu,
+        at::Tensor wv,
+        bool fast_mode,
+        bool spectral_energy,
+        bool uniform_filler_size,
+        bool deterministic_flag,
+        int num_threads
+        )
+    : m_node_size_x(node_size_x)
+    , m_node_size_y(node_size_y)
+    , m_bin_center_x(bin_center_x)
+    , m_bin_center_y(bin_center_y)
+    , m_initial_density_map(initial_density_map)
+    , m_target_density(target_density)
+    , m_xl(xl)
+    , m_yl(yl)
+    , m_xh(xh)
+    , m_yh(yh)
+    , m_bin_size_x(bin_size_x)
+    , m_bin_size_y(bin_size_y)
+    , m_num_movable_nodes(num_movable_nodes)
+    , m_num_filler_nodes(num_filler_nodes)
+    , m_padding(padding)
+    , m_padding_mask(padding_mask)
+    , m_num_bins_x(num_bins_x)
+    , m_num_bins_y(num_bins_y)
+    , m_num_movable_impacted_bins_x(num_movable_impacted_bins_x)
+    , m_num_movable_impacted_bins_y(num_movable_impacted_bins_y)
+    , m_num_filler_impacted_bins_x(num_filler_impacted_bins_x)
+    , m_num_filler_impacted_bins_y(num_filler_impacted_bins_y)
+    , m_inv_wu2_plus_wv2_2X(inv_wu2_plus_wv2_2X.contiguous())
+    , m_wu(wu.contiguous())
+    , m_wv(wv.contiguous())
+    , m_fast_mode(fast_mode)
+    , m_spectral_energy(spectral_energy)
+    , m_uniform_filler_size(uniform_filler_size)
+    , m_deterministic_flag(deterministic_flag)
+    , m_num_threads(num_threads)
+{
+    CHECK_CONTIGUOUS(initial_density_map);
+
+    auto options = initial_density_map.options();
+    m_cos_x = at::empty({spectralCosineTableSize(num_bins_x)}, options);
+    m_cos_y = at::empty({spectralCosineTableSize(num_bins_y)}, options);
+    AT_DISPATCH_FLOATING_TYPES(initial_density_map.type(), "precomputeSpectralCosineTable", [&] {
+            precomputeSpectralCosineTable<scalar_t>(num_bins_x, m_cos_x.data<scalar_t>());
+            precomputeSpectralCosineTable<scalar_t>(num_bins_y, m_cos_y.data<scalar_t>());
+            });
+
+    m_density_map = at::empty({num_bins_x, num_bins_y}, options);
+    m_movable_density_map = at::empty({num_bins_x, num_bins_y}, options);
+    m_auv = at::empty({num_bins_x, num_bins_y}, options);
+    m_field_map_x = at::empty({num_bins_x, num_bins_y}, options);
+    m_field_map_y = at::empty({num_bins_x, num_bins_y}, options);
+    if (!fast_mode && !spectral_energy)
+    {
+        m_potential_map = at::empty({num_bins_x, num_bins_y}, options);
+    }
+    m_work = at::empty({num_bins_x, num_bins_y}, options);
+    m_scratch = at::empty({2, num_bins_x, num_bins_y}, options);
+    m_scatter_buffer = at::empty({0}, options.dtype(at::kLong));
+    m_force = at::zeros({node_size_x.numel()*2}, options);
+}
+
+at::Tensor ElectricPotentialEngine::forward(at::Tensor pos)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+
+    m_pos = pos;
+    compute_density_map(
+            pos,
+            m_node_size_x, m_node_size_y,
+            m_bin_center_x, m_bin_center_y,
+            m_initial_density_map,
+            m_target_density,
+            m_xl, m_yl, m_xh, m_yh,
+            m_bin_size_x, m_bin_size_y,
+            m_num_movable_nodes,
+            m_num_filler_nodes,
+            m_padding,
+            m_padding_mask,
+            m_num_bins_x, m_num_bins_y,
+            m_num_movable_impacted_bins_x, m_num_movable_impacted_bins_y,
+            m_num_filler_impacted_bins_x, m_num_filler_impacted_bins_y,
+            m_uniform_filler_size,
+            m_deterministic_flag,
+            m_num_threads,
+            kDensityScatterAuto,
+            m_scatter_buffer,
+            m_density_map,
+            m_movable_density_map
+            );
+    m_density_map.mul_(1.0/(m_bin_size_x*m_bin_size_y));
+
+    double energy = compute_electric_field(
+            m_density_map,
+            m_inv_wu2_plus_wv2_2X,
+            m_wu, m_wv,
+            m_cos_x, m_cos_y,
+            m_work, m_scratch,
+            m_auv,
+            m_field_map_x, m_field_map_y,
+            m_potential_map,
+            m_spectral_energy,
+            m_num_threads
+            );
+
+    return at::full({1}, energy, pos.options());
+}
+
+at::Tensor ElectricPotentialEngine::backward(at::Tensor grad_pos)
+{
+    compute_electric_force(
+            m_num_bins_x, m_num_bins_y,
+            m_num_movable_impacted_bins_x, m_num_movable_impacted_bins_y,
+            m_num_filler_impacted_bins_x, m_num_filler_impacted_bins_y,
+            m_uniform_filler_size,
+            m_field_map_x, m_field_map_y,
+            m_pos,
+            m_node_size_x, m_node_size_y,
+            m_bin_center_x, m_bin_center_y,
+            m_xl, m_yl, m_xh, m_yh,
+            m_bin_size_x, m_bin_size_y,
+            m_num_movable_nodes,
+            m_num_filler_nodes,
+            m_num_threads,
+            m_force
+            );
+    return m_force.mul(grad_pos).mul_(-1);
+}
+
+DREAMPLACE_END_NAMESPACE
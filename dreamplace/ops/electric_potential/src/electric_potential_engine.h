@@ -0,0 +1,148 @@
+/**
+ * @file   electric_potential_engine.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Electric potential and force on CPU with all intermediate maps allocated once
+ */
+#ifndef _DREAMPLACE_ELECTRIC_POTENTIAL_ENGINE_H
+#define _DREAMPLACE_ELECTRIC_POTENTIAL_ENGINE_H
+
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Density map, spectral coefficients, electric field and energy of one global placement stage.
+/// The bin grid and cell sizes do not change within a stage,
+/// so the maps, the cosine tables of the transforms and the force array
+/// are allocated in the constructor and reused by every iteration.
+/// The frequency weights are computed in Python and kept by reference.
+class ElectricPotentialEngine
+{
+    public:
+        /// @param node_size_x cell width array
+        /// @param node_size_y cell height array
+        /// @param bin_center_x bin center x locations
+        /// @param bin_center_y bin center y locations
+        /// @param initial_density_map initial density map for fixed cells
+        /// @param target_density target density
+        /// @param xl left boundary
+        /// @param yl bottom boundary
+        /// @param xh right boundary
+        /// @param yh top boundary
+        /// @param bin_size_x bin width
+        /// @param bin_size_y bin height
+        /// @param num_movable_nodes number of movable cells
+        /// @param num_filler_nodes number of filler cells
+        /// @param padding bin padding to boundary of placement region
+        /// @param padding_mask padding mask with 0 and 1 to indicate padding bins with padding regions to be 1
+        /// @param num_bins_x number of bins in horizontal bins
+        /// @param num_bins_y number of bins in vertical bins
+        /// @param num_movable_impacted_bins_x number of impacted bins for any movable cell in x direction
+        /// @param num_movable_impacted_bins_y number of impacted bins for any movable cell in y direction
+        /// @param num_filler_impacted_bins_x number of impacted bins for any filler cell in x direction
+        /// @param num_filler_impacted_bins_y number of impacted bins for any filler cell in y direction
+        /// @param inv_wu2_plus_wv2_2X 2/(wu^2+wv^2) of num_bins_x by num_bins_y
+        /// @param wu frequencies of rows, length num_bins_x
+        /// @param wv frequencies of columns, length num_bins_y, scaled by the aspect ratio of bins
+        /// @param fast_mode if true, the potential map and energy are skipped
+        /// @param spectral_energy if true, energy is computed from the spectral coefficients in any mode, and the potential map is skipped
+        /// @param uniform_filler_size whether all filler cells have the same size, which enables specialized kernels
+        /// @param deterministic_flag whether to accumulate the density map in fixed point, so results do not depend on the number of threads
+        /// @param num_threads number of threads
+        ElectricPotentialEngine(
+                at::Tensor node_size_x, at::Tensor node_size_y,
+                at::Tensor bin_center_x, at::Tensor bin_center_y,
+                at::Tensor initial_density_map,
+                double target_density,
+                double xl, double yl, double xh, double yh,
+                double bin_size_x, double bin_size_y,
+                int num_movable_nodes,
+                int num_filler_nodes,
+                int padding,
+                at::Tensor padding_mask,
+                int num_bins_x, int num_bins_y,
+                int num_movable_impacted_bins_x, int num_movable_impacted_bins_y,
+                int num_filler_impacted_bins_x, int num_filler_impacted_bins_y,
+                at::Tensor inv_wu2_plus_wv2_2X,
+                at::Tensor wu,
+                at::Tensor wv,
+                bool fast_mode,
+                bool spectral_energy,
+                bool uniform_filler_size,
+                bool deterministic_flag,
+                int num_threads
+                );
+
+        /// @brief compute density map and electric field, and energy unless it is skipped in fast mode
+        /// @param pos cell locations, array of x locations and then y locations
+        /// @return energy, zero in fast mode unless spectral_energy is set
+        at::Tensor forward(at::Tensor pos);
+        /// @brief gradient of the energy with respect to the cell locations of the last forward
+        /// @param grad_pos input gradient from backward propagation
+        /// @return gradient, the negative electric force scaled by grad_pos
+        at::Tensor backward(at::Tensor grad_pos);
+
+        /// @return density map of the last forward, normalized by bin area
+        at::Tensor density_map() const {return m_density_map;}
+        /// @return density map of fixed and movable cells of the last forward, without fillers and padding, not normalized
+        at::Tensor movable_density_map() const {return m_movable_density_map;}
+        /// @return spectral coefficients of the density map of the last forward
+        at::Tensor auv() const {return m_auv;}
+        /// @return electric field in x direction of the last forward
+        at::Tensor field_map_x() const {return m_field_map_x;}
+        /// @return electric field in y direction of the last forward
+        at::Tensor field_map_y() const {return m_field_map_y;}
+        /// @return potential map of the last forward, only valid if neither fast_mode nor spectral_energy is set
+        at::Tensor potential_map() const {return m_potential_map;}
+
+    protected:
+        at::Tensor m_node_size_x;
+        at::Tensor m_node_size_y;
+        at::Tensor m_bin_center_x;
+        at::Tensor m_bin_center_y;
+        at::Tensor m_initial_density_map;
+        double m_target_density;
+        double m_xl;
+        double m_yl;
+        double m_xh;
+        double m_yh;
+        double m_bin_size_x;
+        double m_bin_size_y;
+        int m_num_movable_nodes;
+        int m_num_filler_nodes;
+        int m_padding;
+        at::Tensor m_padding_mask;
+        int m_num_bins_x;
+        int m_num_bins_y;
+        int m_num_movable_impacted_bins_x;
+        int m_num_movable_impacted_bins_y;
+        int m_num_filler_impacted_bins_x;
+        int m_num_filler_impacted_bins_y;
+        at::Tensor m_inv_wu2_plus_wv2_2X;
+        at::Tensor m_wu;
+        at::Tensor m_wv;
+        bool m_fast_mode;
+        bool m_spectral_energy;
+        bool m_uniform_filler_size;
+        bool m_deterministic_flag;
+        int m_num_threads;
+
+        at::Tensor m_cos_x; ///< cosine table of the transforms along x
+        at::Tensor m_cos_y; ///< cosine table of the transforms along y
+        at::Tensor m_density_map;
+        at::Tensor m_movable_density_map; ///< density map before fillers are added, shared with the overflow metric
+        at::Tensor m_auv;
+        at::Tensor m_field_map_x;
+        at::Tensor m_field_map_y;
+        at::Tensor m_potential_map;
+        at::Tensor m_work; ///< map between the passes of a 2D transform
+        at::Tensor m_scratch; ///< two maps of per-row buffers for one-dimensional transforms
+        at::Tensor m_scatter_buffer; ///< private maps of density scattering, grown on demand
+        at::Tensor m_force; ///< electric force of all cells, zero for fixed cells
+        at::Tensor m_pos; ///< cell locations of the last forward
+};
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
@@ -12,6 +12,7 @@ import pdb
 
 import dreamplace.ops.hpwl.hpwl_cpp as hpwl_cpp
 import dreamplace.ops.hpwl.hpwl_cpp_atomic as hpwl_cpp_atomic
+import dreamplace.ops.hpwl.hpwl_cpp_incremental as hpwl_cpp_incremental
 try:
     import dreamplace.ops.hpwl.hpwl_hip as hpwl_hip
     import dreamplace.ops.hpwl.hpwl_hip_atomic as hpwl_hip_atomic
@@ -24,30 +25,34 @@ class HPWLFunction(Function):
     @param flat_netpin flat netpin map, length of #pins
     @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
     @param net_mask a boolean mask containing whether a net should be computed
-    @param pin2net_map pin2net map, second set of options
+    @param net_degree_buckets nets grouped by degree for CPU, from hpwl_cpp.degree_buckets
+    @param num_threads number of threads for CPU
     """
     @staticmethod
-    def forward(ctx, pos, flat_netpin, netpin_start, net_mask, num_threads):
+    def forward(ctx, pos, flat_netpin, netpin_start, net_mask, net_degree_buckets, num_threads):
         output = pos.new_empty(1)
         if pos.is_cuda:
             output = hpwl_hip.forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_mask)
         else:
-            output = hpwl_cpp.forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_mask, num_threads)
+            output = hpwl_cpp.forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_degree_buckets, num_threads)
         return output
 
 class HPWLAtomicFunction(Function):
     """compute half-perimeter wirelength using atomic max/min.
     @param pos pin location (x array, y array), not cell location
     @param pin2net_map pin2net map, second set of options
+    @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins;
+    used on CPU to split nets into ranges with similar numbers of pins
     @param net_mask a boolean mask containing whether a net should be computed
+    @param num_threads number of threads for CPU
     """
     @staticmethod
-    def forward(ctx, pos, pin2net_map, net_mask):
+    def forward(ctx, pos, pin2net_map, netpin_start, net_mask, num_threads):
         output = pos.new_empty(1)
         if pos.is_cuda:
             output = hpwl_hip_atomic.forward(pos.view(pos.numel()), pin2net_map, net_mask)
         else:
-            output = hpwl_cpp_atomic.forward(pos.view(pos.numel()), pin2net_map, net_mask)
+            output = hpwl_cpp_atomic.forward(pos.view(pos.numel()), pin2net_map, netpin_start, net_mask, num_threads)
         return output
 
 class HPWL(nn.Module):
@@ -70,23 +75,92 @@ class HPWL(nn.Module):
         if algorithm == 'net-by-net':
             assert flat_netpin is not None and netpin_start is not None, "flat_netpin, netpin_start are requried parameters for algorithm net-by-net"
         elif algorithm == 'atomic':
-            assert pin2net_map is not None, "pin2net_map is required for algorithm atomic"
+            assert pin2net_map is not None and netpin_start is not None, "pin2net_map, netpin_start are required for algorithm atomic"
         self.flat_netpin = flat_netpin
         self.netpin_start = netpin_start
         self.pin2net_map = pin2net_map
         self.net_mask = net_mask
+        self.net_degree_buckets = None
         self.algorithm = algorithm
         self.num_threads = num_threads
     def forward(self, pos):
         if self.algorithm == 'net-by-net':
+            # nets are grouped by degree only once for CPU
+            if not pos.is_cuda and self.net_degree_buckets is None:
+                self.net_degree_buckets = hpwl_cpp.degree_buckets(self.netpin_start, self.net_mask)
             return HPWLFunction.apply(pos,
                     self.flat_netpin,
                     self.netpin_start,
                     self.net_mask,
+                    self.net_degree_buckets,
                     self.num_threads
                     )
         elif self.algorithm == 'atomic':
             return HPWLAtomicFunction.apply(pos,
                     self.pin2net_map,
-                    self.net_mask
+                    self.netpin_start,
+                    self.net_mask,
+                    self.num_threads
                     )
+
+class IncrementalHPWL(nn.Module):
+    """
+    @brief Compute half-perimeter wirelength on CPU from cell locations.
+    The bounding box of each net is kept between calls,
+    so only the nets connected to moved cells are recomputed.
+    """
+    def __init__(self, flat_netpin, netpin_start, pin2net_map, pin2node_map, pin_offset_x, pin_offset_y, flat_node2pin, flat_node2pin_start, net_mask, num_threads=8):
+        """
+        @brief initialization
+        @param flat_netpin flat netpin map, length of #pins
+        @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
+        @param pin2net_map pin2net map
+        @param pin2node_map cell of each pin
+        @param pin_offset_x pin offset x to its cell
+        @param pin_offset_y pin offset y to its cell
+        @param flat_node2pin flat node2pin map, length of #pins
+        @param flat_node2pin_start starting index in node2pin map for each cell, length of #physical cells+1
+        @param net_mask whether to compute wirelength, 1 means to compute, 0 means to ignore
+        @param num_threads number of threads
+        """
+        super(IncrementalHPWL, self).__init__()
+        self.hpwl_op = hpwl_cpp_incremental.IncrementalHPWL(
+                flat_netpin,
+                netpin_start,
+                pin2net_map,
+                pin2node_map,
+                pin_offset_x,
+                pin_offset_y,
+                flat_node2pin,
+                flat_node2pin_start,
+                net_mask.to(torch.uint8),
+                num_threads
+                )
+        self.delta = None
+    def forward(self, pos):
+        """
+        @brief update the nets of cells moved since the previous call
+        @param pos cell locations (x array, y array)
+        @return total wirelength, the change from the previous call is saved in self.delta
+        """
+        output = self.hpwl_op.forward(pos.view(pos.numel()))
+        self.delta = output[1]
+        return output[0]
+    def update(self, pos, moved_nodes):
+        """
+        @brief update the nets of given cells
+        @param pos cell locations (x array, y array)
+        @param moved_nodes indices of moved cells
+        @return total wirelength and its change
+        """
+        output = self.hpwl_op.update(pos.view(pos.numel()), moved_nodes.to(torch.int32))
+        self.delta = output[1]
+        return output[0], output[1]
+    def reset(self, pos):
+        """
+        @brief recompute all nets
+        @param pos cell locations (x array, y array)
+        @return total wirelength
+        """
+        self.delta = None
+        return self.hpwl_op.reset(pos.view(pos.numel()))
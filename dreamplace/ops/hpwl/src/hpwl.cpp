@@ -6,6 +6,7 @@
  */
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
+#include "utility/src/net_degree_buckets.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -14,8 +15,7 @@ int computeHPWLLauncher(
         const T* x, const T* y,
         const int* flat_netpin,
         const int* netpin_start,
-        const unsigned char* net_mask,
-        int num_nets,
+        const int* net_degree_buckets,
         int num_threads,
         T* hpwl
         );
@@ -24,16 +24,40 @@ int computeHPWLLauncher(
 #define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x "must have even number of elements")
 #define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x "must be contiguous")
 
+/// @brief Group nets by degree, which only needs to be done once for a netlist
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @return offsets of the degree buckets followed by the net indices, see buildNetDegreeBuckets
+at::Tensor hpwl_degree_buckets(
+        at::Tensor netpin_start,
+        at::Tensor net_mask
+        )
+{
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+
+    std::vector<int> buckets = buildNetDegreeBuckets(
+            netpin_start.data<int>(),
+            net_mask.data<unsigned char>(),
+            netpin_start.numel()-1
+            );
+    at::Tensor net_degree_buckets = at::empty({(int64_t)buckets.size()}, netpin_start.options());
+    std::copy(buckets.begin(), buckets.end(), net_degree_buckets.data<int>());
+    return net_degree_buckets;
+}
+
 /// @brief Compute half-perimeter wirelength
 /// @param pos cell locations, array of x locations and then y locations
 /// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
 /// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
-/// @param net_mask an array to record whether compute the where for a net or not
+/// @param net_degree_buckets nets to compute grouped by degree, from degree_buckets
 at::Tensor hpwl_forward(
         at::Tensor pos,
         at::Tensor flat_netpin,
         at::Tensor netpin_start,
-        at::Tensor net_mask,
+        at::Tensor net_degree_buckets,
         int num_threads
         )
 {
@@ -44,6 +68,8 @@ at::Tensor hpwl_forward(
     CHECK_CONTIGUOUS(flat_netpin);
     CHECK_FLAT(netpin_start);
     CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_degree_buckets);
+    CHECK_CONTIGUOUS(net_degree_buckets);
 
     int num_nets = netpin_start.numel()-1;
     at::Tensor hpwl = at::zeros(num_nets, pos.type());
@@ -52,8 +78,7 @@ at::Tensor hpwl_forward(
                     pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2,
                     flat_netpin.data<int>(),
                     netpin_start.data<int>(),
-                    net_mask.data<unsigned char>(),
-                    num_nets,
+                    net_degree_buckets.data<int>(),
                     num_threads,
                     hpwl.data<scalar_t>()
                     );
@@ -61,38 +86,75 @@ at::Tensor hpwl_forward(
     return hpwl.sum();
 }
 
+/// @brief Half-perimeter wirelength of one net
 template <typename T>
-int computeHPWLLauncher(
-        const T* x, const T* y,
-        const int* flat_netpin,
-        const int* netpin_start,
-        const unsigned char* net_mask,
-        int num_nets,
-        int num_threads,
-        T* hpwl
-        )
+struct HPWLNetKernel
 {
-#pragma omp parallel for num_threads(num_threads)
-    for (int i = 0; i < num_nets; ++i)
+    const T* x;
+    const T* y;
+    const int* flat_netpin;
+    const int* netpin_start;
+    T* hpwl;
+
+    /// @tparam Degree degree of the net, 0 for any degree
+    template <int Degree>
+    void run(int i)
     {
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = (Degree)? Degree : netpin_start[i+1]-netpin_start[i];
+
         T max_x = -std::numeric_limits<T>::max();
         T min_x = std::numeric_limits<T>::max();
         T max_y = -std::numeric_limits<T>::max();
         T min_y = std::numeric_limits<T>::max();
+        for (int j = 0; j < degree; ++j)
+        {
+            T xx = x[pins[j]];
+            T yy = y[pins[j]];
+            min_x = std::min(min_x, xx);
+            max_x = std::max(max_x, xx);
+            min_y = std::min(min_y, yy);
+            max_y = std::max(max_y, yy);
+        }
+        hpwl[i] = max_x-min_x + max_y-min_y;
+    }
+
+    /// @brief parallel min/max reduction over the pins of a high-fanout net
+    void runHighFanout(int i, int num_threads)
+    {
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = netpin_start[i+1]-netpin_start[i];
 
-        // ignore large degree nets
-        if (net_mask[i])
+        T max_x = -std::numeric_limits<T>::max();
+        T min_x = std::numeric_limits<T>::max();
+        T max_y = -std::numeric_limits<T>::max();
+        T min_y = std::numeric_limits<T>::max();
+#pragma omp parallel for num_threads(num_threads) schedule(static, kHighFanoutNetChunkSize) reduction(min:min_x,min_y) reduction(max:max_x,max_y)
+        for (int j = 0; j < degree; ++j)
         {
-            for (int j = netpin_start[i]; j < netpin_start[i+1]; ++j)
-            {
-                min_x = std::min(min_x, x[flat_netpin[j]]);
-                max_x = std::max(max_x, x[flat_netpin[j]]);
-                min_y = std::min(min_y, y[flat_netpin[j]]);
-                max_y = std::max(max_y, y[flat_netpin[j]]);
-            }
-            hpwl[i] = max_x-min_x + max_y-min_y;
+            T xx = x[pins[j]];
+            T yy = y[pins[j]];
+            min_x = std::min(min_x, xx);
+            max_x = std::max(max_x, xx);
+            min_y = std::min(min_y, yy);
+            max_y = std::max(max_y, yy);
         }
+        hpwl[i] = max_x-min_x + max_y-min_y;
     }
+};
+
+template <typename T>
+int computeHPWLLauncher(
+        const T* x, const T* y,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* net_degree_buckets,
+        int num_threads,
+        T* hpwl
+        )
+{
+    HPWLNetKernel<T> kernel = {x, y, flat_netpin, netpin_start, hpwl};
+    forEachNetByDegree(net_degree_buckets, num_threads, kernel);
 
     return 0;
 }
@@ -100,5 +162,6 @@ int computeHPWLLauncher(
 DREAMPLACE_END_NAMESPACE
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  m.def("degree_buckets", &DREAMPLACE_NAMESPACE::hpwl_degree_buckets, "Group nets by degree");
   m.def("forward", &DREAMPLACE_NAMESPACE::hpwl_forward, "HPWL forward");
 }
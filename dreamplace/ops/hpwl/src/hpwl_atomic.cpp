@@ -6,6 +6,7 @@
  */
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
+#include "utility/src/parallel_reduce.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -13,9 +14,11 @@ template <typename T>
 int computeHPWLAtomicLauncher(
         const T* x, const T* y,
         const int* pin2net_map,
+        const int* netpin_start,
         const unsigned char* net_mask,
         int num_nets,
         int num_pins,
+        int num_threads,
         T* partial_hpwl_max,
         T* partial_hpwl_min
         );
@@ -27,17 +30,24 @@ int computeHPWLAtomicLauncher(
 /// @brief Compute half-perimeter wirelength
 /// @param pos cell locations, array of x locations and then y locations
 /// @param pin2net_map map pin to net
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
 /// @param net_mask an array to record whether compute the where for a net or not
+/// @param num_threads number of threads
 at::Tensor hpwl_atomic_forward(
         at::Tensor pos,
         at::Tensor pin2net_map,
-        at::Tensor net_mask)
+        at::Tensor netpin_start,
+        at::Tensor net_mask,
+        int num_threads)
 {
     CHECK_FLAT(pos);
     CHECK_EVEN(pos);
     CHECK_CONTIGUOUS(pos);
     CHECK_FLAT(pin2net_map);
     CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    AT_ASSERTM(netpin_start.numel() == net_mask.numel()+1, "netpin_start must have number of nets + 1 elements");
 
     int num_nets = net_mask.numel();
     // x then y
@@ -45,16 +55,18 @@ at::Tensor hpwl_atomic_forward(
     at::Tensor partial_hpwl_min = at::zeros({2, num_nets}, pos.type());
 
     AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeHPWLAtomicLauncher", [&] {
-            partial_hpwl_max[0].masked_fill_(net_mask, std::numeric_limits<scalar_t>::min());
-            partial_hpwl_max[1].masked_fill_(net_mask, std::numeric_limits<scalar_t>::min());
+            partial_hpwl_max[0].masked_fill_(net_mask, -std::numeric_limits<scalar_t>::max());
+            partial_hpwl_max[1].masked_fill_(net_mask, -std::numeric_limits<scalar_t>::max());
             partial_hpwl_min[0].masked_fill_(net_mask, std::numeric_limits<scalar_t>::max());
             partial_hpwl_min[1].masked_fill_(net_mask, std::numeric_limits<scalar_t>::max());
             computeHPWLAtomicLauncher<scalar_t>(
                     pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2,
                     pin2net_map.data<int>(),
+                    netpin_start.data<int>(),
                     net_mask.data<unsigned char>(),
                     num_nets,
                     pin2net_map.numel(),
+                    num_threads,
                     partial_hpwl_max.data<scalar_t>(),
                     partial_hpwl_min.data<scalar_t>()
                     );
@@ -73,9 +85,11 @@ template <typename T>
 int computeHPWLAtomicLauncher(
         const T* x, const T* y,
         const int* pin2net_map,
+        const int* netpin_start,
         const unsigned char* net_mask,
         int num_nets,
         int num_pins,
+        int num_threads,
         T* partial_hpwl_max,
         T* partial_hpwl_min
         )
@@ -84,15 +98,43 @@ int computeHPWLAtomicLauncher(
     T* partial_hpwl_x_min = partial_hpwl_min;
     T* partial_hpwl_y_max = partial_hpwl_max+num_nets;
     T* partial_hpwl_y_min = partial_hpwl_min+num_nets;
-    for (int i = 0; i < num_pins; ++i)
+    if (num_nets == 0)
     {
-        int net_id = pin2net_map[i];
-        if (net_mask[net_id])
+        return 0;
+    }
+
+    // pins are grouped by ranges of nets with similar numbers of pins,
+    // so that each net is updated by only one thread without atomic operations;
+    // more ranges than threads balance the work
+    NetRangePins range_pins;
+    groupPinsByNetRanges(pin2net_map, net_mask, netpin_start, num_nets, num_pins, num_threads*4, num_threads, range_pins);
+    int num_ranges = range_pins.numRanges();
+#pragma omp parallel num_threads(num_threads)
+    {
+        // each range owns its nets
+#pragma omp for schedule(dynamic, 1)
+        for (int r = 0; r < num_ranges; ++r)
+        {
+            for (int j = range_pins.pin_start[r]; j < range_pins.pin_start[r+1]; ++j)
+            {
+                int i = range_pins.pins[j];
+                int net_id = pin2net_map[i];
+                partial_hpwl_x_max[net_id] = std::max(partial_hpwl_x_max[net_id], x[i]);
+                partial_hpwl_x_min[net_id] = std::min(partial_hpwl_x_min[net_id], x[i]);
+                partial_hpwl_y_max[net_id] = std::max(partial_hpwl_y_max[net_id], y[i]);
+                partial_hpwl_y_min[net_id] = std::min(partial_hpwl_y_min[net_id], y[i]);
+            }
+        }
+
+        // nets without pins have no wirelength
+#pragma omp for schedule(static)
+        for (int i = 0; i < num_nets; ++i)
         {
-            partial_hpwl_x_max[net_id] = std::max(partial_hpwl_x_max[net_id], x[i]);
-            partial_hpwl_x_min[net_id] = std::min(partial_hpwl_x_min[net_id], x[i]);
-            partial_hpwl_y_max[net_id] = std::max(partial_hpwl_y_max[net_id], y[i]);
-            partial_hpwl_y_min[net_id] = std::min(partial_hpwl_y_min[net_id], y[i]);
+            if (partial_hpwl_x_max[i] < partial_hpwl_x_min[i])
+            {
+                partial_hpwl_x_max[i] = partial_hpwl_x_min[i] = 0;
+                partial_hpwl_y_max[i] = partial_hpwl_y_min[i] = 0;
+            }
         }
     }
 
@@ -0,0 +1,449 @@
+/**
+ * @file   hpwl_incremental.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Half-perimeter wirelength that only recomputes the nets of moved cells
+ */
+#include <omp.h>
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+#define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x "must be a flat tensor on CPU")
+#define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x "must have even number of elements")
+#define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x "must be contiguous")
+
+/// @brief Half-perimeter wirelength with the bounding box of each net kept between calls.
+/// When only a few cells move, e.g., late in global placement or during legalization and detailed placement,
+/// only the nets connected to the moved cells are recomputed.
+/// A net is skipped if its moved pins were strictly inside its bounding box and stay inside,
+/// since the bounding box is then decided by pins that did not move.
+/// Bounding boxes and wirelength are kept in double for any type of locations,
+/// so that accumulating the changes over many calls stays accurate.
+class IncrementalHPWL
+{
+    public:
+        /// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
+        /// @param netpin_start similar to the IA array in CSR format, the length is number of nets + 1
+        /// @param pin2net_map net of each pin
+        /// @param pin2node_map cell of each pin
+        /// @param pin_offset_x offset of each pin to the lower left corner of its cell
+        /// @param pin_offset_y offset of each pin to the lower left corner of its cell
+        /// @param flat_node2pin similar to the JA array in CSR format, which is flattened from the node2pin map
+        /// @param flat_node2pin_start similar to the IA array in CSR format, the length is number of physical nodes + 1
+        /// @param net_mask an array to record whether compute the where for a net or not
+        /// @param num_threads number of threads
+        IncrementalHPWL(
+                at::Tensor flat_netpin,
+                at::Tensor netpin_start,
+                at::Tensor pin2net_map,
+                at::Tensor pin2node_map,
+                at::Tensor pin_offset_x,
+                at::Tensor pin_offset_y,
+                at::Tensor flat_node2pin,
+                at::Tensor flat_node2pin_start,
+                at::Tensor net_mask,
+                int num_threads
+                );
+
+        /// @brief recompute the bounding boxes of all nets
+        /// @param pos cell locations, array of x locations and then y locations
+        /// @return total wirelength
+        at::Tensor reset(at::Tensor pos);
+        /// @brief update the nets of cells whose locations differ from the previous call;
+        /// all nets are computed at the first call
+        /// @param pos cell locations, array of x locations and then y locations
+        /// @return total wirelength and its change
+        std::vector<at::Tensor> forward(at::Tensor pos);
+        /// @brief update the nets of the given cells
+        /// @param pos cell locations, array of x locations and then y locations
+        /// @param moved_nodes indices of moved cells, must be in [0, number of cells)
+        /// @return total wirelength and its change
+        std::vector<at::Tensor> update(at::Tensor pos, at::Tensor moved_nodes);
+        /// @return total wirelength of the last call
+        double hpwl() const {return m_hpwl;}
+
+    protected:
+        /// @brief flag the cells whose locations differ from the previous call in m_node_moved
+        /// @return number of moved cells
+        template <typename T>
+        int findMovedNodes(const T* x, const T* y);
+        /// @brief mark the nets of moved cells as dirty, unless a pin moves strictly inside the bounding box of its net;
+        /// cells are read from m_node_x and m_node_y for their previous locations, which must not be updated yet
+        /// @param nodes indices of moved cells, nullptr for the cells flagged in m_node_moved
+        /// @param num_nodes length of nodes, or number of physical nodes if nodes is nullptr
+        template <typename T>
+        void markDirtyNets(const T* x, const T* y, const int* nodes, int num_nodes);
+        /// @brief recompute all nets
+        /// @return total wirelength
+        template <typename T>
+        double computeAllNets(const T* x, const T* y);
+        /// @brief recompute the dirty nets and clear them
+        /// @return change of total wirelength
+        template <typename T>
+        double updateDirtyNets(const T* x, const T* y);
+        /// @brief recompute the bounding box of one net
+        /// @return wirelength of the net
+        template <typename T>
+        double computeNet(const T* x, const T* y, int net_id);
+        /// @brief save cell locations to detect moved cells in the next call
+        template <typename T>
+        void saveNodes(const T* x, const T* y);
+        /// @brief pack the total wirelength and its change into tensors
+        std::vector<at::Tensor> result(at::Tensor pos, double delta) const;
+
+        at::Tensor m_flat_netpin;
+        at::Tensor m_netpin_start;
+        at::Tensor m_pin2net_map;
+        at::Tensor m_pin2node_map;
+        at::Tensor m_pin_offset_x;
+        at::Tensor m_pin_offset_y;
+        at::Tensor m_flat_node2pin;
+        at::Tensor m_flat_node2pin_start;
+        at::Tensor m_net_mask;
+        int m_num_threads;
+        int m_num_nets;
+        int m_num_nodes; ///< number of physical nodes
+
+        /// number of moved cells above which their nets are marked with multiple threads
+        static constexpr int kParallelMarkThreshold = 256;
+
+        std::vector<double> m_net_xl; ///< bounding box of each net
+        std::vector<double> m_net_yl;
+        std::vector<double> m_net_xh;
+        std::vector<double> m_net_yh;
+        std::vector<double> m_net_hpwl; ///< wirelength of each net
+        std::vector<double> m_node_x; ///< cell locations of the previous call
+        std::vector<double> m_node_y;
+        std::vector<unsigned char> m_node_moved; ///< whether a cell moved since the previous call
+        std::vector<unsigned char> m_net_dirty; ///< whether a net is in m_dirty_nets
+        std::vector<int> m_dirty_nets; ///< nets to recompute
+        std::vector<std::vector<int> > m_thread_dirty_nets; ///< nets marked by each thread, merged into m_dirty_nets
+        double m_hpwl; ///< total wirelength
+        bool m_valid; ///< whether bounding boxes have been computed
+};
+
+IncrementalHPWL::IncrementalHPWL(
+        at::Tensor flat_netpin,
+        at::Tensor netpin_start,
+        at::Tensor pin2net_map,
+        at::Tensor pin2node_map,
+        at::Tensor pin_offset_x,
+        at::Tensor pin_offset_y,
+        at::Tensor flat_node2pin,
+        at::Tensor flat_node2pin_start,
+        at::Tensor net_mask,
+        int num_threads
+        )
+    : m_flat_netpin(flat_netpin)
+    , m_netpin_start(netpin_start)
+    , m_pin2net_map(pin2net_map)
+    , m_pin2node_map(pin2node_map)
+    , m_pin_offset_x(pin_offset_x)
+    , m_pin_offset_y(pin_offset_y)
+    , m_flat_node2pin(flat_node2pin)
+    , m_flat_node2pin_start(flat_node2pin_start)
+    , m_net_mask(net_mask)
+    , m_num_threads(num_threads)
+    , m_hpwl(0)
+    , m_valid(false)
+{
+    CHECK_FLAT(flat_netpin);
+    CHECK_CONTIGUOUS(flat_netpin);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(pin2node_map);
+    CHECK_CONTIGUOUS(pin2node_map);
+    CHECK_FLAT(pin_offset_x);
+    CHECK_CONTIGUOUS(pin_offset_x);
+    CHECK_FLAT(pin_offset_y);
+    CHECK_CONTIGUOUS(pin_offset_y);
+    CHECK_FLAT(flat_node2pin);
+    CHECK_CONTIGUOUS(flat_node2pin);
+    CHECK_FLAT(flat_node2pin_start);
+    CHECK_CONTIGUOUS(flat_node2pin_start);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+
+    m_num_nets = netpin_start.numel()-1;
+    m_num_nodes = flat_node2pin_start.numel()-1;
+    m_net_xl.assign(m_num_nets, 0);
+    m_net_yl.assign(m_num_nets, 0);
+    m_net_xh.assign(m_num_nets, 0);
+    m_net_yh.assign(m_num_nets, 0);
+    m_net_hpwl.assign(m_num_nets, 0);
+    m_node_x.assign(m_num_nodes, 0);
+    m_node_y.assign(m_num_nodes, 0);
+    m_node_moved.assign(m_num_nodes, 0);
+    m_net_dirty.assign(m_num_nets, 0);
+    m_dirty_nets.reserve(m_num_nets);
+    m_thread_dirty_nets.resize(std::max(num_threads, 1));
+}
+
+at::Tensor IncrementalHPWL::reset(at::Tensor pos)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "IncrementalHPWL::reset", [&] {
+            const scalar_t* x = pos.data<scalar_t>();
+            const scalar_t* y = x+pos.numel()/2;
+            m_hpwl = computeAllNets(x, y);
+            saveNodes(x, y);
+            });
+    m_valid = true;
+
+    return result(pos, 0)[0];
+}
+
+std::vector<at::Tensor> IncrementalHPWL::forward(at::Tensor pos)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+
+    if (!m_valid)
+    {
+        double prev_hpwl = m_hpwl;
+        reset(pos);
+        return result(pos, m_hpwl-prev_hpwl);
+    }
+
+    double delta = 0;
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "IncrementalHPWL::forward", [&] {
+            const scalar_t* x = pos.data<scalar_t>();
+            const scalar_t* y = x+pos.numel()/2;
+            if (findMovedNodes(x, y))
+            {
+                markDirtyNets(x, y, nullptr, m_num_nodes);
+                saveNodes(x, y);
+                delta = updateDirtyNets(x, y);
+            }
+            });
+    m_hpwl += delta;
+
+    return result(pos, delta);
+}
+
+std::vector<at::Tensor> IncrementalHPWL::update(at::Tensor pos, at::Tensor moved_nodes)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(moved_nodes);
+    CHECK_CONTIGUOUS(moved_nodes);
+
+    if (!m_valid)
+    {
+        double prev_hpwl = m_hpwl;
+        reset(pos);
+        return result(pos, m_hpwl-prev_hpwl);
+    }
+
+    const int* nodes = moved_nodes.data<int>();
+    int num_moved_nodes = moved_nodes.numel();
+    int num_pos_nodes = pos.numel()/2;
+    for (int i = 0; i < num_moved_nodes; ++i)
+    {
+        AT_ASSERTM(nodes[i] >= 0 && nodes[i] < num_pos_nodes, "moved_nodes must be indices of cells in pos");
+    }
+    double delta = 0;
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "IncrementalHPWL::update", [&] {
+            const scalar_t* x = pos.data<scalar_t>();
+            const scalar_t* y = x+pos.numel()/2;
+            markDirtyNets(x, y, nodes, num_moved_nodes);
+            // saved after marking, as a cell may be listed more than once
+            for (int i = 0; i < num_moved_nodes; ++i)
+            {
+                int node_id = nodes[i];
+                // fillers have no pins
+                if (node_id < m_num_nodes)
+                {
+                    m_node_x[node_id] = x[node_id];
+                    m_node_y[node_id] = y[node_id];
+                }
+            }
+            delta = updateDirtyNets(x, y);
+            });
+    m_hpwl += delta;
+
+    return result(pos, delta);
+}
+
+template <typename T>
+void IncrementalHPWL::markDirtyNets(const T* x, const T* y, const int* nodes, int num_nodes)
+{
+    const int* flat_node2pin = m_flat_node2pin.data<int>();
+    const int* flat_node2pin_start = m_flat_node2pin_start.data<int>();
+    const int* pin2net_map = m_pin2net_map.data<int>();
+    const unsigned char* net_mask = m_net_mask.data<unsigned char>();
+    const T* pin_offset_x = m_pin_offset_x.data<T>();
+    const T* pin_offset_y = m_pin_offset_y.data<T>();
+
+#pragma omp parallel num_threads((int)m_thread_dirty_nets.size()) if (num_nodes > kParallelMarkThreshold)
+    {
+        std::vector<int>& dirty_nets = m_thread_dirty_nets[omp_get_thread_num()];
+#pragma omp for schedule(static)
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            int node_id = (nodes)? nodes[i] : i;
+            // fillers have no pins
+            if ((nodes)? node_id >= m_num_nodes : !m_node_moved[node_id])
+            {
+                continue;
+            }
+            // the same arithmetic as computeNet, so that pins on the bounding box compare equal
+            T prev_node_x = m_node_x[node_id];
+            T prev_node_y = m_node_y[node_id];
+            for (int j = flat_node2pin_start[node_id]; j < flat_node2pin_start[node_id+1]; ++j)
+            {
+                int pin_id = flat_node2pin[j];
+                int net_id = pin2net_map[pin_id];
+                if (!net_mask[net_id])
+                {
+                    continue;
+                }
+                double prev_xx = prev_node_x+pin_offset_x[pin_id];
+                double prev_yy = prev_node_y+pin_offset_y[pin_id];
+                double xx = x[node_id]+pin_offset_x[pin_id];
+                double yy = y[node_id]+pin_offset_y[pin_id];
+                if (prev_xx > m_net_xl[net_id] && prev_xx < m_net_xh[net_id] && prev_yy > m_net_yl[net_id] && prev_yy < m_net_yh[net_id]
+                        && xx >= m_net_xl[net_id] && xx <= m_net_xh[net_id] && yy >= m_net_yl[net_id] && yy <= m_net_yh[net_id])
+                {
+                    continue;
+                }
+                unsigned char dirty;
+#pragma omp atomic capture
+                {
+                    dirty = m_net_dirty[net_id];
+                    m_net_dirty[net_id] = 1;
+                }
+                if (!dirty)
+                {
+                    dirty_nets.push_back(net_id);
+                }
+            }
+        }
+    }
+    for (std::vector<int>& dirty_nets : m_thread_dirty_nets)
+    {
+        m_dirty_nets.insert(m_dirty_nets.end(), dirty_nets.begin(), dirty_nets.end());
+        dirty_nets.clear();
+    }
+}
+
+template <typename T>
+int IncrementalHPWL::findMovedNodes(const T* x, const T* y)
+{
+    int num_moved_nodes = 0;
+#pragma omp parallel for num_threads(m_num_threads) schedule(static) reduction(+:num_moved_nodes)
+    for (int i = 0; i < m_num_nodes; ++i)
+    {
+        unsigned char moved = (m_node_x[i] != (double)x[i] || m_node_y[i] != (double)y[i]);
+        m_node_moved[i] = moved;
+        num_moved_nodes += moved;
+    }
+    return num_moved_nodes;
+}
+
+template <typename T>
+double IncrementalHPWL::computeAllNets(const T* x, const T* y)
+{
+    const unsigned char* net_mask = m_net_mask.data<unsigned char>();
+    double total = 0;
+#pragma omp parallel for num_threads(m_num_threads) schedule(dynamic, 256) reduction(+:total)
+    for (int i = 0; i < m_num_nets; ++i)
+    {
+        total += (net_mask[i])? computeNet(x, y, i) : 0;
+    }
+    return total;
+}
+
+template <typename T>
+double IncrementalHPWL::updateDirtyNets(const T* x, const T* y)
+{
+    int num_dirty_nets = m_dirty_nets.size();
+    double delta = 0;
+#pragma omp parallel for num_threads(m_num_threads) schedule(dynamic, 64) reduction(+:delta) if (num_dirty_nets > 1024)
+    for (int i = 0; i < num_dirty_nets; ++i)
+    {
+        int net_id = m_dirty_nets[i];
+        double prev_hpwl = m_net_hpwl[net_id];
+        delta += computeNet(x, y, net_id)-prev_hpwl;
+        m_net_dirty[net_id] = 0;
+    }
+    m_dirty_nets.clear();
+    return delta;
+}
+
+template <typename T>
+double IncrementalHPWL::computeNet(const T* x, const T* y, int net_id)
+{
+    const int* flat_netpin = m_flat_netpin.data<int>();
+    const int* netpin_start = m_netpin_start.data<int>();
+    const int* pin2node_map = m_pin2node_map.data<int>();
+    const T* pin_offset_x = m_pin_offset_x.data<T>();
+    const T* pin_offset_y = m_pin_offset_y.data<T>();
+
+    double xl = std::numeric_limits<double>::max();
+    double yl = std::numeric_limits<double>::max();
+    double xh = -std::numeric_limits<double>::max();
+    double yh = -std::numeric_limits<double>::max();
+    for (int j = netpin_start[net_id]; j < netpin_start[net_id+1]; ++j)
+    {
+        int pin_id = flat_netpin[j];
+        int node_id = pin2node_map[pin_id];
+        double xx = x[node_id]+pin_offset_x[pin_id];
+        double yy = y[node_id]+pin_offset_y[pin_id];
+        xl = std::min(xl, xx);
+        xh = std::max(xh, xx);
+        yl = std::min(yl, yy);
+        yh = std::max(yh, yy);
+    }
+    m_net_xl[net_id] = xl;
+    m_net_yl[net_id] = yl;
+    m_net_xh[net_id] = xh;
+    m_net_yh[net_id] = yh;
+    // nets without pins have no wirelength
+    double hpwl = (xl <= xh)? xh-xl + yh-yl : 0;
+    m_net_hpwl[net_id] = hpwl;
+    return hpwl;
+}
+
+template <typename T>
+void IncrementalHPWL::saveNodes(const T* x, const T* y)
+{
+#pragma omp parallel for num_threads(m_num_threads)
+    for (int i = 0; i < m_num_nodes; ++i)
+    {
+        m_node_x[i] = x[i];
+        m_node_y[i] = y[i];
+    }
+}
+
+std::vector<at::Tensor> IncrementalHPWL::result(at::Tensor pos, double delta) const
+{
+    at::Tensor hpwl = at::zeros({1}, pos.options());
+    at::Tensor hpwl_delta = at::zeros({1}, pos.options());
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "IncrementalHPWL::result", [&] {
+            hpwl.data<scalar_t>()[0] = m_hpwl;
+            hpwl_delta.data<scalar_t>()[0] = delta;
+            });
+    return {hpwl, hpwl_delta};
+}
+
+DREAMPLACE_END_NAMESPACE
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  pybind11::class_<DREAMPLACE_NAMESPACE::IncrementalHPWL>(m, "IncrementalHPWL")
+      .def(pybind11::init<at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor, at::Tensor, int>())
+      .def("reset", &DREAMPLACE_NAMESPACE::IncrementalHPWL::reset, "Recompute all nets")
+      .def("forward", &DREAMPLACE_NAMESPACE::IncrementalHPWL::forward, "Update nets of cells moved since the previous call")
+      .def("update", &DREAMPLACE_NAMESPACE::IncrementalHPWL::update, "Update nets of the given moved cells")
+      .def("hpwl", &DREAMPLACE_NAMESPACE::IncrementalHPWL::hpwl, "Total wirelength of the previous call")
+      ;
+}
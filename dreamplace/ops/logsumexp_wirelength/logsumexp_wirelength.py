@@ -10,6 +10,8 @@ from torch import nn
 from torch.autograd import Function
 
 import dreamplace.ops.logsumexp_wirelength.logsumexp_wirelength_cpp as logsumexp_wirelength_cpp
+import dreamplace.ops.logsumexp_wirelength.logsumexp_wirelength_cpp_atomic as logsumexp_wirelength_cpp_atomic
+import dreamplace.ops.logsumexp_wirelength.logsumexp_wirelength_cpp_sparse as logsumexp_wirelength_cpp_sparse
 try:
     import dreamplace.ops.logsumexp_wirelength.logsumexp_wirelength_hip as logsumexp_wirelength_hip
     import dreamplace.ops.logsumexp_wirelength.logsumexp_wirelength_hip_atomic as logsumexp_wirelength_hip_atomic
@@ -22,18 +24,20 @@ class LogSumExpWirelengthFunction(Function):
     @param pos pin location (x array, y array), not cell location
     @param flat_netpin flat netpin map, length of #pins
     @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
+    @param net_degree_buckets nets grouped by degree for CPU, from logsumexp_wirelength_cpp.degree_buckets
     @param gamma the smaller, the closer to HPWL
     """
     @staticmethod
-    def forward(ctx, pos, flat_netpin, netpin_start, netpin_values, net_mask, gamma, num_threads):
+    def forward(ctx, pos, flat_netpin, netpin_start, netpin_values, net_mask, net_degree_buckets, gamma, num_threads):
         if pos.is_cuda:
             output = logsumexp_wirelength_hip.forward(pos.view(pos.numel()), flat_netpin, netpin_start, netpin_values, net_mask, gamma)
         else:
-            output = logsumexp_wirelength_cpp.forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_mask, gamma, num_threads)
+            output = logsumexp_wirelength_cpp.forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_degree_buckets, gamma, num_threads)
         ctx.flat_netpin = flat_netpin
         ctx.netpin_start = netpin_start
         ctx.netpin_values = netpin_values
         ctx.net_mask = net_mask
+        ctx.net_degree_buckets = net_degree_buckets
         ctx.gamma = gamma
         ctx.exp_xy = output[1]
         ctx.exp_nxy = output[2]
@@ -67,27 +71,68 @@ class LogSumExpWirelengthFunction(Function):
                     ctx.exp_xy_sum, ctx.exp_nxy_sum,
                     ctx.flat_netpin,
                     ctx.netpin_start,
-                    ctx.net_mask,
+                    ctx.net_degree_buckets,
                     ctx.gamma,
                     ctx.num_threads
                     )
         #if torch.isnan(output).any():
         #    pdb.set_trace()
-        return output, None, None, None, None, None, None
+        return output, None, None, None, None, None, None, None
+
+class LogSumExpWirelengthNodeFunction(Function):
+    """compute log-sum-exp wirelength from cell locations on CPU.
+    Pin locations are computed on the fly and the gradient is summed up to cells directly.
+    @param pos cell location (x array, y array), not pin location
+    @param pin_offset_x pin offset x to its cell
+    @param pin_offset_y pin offset y to its cell
+    @param pin2node_map cell of each pin
+    @param flat_node2pin flat node2pin map, length of #pins
+    @param flat_node2pin_start starting index in node2pin map for each cell, length of #physical cells+1
+    @param flat_netpin flat netpin map, length of #pins
+    @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
+    @param net_degree_buckets nets grouped by degree, from logsumexp_wirelength_cpp.degree_buckets
+    @param gamma the smaller, the closer to HPWL
+    @param grad_pin gradient buffer of pins, 2*#pins elements zero-initialized once and reused
+    @param num_threads number of threads for CPU
+    """
+    @staticmethod
+    def forward(ctx, pos, pin_offset_x, pin_offset_y, pin2node_map, flat_node2pin, flat_node2pin_start, flat_netpin, netpin_start, net_degree_buckets, gamma, grad_pin, num_threads):
+        output = logsumexp_wirelength_cpp.fused_node_forward(
+                pos.view(pos.numel()),
+                pin_offset_x, pin_offset_y,
+                pin2node_map,
+                flat_node2pin, flat_node2pin_start,
+                torch.empty(0, dtype=torch.uint8), # no pin is masked
+                flat_netpin, netpin_start,
+                net_degree_buckets,
+                gamma,
+                grad_pin,
+                num_threads
+                )
+        ctx.grad_intermediate = output[1]
+        return output[0]
+
+    @staticmethod
+    def backward(ctx, grad_pos):
+        output = ctx.grad_intermediate.mul(grad_pos)
+        return output, None, None, None, None, None, None, None, None, None, None, None
 
 class LogSumExpWirelengthAtomicFunction(Function):
     """compute weighted average wirelength.
     @param pos pin location (x array, y array), not cell location
     @param pin2net_map pin2net map
+    @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins;
+    used on CPU to split nets into ranges with similar numbers of pins
     @param net_mask whether to compute wirelength
     @param gamma the smaller, the closer to HPWL
+    @param num_threads number of threads for CPU
     """
     @staticmethod
-    def forward(ctx, pos, pin2net_map, net_mask, gamma):
+    def forward(ctx, pos, pin2net_map, netpin_start, net_mask, gamma, num_threads):
         if pos.is_cuda:
             output = logsumexp_wirelength_hip_atomic.forward(pos.view(pos.numel()), pin2net_map, net_mask, gamma)
         else:
-            assert 0, "CPU version NOT IMPLEMENTED"
+            output = logsumexp_wirelength_cpp_atomic.forward(pos.view(pos.numel()), pin2net_map, netpin_start, net_mask, gamma, num_threads)
         ctx.pin2net_map = pin2net_map
         ctx.net_mask = net_mask
         ctx.gamma = gamma
@@ -95,6 +140,7 @@ class LogSumExpWirelengthAtomicFunction(Function):
         ctx.exp_nxy = output[2]
         ctx.exp_xy_sum = output[3];
         ctx.exp_nxy_sum = output[4];
+        ctx.num_threads = num_threads
         ctx.pos = pos
         #if torch.isnan(ctx.exp_xy).any() or torch.isnan(ctx.exp_nxy).any() or torch.isnan(ctx.exp_xy_sum).any() or torch.isnan(ctx.exp_nxy_sum).any() or torch.isnan(output[0]).any():
         #    pdb.set_trace()
@@ -113,14 +159,62 @@ class LogSumExpWirelengthAtomicFunction(Function):
                     ctx.gamma
                     )
         else:
-            assert 0, "CPU version NOT IMPLEMENTED"
+            output = logsumexp_wirelength_cpp_atomic.backward(
+                    grad_pos,
+                    ctx.pos,
+                    ctx.exp_xy.view([-1]), ctx.exp_nxy.view([-1]),
+                    ctx.exp_xy_sum.view([-1]), ctx.exp_nxy_sum.view([-1]),
+                    ctx.pin2net_map,
+                    ctx.net_mask,
+                    ctx.gamma,
+                    ctx.num_threads
+                    )
         #if torch.isnan(output).any():
         #    pdb.set_trace()
-        return output, None, None, None
+        return output, None, None, None, None, None
+
+class LogSumExpWirelengthSparseFunction(Function):
+    """compute log-sum-exp wirelength with CSR net-to-pin map on CPU.
+    GPU sparse algorithm is implemented by LogSumExpWirelengthFunction with netpin_values.
+    @param pos pin location (x array, y array), not cell location
+    @param flat_netpin flat netpin map, length of #pins
+    @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
+    @param pin2net_map pin2net map
+    @param net_mask whether to compute wirelength
+    @param gamma the smaller, the closer to HPWL
+    @param num_threads number of threads
+    """
+    @staticmethod
+    def forward(ctx, pos, flat_netpin, netpin_start, pin2net_map, net_mask, gamma, num_threads):
+        output = logsumexp_wirelength_cpp_sparse.forward(pos.view(pos.numel()), flat_netpin, netpin_start, pin2net_map, net_mask, gamma, num_threads)
+        ctx.pin2net_map = pin2net_map
+        ctx.net_mask = net_mask
+        ctx.gamma = gamma
+        ctx.exp_xy = output[1]
+        ctx.exp_nxy = output[2]
+        ctx.exp_xy_sum = output[3]
+        ctx.exp_nxy_sum = output[4]
+        ctx.num_threads = num_threads
+        ctx.pos = pos
+        return output[0]
+
+    @staticmethod
+    def backward(ctx, grad_pos):
+        output = logsumexp_wirelength_cpp_sparse.backward(
+                grad_pos,
+                ctx.pos,
+                ctx.exp_xy, ctx.exp_nxy,
+                ctx.exp_xy_sum, ctx.exp_nxy_sum,
+                ctx.pin2net_map,
+                ctx.net_mask,
+                ctx.gamma,
+                ctx.num_threads
+                )
+        return output, None, None, None, None, None, None
 
 class LogSumExpWirelength(nn.Module):
     """ Compute log-sum-exp wirelength.
-    CPU only supports net-by-net algorithm.
+    CPU supports three algorithms: net-by-net, atomic, sparse.
     GPU supports two algorithms: atomic, sparse.
     Different parameters are required for different algorithms.
 
@@ -130,14 +224,23 @@ class LogSumExpWirelength(nn.Module):
     @param net_mask whether to compute wirelength, 1 means to compute, 0 means to ignore
     @param gamma the smaller, the closer to HPWL
     @param algorithm must be net-by-net | atomic | sparse
+    @param pin2node_map cell of each pin, optional
+    @param pin_offset_x pin offset x to its cell, optional
+    @param pin_offset_y pin offset y to its cell, optional
+    @param flat_node2pin flat node2pin map, length of #pins, optional
+    @param flat_node2pin_start starting index in node2pin map for each cell, length of #physical cells+1, optional
+
+    If pin2node_map, pin offsets and the node2pin map are given, the input is cell locations instead of pin locations.
+    The CPU net-by-net algorithm then computes pin locations on the fly and sums up gradients to cells without pin-sized location arrays.
     """
-    def __init__(self, flat_netpin=None, netpin_start=None, pin2net_map=None, net_mask=None, gamma=None, algorithm='atomic', num_threads=8):
+    def __init__(self, flat_netpin=None, netpin_start=None, pin2net_map=None, net_mask=None, gamma=None, algorithm='atomic', num_threads=8,
+            pin2node_map=None, pin_offset_x=None, pin_offset_y=None, flat_node2pin=None, flat_node2pin_start=None):
         super(LogSumExpWirelength, self).__init__()
         assert net_mask is not None and gamma is not None, "net_mask, gamma are requried parameters"
         if algorithm == 'net-by-net':
             assert flat_netpin is not None and netpin_start is not None, "flat_netpin, netpin_start are requried parameters for algorithm net-by-net"
         elif algorithm == 'atomic':
-            assert pin2net_map is not None, "pin2net_map is required for algorithm atomic"
+            assert pin2net_map is not None and netpin_start is not None, "pin2net_map, netpin_start are required for algorithm atomic"
         elif algorithm == 'sparse':
             assert flat_netpin is not None and netpin_start is not None and pin2net_map is not None, "flat_netpin, netpin_start, pin2net_map are requried parameters for algorithm sparse"
         self.flat_netpin = flat_netpin
@@ -145,16 +248,61 @@ class LogSumExpWirelength(nn.Module):
         self.netpin_values = None
         self.pin2net_map = pin2net_map
         self.net_mask = net_mask
+        self.net_degree_buckets = None
         self.gamma = gamma
         self.algorithm = algorithm
         self.num_threads = num_threads
+        self.pin2node_map = pin2node_map
+        self.pin_offset_x = pin_offset_x
+        self.pin_offset_y = pin_offset_y
+        self.flat_node2pin = flat_node2pin
+        self.flat_node2pin_start = flat_node2pin_start
+        self.grad_pin = None
+        if pin2node_map is not None:
+            assert pin_offset_x is not None and pin_offset_y is not None and flat_node2pin is not None and flat_node2pin_start is not None, "pin_offset_x, pin_offset_y, flat_node2pin, flat_node2pin_start are required with pin2node_map"
     def forward(self, pos):
+        """
+        @param pos cell locations if pin2node_map is given, otherwise pin locations
+        """
+        if self.pin2node_map is None:
+            return self.forward_pin(pos)
+        if self.algorithm not in ['atomic', 'sparse'] and not pos.is_cuda:
+            # nets are grouped by degree only once for CPU
+            if self.net_degree_buckets is None:
+                self.net_degree_buckets = logsumexp_wirelength_cpp.degree_buckets(self.netpin_start, self.net_mask)
+            # pins of ignored nets are never written, so the buffer is only zeroed when allocated
+            if self.grad_pin is None or self.grad_pin.dtype != pos.dtype:
+                self.grad_pin = torch.zeros(2*self.pin2node_map.numel(), dtype=pos.dtype)
+            return LogSumExpWirelengthNodeFunction.apply(pos,
+                    self.pin_offset_x,
+                    self.pin_offset_y,
+                    self.pin2node_map,
+                    self.flat_node2pin,
+                    self.flat_node2pin_start,
+                    self.flat_netpin,
+                    self.netpin_start,
+                    self.net_degree_buckets,
+                    self.gamma,
+                    self.grad_pin,
+                    self.num_threads
+                    )
+        # other algorithms work on pin locations
+        num_nodes = pos.numel()//2
+        pin_x = self.pin_offset_x.add(torch.index_select(pos[:num_nodes], dim=0, index=self.pin2node_map.long()))
+        pin_y = self.pin_offset_y.add(torch.index_select(pos[num_nodes:], dim=0, index=self.pin2node_map.long()))
+        return self.forward_pin(torch.cat([pin_x, pin_y], dim=0))
+    def forward_pin(self, pos):
+        """
+        @param pos pin locations
+        """
         if pos.is_cuda:
             if self.algorithm == 'atomic':
                 return LogSumExpWirelengthAtomicFunction.apply(pos,
                         self.pin2net_map,
+                        self.netpin_start,
                         self.net_mask,
-                        self.gamma
+                        self.gamma,
+                        self.num_threads
                         )
             elif self.algorithm == 'sparse':
                 if self.netpin_values is None:
@@ -164,15 +312,37 @@ class LogSumExpWirelength(nn.Module):
                         self.netpin_start,
                         self.netpin_values,
                         self.net_mask,
+                        None,
                         self.gamma,
                         self.num_threads
                         )
-        else: # only net-by-net for CPU
+        elif self.algorithm == 'atomic':
+            return LogSumExpWirelengthAtomicFunction.apply(pos,
+                    self.pin2net_map,
+                    self.netpin_start,
+                    self.net_mask,
+                    self.gamma,
+                    self.num_threads
+                    )
+        elif self.algorithm == 'sparse':
+            return LogSumExpWirelengthSparseFunction.apply(pos,
+                    self.flat_netpin,
+                    self.netpin_start,
+                    self.pin2net_map,
+                    self.net_mask,
+                    self.gamma,
+                    self.num_threads
+                    )
+        else:
+            # nets are grouped by degree only once for CPU
+            if self.net_degree_buckets is None:
+                self.net_degree_buckets = logsumexp_wirelength_cpp.degree_buckets(self.netpin_start, self.net_mask)
             return LogSumExpWirelengthFunction.apply(pos,
                     self.flat_netpin,
                     self.netpin_start,
                     None,
                     self.net_mask,
+                    self.net_degree_buckets,
                     self.gamma,
                     self.num_threads
                     )
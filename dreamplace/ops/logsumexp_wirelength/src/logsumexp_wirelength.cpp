@@ -7,6 +7,9 @@
 #include <cfloat>
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
+#include "utility/src/net_degree_buckets.h"
+#include "utility/src/vector_exp.h"
+#include "utility/src/pin_position.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -15,7 +18,7 @@ int computeLogSumExpWirelengthLauncher(
         const T* x, const T* y,
         const int* flat_netpin,
         const int* netpin_start,
-        const unsigned char* net_mask,
+        const int* net_degree_buckets,
         int num_nets,
         int num_pins,
         const T* gamma,
@@ -27,6 +30,18 @@ int computeLogSumExpWirelengthLauncher(
         T* grad_x_tensor, T* grad_y_tensor
         );
 
+template <typename T, typename PinPos>
+int computeLogSumExpWirelengthFusedLauncher(
+        const PinPos& pin_pos,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* net_degree_buckets,
+        const T* gamma,
+        T* wl,
+        int num_threads,
+        T* grad_intermediate_x, T* grad_intermediate_y
+        );
+
 #define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x " must be a flat tensor on CPU")
 #define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x " must have even number of elements")
 #define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x " must be contiguous")
@@ -36,13 +51,13 @@ int computeLogSumExpWirelengthLauncher(
 /// @param pos cell locations, array of x locations and then y locations
 /// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
 /// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
-/// @param net_mask an array to record whether compute the where for a net or not
+/// @param net_degree_buckets nets to compute grouped by degree, from degree_buckets
 /// @param gamma a scalar tensor for the parameter in the equation
 std::vector<at::Tensor> logsumexp_wirelength_forward(
         at::Tensor pos,
         at::Tensor flat_netpin,
         at::Tensor netpin_start,
-        at::Tensor net_mask,
+        at::Tensor net_degree_buckets,
         at::Tensor gamma,
         int num_threads
         )
@@ -54,6 +69,8 @@ std::vector<at::Tensor> logsumexp_wirelength_forward(
     CHECK_CONTIGUOUS(flat_netpin);
     CHECK_FLAT(netpin_start);
     CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_degree_buckets);
+    CHECK_CONTIGUOUS(net_degree_buckets);
     int num_nets = netpin_start.numel()-1;
     at::Tensor wl = at::zeros({num_nets}, pos.type());
     at::Tensor exp_xy = at::zeros_like(pos);
@@ -66,7 +83,7 @@ std::vector<at::Tensor> logsumexp_wirelength_forward(
                     pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2,
                     flat_netpin.data<int>(),
                     netpin_start.data<int>(),
-                    net_mask.data<unsigned char>(),
+                    net_degree_buckets.data<int>(),
                     num_nets,
                     flat_netpin.numel(),
                     gamma.data<scalar_t>(),
@@ -82,6 +99,124 @@ std::vector<at::Tensor> logsumexp_wirelength_forward(
     return {wl.sum(), exp_xy, exp_nxy, exp_xy_sum, exp_nxy_sum};
 }
 
+/// @brief Compute log-sum-exp wirelength from cell locations and the gradient of each cell in one pass.
+/// Pin locations are computed on the fly from pin offsets, and the gradients of pins are summed up to cells.
+/// The gradient is computed for a unit output gradient, so backward only needs to scale it by grad_pos.
+/// @param pos cell locations, array of x locations and then y locations
+/// @param pin_offset_x pin offset x to its cell
+/// @param pin_offset_y pin offset y to its cell
+/// @param pin2node_map cell of each pin
+/// @param flat_node2pin similar to the JA array in CSR format, which is flattened from the node2pin map (array of array)
+/// @param flat_node2pin_start similar to the IA array in CSR format, the length is number of physical cells + 1
+/// @param pin_mask whether to ignore the gradient of a pin, 1 means to ignore, 0 means to compute; empty to compute all pins
+/// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_degree_buckets nets to compute grouped by degree, from degree_buckets
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param grad_pin gradient buffer of pins owned by the caller with 2*num_pins elements,
+/// zero-initialized once; pins of ignored nets are never written, so they keep zero gradient
+/// @return the total wirelength and the intermediate gradient with the same layout as pos
+std::vector<at::Tensor> logsumexp_wirelength_fused_node_forward(
+        at::Tensor pos,
+        at::Tensor pin_offset_x,
+        at::Tensor pin_offset_y,
+        at::Tensor pin2node_map,
+        at::Tensor flat_node2pin,
+        at::Tensor flat_node2pin_start,
+        at::Tensor pin_mask,
+        at::Tensor flat_netpin,
+        at::Tensor netpin_start,
+        at::Tensor net_degree_buckets,
+        at::Tensor gamma,
+        at::Tensor grad_pin,
+        int num_threads
+        )
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(pin_offset_x);
+    CHECK_CONTIGUOUS(pin_offset_x);
+    CHECK_FLAT(pin_offset_y);
+    CHECK_CONTIGUOUS(pin_offset_y);
+    CHECK_FLAT(pin2node_map);
+    CHECK_CONTIGUOUS(pin2node_map);
+    CHECK_FLAT(flat_node2pin);
+    CHECK_CONTIGUOUS(flat_node2pin);
+    CHECK_FLAT(flat_node2pin_start);
+    CHECK_CONTIGUOUS(flat_node2pin_start);
+    CHECK_FLAT(pin_mask);
+    CHECK_CONTIGUOUS(pin_mask);
+    CHECK_FLAT(flat_netpin);
+    CHECK_CONTIGUOUS(flat_netpin);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_degree_buckets);
+    CHECK_CONTIGUOUS(net_degree_buckets);
+    CHECK_FLAT(grad_pin);
+    CHECK_CONTIGUOUS(grad_pin);
+
+    int num_nets = netpin_start.numel()-1;
+    int num_pins = pin2node_map.numel();
+    AT_ASSERTM(grad_pin.scalar_type() == pos.scalar_type(), "grad_pin must have the type of pos");
+    AT_ASSERTM(grad_pin.numel() == 2*num_pins, "grad_pin must hold 2*num_pins elements");
+    at::Tensor wl = at::zeros({num_nets}, pos.options());
+    // cells without pins, e.g., fillers, have zero gradient
+    at::Tensor grad_intermediate = at::zeros_like(pos);
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeLogSumExpWirelengthFusedLauncher", [&] {
+            PinPositionFromNodes<scalar_t> pin_pos = {
+                pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2,
+                pin_offset_x.data<scalar_t>(), pin_offset_y.data<scalar_t>(),
+                pin2node_map.data<int>()
+            };
+            computeLogSumExpWirelengthFusedLauncher<scalar_t>(
+                    pin_pos,
+                    flat_netpin.data<int>(),
+                    netpin_start.data<int>(),
+                    net_degree_buckets.data<int>(),
+                    gamma.data<scalar_t>(),
+                    wl.data<scalar_t>(),
+                    num_threads,
+                    grad_pin.data<scalar_t>(), grad_pin.data<scalar_t>()+num_pins
+                    );
+            sumPinGradToNodes<scalar_t>(
+                    grad_pin.data<scalar_t>(), grad_pin.data<scalar_t>()+num_pins,
+                    flat_node2pin.data<int>(),
+                    flat_node2pin_start.data<int>(),
+                    (pin_mask.numel())? pin_mask.data<unsigned char>() : nullptr,
+                    flat_node2pin_start.numel()-1,
+                    num_threads,
+                    grad_intermediate.data<scalar_t>(), grad_intermediate.data<scalar_t>()+pos.numel()/2
+                    );
+            });
+    return {wl.sum(), grad_intermediate};
+}
+
+/// @brief Group nets by degree, which only needs to be done once for a netlist
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @return offsets of the degree buckets followed by the net indices, see buildNetDegreeBuckets
+at::Tensor logsumexp_wirelength_degree_buckets(
+        at::Tensor netpin_start,
+        at::Tensor net_mask
+        )
+{
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+
+    std::vector<int> buckets = buildNetDegreeBuckets(
+            netpin_start.data<int>(),
+            net_mask.data<unsigned char>(),
+            netpin_start.numel()-1
+            );
+    at::Tensor net_degree_buckets = at::empty({(int64_t)buckets.size()}, netpin_start.options());
+    std::copy(buckets.begin(), buckets.end(), net_degree_buckets.data<int>());
+    return net_degree_buckets;
+}
+
 /// @brief Compute gradient
 /// @param grad_pos input gradient from back-propagation
 /// @param pos locations of pins
@@ -91,7 +226,7 @@ std::vector<at::Tensor> logsumexp_wirelength_forward(
 /// @param exp_nxy_sum array of \sum(exp(-x/gamma)) for each net and then \sum(exp(-y/gamma))
 /// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
 /// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
-/// @param net_mask an array to record whether compute the where for a net or not
+/// @param net_degree_buckets nets to compute grouped by degree, from degree_buckets
 /// @param gamma a scalar tensor for the parameter in the equation
 at::Tensor logsumexp_wirelength_backward(
         at::Tensor grad_pos,
@@ -100,7 +235,7 @@ at::Tensor logsumexp_wirelength_backward(
         at::Tensor exp_xy_sum, at::Tensor exp_nxy_sum,
         at::Tensor flat_netpin,
         at::Tensor netpin_start,
-        at::Tensor net_mask,
+        at::Tensor net_degree_buckets,
         at::Tensor gamma, // a scalar tensor
         int num_threads
         )
@@ -124,6 +259,8 @@ at::Tensor logsumexp_wirelength_backward(
     CHECK_CONTIGUOUS(flat_netpin);
     CHECK_FLAT(netpin_start);
     CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_degree_buckets);
+    CHECK_CONTIGUOUS(net_degree_buckets);
     at::Tensor grad_out = at::zeros_like(pos);
 
     AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeLogSumExpWirelengthLauncher", [&] {
@@ -131,7 +268,7 @@ at::Tensor logsumexp_wirelength_backward(
                     pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2,
                     flat_netpin.data<int>(),
                     netpin_start.data<int>(),
-                    net_mask.data<unsigned char>(),
+                    net_degree_buckets.data<int>(),
                     netpin_start.numel()-1,
                     flat_netpin.numel(),
                     gamma.data<scalar_t>(),
@@ -146,105 +283,361 @@ at::Tensor logsumexp_wirelength_backward(
     return grad_out;
 }
 
-template <typename T>
-int computeLogSumExpWirelengthLauncher(
-        const T* x, const T* y,
-        const int* flat_netpin,
-        const int* netpin_start,
-        const unsigned char* net_mask,
-        int num_nets,
-        int num_pins,
-        const T* gamma,
-        T* exp_xy, T* exp_nxy,
-        T* exp_xy_sum, T* exp_nxy_sum,
-        T* wl,
-        const T* grad_tensor,
-        int num_threads,
-        T* grad_x_tensor, T* grad_y_tensor
-        )
+/// @brief Log-sum-exp wirelength of one net.
+/// The exponentials are saved if exp_xy is not nullptr,
+/// the gradient for a unit output gradient is saved if grad_intermediate_x is not nullptr.
+/// @tparam PinPos accessor of pin locations, see pin_position.h
+template <typename T, typename PinPos>
+struct LogSumExpWirelengthNetKernel
 {
-    T tol = 80; // tolerance to trigger numeric adjustment, which may cause precision loss
-    if (grad_tensor)
+    PinPos pin_pos;
+    const int* flat_netpin;
+    const int* netpin_start;
+    int num_nets;
+    int num_pins;
+    T gamma;
+    T* exp_xy;
+    T* exp_nxy;
+    T* exp_xy_sum;
+    T* exp_nxy_sum;
+    T* wl;
+    T* grad_intermediate_x;
+    T* grad_intermediate_y;
+    /// thread-local buffer for nets larger than the specialized degrees
+    std::vector<T> buf;
+
+    /// @tparam Degree degree of the net, 0 for any degree
+    template <int Degree>
+    void run(int i)
     {
-#pragma omp parallel for num_threads(num_threads)
-        for (int i = 0; i < num_pins; ++i)
+        T tol = 80; // tolerance to trigger numeric adjustment, which may cause precision loss
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = (Degree)? Degree : netpin_start[i+1]-netpin_start[i];
+
+        // exponentials of x, -x, y, -y for all pins are evaluated with one call to the vectorized exponential;
+        // small nets keep them in fixed-size arrays
+        T local[(Degree)? 4*Degree : 1];
+        T* exp_buf = local;
+        if (!Degree)
         {
-            grad_x_tensor[i] = 0;
-            grad_y_tensor[i] = 0;
+            if (buf.size() < (size_t)(4*degree))
+            {
+                buf.resize(4*degree);
+            }
+            exp_buf = buf.data();
         }
-    }
-#pragma omp parallel for num_threads(num_threads)
-    for (int i = 0; i < num_nets; ++i)
-    {
-        if (!net_mask[i])
+
+        T xy_max[2];
+        T xy_min[2];
+        for (int k = 0; k < 2; ++k)
         {
-            continue;
+            T* e = exp_buf+2*k*degree;
+            T* ne = e+degree;
+
+            xy_max[k] = -std::numeric_limits<T>::max(); // maximum x to resolve numerical overflow
+            xy_min[k] = std::numeric_limits<T>::max(); // minimum x to resolve numerical overflow
+            for (int j = 0; j < degree; ++j)
+            {
+                T xx = (k)? pin_pos.getY(pins[j]) : pin_pos.getX(pins[j]);
+                e[j] = xx;
+                xy_max[k] = std::max(xy_max[k], xx);
+                xy_min[k] = std::min(xy_min[k], xx);
+            }
+            if (xy_max[k] < tol*gamma)
+            {
+                xy_max[k] = 0;
+            }
+            if (xy_min[k] > -tol*gamma)
+            {
+                xy_min[k] = 0;
+            }
+            for (int j = 0; j < degree; ++j)
+            {
+                T xx = e[j];
+                e[j] = (xx-xy_max[k])/gamma;
+                ne[j] = -(xx-xy_min[k])/gamma;
+            }
         }
+        vectorExp(exp_buf, degree<<2);
+
         for (int k = 0; k < 2; ++k)
         {
-            const T* xy = (k)? y : x;
-            T* grad = (k)? grad_y_tensor : grad_x_tensor;
+            const T* e = exp_buf+2*k*degree;
+            const T* ne = e+degree;
 
-            if (grad_tensor) // gradient
+            T sum = 0;
+            T nsum = 0;
+            for (int j = 0; j < degree; ++j)
             {
-                T reciprocal_exp_xy_sum = 1.0/exp_xy_sum[i+k*num_nets];
-                T reciprocal_exp_nxy_sum = 1.0/exp_nxy_sum[i+k*num_nets];
-                for (int j = netpin_start[i]; j < netpin_start[i+1]; ++j)
+                sum += e[j];
+                nsum += ne[j];
+            }
+            if (exp_xy)
+            {
+                for (int j = 0; j < degree; ++j)
                 {
-                    // I assume one pin will only appear in one net
-                    // for x
-                    grad[flat_netpin[j]] = (exp_xy[flat_netpin[j]+k*netpin_start[num_nets]]*reciprocal_exp_xy_sum - exp_nxy[flat_netpin[j]+k*netpin_start[num_nets]]*reciprocal_exp_nxy_sum)*(*grad_tensor);
+                    int pin_id = pins[j]+k*num_pins;
+                    exp_xy[pin_id] = e[j];
+                    exp_nxy[pin_id] = ne[j];
                 }
+                exp_xy_sum[i+k*num_nets] = sum;
+                exp_nxy_sum[i+k*num_nets] = nsum;
             }
-            else // wirelength
+            if (grad_intermediate_x)
             {
-                exp_xy_sum[i+k*num_nets] = 0;
-                exp_nxy_sum[i+k*num_nets] = 0;
+                T* grad = (k)? grad_intermediate_y : grad_intermediate_x;
+                T reciprocal_exp_xy_sum = 1.0/sum;
+                T reciprocal_exp_nxy_sum = 1.0/nsum;
+                for (int j = 0; j < degree; ++j)
+                {
+                    grad[pins[j]] = e[j]*reciprocal_exp_xy_sum - ne[j]*reciprocal_exp_nxy_sum;
+                }
+            }
+
+            T log_exp_xy_sum = log(sum)*gamma + xy_max[k];
+            T log_exp_nxy_sum = log(nsum)*gamma - xy_min[k];
 
-                T xy_max = -std::numeric_limits<T>::max(); // maximum x to resolve numerical overflow
-                T xy_min = std::numeric_limits<T>::max(); // minimum x to resolve numerical overflow
+            wl[i] += log_exp_xy_sum + log_exp_nxy_sum;
+        }
+    }
+
+    /// @brief same as run, but the min/max, the exponentials, the sums and the gradient
+    /// of a high-fanout net are computed with all threads
+    void runHighFanout(int i, int num_threads)
+    {
+        T tol = 80; // tolerance to trigger numeric adjustment, which may cause precision loss
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = netpin_start[i+1]-netpin_start[i];
+        int num_chunks = (degree+kHighFanoutNetChunkSize-1)/kHighFanoutNetChunkSize;
+
+        if (buf.size() < (size_t)(4*degree))
+        {
+            buf.resize(4*degree);
+        }
+        T* exp_buf = buf.data();
+
+        for (int k = 0; k < 2; ++k)
+        {
+            T* e = exp_buf+2*k*degree;
+            T* ne = e+degree;
+
+            T xy_max = -std::numeric_limits<T>::max(); // maximum x to resolve numerical overflow
+            T xy_min = std::numeric_limits<T>::max(); // minimum x to resolve numerical overflow
+#pragma omp parallel for num_threads(num_threads) schedule(static, kHighFanoutNetChunkSize) reduction(min:xy_min) reduction(max:xy_max)
+            for (int j = 0; j < degree; ++j)
+            {
+                T xx = (k)? pin_pos.getY(pins[j]) : pin_pos.getX(pins[j]);
+                e[j] = xx;
+                xy_max = std::max(xy_max, xx);
+                xy_min = std::min(xy_min, xx);
+            }
+            if (xy_max < tol*gamma)
+            {
+                xy_max = 0;
+            }
+            if (xy_min > -tol*gamma)
+            {
+                xy_min = 0;
+            }
 
-                for (int j = netpin_start[i]; j < netpin_start[i+1]; ++j)
+            // each chunk evaluates its exponentials with the vectorized exponential
+            T sum = 0;
+            T nsum = 0;
+#pragma omp parallel for num_threads(num_threads) schedule(static) reduction(+:sum,nsum)
+            for (int c = 0; c < num_chunks; ++c)
+            {
+                int begin = c*kHighFanoutNetChunkSize;
+                int end = std::min(begin+(int)kHighFanoutNetChunkSize, degree);
+                for (int j = begin; j < end; ++j)
                 {
-                    // for x
-                    T xx = xy[flat_netpin[j]];
-                    xy_max = std::max(xy_max, xx);
-                    xy_min = std::min(xy_min, xx);
+                    T xx = e[j];
+                    e[j] = (xx-xy_max)/gamma;
+                    ne[j] = -(xx-xy_min)/gamma;
                 }
-                if (xy_max < tol*(*gamma))
+                vectorExp(e+begin, end-begin);
+                vectorExp(ne+begin, end-begin);
+                for (int j = begin; j < end; ++j)
                 {
-                    xy_max = 0;
+                    sum += e[j];
+                    nsum += ne[j];
                 }
-                if (xy_min > -tol*(*gamma))
+            }
+
+            T reciprocal_exp_xy_sum = 1.0/sum;
+            T reciprocal_exp_nxy_sum = 1.0/nsum;
+            T* grad = (k)? grad_intermediate_y : grad_intermediate_x;
+#pragma omp parallel for num_threads(num_threads) schedule(static, kHighFanoutNetChunkSize)
+            for (int j = 0; j < degree; ++j)
+            {
+                if (exp_xy)
                 {
-                    xy_min = 0;
+                    int pin_id = pins[j]+k*num_pins;
+                    exp_xy[pin_id] = e[j];
+                    exp_nxy[pin_id] = ne[j];
                 }
-                for (int j = netpin_start[i]; j < netpin_start[i+1]; ++j)
+                if (grad)
                 {
-                    // for x
-                    T xx = xy[flat_netpin[j]];
-                    exp_xy[flat_netpin[j]+k*netpin_start[num_nets]] = exp((xx-xy_max)/(*gamma));
-                    exp_nxy[flat_netpin[j]+k*netpin_start[num_nets]] = exp(-(xx-xy_min)/(*gamma));
-
-                    exp_xy_sum[i+k*num_nets] += exp_xy[flat_netpin[j]+k*netpin_start[num_nets]];
-                    exp_nxy_sum[i+k*num_nets] += exp_nxy[flat_netpin[j]+k*netpin_start[num_nets]];
+                    grad[pins[j]] = e[j]*reciprocal_exp_xy_sum - ne[j]*reciprocal_exp_nxy_sum;
                 }
+            }
+            if (exp_xy)
+            {
+                exp_xy_sum[i+k*num_nets] = sum;
+                exp_nxy_sum[i+k*num_nets] = nsum;
+            }
+
+            T log_exp_xy_sum = log(sum)*gamma + xy_max;
+            T log_exp_nxy_sum = log(nsum)*gamma - xy_min;
+
+            wl[i] += log_exp_xy_sum + log_exp_nxy_sum;
+        }
+    }
+};
+
+/// @brief Gradient of log-sum-exp wirelength of one net
+template <typename T>
+struct LogSumExpWirelengthGradNetKernel
+{
+    const int* flat_netpin;
+    const int* netpin_start;
+    int num_nets;
+    int num_pins;
+    const T* exp_xy;
+    const T* exp_nxy;
+    const T* exp_xy_sum;
+    const T* exp_nxy_sum;
+    T grad;
+    T* grad_x_tensor;
+    T* grad_y_tensor;
 
-                T log_exp_xy_sum = log(exp_xy_sum[i+k*num_nets])*(*gamma) + xy_max;
-                T log_exp_nxy_sum = log(exp_nxy_sum[i+k*num_nets])*(*gamma) - xy_min;
+    /// @tparam Degree degree of the net, 0 for any degree
+    template <int Degree>
+    void run(int i)
+    {
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = (Degree)? Degree : netpin_start[i+1]-netpin_start[i];
 
-                T wl_xy = log_exp_xy_sum + log_exp_nxy_sum;
-                wl[i] += wl_xy;
+        for (int k = 0; k < 2; ++k)
+        {
+            T* grad_xy = (k)? grad_y_tensor : grad_x_tensor;
+            T reciprocal_exp_xy_sum = 1.0/exp_xy_sum[i+k*num_nets];
+            T reciprocal_exp_nxy_sum = 1.0/exp_nxy_sum[i+k*num_nets];
+            for (int j = 0; j < degree; ++j)
+            {
+                // I assume one pin will only appear in one net
+                int pin_id = pins[j];
+                grad_xy[pin_id] = (exp_xy[pin_id+k*num_pins]*reciprocal_exp_xy_sum - exp_nxy[pin_id+k*num_pins]*reciprocal_exp_nxy_sum)*grad;
             }
         }
     }
 
+    /// @brief same as run, but the pins of a high-fanout net are split among all threads
+    void runHighFanout(int i, int num_threads)
+    {
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = netpin_start[i+1]-netpin_start[i];
+
+        for (int k = 0; k < 2; ++k)
+        {
+            T* grad_xy = (k)? grad_y_tensor : grad_x_tensor;
+            T reciprocal_exp_xy_sum = 1.0/exp_xy_sum[i+k*num_nets];
+            T reciprocal_exp_nxy_sum = 1.0/exp_nxy_sum[i+k*num_nets];
+#pragma omp parallel for num_threads(num_threads) schedule(static, kHighFanoutNetChunkSize)
+            for (int j = 0; j < degree; ++j)
+            {
+                int pin_id = pins[j];
+                grad_xy[pin_id] = (exp_xy[pin_id+k*num_pins]*reciprocal_exp_xy_sum - exp_nxy[pin_id+k*num_pins]*reciprocal_exp_nxy_sum)*grad;
+            }
+        }
+    }
+};
+
+template <typename T>
+int computeLogSumExpWirelengthLauncher(
+        const T* x, const T* y,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* net_degree_buckets,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* wl,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        )
+{
+    if (grad_tensor) // gradient
+    {
+#pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < num_pins; ++i)
+        {
+            grad_x_tensor[i] = 0;
+            grad_y_tensor[i] = 0;
+        }
+        LogSumExpWirelengthGradNetKernel<T> kernel = {
+            flat_netpin, netpin_start,
+            num_nets, num_pins,
+            exp_xy, exp_nxy,
+            exp_xy_sum, exp_nxy_sum,
+            *grad_tensor,
+            grad_x_tensor, grad_y_tensor
+        };
+        forEachNetByDegree(net_degree_buckets, num_threads, kernel);
+    }
+    else // wirelength
+    {
+        PinPositionFromPins<T> pin_pos = {x, y};
+        LogSumExpWirelengthNetKernel<T, PinPositionFromPins<T> > kernel = {
+            pin_pos,
+            flat_netpin, netpin_start,
+            num_nets, num_pins,
+            *gamma,
+            exp_xy, exp_nxy,
+            exp_xy_sum, exp_nxy_sum,
+            wl,
+            nullptr, nullptr
+        };
+        forEachNetByDegree(net_degree_buckets, num_threads, kernel);
+    }
+
+    return 0;
+}
+
+template <typename T, typename PinPos>
+int computeLogSumExpWirelengthFusedLauncher(
+        const PinPos& pin_pos,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* net_degree_buckets,
+        const T* gamma,
+        T* wl,
+        int num_threads,
+        T* grad_intermediate_x, T* grad_intermediate_y
+        )
+{
+    LogSumExpWirelengthNetKernel<T, PinPos> kernel = {
+        pin_pos,
+        flat_netpin, netpin_start,
+        0, 0,
+        *gamma,
+        nullptr, nullptr,
+        nullptr, nullptr,
+        wl,
+        grad_intermediate_x, grad_intermediate_y
+    };
+    forEachNetByDegree(net_degree_buckets, num_threads, kernel);
+
     return 0;
 }
 
 DREAMPLACE_END_NAMESPACE
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  m.def("degree_buckets", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_degree_buckets, "Group nets by degree");
   m.def("forward", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_forward, "LogSumExpWirelength forward");
   m.def("backward", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_backward, "LogSumExpWirelength backward");
+  m.def("fused_node_forward", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_fused_node_forward, "LogSumExpWirelength forward with gradient from cell locations");
 }
@@ -0,0 +1,301 @@
+/**
+ * @file   logsumexp_wirelength_atomic.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Compute log-sum-exp wirelength and gradient in parallel over pins on CPU
+ */
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+#include "utility/src/parallel_reduce.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+template <typename T>
+int computeLogSumExpWirelengthAtomicLauncher(
+        const T* x, const T* y,
+        const int* pin2net_map,
+        const int* netpin_start,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl, // wirelength of each net
+        int num_threads
+        );
+
+template <typename T>
+int computeLogSumExpWirelengthGradAtomicLauncher(
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        );
+
+#define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x " must be a flat tensor on CPU")
+#define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x " must have even number of elements")
+#define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x " must be contiguous")
+
+/// @brief Compute log-sum-exp wirelength with parallelization over pins.
+///     gamma * (log(\sum exp(x_i/gamma)) + log(\sum exp(-x_i/gamma)))
+/// Pins are grouped by contiguous ranges of nets, and each thread accumulates the pins of the ranges it owns,
+/// so no atomic operation or thread-local copy of the net arrays is needed.
+/// Scratch takes O(#pins), and the pins of a net are summed in index order
+/// regardless of the number of threads.
+/// @param pos location of pins, x array followed by y array.
+/// @param pin2net_map map pin to net
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_mask whether compute the wirelength for a net or not
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param num_threads number of threads
+/// @return total wirelength cost with auxiliary tensors for backward propagation.
+std::vector<at::Tensor> logsumexp_wirelength_atomic_forward(
+        at::Tensor pos,
+        at::Tensor pin2net_map,
+        at::Tensor netpin_start,
+        at::Tensor net_mask,
+        at::Tensor gamma,
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+    AT_ASSERTM(netpin_start.numel() == net_mask.numel()+1, "netpin_start must have number of nets + 1 elements");
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    at::Tensor wl = at::zeros({num_nets}, pos.options());
+    at::Tensor exp_xy = at::zeros_like(pos);
+    at::Tensor exp_nxy = at::zeros_like(pos);
+    at::Tensor exp_xy_sum = at::zeros({2*num_nets}, pos.options());
+    at::Tensor exp_nxy_sum = at::zeros({2*num_nets}, pos.options());
+    at::Tensor xy_max = at::empty({2*num_nets}, pos.options());
+    at::Tensor xy_min = at::empty({2*num_nets}, pos.options());
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeLogSumExpWirelengthAtomicLauncher", [&] {
+            computeLogSumExpWirelengthAtomicLauncher<scalar_t>(
+                    pos.data<scalar_t>(), pos.data<scalar_t>()+num_pins,
+                    pin2net_map.data<int>(),
+                    netpin_start.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    gamma.data<scalar_t>(),
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    xy_max.data<scalar_t>(), xy_min.data<scalar_t>(),
+                    wl.data<scalar_t>(),
+                    num_threads
+                    );
+            });
+
+    return {wl.sum(), exp_xy, exp_nxy, exp_xy_sum, exp_nxy_sum};
+}
+
+/// @brief Compute gradient
+/// @param grad_pos input gradient from back-propagation
+/// @param pos locations of pins
+/// @param exp_xy array of exp(x/gamma) and then exp(y/gamma)
+/// @param exp_nxy array of exp(-x/gamma) and then exp(-y/gamma)
+/// @param exp_xy_sum array of \sum(exp(x/gamma)) for each net and then \sum(exp(y/gamma))
+/// @param exp_nxy_sum array of \sum(exp(-x/gamma)) for each net and then \sum(exp(-y/gamma))
+/// @param pin2net_map map pin to net
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param num_threads number of threads
+at::Tensor logsumexp_wirelength_atomic_backward(
+        at::Tensor grad_pos,
+        at::Tensor pos,
+        at::Tensor exp_xy, at::Tensor exp_nxy,
+        at::Tensor exp_xy_sum, at::Tensor exp_nxy_sum,
+        at::Tensor pin2net_map,
+        at::Tensor net_mask,
+        at::Tensor gamma, // a scalar tensor
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(exp_xy);
+    CHECK_EVEN(exp_xy);
+    CHECK_CONTIGUOUS(exp_xy);
+    CHECK_FLAT(exp_nxy);
+    CHECK_EVEN(exp_nxy);
+    CHECK_CONTIGUOUS(exp_nxy);
+    CHECK_FLAT(exp_xy_sum);
+    CHECK_EVEN(exp_xy_sum);
+    CHECK_CONTIGUOUS(exp_xy_sum);
+    CHECK_FLAT(exp_nxy_sum);
+    CHECK_EVEN(exp_nxy_sum);
+    CHECK_CONTIGUOUS(exp_nxy_sum);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+    at::Tensor grad_out = at::zeros_like(pos);
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeLogSumExpWirelengthGradAtomicLauncher", [&] {
+            computeLogSumExpWirelengthGradAtomicLauncher<scalar_t>(
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    pin2net_map.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    grad_pos.data<scalar_t>(),
+                    num_threads,
+                    grad_out.data<scalar_t>(), grad_out.data<scalar_t>()+num_pins
+                    );
+            });
+    return grad_out;
+}
+
+template <typename T>
+int computeLogSumExpWirelengthAtomicLauncher(
+        const T* x, const T* y,
+        const int* pin2net_map,
+        const int* netpin_start,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl,
+        int num_threads
+        )
+{
+    T tol = 80; // tolerance to trigger numeric adjustment, which may cause precision loss
+    if (num_nets == 0)
+    {
+        return 0;
+    }
+
+    // pins are grouped by ranges of nets with similar numbers of pins,
+    // so that each net is updated by only one thread without atomic operations;
+    // more ranges than threads balance the work
+    NetRangePins range_pins;
+    groupPinsByNetRanges(pin2net_map, net_mask, netpin_start, num_nets, num_pins, num_threads*4, num_threads, range_pins);
+    int num_ranges = range_pins.numRanges();
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+    for (int r = 0; r < num_ranges; ++r)
+    {
+        const int* pins = range_pins.pins.data();
+        int pin_begin = range_pins.pin_start[r];
+        int pin_end = range_pins.pin_start[r+1];
+        int net_begin = range_pins.net_start[r];
+        int net_end = range_pins.net_start[r+1];
+
+        // max/min of x and y for each net of the range
+        for (int i = net_begin; i < net_end; ++i)
+        {
+            xy_max[i] = xy_max[num_nets+i] = -std::numeric_limits<T>::max();
+            xy_min[i] = xy_min[num_nets+i] = std::numeric_limits<T>::max();
+        }
+        for (int j = pin_begin; j < pin_end; ++j)
+        {
+            int i = pins[j];
+            int net_id = pin2net_map[i];
+            xy_max[net_id] = std::max(xy_max[net_id], x[i]);
+            xy_max[num_nets+net_id] = std::max(xy_max[num_nets+net_id], y[i]);
+            xy_min[net_id] = std::min(xy_min[net_id], x[i]);
+            xy_min[num_nets+net_id] = std::min(xy_min[num_nets+net_id], y[i]);
+        }
+
+        // only shift the exponents when they are large enough to overflow
+        for (int k = 0; k < 2; ++k)
+        {
+            for (int i = k*num_nets+net_begin; i < k*num_nets+net_end; ++i)
+            {
+                if (xy_max[i] < tol*(*gamma))
+                {
+                    xy_max[i] = 0;
+                }
+                if (xy_min[i] > -tol*(*gamma))
+                {
+                    xy_min[i] = 0;
+                }
+            }
+        }
+
+        // exponentials and their sums
+        for (int j = pin_begin; j < pin_end; ++j)
+        {
+            int i = pins[j];
+            int net_id = pin2net_map[i];
+            exp_xy[i] = exp((x[i]-xy_max[net_id])/(*gamma));
+            exp_nxy[i] = exp(-(x[i]-xy_min[net_id])/(*gamma));
+            exp_xy[num_pins+i] = exp((y[i]-xy_max[num_nets+net_id])/(*gamma));
+            exp_nxy[num_pins+i] = exp(-(y[i]-xy_min[num_nets+net_id])/(*gamma));
+            exp_xy_sum[net_id] += exp_xy[i];
+            exp_xy_sum[num_nets+net_id] += exp_xy[num_pins+i];
+            exp_nxy_sum[net_id] += exp_nxy[i];
+            exp_nxy_sum[num_nets+net_id] += exp_nxy[num_pins+i];
+        }
+
+        for (int i = net_begin; i < net_end; ++i)
+        {
+            if (net_mask[i])
+            {
+                wl[i] = log(exp_xy_sum[i])*(*gamma) + xy_max[i]
+                    + log(exp_nxy_sum[i])*(*gamma) - xy_min[i]
+                    + log(exp_xy_sum[num_nets+i])*(*gamma) + xy_max[num_nets+i]
+                    + log(exp_nxy_sum[num_nets+i])*(*gamma) - xy_min[num_nets+i];
+            }
+        }
+    }
+
+    return 0;
+}
+
+template <typename T>
+int computeLogSumExpWirelengthGradAtomicLauncher(
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        )
+{
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < num_pins; ++i)
+    {
+        int net_id = pin2net_map[i];
+        if (net_id >= 0 && net_mask[net_id])
+        {
+            grad_x_tensor[i] = (exp_xy[i]/exp_xy_sum[net_id] - exp_nxy[i]/exp_nxy_sum[net_id])*(*grad_tensor);
+            grad_y_tensor[i] = (exp_xy[num_pins+i]/exp_xy_sum[num_nets+net_id] - exp_nxy[num_pins+i]/exp_nxy_sum[num_nets+net_id])*(*grad_tensor);
+        }
+    }
+
+    return 0;
+}
+
+DREAMPLACE_END_NAMESPACE
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  m.def("forward", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_atomic_forward, "LogSumExpWirelength forward (CPU atomic)");
+  m.def("backward", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_atomic_backward, "LogSumExpWirelength backward (CPU atomic)");
+}
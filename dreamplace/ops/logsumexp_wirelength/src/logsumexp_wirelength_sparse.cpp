@@ -0,0 +1,326 @@
+/**
+ * @file   logsumexp_wirelength_sparse.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Compute log-sum-exp wirelength and gradient with CSR net-to-pin map on CPU
+ */
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+#include "utility/src/parallel_reduce.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+template <typename T>
+int computeLogSumExpWirelengthSparseLauncher(
+        const T* x, const T* y,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl, // wirelength of each net
+        int num_threads
+        );
+
+template <typename T>
+int computeLogSumExpWirelengthGradSparseLauncher(
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        );
+
+#define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x " must be a flat tensor on CPU")
+#define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x " must have even number of elements")
+#define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x " must be contiguous")
+
+/// @brief Compute log-sum-exp wirelength with the CSR net-to-pin map.
+///     gamma * (log(\sum exp(x_i/gamma)) + log(\sum exp(-x_i/gamma)))
+/// The pins are evenly split among threads regardless of net degrees,
+/// and nets cut by thread boundaries are merged without atomic operations.
+/// @param pos location of pins, x array followed by y array.
+/// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param pin2net_map map pin to net
+/// @param net_mask whether compute the wirelength for a net or not
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param num_threads number of threads
+/// @return total wirelength cost with auxiliary tensors for backward propagation.
+std::vector<at::Tensor> logsumexp_wirelength_sparse_forward(
+        at::Tensor pos,
+        at::Tensor flat_netpin,
+        at::Tensor netpin_start,
+        at::Tensor pin2net_map,
+        at::Tensor net_mask,
+        at::Tensor gamma,
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(flat_netpin);
+    CHECK_CONTIGUOUS(flat_netpin);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    at::Tensor wl = at::zeros({num_nets}, pos.options());
+    at::Tensor exp_xy = at::zeros_like(pos);
+    at::Tensor exp_nxy = at::zeros_like(pos);
+    at::Tensor exp_xy_sum = at::zeros({2*num_nets}, pos.options());
+    at::Tensor exp_nxy_sum = at::zeros({2*num_nets}, pos.options());
+    at::Tensor xy_max = at::zeros({2*num_nets}, pos.options());
+    at::Tensor xy_min = at::zeros({2*num_nets}, pos.options());
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeLogSumExpWirelengthSparseLauncher", [&] {
+            computeLogSumExpWirelengthSparseLauncher<scalar_t>(
+                    pos.data<scalar_t>(), pos.data<scalar_t>()+num_pins,
+                    flat_netpin.data<int>(),
+                    netpin_start.data<int>(),
+                    pin2net_map.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    gamma.data<scalar_t>(),
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    xy_max.data<scalar_t>(), xy_min.data<scalar_t>(),
+                    wl.data<scalar_t>(),
+                    num_threads
+                    );
+            });
+
+    return {wl.sum(), exp_xy, exp_nxy, exp_xy_sum, exp_nxy_sum};
+}
+
+/// @brief Compute gradient
+/// @param grad_pos input gradient from back-propagation
+/// @param pos locations of pins
+/// @param exp_xy array of exp(x/gamma) and then exp(y/gamma)
+/// @param exp_nxy array of exp(-x/gamma) and then exp(-y/gamma)
+/// @param exp_xy_sum array of \sum(exp(x/gamma)) for each net and then \sum(exp(y/gamma))
+/// @param exp_nxy_sum array of \sum(exp(-x/gamma)) for each net and then \sum(exp(-y/gamma))
+/// @param pin2net_map map pin to net
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param num_threads number of threads
+at::Tensor logsumexp_wirelength_sparse_backward(
+        at::Tensor grad_pos,
+        at::Tensor pos,
+        at::Tensor exp_xy, at::Tensor exp_nxy,
+        at::Tensor exp_xy_sum, at::Tensor exp_nxy_sum,
+        at::Tensor pin2net_map,
+        at::Tensor net_mask,
+        at::Tensor gamma, // a scalar tensor
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(exp_xy);
+    CHECK_EVEN(exp_xy);
+    CHECK_CONTIGUOUS(exp_xy);
+    CHECK_FLAT(exp_nxy);
+    CHECK_EVEN(exp_nxy);
+    CHECK_CONTIGUOUS(exp_nxy);
+    CHECK_FLAT(exp_xy_sum);
+    CHECK_EVEN(exp_xy_sum);
+    CHECK_CONTIGUOUS(exp_xy_sum);
+    CHECK_FLAT(exp_nxy_sum);
+    CHECK_EVEN(exp_nxy_sum);
+    CHECK_CONTIGUOUS(exp_nxy_sum);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+    at::Tensor grad_out = at::zeros_like(pos);
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeLogSumExpWirelengthGradSparseLauncher", [&] {
+            computeLogSumExpWirelengthGradSparseLauncher<scalar_t>(
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    pin2net_map.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    grad_pos.data<scalar_t>(),
+                    num_threads,
+                    grad_out.data<scalar_t>(), grad_out.data<scalar_t>()+num_pins
+                    );
+            });
+    return grad_out;
+}
+
+/// @brief bounding box of a net
+template <typename T>
+struct LogSumExpNetBox
+{
+    T x_max;
+    T y_max;
+    T x_min;
+    T y_min;
+};
+
+/// @brief sums of exponentials of a net
+template <typename T>
+struct LogSumExpNetSum
+{
+    T exp_x_sum;
+    T exp_y_sum;
+    T exp_nx_sum;
+    T exp_ny_sum;
+};
+
+template <typename T>
+int computeLogSumExpWirelengthSparseLauncher(
+        const T* x, const T* y,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl,
+        int num_threads
+        )
+{
+    typedef LogSumExpNetBox<T> Box;
+    typedef LogSumExpNetSum<T> Sum;
+    T tol = 80; // tolerance to trigger numeric adjustment, which may cause precision loss
+
+    // max/min of x and y for each net
+    segmentedReduceNetPins<Box>(flat_netpin, netpin_start, num_nets, num_threads,
+            []() {
+                T inf = std::numeric_limits<T>::max();
+                return Box {-inf, -inf, inf, inf};
+            },
+            [&](int net_id, int pin_id, Box& box) {
+                if (net_mask[net_id])
+                {
+                    box.x_max = std::max(box.x_max, x[pin_id]);
+                    box.y_max = std::max(box.y_max, y[pin_id]);
+                    box.x_min = std::min(box.x_min, x[pin_id]);
+                    box.y_min = std::min(box.y_min, y[pin_id]);
+                }
+            },
+            [](Box& box, const Box& other) {
+                box.x_max = std::max(box.x_max, other.x_max);
+                box.y_max = std::max(box.y_max, other.y_max);
+                box.x_min = std::min(box.x_min, other.x_min);
+                box.y_min = std::min(box.y_min, other.y_min);
+            },
+            [&](int net_id, const Box& box) {
+                // only shift the exponents when they are large enough to overflow
+                xy_max[net_id] = (box.x_max < tol*(*gamma))? 0 : box.x_max;
+                xy_max[num_nets+net_id] = (box.y_max < tol*(*gamma))? 0 : box.y_max;
+                xy_min[net_id] = (box.x_min > -tol*(*gamma))? 0 : box.x_min;
+                xy_min[num_nets+net_id] = (box.y_min > -tol*(*gamma))? 0 : box.y_min;
+            }
+            );
+
+    // exponentials are independent for each pin
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < num_pins; ++i)
+    {
+        int net_id = pin2net_map[i];
+        if (net_id >= 0 && net_mask[net_id])
+        {
+            exp_xy[i] = exp((x[i]-xy_max[net_id])/(*gamma));
+            exp_nxy[i] = exp(-(x[i]-xy_min[net_id])/(*gamma));
+            exp_xy[num_pins+i] = exp((y[i]-xy_max[num_nets+net_id])/(*gamma));
+            exp_nxy[num_pins+i] = exp(-(y[i]-xy_min[num_nets+net_id])/(*gamma));
+        }
+    }
+
+    // sums of exponentials and wirelength for each net
+    segmentedReduceNetPins<Sum>(flat_netpin, netpin_start, num_nets, num_threads,
+            []() {
+                return Sum {0, 0, 0, 0};
+            },
+            [&](int net_id, int pin_id, Sum& sum) {
+                sum.exp_x_sum += exp_xy[pin_id];
+                sum.exp_y_sum += exp_xy[num_pins+pin_id];
+                sum.exp_nx_sum += exp_nxy[pin_id];
+                sum.exp_ny_sum += exp_nxy[num_pins+pin_id];
+            },
+            [](Sum& sum, const Sum& other) {
+                sum.exp_x_sum += other.exp_x_sum;
+                sum.exp_y_sum += other.exp_y_sum;
+                sum.exp_nx_sum += other.exp_nx_sum;
+                sum.exp_ny_sum += other.exp_ny_sum;
+            },
+            [&](int net_id, const Sum& sum) {
+                if (!net_mask[net_id])
+                {
+                    return;
+                }
+                exp_xy_sum[net_id] = sum.exp_x_sum;
+                exp_xy_sum[num_nets+net_id] = sum.exp_y_sum;
+                exp_nxy_sum[net_id] = sum.exp_nx_sum;
+                exp_nxy_sum[num_nets+net_id] = sum.exp_ny_sum;
+                wl[net_id] = log(sum.exp_x_sum)*(*gamma) + xy_max[net_id]
+                    + log(sum.exp_nx_sum)*(*gamma) - xy_min[net_id]
+                    + log(sum.exp_y_sum)*(*gamma) + xy_max[num_nets+net_id]
+                    + log(sum.exp_ny_sum)*(*gamma) - xy_min[num_nets+net_id];
+            }
+            );
+
+    return 0;
+}
+
+template <typename T>
+int computeLogSumExpWirelengthGradSparseLauncher(
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        )
+{
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < num_pins; ++i)
+    {
+        int net_id = pin2net_map[i];
+        if (net_id >= 0 && net_mask[net_id])
+        {
+            grad_x_tensor[i] = (exp_xy[i]/exp_xy_sum[net_id] - exp_nxy[i]/exp_nxy_sum[net_id])*(*grad_tensor);
+            grad_y_tensor[i] = (exp_xy[num_pins+i]/exp_xy_sum[num_nets+net_id] - exp_nxy[num_pins+i]/exp_nxy_sum[num_nets+net_id])*(*grad_tensor);
+        }
+    }
+
+    return 0;
+}
+
+DREAMPLACE_END_NAMESPACE
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  m.def("forward", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_sparse_forward, "LogSumExpWirelength forward (CPU sparse)");
+  m.def("backward", &DREAMPLACE_NAMESPACE::logsumexp_wirelength_sparse_backward, "LogSumExpWirelength backward (CPU sparse)");
+}
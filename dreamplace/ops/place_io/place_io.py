@@ -21,5 +21,7 @@ class PlaceIOFunction(Function):
             args += " --def_input %s" % (params.def_input)
         if "verilog_input" in params.__dict__:
             args += " --verilog_input %s" % (params.verilog_input)
+        if "ignore_net_degree" in params.__dict__:
+            args += " --ignore_net_degree %d" % (params.ignore_net_degree)
 
         return place_io_cpp.forward(args.split(' '))
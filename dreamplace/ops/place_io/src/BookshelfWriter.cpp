@@ -82,15 +82,18 @@ bool BookShelfWriter::writeNodes(std::string const& outFileNoSuffix) const
     fprintf(out, "NumTerminals : %lu\n", m_db.numFixed()+m_db.numIOPin());
     fprintf(out, "\n");
 
-    // write movable nodes 
-    for (MovableNodeConstIterator it = m_db.movableNodeBegin(); it.inRange(); ++it)
-        fprintf(out, "%s %ld %ld\n", m_db.nodeName(*it).c_str(), it->width(), it->height());
-    // write io pins 
-    for (IOPinNodeConstIterator it = m_db.iopinNodeBegin(); it.inRange(); ++it)
-        fprintf(out, "%s %ld %ld terminal_NI\n", m_db.nodeName(*it).c_str(), it->width(), it->height());
-    // write fixed nodes 
-    for (FixedNodeConstIterator it = m_db.fixedNodeBegin(); it.inRange(); ++it)
-        fprintf(out, "%s %ld %ld terminal\n", m_db.nodeName(*it).c_str(), it->width(), it->height());
+    // write nodes in the order of input files 
+    std::vector<index_type> const vNodeOld2New = m_db.nodeOld2NewMap();
+    for (std::vector<index_type>::const_iterator it = vNodeOld2New.begin(), ite = vNodeOld2New.end(); it != ite; ++it)
+    {
+        Node const& node = vNode[*it]; 
+        fprintf(out, "%s %ld %ld", m_db.nodeName(node).c_str(), node.width(), node.height());
+        if (node.id() >= m_db.numMovable()+m_db.numFixed()) // io pins 
+            fprintf(out, " terminal_NI"); 
+        else if (node.id() >= m_db.numMovable()) // fixed nodes 
+            fprintf(out, " terminal"); 
+        fprintf(out, "\n"); 
+    }
 
     closeFile(out);
     return true;
@@ -111,9 +114,11 @@ bool BookShelfWriter::writeNets(std::string const& outFileNoSuffix) const
     // write total number of pins 
     fprintf(out, "NumPins : %lu\n", vPin.size());
     fprintf(out, "\n");
-    // write nets 
-    for (std::vector<Net>::const_iterator it = vNet.begin(), ite = vNet.end(); it != ite; ++it)
+    // write nets in the order of input files 
+    std::vector<index_type> const vNetOld2New = m_db.netOld2NewMap();
+    for (std::vector<index_type>::const_iterator itn = vNetOld2New.begin(), itne = vNetOld2New.end(); itn != itne; ++itn)
     {
+        std::vector<Net>::const_iterator it = vNet.begin()+*itn;
         std::vector<index_type> const& vNetPin = it->pins();
         fprintf(out, "NetDegree : %lu %s\n", vNetPin.size(), m_db.netName(*it).c_str());
         for (std::vector<index_type>::const_iterator itp = vNetPin.begin(), itpe = vNetPin.end(); itp != itpe; ++itp)
@@ -202,10 +207,12 @@ bool BookShelfWriter::writePlx(std::string const& outFileNoSuffix) const
 
     writeHeader(out, "pl"); // use pl instead of plx to accommodate parser
 
+    // write nodes in the order of input files 
     std::vector<Node> const& vNode = m_db.nodes();
-    for (std::vector<Node>::const_iterator it = vNode.begin(), ite = vNode.end(); it != ite; ++it)
+    std::vector<index_type> const vNodeOld2New = m_db.nodeOld2NewMap();
+    for (std::vector<index_type>::const_iterator it = vNodeOld2New.begin(), ite = vNodeOld2New.end(); it != ite; ++it)
     {
-        Node const& node = *it; 
+        Node const& node = vNode[*it]; 
         fprintf(out, "%s %d %d : %s", m_db.nodeName(node).c_str(), node.xl(), node.yl(), std::string(Orient(node.orient())).c_str());
         if (node.id() < m_db.numMovable()+m_db.numFixed() && node.status() == PlaceStatusEnum::FIXED) // fixed instance
             fprintf(out, " /FIXED"); 
@@ -271,20 +278,21 @@ bool BookShelfWriter::writeRoute(std::string const& outFileNoSuffix) const
     fprintf(out, "BlockagePorosity : %d\n", blockagePorosity); 
     fprintf(out, "\n"); 
 
-    // routing blockages from fixed instances 
+    // routing blockages from fixed instances in the order of input files 
     std::vector<Node> const& vNode = m_db.nodes();
+    std::vector<index_type> const vNodeOld2New = m_db.nodeOld2NewMap();
     int numBlockages = 0; 
-    for (std::vector<Node>::const_iterator it = vNode.begin(), ite = vNode.end(); it != ite; ++it)
+    for (std::vector<index_type>::const_iterator it = vNodeOld2New.begin(), ite = vNodeOld2New.end(); it != ite; ++it)
     {
-        Node const& node = *it; 
+        Node const& node = vNode[*it]; 
         if (node.status() == PlaceStatusEnum::FIXED || node.status() == PlaceStatusEnum::DUMMY_FIXED)
             ++numBlockages; 
     }
     fprintf(out, "NumBlockageNodes : %d\n", numBlockages); 
     fprintf(out, "\n"); 
-    for (std::vector<Node>::const_iterator it = vNode.begin(), ite = vNode.end(); it != ite; ++it)
+    for (std::vector<index_type>::const_iterator it = vNodeOld2New.begin(), ite = vNodeOld2New.end(); it != ite; ++it)
     {
-        Node const& node = *it; 
+        Node const& node = vNode[*it]; 
         if (node.status() == PlaceStatusEnum::FIXED || node.status() == PlaceStatusEnum::DUMMY_FIXED)
         {
             fprintf(out, "%s : %d ", m_db.nodeName(node).c_str(), numBlockedLayer);
@@ -66,6 +66,7 @@ UserParam::UserParam()
 
     fileFormat = DEF;
     maxIters = 6;
+    ignoreNetDegree = 100;
 }
 bool UserParam::read(int argc, char** argv)
 {
@@ -150,6 +151,7 @@ bool UserParam::readNormal(int argc, char** argv, UserParamExtHelper const& help
         .add_option(Value<std::string>("--draw_region", &drawRegionStr, "draw placement region").default_value(defaultDrawRegionStr))
         .add_option(Value<std::string>("--file_format", &fileFormatStr, "file format to write placement solution <DEF | DEFSIMPLE | BOOKSHELF | BOOKSHELFALL>").default_value(toString(defaultParam.fileFormat)))
         .add_option(Value<unsigned>("--max_iters", &maxIters, "maximum optimization iterations").default_value(defaultParam.maxIters))
+        .add_option(Value<unsigned>("--ignore_net_degree", &ignoreNetDegree, "ignore nets with more pins when ordering cells by connectivity").default_value(defaultParam.ignoreNetDegree))
         ;
     helper.addOptions(desc); // extension
 
@@ -373,6 +375,7 @@ void UserParam::printParams() const
     dreamplacePrint(kINFO, "cluster_cell = %s\n", ((clusterCell)? "true" : "false"));
     dreamplacePrint(kINFO, "file_format = %s\n", toString(fileFormat).c_str());
     dreamplacePrint(kINFO, "max_iters = %u\n", maxIters);
+    dreamplacePrint(kINFO, "ignore_net_degree = %u\n", ignoreNetDegree);
 }
 
 void UserParam::printWelcome() const 
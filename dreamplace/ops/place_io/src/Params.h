@@ -117,6 +117,7 @@ struct UserParam
     /// additional options
     SolutionFileFormat fileFormat; ///< file format to write placement solution 
     unsigned maxIters; ///< maximum optimization iterations 
+    unsigned ignoreNetDegree; ///< nets with more pins are ignored when ordering cells by connectivity 
 
     protected:
         /// read command line options
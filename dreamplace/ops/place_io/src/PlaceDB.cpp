@@ -1139,9 +1139,20 @@ void PlaceDB::adjustParams()
     dreamplacePrint(kWARN, "%lu nets with %lu pins from same nodes\n", m_numNetsWithDuplicatePins, m_numPinsDuplicatedInNets);
     dreamplacePrint(kWARN, "%lu nets should be ignored due to not enough pins\n", std::count(m_vNetIgnoreFlag.begin(), m_vNetIgnoreFlag.end(), true));
 
+    // remember the order in input files for writers 
+    m_vNodeOrigIndex.resize(m_vNode.size()); 
+    for (index_type i = 0, ie = m_vNode.size(); i != ie; ++i)
+        m_vNodeOrigIndex[i] = i; 
+    m_vNetOrigIndex.resize(m_vNet.size()); 
+    for (index_type i = 0, ie = m_vNet.size(); i != ie; ++i)
+        m_vNetOrigIndex[i] = i; 
+
     // sort nodes such that 
     // movable cells are followed by fixed cells 
     sortNodeByPlaceStatus();
+    // sort movable nodes such that 
+    // connected cells have close indices 
+    sortNodeByConnectivity();
     // sort nets and pins such that 
     // nets are ordered from small to large degrees 
     // pins are ordered to have bulk locations for each net 
@@ -1270,18 +1281,41 @@ void PlaceDB::printNet(PlaceDB::index_type id) const
     }
 }
 
+/// @brief Invert the map from current index to index in input files. 
+/// Objects keep their current order if the map is not built yet. 
+static std::vector<PlaceDB::index_type> invertOrigIndex(std::vector<PlaceDB::index_type> const& vOrigIndex, std::size_t n)
+{
+    std::vector<PlaceDB::index_type> vOld2New (n); 
+    for (PlaceDB::index_type i = 0; i < n; ++i)
+        vOld2New[(vOrigIndex.size() == n)? vOrigIndex[i] : i] = i; 
+    return vOld2New; 
+}
+std::vector<PlaceDB::index_type> PlaceDB::nodeOld2NewMap() const
+{
+    return invertOrigIndex(m_vNodeOrigIndex, m_vNode.size()); 
+}
+std::vector<PlaceDB::index_type> PlaceDB::netOld2NewMap() const
+{
+    return invertOrigIndex(m_vNetOrigIndex, m_vNet.size()); 
+}
+
 struct ArgSortNetByDegree
 {
     std::vector<Net> const& vNet;
+    std::vector<PlaceDB::index_type> const& vNetNode; ///< smallest node id in each net 
 
-    ArgSortNetByDegree(std::vector<Net> const& v) : vNet(v)
+    ArgSortNetByDegree(std::vector<Net> const& v, std::vector<PlaceDB::index_type> const& vn) : vNet(v), vNetNode(vn)
     {
     }
+    /// nets with the same degree follow the order of nodes, 
+    /// so neighboring nets touch neighboring nodes 
     bool operator()(PlaceDB::index_type i, PlaceDB::index_type j) const 
     {
         PlaceDB::index_type degree1 = vNet[i].pins().size(); 
         PlaceDB::index_type degree2 = vNet[j].pins().size(); 
-        return degree1 < degree2 || (degree1 == degree2 && i < j);
+        return degree1 < degree2 
+            || (degree1 == degree2 && vNetNode[i] < vNetNode[j]) 
+            || (degree1 == degree2 && vNetNode[i] == vNetNode[j] && i < j);
     }
 };
 
@@ -1309,7 +1343,14 @@ void PlaceDB::sortNetByDegree()
     for (index_type i = 0, ie = vNetOrder.size(); i != ie; ++i)
         vNetOrder[i] = i; 
 
-    std::sort(vNetOrder.begin(), vNetOrder.end(), ArgSortNetByDegree(m_vNet));
+    std::vector<index_type> vNetNode (m_vNet.size(), std::numeric_limits<index_type>::max()); 
+    for (index_type i = 0, ie = m_vNet.size(); i != ie; ++i)
+    {
+        for (std::vector<index_type>::const_iterator it = m_vNet[i].pins().begin(), ite = m_vNet[i].pins().end(); it != ite; ++it)
+            vNetNode[i] = std::min(vNetNode[i], m_vPin[*it].nodeId()); 
+    }
+
+    std::sort(vNetOrder.begin(), vNetOrder.end(), ArgSortNetByDegree(m_vNet, vNetNode));
 
     // map net id to order 
     std::vector<index_type> vNetId2Order (m_vNet.size());
@@ -1332,6 +1373,8 @@ void PlaceDB::sortNetByDegree()
 
             std::swap( m_vNet[i], m_vNet[alt] );
             std::swap( m_vNetProperty[i], m_vNetProperty[alt] );
+            std::swap( m_vNetOrigIndex[i], m_vNetOrigIndex[alt] );
+            std::vector<bool>::swap( m_vNetIgnoreFlag[i], m_vNetIgnoreFlag[alt] );
 
             std::swap( vNetId2Order[i], vNetId2Order[alt] );
         }
@@ -1478,6 +1521,92 @@ void PlaceDB::sortNodeByPlaceStatus()
 
     std::sort(vNodeOrder.begin(), vNodeOrder.end(), ArgSortNodeByPlaceStatus(m_vNode));
 
+    permuteNodes(vNodeOrder); 
+    for (index_type i = 1, ie = vNodeOrder.size(); i != ie; ++i)
+    {
+        dreamplaceAssertMsg(ArgSortNodeByPlaceStatus::statusOrder(m_vNode[i-1].status()) <= ArgSortNodeByPlaceStatus::statusOrder(m_vNode[i].status()), "permuting nodes error"); 
+    }
+}
+
+struct ArgSortNodeByDegree
+{
+    std::vector<Node> const& vNode;
+
+    ArgSortNodeByDegree(std::vector<Node> const& v) : vNode(v)
+    {
+    }
+    bool operator()(PlaceDB::index_type i, PlaceDB::index_type j) const 
+    {
+        PlaceDB::index_type degree1 = vNode[i].pins().size(); 
+        PlaceDB::index_type degree2 = vNode[j].pins().size(); 
+        return degree1 < degree2 || (degree1 == degree2 && i < j);
+    }
+};
+
+void PlaceDB::sortNodeByConnectivity()
+{
+    dreamplacePrint(kINFO, "sort movable nodes with reverse Cuthill-McKee ordering on the netlist\n");
+    // nets with too many pins connect cells all over the layout, e.g., clock nets, 
+    // expanding them would put unrelated cells next to each other 
+    index_type const maxNetDegree = m_userParam.ignoreNetDegree; 
+    // only UNPLACED and PLACED cells are reordered, they come first after sortNodeByPlaceStatus() 
+    index_type numCells = 0; 
+    while (numCells < m_numMovable && m_vNode[numCells].status() != PlaceStatusEnum::DUMMY_FIXED)
+        ++numCells; 
+
+    // reverse Cuthill-McKee ordering for movable nodes 
+    // breadth-first search through nets, so large nets are not expanded into cliques 
+    // each search starts from an unvisited node with the smallest degree 
+    std::vector<index_type> vStartOrder (numCells); 
+    for (index_type i = 0; i < numCells; ++i)
+        vStartOrder[i] = i; 
+    std::sort(vStartOrder.begin(), vStartOrder.end(), ArgSortNodeByDegree(m_vNode)); 
+
+    std::vector<index_type> vNodeOrder; 
+    vNodeOrder.reserve(m_vNode.size()); 
+    std::vector<unsigned char> vNodeVisited (numCells, 0); 
+    std::vector<unsigned char> vNetVisited (m_vNet.size(), 0); 
+    for (std::vector<index_type>::const_iterator its = vStartOrder.begin(), itse = vStartOrder.end(); its != itse; ++its)
+    {
+        if (vNodeVisited[*its])
+            continue; 
+        vNodeVisited[*its] = 1; 
+        vNodeOrder.push_back(*its); 
+        for (index_type head = vNodeOrder.size()-1; head < vNodeOrder.size(); ++head)
+        {
+            index_type numOrdered = vNodeOrder.size(); 
+            Node const& node = m_vNode[vNodeOrder[head]]; 
+            for (std::vector<index_type>::const_iterator itp = node.pins().begin(), itpe = node.pins().end(); itp != itpe; ++itp)
+            {
+                Net const& net = m_vNet[m_vPin[*itp].netId()]; 
+                if (vNetVisited[net.id()] || net.pins().size() > maxNetDegree)
+                    continue; 
+                vNetVisited[net.id()] = 1; 
+                for (std::vector<index_type>::const_iterator itn = net.pins().begin(), itne = net.pins().end(); itn != itne; ++itn)
+                {
+                    index_type nodeId = m_vPin[*itn].nodeId(); 
+                    if (nodeId < numCells && !vNodeVisited[nodeId])
+                    {
+                        vNodeVisited[nodeId] = 1; 
+                        vNodeOrder.push_back(nodeId); 
+                    }
+                }
+            }
+            // neighbors are visited from small degree to large degree 
+            std::sort(vNodeOrder.begin()+numOrdered, vNodeOrder.end(), ArgSortNodeByDegree(m_vNode)); 
+        }
+    }
+    std::reverse(vNodeOrder.begin(), vNodeOrder.end()); 
+    // dummy fixed nodes, fixed nodes and io pins stay where they are 
+    for (index_type i = numCells, ie = m_vNode.size(); i < ie; ++i)
+        vNodeOrder.push_back(i); 
+
+    permuteNodes(vNodeOrder); 
+}
+
+void PlaceDB::permuteNodes(std::vector<index_type> const& vNodeOrder)
+{
+    dreamplaceAssert(vNodeOrder.size() == m_vNode.size()); 
     // map node id to order 
     std::vector<index_type> vNodeId2Order (m_vNode.size());
     for (index_type i = 0, ie = vNodeOrder.size(); i != ie; ++i)
@@ -1499,14 +1628,14 @@ void PlaceDB::sortNodeByPlaceStatus()
 
             std::swap( m_vNode[i], m_vNode[alt] );
             std::swap( m_vNodeProperty[i], m_vNodeProperty[alt] );
+            std::swap( m_vNodeOrigIndex[i], m_vNodeOrigIndex[alt] );
 
             std::swap( vNodeId2Order[i], vNodeId2Order[alt] );
         }
     }
-    for (index_type i = 1, ie = vNodeOrder.size(); i != ie; ++i)
+    for (index_type i = 0, ie = vNodeOrder.size(); i != ie; ++i)
     {
-        dreamplaceAssert(m_vNode[i].id() == vNodeOrder[i]); 
-        dreamplaceAssertMsg(ArgSortNodeByPlaceStatus::statusOrder(m_vNode[i-1].status()) <= ArgSortNodeByPlaceStatus::statusOrder(m_vNode[i].status()), "permuting nodes error"); 
+        dreamplaceAssertMsg(m_vNode[i].id() == vNodeOrder[i], "permuting nodes error"); 
     }
     // update node id and pin to node id 
     for (index_type i = 0, ie = m_vNode.size(); i != ie; ++i)
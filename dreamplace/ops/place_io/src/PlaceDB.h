@@ -243,6 +243,14 @@ class PlaceDB : public DefParser::DefDataBase
         /// sort nodes such that 
         /// movable cells are followed by fixed cells 
         void sortNodeByPlaceStatus();
+        /// sort unplaced and placed cells with reverse Cuthill-McKee ordering on the netlist 
+        /// such that connected cells have close indices, 
+        /// must be called after sortNodeByPlaceStatus() 
+        void sortNodeByConnectivity();
+        /// \return current node id of each node in the order of input files 
+        std::vector<index_type> nodeOld2NewMap() const;
+        /// \return current net id of each net in the order of input files 
+        std::vector<index_type> netOld2NewMap() const;
 
         /// \return site width 
         coordinate_type siteWidth() const {return m_site.width();}
@@ -380,6 +388,9 @@ class PlaceDB : public DefParser::DefDataBase
         void addPin(index_type macroPinId, Net& net, Node& node);
         /// lower level helper to addPin()
         Pin& createPin(Net& net, Node& node, SignalDirect const& direct, Point<coordinate_type> const& offset, index_type macroPinId);
+        /// move nodes to new indices and update pins and node indices 
+        /// \param vNodeOrder old node id of each new index 
+        void permuteNodes(std::vector<index_type> const& vNodeOrder);
 
         /// kernel data for placement 
         std::vector<Node> m_vNode; ///< instances, including movable and fixed instances, and virtual io pins (appended) 
@@ -410,6 +421,8 @@ class PlaceDB : public DefParser::DefDataBase
     
         std::vector<index_type> m_vMovableNodeIndex; ///< movable node index 
         std::vector<index_type> m_vFixedNodeIndex; ///< fixed node index 
+        std::vector<index_type> m_vNodeOrigIndex; ///< index of each node in input files, nodes are sorted in adjustParams() 
+        std::vector<index_type> m_vNetOrigIndex; ///< index of each net in input files, nets are sorted in adjustParams() 
 
         /// data only used in parsers
         int m_lefUnit;
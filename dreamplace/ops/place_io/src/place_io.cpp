@@ -198,6 +198,9 @@ struct PyPlaceDB
     pybind11::list pin2node_map; // 1D array, contain parent node id of each pin 
     pybind11::list pin2net_map; // 1D array, contain parent net id of each pin 
 
+    pybind11::list node_old2new_map; // 1D array, node id of each node in the order of input files 
+    pybind11::list net_old2new_map; // 1D array, net id of each net in the order of input files 
+
     pybind11::list rows; // NumRows x 4 array, stores xl, yl, xh, yh of each row 
 
     int xl; 
@@ -293,6 +296,19 @@ struct PyPlaceDB
         }
         flat_net2pin_start_map.append(count); 
 
+        // nodes and nets are renumbered for locality, 
+        // writers use these maps to keep the order of input files 
+        std::vector<PlaceDB::index_type> const vNodeOld2New = db.nodeOld2NewMap(); 
+        for (std::vector<PlaceDB::index_type>::const_iterator it = vNodeOld2New.begin(), ite = vNodeOld2New.end(); it != ite; ++it)
+        {
+            node_old2new_map.append(*it); 
+        }
+        std::vector<PlaceDB::index_type> const vNetOld2New = db.netOld2NewMap(); 
+        for (std::vector<PlaceDB::index_type>::const_iterator it = vNetOld2New.begin(), ite = vNetOld2New.end(); it != ite; ++it)
+        {
+            net_old2new_map.append(*it); 
+        }
+
         for (std::vector<Row>::const_iterator it = db.rows().begin(), ite = db.rows().end(); it != ite; ++it)
         {
             pybind11::tuple row = pybind11::make_tuple(it->xl(), it->yl(), it->xh(), it->yh()); 
@@ -392,6 +408,8 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
         .def_readwrite("flat_node2pin_start_map", &DREAMPLACE_NAMESPACE::PyPlaceDB::flat_node2pin_start_map)
         .def_readwrite("pin2node_map", &DREAMPLACE_NAMESPACE::PyPlaceDB::pin2node_map)
         .def_readwrite("pin2net_map", &DREAMPLACE_NAMESPACE::PyPlaceDB::pin2net_map)
+        .def_readwrite("node_old2new_map", &DREAMPLACE_NAMESPACE::PyPlaceDB::node_old2new_map)
+        .def_readwrite("net_old2new_map", &DREAMPLACE_NAMESPACE::PyPlaceDB::net_old2new_map)
         .def_readwrite("rows", &DREAMPLACE_NAMESPACE::PyPlaceDB::rows)
         .def_readwrite("xl", &DREAMPLACE_NAMESPACE::PyPlaceDB::xl)
         .def_readwrite("yl", &DREAMPLACE_NAMESPACE::PyPlaceDB::yl)
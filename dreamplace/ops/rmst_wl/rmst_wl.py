@@ -17,20 +17,30 @@ class RMSTWLFunction(Function):
   @param flat_netpin flat netpin map, length of #pins
   @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
   @param ignore_net_degree ignore nets with degree larger than some value
+  @param POWVFILE look-up table of flute for wirelength vectors, only loaded at the first call in a process
+  @param POSTFILE look-up table of flute for Steiner trees, only loaded at the first call in a process
+  @param num_threads number of threads
   """
   @staticmethod
-  def forward(ctx, pos, flat_netpin, netpin_start, ignore_net_degree, read_lut_flag, POWVFILE, POSTFILE):
+  def forward(ctx, pos, flat_netpin, netpin_start, ignore_net_degree, POWVFILE, POSTFILE, num_threads):
       output = pos.new_empty(netpin_start.numel()-1)
       if pos.is_cuda:
           assert 0, "CUDA version NOT IMPLEMENTED"
           rmst_wl_cuda.forward(pos.view(pos.numel()), flat_netpin, netpin_start, ignore_net_degree, output)
       else:
-          rmst_wl_cpp.forward(pos.view(pos.numel()), flat_netpin, netpin_start, ignore_net_degree, read_lut_flag, POWVFILE, POSTFILE, output)
+          rmst_wl_cpp.forward(pos.view(pos.numel()), flat_netpin, netpin_start, ignore_net_degree, POWVFILE, POSTFILE, num_threads, output)
       return output
 
 
 class RMSTWL(nn.Module):
-    def __init__(self, flat_netpin, netpin_start, ignore_net_degree=None, POWVFILE="POWV9.dat", POSTFILE="POST9.dat"):
+    """
+    @brief compute rectilinear Steiner minimum tree wirelength with flute.
+    With cache_topology, the flute topology of each net is kept between calls on CPU,
+    and only nets whose pins change their order in x or y get new topologies.
+    Flute chooses topologies by the distances between pins, so a kept topology may be longer than a fresh one
+    after large moves; each topology is rebuilt after rebuild_interval reuses to bound this error.
+    """
+    def __init__(self, flat_netpin, netpin_start, ignore_net_degree=None, POWVFILE="POWV9.dat", POSTFILE="POST9.dat", num_threads=8, cache_topology=False, rebuild_interval=10):
         super(RMSTWL, self).__init__()
         self.flat_netpin = flat_netpin
         self.netpin_start = netpin_start
@@ -40,12 +50,31 @@ class RMSTWL(nn.Module):
             self.ignore_net_degree = ignore_net_degree
         self.POWVFILE = POWVFILE
         self.POSTFILE = POSTFILE
-    def forward(self, pos, read_lut_flag):
+        self.num_threads = num_threads
+        self.cache_topology = cache_topology
+        self.rebuild_interval = rebuild_interval
+        # topologies of nets, built at the first call
+        self.cache = None
+    def forward(self, pos):
+        if self.cache_topology and not pos.is_cuda:
+            if self.cache is None:
+                self.cache = rmst_wl_cpp.SteinerTopologyCache(
+                        self.flat_netpin,
+                        self.netpin_start,
+                        int(self.ignore_net_degree),
+                        self.POWVFILE,
+                        self.POSTFILE,
+                        self.num_threads,
+                        self.rebuild_interval
+                        )
+            output = pos.new_empty(self.netpin_start.numel()-1)
+            self.cache.forward(pos.view(pos.numel()), output)
+            return output
         return RMSTWLFunction.apply(pos,
                 self.flat_netpin,
                 self.netpin_start,
                 self.ignore_net_degree,
-                read_lut_flag,
                 self.POWVFILE,
-                self.POSTFILE
+                self.POSTFILE,
+                self.num_threads
                 )
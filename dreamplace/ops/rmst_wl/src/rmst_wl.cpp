@@ -3,6 +3,9 @@
  * @author Xu Li
  * @date   10 2024
  */
+#include <mutex>
+#include <string>
+#include <algorithm>
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
 
@@ -10,6 +13,10 @@ extern "C"
 {
 #include <flute.h>
 }
+// flute.h defines function-like macros which clash with the standard library
+#undef max
+#undef min
+#undef abs
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -20,9 +27,9 @@ int computeRMSTWLLauncher(
         const int* netpin_start,
         const int ignore_net_degree,
         int num_nets,
-        int read_lut_flag,
         const char* POWVFILE,
         const char* POSTFILE,
+        int num_threads,
         T* rmst_wl
         );
 
@@ -30,14 +37,32 @@ int computeRMSTWLLauncher(
 #define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x "must have even number of elements")
 #define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x "must be contiguous")
 
+/// @brief Load the look-up tables of flute once per process.
+/// flute keeps them in global arrays, which are only read by flute_wl afterwards,
+/// so nets can be evaluated in parallel once the tables are loaded.
+void loadFluteLUT(const char* POWVFILE, const char* POSTFILE)
+{
+    static std::once_flag flag;
+    std::call_once(flag, readLUT, POWVFILE, POSTFILE);
+}
+
+/// @brief Compute rectilinear Steiner minimum tree wirelength of each net with flute
+/// @param pos pin locations, array of x locations and then y locations
+/// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param ignore_net_degree nets with degree no less than this value are ignored
+/// @param POWVFILE look-up table of flute for wirelength vectors
+/// @param POSTFILE look-up table of flute for Steiner trees
+/// @param num_threads number of threads
+/// @param rmst_wl output wirelength of each net
 int rmst_wl_forward(
         at::Tensor pos,
         at::Tensor flat_netpin,
         at::Tensor netpin_start,
         int ignore_net_degree,
-        int read_lut_flag,
         const char* POWVFILE,
         const char* POSTFILE,
+        int num_threads,
         at::Tensor rmst_wl)
 {
     CHECK_FLAT(pos);
@@ -58,9 +83,9 @@ int rmst_wl_forward(
                     netpin_start.data<int>(),
                     ignore_net_degree,
                     netpin_start.numel()-1,
-                    read_lut_flag,
                     POWVFILE,
                     POSTFILE,
+                    num_threads,
                     rmst_wl.data<scalar_t>()
                     );
             });
@@ -74,50 +99,336 @@ int computeRMSTWLLauncher(
         const int* netpin_start,
         const int ignore_net_degree,
         int num_nets,
-        int read_lut_flag,
         const char* POWVFILE,
         const char* POSTFILE,
+        int num_threads,
         T* rmst_wl
         )
 {
-    // read look-up table for flute
-    if (read_lut_flag)
+    loadFluteLUT(POWVFILE, POSTFILE);
+
+    int scale = 1000; // scale factor, flute only supports integer
+#pragma omp parallel num_threads(num_threads)
     {
-        readLUT(POWVFILE, POSTFILE);
+        // per-thread buffers to temporarily store x and y positions
+        std::vector<int> vx (MAXD, 0);
+        std::vector<int> vy (MAXD, 0);
+#pragma omp for schedule(dynamic, 64)
+        for (int i = 0; i < num_nets; ++i)
+        {
+            int degree = netpin_start[i+1]-netpin_start[i];
+            // ignore large degree nets, flute cannot handle more than MAXD pins either
+            if (degree < 2 || degree >= ignore_net_degree || degree > MAXD)
+            {
+                rmst_wl[i] = 0;
+                continue;
+            }
+
+            for (int j = netpin_start[i], k = 0; j < netpin_start[i+1]; ++j, ++k)
+            {
+                vx[k] = x[flat_netpin[j]]*scale;
+                vy[k] = y[flat_netpin[j]]*scale;
+            }
+            int wl = flute_wl(degree, vx.data(), vy.data(), ACCURACY);
+            rmst_wl[i] = wl/(T)scale;
+        }
     }
-    // temporary store x and y positions
-    std::vector<int> vx (ignore_net_degree, 0);
-    std::vector<int> vy (ignore_net_degree, 0);
+
+    return 0;
+}
+
+/// @brief Rectilinear Steiner minimum tree wirelength with the flute topology of each net kept between calls.
+/// A topology is kept as the neighbor of each tree node, and the pins that give the x and y coordinates of each node,
+/// since flute places all Steiner points on the Hanan grid.
+/// As long as the pins of a net keep their order in both x and y,
+/// the wirelength is re-evaluated on the cached tree instead of calling flute again.
+/// The re-evaluated tree is a valid Steiner tree, but flute picks topologies from the distances between pins,
+/// so the cached tree gets longer than a fresh one when pins move far without changing their order.
+/// Each topology is therefore rebuilt after it has been reused rebuild_interval times.
+/// The first rebuilds are staggered by net, so about 1/rebuild_interval of the nets are rebuilt in each call.
+class SteinerTopologyCache
+{
+    public:
+        /// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
+        /// @param netpin_start similar to the IA array in CSR format, the length is number of nets + 1
+        /// @param ignore_net_degree nets with degree no less than this value are ignored
+        /// @param POWVFILE look-up table of flute for wirelength vectors
+        /// @param POSTFILE look-up table of flute for Steiner trees
+        /// @param num_threads number of threads
+        /// @param rebuild_interval number of reuses before a topology is rebuilt, non-positive values never rebuild unchanged nets
+        SteinerTopologyCache(
+                at::Tensor flat_netpin,
+                at::Tensor netpin_start,
+                int ignore_net_degree,
+                std::string POWVFILE,
+                std::string POSTFILE,
+                int num_threads,
+                int rebuild_interval
+                );
+
+        /// @brief compute the wirelength of each net, topologies are only rebuilt for nets whose pin order changes
+        /// @param pos pin locations, array of x locations and then y locations
+        /// @param rmst_wl output wirelength of each net
+        void forward(at::Tensor pos, at::Tensor rmst_wl);
+        /// @return number of nets whose topologies were rebuilt by the last call
+        int numRebuiltNets() const {return m_num_rebuilt_nets;}
+
+    protected:
+        template <typename T>
+        void computeNets(const T* x, const T* y, T* rmst_wl);
+        /// @brief evaluate the cached topology of a net
+        /// @param vx scaled x coordinates of the pins of the net
+        /// @param vy scaled y coordinates of the pins of the net
+        /// @param wl output wirelength in scaled coordinates
+        /// @return false if there is no cached topology, it has been reused for rebuild_interval times, or the order of pins changes
+        bool evaluateTopology(int net_id, const int* vx, const int* vy, int& wl) const;
+        /// @brief build and cache the topology of a net with flute
+        /// @param vx scaled x coordinates of the pins of the net
+        /// @param vy scaled y coordinates of the pins of the net
+        /// @param sorted thread-local buffer with the length of net degree
+        /// @return wirelength in scaled coordinates
+        int buildTopology(int net_id, int* vx, int* vy, std::vector<int>& sorted);
+
+        at::Tensor m_flat_netpin;
+        at::Tensor m_netpin_start;
+        int m_ignore_net_degree;
+        std::string m_powv_file;
+        std::string m_post_file;
+        int m_num_threads;
+        int m_rebuild_interval;
+        int m_num_nets;
+        int m_num_rebuilt_nets;
+
+        std::vector<int> m_order_x; ///< pins of each net sorted by x, indexed from 0 in each net, in CSR format by netpin_start
+        std::vector<int> m_order_y; ///< pins of each net sorted by y
+        std::vector<int> m_node_start; ///< starting index of the tree nodes of each net, a net of degree d has 2d-2 nodes
+        std::vector<int> m_node_x_pin; ///< pin giving the x coordinate of each tree node
+        std::vector<int> m_node_y_pin; ///< pin giving the y coordinate of each tree node
+        std::vector<int> m_node_neighbor; ///< neighbor of each tree node, indexed from 0 in each net
+        std::vector<unsigned char> m_cached; ///< whether a net has a cached topology
+        std::vector<int> m_num_reuses; ///< number of times the cached topology of each net has been reused
+};
+
+SteinerTopologyCache::SteinerTopologyCache(
+        at::Tensor flat_netpin,
+        at::Tensor netpin_start,
+        int ignore_net_degree,
+        std::string POWVFILE,
+        std::string POSTFILE,
+        int num_threads,
+        int rebuild_interval
+        )
+    : m_flat_netpin(flat_netpin)
+    , m_netpin_start(netpin_start)
+    , m_ignore_net_degree(ignore_net_degree)
+    , m_powv_file(POWVFILE)
+    , m_post_file(POSTFILE)
+    , m_num_threads(num_threads)
+    , m_rebuild_interval(rebuild_interval)
+    , m_num_rebuilt_nets(0)
+{
+    CHECK_FLAT(flat_netpin);
+    CHECK_CONTIGUOUS(flat_netpin);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+
+    const int* start = netpin_start.data<int>();
+    m_num_nets = netpin_start.numel()-1;
+    m_order_x.assign(flat_netpin.numel(), 0);
+    m_order_y.assign(flat_netpin.numel(), 0);
+    m_node_start.assign(m_num_nets+1, 0);
+    for (int i = 0; i < m_num_nets; ++i)
+    {
+        int degree = start[i+1]-start[i];
+        m_node_start[i+1] = m_node_start[i] + ((degree >= 2)? 2*degree-2 : 0);
+    }
+    m_node_x_pin.assign(m_node_start.back(), 0);
+    m_node_y_pin.assign(m_node_start.back(), 0);
+    m_node_neighbor.assign(m_node_start.back(), 0);
+    m_cached.assign(m_num_nets, 0);
+    // stagger the first rebuilds so they do not all happen in the same call
+    m_num_reuses.assign(m_num_nets, 0);
+    if (m_rebuild_interval > 0)
+    {
+        for (int i = 0; i < m_num_nets; ++i)
+        {
+            m_num_reuses[i] = i%m_rebuild_interval;
+        }
+    }
+}
+
+void SteinerTopologyCache::forward(at::Tensor pos, at::Tensor rmst_wl)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(rmst_wl);
+    CHECK_CONTIGUOUS(rmst_wl);
+
+    loadFluteLUT(m_powv_file.c_str(), m_post_file.c_str());
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "SteinerTopologyCache::computeNets", [&] {
+            computeNets<scalar_t>(
+                    pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2,
+                    rmst_wl.data<scalar_t>()
+                    );
+            });
+}
+
+template <typename T>
+void SteinerTopologyCache::computeNets(const T* x, const T* y, T* rmst_wl)
+{
+    const int* flat_netpin = m_flat_netpin.data<int>();
+    const int* netpin_start = m_netpin_start.data<int>();
     int scale = 1000; // scale factor, flute only supports integer
-    for (int i = 0; i < num_nets; ++i)
+    int num_rebuilt_nets = 0;
+#pragma omp parallel num_threads(m_num_threads) reduction(+:num_rebuilt_nets)
     {
-        int degree = netpin_start[i+1]-netpin_start[i];
-        // ignore large degree nets
-        if (degree >= ignore_net_degree)
+        // per-thread buffers to temporarily store x and y positions
+        std::vector<int> vx (MAXD, 0);
+        std::vector<int> vy (MAXD, 0);
+        std::vector<int> sorted (MAXD, 0);
+#pragma omp for schedule(dynamic, 64)
+        for (int i = 0; i < m_num_nets; ++i)
         {
-            rmst_wl[i] = 0;
-            continue;
+            int degree = netpin_start[i+1]-netpin_start[i];
+            // ignore large degree nets, flute cannot handle more than MAXD pins either
+            if (degree < 2 || degree >= m_ignore_net_degree || degree > MAXD)
+            {
+                rmst_wl[i] = 0;
+                continue;
+            }
+
+            for (int j = netpin_start[i], k = 0; j < netpin_start[i+1]; ++j, ++k)
+            {
+                vx[k] = x[flat_netpin[j]]*scale;
+                vy[k] = y[flat_netpin[j]]*scale;
+            }
+            int wl = 0;
+            if (evaluateTopology(i, vx.data(), vy.data(), wl))
+            {
+                m_num_reuses[i] += 1;
+            }
+            else
+            {
+                wl = buildTopology(i, vx.data(), vy.data(), sorted);
+                num_rebuilt_nets += 1;
+            }
+            rmst_wl[i] = wl/(T)scale;
         }
+    }
+    m_num_rebuilt_nets = num_rebuilt_nets;
+}
+
+bool SteinerTopologyCache::evaluateTopology(int net_id, const int* vx, const int* vy, int& wl) const
+{
+    if (!m_cached[net_id] || (m_rebuild_interval > 0 && m_num_reuses[net_id] >= m_rebuild_interval))
+    {
+        return false;
+    }
 
-        std::fill(vx.begin(), vx.end(), 0);
-        std::fill(vy.begin(), vy.end(), 0);
-        for (int j = netpin_start[i], k = 0; j < netpin_start[i+1]; ++j, ++k)
+    const int* netpin_start = m_netpin_start.data<int>();
+    int degree = netpin_start[net_id+1]-netpin_start[net_id];
+    const int* order_x = m_order_x.data()+netpin_start[net_id];
+    const int* order_y = m_order_y.data()+netpin_start[net_id];
+    for (int k = 1; k < degree; ++k)
+    {
+        if (vx[order_x[k-1]] > vx[order_x[k]] || vy[order_y[k-1]] > vy[order_y[k]])
         {
-            vx[k] = x[flat_netpin[j]]*scale;
-            vy[k] = y[flat_netpin[j]]*scale;
+            return false;
         }
-        //printf("net %d degree %d\n", i, degree);
-        int wl = flute_wl(degree, vx.data(), vy.data(), ACCURACY);
-        //printf("net %d wl %g\n", i, wl/(double)scale);
-        rmst_wl[i] = wl/(T)scale;
     }
 
-    return 0;
+    int begin = m_node_start[net_id];
+    int num_nodes = m_node_start[net_id+1]-begin;
+    const int* x_pin = m_node_x_pin.data()+begin;
+    const int* y_pin = m_node_y_pin.data()+begin;
+    const int* neighbor = m_node_neighbor.data()+begin;
+    wl = 0;
+    for (int k = 0; k < num_nodes; ++k)
+    {
+        int n = neighbor[k];
+        wl += std::abs(vx[x_pin[k]]-vx[x_pin[n]]) + std::abs(vy[y_pin[k]]-vy[y_pin[n]]);
+    }
+    return true;
+}
+
+int SteinerTopologyCache::buildTopology(int net_id, int* vx, int* vy, std::vector<int>& sorted)
+{
+    const int* netpin_start = m_netpin_start.data<int>();
+    int degree = netpin_start[net_id+1]-netpin_start[net_id];
+    int* order_x = m_order_x.data()+netpin_start[net_id];
+    int* order_y = m_order_y.data()+netpin_start[net_id];
+
+    Tree tree;
+    if (degree > D1(ACCURACY))
+    {
+        // flute uses global buffers for high degrees
+#pragma omp critical (flute_high_degree)
+        tree = flute(degree, vx, vy, ACCURACY);
+    }
+    else
+    {
+        tree = flute(degree, vx, vy, ACCURACY);
+    }
+    int wl = tree.length;
+
+    // the pin order to detect changes, which also maps tree coordinates back to pins
+    for (int k = 0; k < degree; ++k)
+    {
+        order_x[k] = k;
+        order_y[k] = k;
+    }
+    std::sort(order_x, order_x+degree, [&](int a, int b) {return vx[a] < vx[b] || (vx[a] == vx[b] && a < b);});
+    std::sort(order_y, order_y+degree, [&](int a, int b) {return vy[a] < vy[b] || (vy[a] == vy[b] && a < b);});
+
+    int begin = m_node_start[net_id];
+    int num_nodes = m_node_start[net_id+1]-begin;
+    int* x_pin = m_node_x_pin.data()+begin;
+    int* y_pin = m_node_y_pin.data()+begin;
+    int* neighbor = m_node_neighbor.data()+begin;
+    bool cached = true;
+    for (int k = 0; k < degree; ++k)
+    {
+        sorted[k] = vx[order_x[k]];
+    }
+    for (int k = 0; k < num_nodes && cached; ++k)
+    {
+        int* found = std::lower_bound(sorted.data(), sorted.data()+degree, tree.branch[k].x);
+        cached = (found != sorted.data()+degree && *found == tree.branch[k].x);
+        x_pin[k] = (cached)? order_x[found-sorted.data()] : 0;
+        neighbor[k] = tree.branch[k].n;
+    }
+    for (int k = 0; k < degree; ++k)
+    {
+        sorted[k] = vy[order_y[k]];
+    }
+    for (int k = 0; k < num_nodes && cached; ++k)
+    {
+        int* found = std::lower_bound(sorted.data(), sorted.data()+degree, tree.branch[k].y);
+        cached = (found != sorted.data()+degree && *found == tree.branch[k].y);
+        y_pin[k] = (cached)? order_y[found-sorted.data()] : 0;
+    }
+    // nets built for the first time keep the staggered count from the constructor
+    if (m_cached[net_id])
+    {
+        m_num_reuses[net_id] = 0;
+    }
+    // a tree off the Hanan grid is not cached and rebuilt next time
+    m_cached[net_id] = cached;
+    free(tree.branch);
+
+    return wl;
 }
 
 DREAMPLACE_END_NAMESPACE
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
   m.def("forward", &DREAMPLACE_NAMESPACE::rmst_wl_forward, "RMSTWL forward");
+  pybind11::class_<DREAMPLACE_NAMESPACE::SteinerTopologyCache>(m, "SteinerTopologyCache")
+      .def(pybind11::init<at::Tensor, at::Tensor, int, std::string, std::string, int, int>())
+      .def("forward", &DREAMPLACE_NAMESPACE::SteinerTopologyCache::forward, "RMSTWL forward with cached topologies")
+      .def("num_rebuilt_nets", &DREAMPLACE_NAMESPACE::SteinerTopologyCache::numRebuiltNets, "Number of nets whose topologies were rebuilt by the last call")
+      ;
   //m.def("backward", &DREAMPLACE_NAMESPACE::rmst_wl_backward, "RMSTWL backward");
 }
@@ -0,0 +1,778 @@
+/**
+ * @file   density_scatter.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Accumulate cell areas into a density map from multiple threads
+ */
+
+#ifndef _DREAMPLACE_UTILITY_DENSITY_SCATTER_H
+#define _DREAMPLACE_UTILITY_DENSITY_SCATTER_H
+
+#include <omp.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "utility/src/Namespace.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Strategies to resolve write conflicts when cells add to the same bins
+enum DensityScatterMode
+{
+    kDensityScatterAuto = -1, ///< chosen from the numbers of cells and bins by chooseDensityScatterMode
+    kDensityScatterAtomic, ///< one atomic addition per cell-bin pair
+    kDensityScatterPrivateMaps, ///< each thread adds to its own map, then the maps are summed up
+    kDensityScatterStripes ///< cells are bucketed by vertical stripes of bins, stripes not adjacent to each other are processed in parallel
+};
+
+/// @brief Private maps are used if zeroing and summing them up costs no more than
+/// this many times the number of cells
+enum { kDensityScatterPrivateMapRatio = 4 };
+
+/// @brief Minimum number of stripes per thread in each of the two phases of the stripe mode
+enum { kDensityScatterStripesPerThread = 2 };
+
+/// @brief Add a value to a bin, atomically or not
+template <typename T, bool Atomic>
+struct DensityAdder
+{
+    static void add(T& density, T value)
+    {
+        density += value;
+    }
+};
+
+template <typename T>
+struct DensityAdder<T, true>
+{
+    static void add(T& density, T value)
+    {
+#pragma omp atomic
+        density += value;
+    }
+};
+
+/// @brief Fractional bits of the fixed-point areas of the deterministic mode, in units of bin area.
+/// A bin can hold up to 2^(63-kDensityFixedPointBits) bin areas.
+enum { kDensityFixedPointBits = 32 };
+
+/// @brief Density map of 64-bit fixed-point areas.
+/// Integer additions are associative, so the map does not depend on the order of additions,
+/// i.e., on the number of threads and scheduling.
+template <typename T>
+struct DensityFixedPointMap
+{
+    long long* density_map; ///< areas in units of 1/scale
+    double scale; ///< 2^kDensityFixedPointBits/bin area
+};
+
+/// @brief Add a value to a bin of a density map, atomically or not
+template <bool Atomic, typename T>
+inline void addDensity(T* density_map, long index, T value)
+{
+    DensityAdder<T, Atomic>::add(density_map[index], value);
+}
+
+/// @brief Add a value to a bin of a fixed-point density map, with integer atomics if Atomic
+template <bool Atomic, typename T>
+inline void addDensity(const DensityFixedPointMap<T>& density_map, long index, T value)
+{
+    DensityAdder<long long, Atomic>::add(density_map.density_map[index], std::llrint(value*density_map.scale));
+}
+
+/// @brief Density map removing the areas added to it, for the old footprints of moved cells
+template <typename T>
+struct DensityRemovalMap
+{
+    T* density_map;
+};
+
+/// @brief Remove a value from a bin of a density map, atomically or not
+template <bool Atomic, typename T>
+inline void addDensity(const DensityRemovalMap<T>& density_map, long index, T value)
+{
+    DensityAdder<T, Atomic>::add(density_map.density_map[index], -value);
+}
+
+/// @brief Fixed-point changes of a sorted subset of bins, for the deterministic update of moved cells
+template <typename T>
+struct DensityBinsFixedPointMap
+{
+    const long* bins; ///< sorted indices of the bins in the subset
+    long num_bins; ///< number of bins in the subset
+    long long* density_map; ///< changes of the areas in the subset in units of 1/scale
+    double scale; ///< 2^kDensityFixedPointBits/bin area
+    long long sign; ///< 1 to add areas and -1 to remove them
+};
+
+/// @brief Add a value to a bin of a subset of bins in fixed point, with integer atomics if Atomic
+template <bool Atomic, typename T>
+inline void addDensity(const DensityBinsFixedPointMap<T>& density_map, long index, T value)
+{
+    long k = std::lower_bound(density_map.bins, density_map.bins+density_map.num_bins, index)-density_map.bins;
+    DensityAdder<long long, Atomic>::add(density_map.density_map[k], density_map.sign*std::llrint(value*density_map.scale));
+}
+
+/// @brief Bins of a density map and density maps of the same kind on other bins, for private maps of threads
+template <typename DensityMap>
+struct DensityMapTraits;
+
+template <typename T>
+struct DensityMapTraits<T*>
+{
+    typedef T value_type;
+    static T* data(T* density_map) {return density_map;}
+    static T* rebind(T*, T* data) {return data;}
+};
+
+template <typename T>
+struct DensityMapTraits<DensityFixedPointMap<T> >
+{
+    typedef long long value_type;
+    static long long* data(const DensityFixedPointMap<T>& density_map) {return density_map.density_map;}
+    static DensityFixedPointMap<T> rebind(const DensityFixedPointMap<T>& density_map, long long* data)
+    {
+        DensityFixedPointMap<T> map = {data, density_map.scale};
+        return map;
+    }
+};
+
+/// @brief Choose a strategy from the cell and bin counts.
+/// @param num_nodes number of cells
+/// @param num_bins_x number of bins in horizontal direction
+/// @param num_bins_y number of bins in vertical direction
+/// @param max_span_x maximum number of bins in horizontal direction a cell can touch
+/// @param num_threads number of threads
+inline DensityScatterMode chooseDensityScatterMode(int num_nodes, int num_bins_x, int num_bins_y, int max_span_x, int num_threads)
+{
+    if ((long)(num_threads-1)*num_bins_x*num_bins_y <= (long)kDensityScatterPrivateMapRatio*num_nodes)
+    {
+        return kDensityScatterPrivateMaps;
+    }
+    if (num_bins_x >= 2*kDensityScatterStripesPerThread*num_threads*std::max(max_span_x, 1))
+    {
+        return kDensityScatterStripes;
+    }
+    return kDensityScatterAtomic;
+}
+
+/// @brief Scatter cells to private maps of threads and sum them up, see kDensityScatterPrivateMaps
+/// @param private_maps storage of num_threads-1 maps of num_bins, kept by the caller and zeroed here
+template <typename DensityFunctor, typename DensityMap>
+void scatterDensityPrivateMaps(
+        const DensityFunctor& f,
+        int num_nodes,
+        int num_bins,
+        int num_threads,
+        typename DensityMapTraits<DensityMap>::value_type* private_maps,
+        DensityMap density_map
+        )
+{
+    typedef DensityMapTraits<DensityMap> Traits;
+    typedef typename Traits::value_type V;
+    V* output = Traits::data(density_map);
+    // thread 0 adds to the output directly
+#pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        V* map = (tid)? private_maps+(long)(tid-1)*num_bins : output;
+        if (tid)
+        {
+            std::fill(map, map+num_bins, V(0));
+        }
+#pragma omp for schedule(static)
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            f.template scatter<false>(i, Traits::rebind(density_map, map));
+        }
+#pragma omp for schedule(static)
+        for (int b = 0; b < num_bins; ++b)
+        {
+            V density = 0;
+            for (int t = 1; t < nt; ++t)
+            {
+                density += private_maps[(long)(t-1)*num_bins+b];
+            }
+            output[b] += density;
+        }
+    }
+}
+
+/// @brief Scatter cells bucketed by vertical stripes of bins, see kDensityScatterStripes
+/// @param node_bin_xl the first bin of each cell in horizontal direction, clamped into the map
+/// @param max_span_x maximum number of bins in horizontal direction a cell can touch
+template <typename DensityFunctor, typename DensityMap>
+void scatterDensityStripes(
+        const DensityFunctor& f,
+        const std::vector<int>& node_bin_xl,
+        int max_span_x,
+        int num_bins_x,
+        int num_threads,
+        DensityMap density_map
+        )
+{
+    int num_nodes = node_bin_xl.size();
+    // a cell starting in stripe s only touches stripes s and s+1,
+    // so all even stripes, and then all odd stripes, can be processed in parallel
+    int stripe_width = std::max(max_span_x, (num_bins_x+2*kDensityScatterStripesPerThread*num_threads-1)/(2*kDensityScatterStripesPerThread*num_threads));
+    int num_stripes = (num_bins_x+stripe_width-1)/stripe_width;
+
+    // parallel counting sort of cells by stripes, which keeps the order of cells in a stripe
+    std::vector<int> stripe_start (num_stripes+1, 0);
+    std::vector<int> thread_offsets ((long)num_threads*num_stripes, 0);
+    std::vector<int> sorted_nodes (num_nodes);
+#pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int node_begin = (long)num_nodes*tid/nt;
+        int node_end = (long)num_nodes*(tid+1)/nt;
+        int* offsets = thread_offsets.data()+(long)tid*num_stripes;
+        for (int i = node_begin; i < node_end; ++i)
+        {
+            offsets[node_bin_xl[i]/stripe_width] += 1;
+        }
+#pragma omp barrier
+#pragma omp single
+        {
+            int count = 0;
+            for (int s = 0; s < num_stripes; ++s)
+            {
+                stripe_start[s] = count;
+                for (int t = 0; t < nt; ++t)
+                {
+                    int c = thread_offsets[(long)t*num_stripes+s];
+                    thread_offsets[(long)t*num_stripes+s] = count;
+                    count += c;
+                }
+            }
+            stripe_start[num_stripes] = count;
+        }
+        for (int i = node_begin; i < node_end; ++i)
+        {
+            sorted_nodes[offsets[node_bin_xl[i]/stripe_width]++] = i;
+        }
+    }
+
+    for (int color = 0; color < 2; ++color)
+    {
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+        for (int s = color; s < num_stripes; s += 2)
+        {
+            for (int j = stripe_start[s]; j < stripe_start[s+1]; ++j)
+            {
+                f.template scatter<false>(sorted_nodes[j], density_map);
+            }
+        }
+    }
+}
+
+/// @brief Scatter cells with one atomic addition per cell-bin pair, see kDensityScatterAtomic
+template <typename DensityFunctor, typename DensityMap>
+void scatterDensityAtomic(
+        const DensityFunctor& f,
+        int num_nodes,
+        int num_threads,
+        DensityMap density_map
+        )
+{
+#pragma omp parallel for num_threads(num_threads)
+    for (int i = 0; i < num_nodes; ++i)
+    {
+        f.template scatter<true>(i, density_map);
+    }
+}
+
+/// @brief Scatter cells to a density map with a strategy from chooseDensityScatterMode
+/// @param private_maps storage of the private maps, only used by kDensityScatterPrivateMaps
+template <typename DensityFunctor, typename DensityMap>
+void scatterDensityMode(
+        const DensityFunctor& f,
+        DensityScatterMode mode,
+        const std::vector<int>& node_bin_xl,
+        int max_span_x,
+        int num_bins_x, int num_bins_y,
+        int num_threads,
+        typename DensityMapTraits<DensityMap>::value_type* private_maps,
+        DensityMap density_map
+        )
+{
+    int num_nodes = node_bin_xl.size();
+    switch (mode)
+    {
+        case kDensityScatterPrivateMaps:
+            scatterDensityPrivateMaps(f, num_nodes, num_bins_x*num_bins_y, num_threads, private_maps, density_map);
+            break;
+        case kDensityScatterStripes:
+            scatterDensityStripes(f, node_bin_xl, max_span_x, num_bins_x, num_threads, density_map);
+            break;
+        default:
+            scatterDensityAtomic(f, num_nodes, num_threads, density_map);
+            break;
+    }
+}
+
+/// @brief Scatter cells to a density map.
+/// The functor f provides
+/// members bin_size_x and bin_size_y, the bin width and height;
+/// void binRangeX(int i, int& bin_index_xl, int& bin_index_xh) const, the bins touched by cell i in horizontal direction with exclusive upper bound;
+/// template <bool Atomic, typename DensityMap> void scatter(int i, DensityMap density_map) const, add the areas of cell i to bins through addDensity<Atomic>,
+/// where DensityMap is either T* or DensityFixedPointMap<T>.
+/// The private maps and the fixed-point map live in a buffer of the caller kept across evaluations,
+/// given by reserve, which provides long long* operator()(long num_words) returning at least num_words 64-bit words,
+/// so they are only allocated when the buffer has to grow.
+/// @param f density functor
+/// @param num_nodes number of cells
+/// @param num_bins_x number of bins in horizontal direction
+/// @param num_bins_y number of bins in vertical direction
+/// @param deterministic_flag if true, areas are accumulated in 64-bit fixed point and converted once,
+/// so the map is the same bit for bit with any number of threads
+/// @param num_threads number of threads
+/// @param scatter_mode a DensityScatterMode, kDensityScatterAuto to choose one from the numbers of cells and bins
+/// @param reserve buffer of the caller
+/// @param density_map density map of num_bins_x*num_bins_y, initialized outside
+template <typename T, typename DensityFunctor, typename Reserve>
+void scatterDensityMap(
+        const DensityFunctor& f,
+        int num_nodes,
+        int num_bins_x, int num_bins_y,
+        bool deterministic_flag,
+        int num_threads,
+        int scatter_mode,
+        Reserve& reserve,
+        T* density_map
+        )
+{
+    if (num_nodes <= 0)
+    {
+        return;
+    }
+    num_threads = std::max(num_threads, 1);
+
+    // the first bin of each cell in horizontal direction, and the widest cell in bins
+    std::vector<int> node_bin_xl (num_nodes);
+    int max_span_x = 0;
+#pragma omp parallel for num_threads(num_threads) reduction(max:max_span_x)
+    for (int i = 0; i < num_nodes; ++i)
+    {
+        int bin_index_xl;
+        int bin_index_xh;
+        f.binRangeX(i, bin_index_xl, bin_index_xh);
+        // cells out of the region touch no bins and can go to any stripe
+        node_bin_xl[i] = std::min(std::max(bin_index_xl, 0), num_bins_x-1);
+        max_span_x = std::max(max_span_x, bin_index_xh-bin_index_xl);
+    }
+
+    DensityScatterMode mode = (scatter_mode == kDensityScatterAuto)?
+        chooseDensityScatterMode(num_nodes, num_bins_x, num_bins_y, max_span_x, num_threads) : (DensityScatterMode)scatter_mode;
+    int num_bins = num_bins_x*num_bins_y;
+    long num_private_values = (mode == kDensityScatterPrivateMaps)? (long)(num_threads-1)*num_bins : 0;
+    if (!deterministic_flag)
+    {
+        T* private_maps = (num_private_values)?
+            reinterpret_cast<T*>(reserve((num_private_values*(long)sizeof(T)+(long)sizeof(long long)-1)/(long)sizeof(long long))) : NULL;
+        scatterDensityMode(f, mode, node_bin_xl, max_span_x, num_bins_x, num_bins_y, num_threads, private_maps, density_map);
+        return;
+    }
+
+    // the fixed-point map, followed by the private maps if any
+    long long* fixed_point_map = reserve(num_bins+num_private_values);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int b = 0; b < num_bins; ++b)
+    {
+        fixed_point_map[b] = 0;
+    }
+    DensityFixedPointMap<T> map = {fixed_point_map, std::ldexp(1.0/(double(f.bin_size_x)*f.bin_size_y), kDensityFixedPointBits)};
+    scatterDensityMode(f, mode, node_bin_xl, max_span_x, num_bins_x, num_bins_y, num_threads, fixed_point_map+num_bins, map);
+    double inv_scale = 1.0/map.scale;
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int b = 0; b < num_bins; ++b)
+    {
+        density_map[b] += fixed_point_map[b]*inv_scale;
+    }
+}
+
+/// @brief Cells touching more bins than this go through a difference array instead of bin-by-bin additions
+enum { kDensityDifferenceMinBins = 256 };
+
+/// @brief Bins of a cell in one direction with the same overlap
+template <typename T>
+struct DensityRun
+{
+    int bin_index_l; ///< first bin
+    int bin_index_h; ///< last bin, exclusive
+    T overlap; ///< overlap of the cell with each bin of the run
+};
+
+/// @brief Group bins [bin_index_l, bin_index_h) of a cell in one direction into runs of the same overlap.
+/// Bins fully covered by the cell all take the bin size, so a large cell has only a few runs.
+/// @param overlap functor T(int k), overlap of the cell with bin k
+/// @param full functor bool(int k), whether bin k is fully covered by the cell
+/// @param bin_index_l first bin
+/// @param bin_index_h last bin, exclusive
+/// @param bin_size bin size
+/// @param runs output runs, bins without overlap are skipped
+template <typename T, typename OverlapFunc, typename FullFunc>
+void computeDensityRuns(
+        const OverlapFunc& overlap,
+        const FullFunc& full,
+        int bin_index_l, int bin_index_h,
+        T bin_size,
+        std::vector<DensityRun<T> >& runs
+        )
+{
+    runs.clear();
+    for (int k = bin_index_l; k < bin_index_h; ++k)
+    {
+        T value = (full(k))? bin_size : overlap(k);
+        if (value == T(0))
+        {
+            continue;
+        }
+        if (!runs.empty() && runs.back().bin_index_h == k && runs.back().overlap == value)
+        {
+            runs.back().bin_index_h = k+1;
+        }
+        else
+        {
+            DensityRun<T> run = {k, k+1, value};
+            runs.push_back(run);
+        }
+    }
+}
+
+/// @brief Rectangles of constant density added to a density map through a 2D difference array.
+/// A rectangle costs 4 updates no matter how many bins it covers,
+/// and the map is recovered by one prefix sum in each direction.
+/// The difference array is in double precision to limit the cancellation errors of the prefix sums.
+class DensityDifferenceMap
+{
+    public:
+        /// @param num_bins_x number of bins in horizontal direction
+        /// @param num_bins_y number of bins in vertical direction
+        DensityDifferenceMap(int num_bins_x, int num_bins_y)
+            : m_num_bins_x(num_bins_x)
+            , m_num_bins_y(num_bins_y)
+            , m_diff((long)num_bins_x*num_bins_y, 0.0)
+        {
+        }
+
+        /// @brief add value to bins [bin_index_xl, bin_index_xh) x [bin_index_yl, bin_index_yh)
+        void add(int bin_index_xl, int bin_index_xh, int bin_index_yl, int bin_index_yh, double value)
+        {
+            // updates beyond the map are never accumulated
+            m_diff[(long)bin_index_xl*m_num_bins_y+bin_index_yl] += value;
+            if (bin_index_yh < m_num_bins_y)
+            {
+                m_diff[(long)bin_index_xl*m_num_bins_y+bin_index_yh] -= value;
+            }
+            if (bin_index_xh < m_num_bins_x)
+            {
+                m_diff[(long)bin_index_xh*m_num_bins_y+bin_index_yl] -= value;
+                if (bin_index_yh < m_num_bins_y)
+                {
+                    m_diff[(long)bin_index_xh*m_num_bins_y+bin_index_yh] += value;
+                }
+            }
+        }
+
+        /// @brief add the areas of a cell given by its runs in both directions
+        template <typename T>
+        void add(const std::vector<DensityRun<T> >& runs_x, const std::vector<DensityRun<T> >& runs_y)
+        {
+            for (typename std::vector<DensityRun<T> >::const_iterator rx = runs_x.begin(); rx != runs_x.end(); ++rx)
+            {
+                for (typename std::vector<DensityRun<T> >::const_iterator ry = runs_y.begin(); ry != runs_y.end(); ++ry)
+                {
+                    add(rx->bin_index_l, rx->bin_index_h, ry->bin_index_l, ry->bin_index_h, double(rx->overlap)*ry->overlap);
+                }
+            }
+        }
+
+        /// @brief recover the areas by prefix sums and add them to a density map, the difference array is consumed
+        template <typename T>
+        void accumulate(int num_threads, T* density_map)
+        {
+#pragma omp parallel num_threads(num_threads)
+            {
+                // prefix sums along y within rows
+#pragma omp for schedule(static)
+                for (int k = 0; k < m_num_bins_x; ++k)
+                {
+                    double* row = m_diff.data()+(long)k*m_num_bins_y;
+                    for (int h = 1; h < m_num_bins_y; ++h)
+                    {
+                        row[h] += row[h-1];
+                    }
+                }
+                // prefix sums along x, each thread takes a range of columns so rows are read contiguously
+                int tid = omp_get_thread_num();
+                int nt = omp_get_num_threads();
+                int bin_index_yl = (long)m_num_bins_y*tid/nt;
+                int bin_index_yh = (long)m_num_bins_y*(tid+1)/nt;
+                for (int k = 0; k < m_num_bins_x; ++k)
+                {
+                    double* row = m_diff.data()+(long)k*m_num_bins_y;
+                    T* density_map_row = density_map+(long)k*m_num_bins_y;
+                    if (k)
+                    {
+                        const double* prev_row = row-m_num_bins_y;
+                        for (int h = bin_index_yl; h < bin_index_yh; ++h)
+                        {
+                            row[h] += prev_row[h];
+                        }
+                    }
+                    for (int h = bin_index_yl; h < bin_index_yh; ++h)
+                    {
+                        density_map_row[h] += row[h];
+                    }
+                }
+            }
+        }
+
+    protected:
+        int m_num_bins_x;
+        int m_num_bins_y;
+        std::vector<double> m_diff;
+};
+
+/// @brief Scatter cells touching many bins through a difference array.
+/// Cells are added in index order, so the result does not depend on the number of threads.
+/// The functor f provides
+/// bool large(int i) const, whether cell i should take this path, which should be rare;
+/// void runs(int i, std::vector<DensityRun<T> >& runs_x, std::vector<DensityRun<T> >& runs_y) const, the runs of cell i in both directions.
+/// @param f density functor
+/// @param num_nodes number of cells
+/// @param num_bins_x number of bins in horizontal direction
+/// @param num_bins_y number of bins in vertical direction
+/// @param num_threads number of threads
+/// @param density_map density map of num_bins_x*num_bins_y, initialized outside
+template <typename T, typename DensityFunctor>
+void scatterLargeCells(
+        const DensityFunctor& f,
+        int num_nodes,
+        int num_bins_x, int num_bins_y,
+        int num_threads,
+        T* density_map
+        )
+{
+    num_threads = std::max(num_threads, 1);
+
+    std::vector<int> large_nodes;
+#pragma omp parallel num_threads(num_threads)
+    {
+        std::vector<int> local_large_nodes;
+#pragma omp for schedule(static) nowait
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            if (f.large(i))
+            {
+                local_large_nodes.push_back(i);
+            }
+        }
+#pragma omp critical
+        large_nodes.insert(large_nodes.end(), local_large_nodes.begin(), local_large_nodes.end());
+    }
+    if (large_nodes.empty())
+    {
+        return;
+    }
+    // keep the order of additions independent of threads
+    std::sort(large_nodes.begin(), large_nodes.end());
+
+    DensityDifferenceMap diff (num_bins_x, num_bins_y);
+    std::vector<DensityRun<T> > runs_x;
+    std::vector<DensityRun<T> > runs_y;
+    for (std::vector<int>::const_iterator it = large_nodes.begin(); it != large_nodes.end(); ++it)
+    {
+        f.runs(*it, runs_x, runs_y);
+        diff.add(runs_x, runs_y);
+    }
+    diff.accumulate(num_threads, density_map);
+}
+
+/// @brief Add the areas of a cell given by its runs in both directions bin by bin
+template <bool Atomic, typename T, typename DensityMap>
+void addDensityRuns(
+        const std::vector<DensityRun<T> >& runs_x, const std::vector<DensityRun<T> >& runs_y,
+        int num_bins_y,
+        DensityMap density_map
+        )
+{
+    for (typename std::vector<DensityRun<T> >::const_iterator rx = runs_x.begin(); rx != runs_x.end(); ++rx)
+    {
+        for (typename std::vector<DensityRun<T> >::const_iterator ry = runs_y.begin(); ry != runs_y.end(); ++ry)
+        {
+            T area = rx->overlap*ry->overlap;
+            for (int k = rx->bin_index_l; k < rx->bin_index_h; ++k)
+            {
+                for (int h = ry->bin_index_l; h < ry->bin_index_h; ++h)
+                {
+                    addDensity<Atomic>(density_map, (long)k*num_bins_y+h, area);
+                }
+            }
+        }
+    }
+}
+
+/// @brief Add the areas of all cells bin by bin, large cells included
+template <bool Atomic, typename T, typename DensityFunctor, typename DensityMap>
+void scatterMovedCells(
+        const DensityFunctor& f,
+        int num_nodes,
+        int num_bins_y,
+        int num_threads,
+        DensityMap density_map
+        )
+{
+#pragma omp parallel num_threads(num_threads)
+    {
+        std::vector<DensityRun<T> > runs_x;
+        std::vector<DensityRun<T> > runs_y;
+#pragma omp for schedule(static)
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            if (f.large(i))
+            {
+                f.runs(i, runs_x, runs_y);
+                addDensityRuns<Atomic>(runs_x, runs_y, num_bins_y, density_map);
+            }
+            else
+            {
+                f.template scatter<Atomic>(i, density_map);
+            }
+        }
+    }
+}
+
+/// @brief Total overflow of some bins of a density map, summed up in the order of bins
+template <typename T>
+T computeBinsOverflow(const std::vector<long>& bins, T target_area, const T* density_map)
+{
+    T overflow = 0;
+    for (std::vector<long>::const_iterator it = bins.begin(); it != bins.end(); ++it)
+    {
+        overflow += std::max(density_map[*it]-target_area, T(0));
+    }
+    return overflow;
+}
+
+/// @brief Move cells on a density map, removing their old footprints and adding the new ones.
+/// The cost scales with the number of moved cells and the bins they touch, not with the size of the map.
+/// The functors old_f and new_f describe the same cells at the old and new locations, and provide
+/// void binRange(int i, int& bin_index_xl, int& bin_index_xh, int& bin_index_yl, int& bin_index_yh) const, the bins touched by cell i with exclusive upper bounds;
+/// bool large(int i) const and void runs(int i, std::vector<DensityRun<T> >& runs_x, std::vector<DensityRun<T> >& runs_y) const, see scatterLargeCells;
+/// template <bool Atomic, typename DensityMap> void scatter(int i, DensityMap density_map) const, see scatterDensityMap, which may skip large cells.
+/// Floating-point removals do not cancel additions exactly, so a map updated many times drifts by rounding errors
+/// and should be recomputed from scratch now and then.
+/// In deterministic mode, the change of each bin is accumulated in the fixed point of scatterDensityMap
+/// and added once, so the map is the same bit for bit with any number of threads.
+/// The functors then provide bin_size_x and bin_size_y for the fixed-point scale.
+/// @param old_f density functor of the moved cells at their old locations
+/// @param new_f density functor of the moved cells at their new locations
+/// @param num_nodes number of moved cells
+/// @param num_bins_x number of bins in horizontal direction
+/// @param num_bins_y number of bins in vertical direction
+/// @param target_area target area of a bin for the overflow
+/// @param deterministic_flag if true, changes are accumulated in fixed point, so the map does not depend on the number of threads
+/// @param num_threads number of threads
+/// @param padding_mask padding bins with 1, which stay at target_area as set by the full computation, NULL for no padding
+/// @param density_map density map of num_bins_x*num_bins_y, not normalized by bin area, updated in place
+/// @return change of the total overflow of the map
+template <typename T, typename DensityFunctor>
+T updateDensityMap(
+        const DensityFunctor& old_f,
+        const DensityFunctor& new_f,
+        int num_nodes,
+        int num_bins_x, int num_bins_y,
+        T target_area,
+        bool deterministic_flag,
+        int num_threads,
+        const unsigned char* padding_mask,
+        T* density_map
+        )
+{
+    if (num_nodes <= 0)
+    {
+        return 0;
+    }
+    num_threads = std::max(num_threads, 1);
+
+    // bins touched at the old or new locations, the only ones whose overflow can change
+    std::vector<long> bins;
+    for (int i = 0; i < num_nodes; ++i)
+    {
+        const DensityFunctor* fs[2] = {&old_f, &new_f};
+        for (int j = 0; j < 2; ++j)
+        {
+            int bin_index_xl;
+            int bin_index_xh;
+            int bin_index_yl;
+            int bin_index_yh;
+            fs[j]->binRange(i, bin_index_xl, bin_index_xh, bin_index_yl, bin_index_yh);
+            for (int k = bin_index_xl; k < bin_index_xh; ++k)
+            {
+                for (int h = bin_index_yl; h < bin_index_yh; ++h)
+                {
+                    bins.push_back((long)k*num_bins_y+h);
+                }
+            }
+        }
+    }
+    std::sort(bins.begin(), bins.end());
+    bins.erase(std::unique(bins.begin(), bins.end()), bins.end());
+
+    T overflow = computeBinsOverflow(bins, target_area, density_map);
+    if (deterministic_flag)
+    {
+        std::vector<long long> fixed_point_delta (bins.size(), 0);
+        double scale = std::ldexp(1.0/(double(old_f.bin_size_x)*old_f.bin_size_y), kDensityFixedPointBits);
+        DensityBinsFixedPointMap<T> removal_map = {bins.data(), (long)bins.size(), fixed_point_delta.data(), scale, -1};
+        DensityBinsFixedPointMap<T> addition_map = {bins.data(), (long)bins.size(), fixed_point_delta.data(), scale, 1};
+        if (num_threads == 1)
+        {
+            scatterMovedCells<false, T>(old_f, num_nodes, num_bins_y, 1, removal_map);
+            scatterMovedCells<false, T>(new_f, num_nodes, num_bins_y, 1, addition_map);
+        }
+        else
+        {
+            scatterMovedCells<true, T>(old_f, num_nodes, num_bins_y, num_threads, removal_map);
+            scatterMovedCells<true, T>(new_f, num_nodes, num_bins_y, num_threads, addition_map);
+        }
+        double inv_scale = 1.0/scale;
+        for (std::size_t k = 0; k < bins.size(); ++k)
+        {
+            density_map[bins[k]] += fixed_point_delta[k]*inv_scale;
+        }
+    }
+    else
+    {
+        DensityRemovalMap<T> removal_map = {density_map};
+        if (num_threads == 1)
+        {
+            scatterMovedCells<false, T>(old_f, num_nodes, num_bins_y, 1, removal_map);
+            scatterMovedCells<false, T>(new_f, num_nodes, num_bins_y, 1, density_map);
+        }
+        else
+        {
+            scatterMovedCells<true, T>(old_f, num_nodes, num_bins_y, num_threads, removal_map);
+            scatterMovedCells<true, T>(new_f, num_nodes, num_bins_y, num_threads, density_map);
+        }
+    }
+    if (padding_mask)
+    {
+        for (std::vector<long>::const_iterator it = bins.begin(); it != bins.end(); ++it)
+        {
+            if (padding_mask[*it])
+            {
+                density_map[*it] = target_area;
+            }
+        }
+    }
+    return computeBinsOverflow(bins, target_area, density_map)-overflow;
+}
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file   density_scatter_tensor.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Buffer of density scattering kept in a tensor of the op across evaluations
+ */
+
+#ifndef _DREAMPLACE_UTILITY_DENSITY_SCATTER_TENSOR_H
+#define _DREAMPLACE_UTILITY_DENSITY_SCATTER_TENSOR_H
+
+#include "utility/src/torch.h"
+#include "utility/src/density_scatter.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Reserve functor of scatterDensityMap backed by an int64 tensor on CPU.
+/// The tensor belongs to the op and is resized in place only when more words are needed,
+/// so the private maps are not allocated in every evaluation.
+struct DensityScatterTensorBuffer
+{
+    at::Tensor buffer; ///< int64 tensor, may be empty
+
+    long long* operator()(long num_words)
+    {
+        if (buffer.numel() < num_words)
+        {
+            buffer.resize_({num_words});
+        }
+        return reinterpret_cast<long long*>(buffer.data<int64_t>());
+    }
+};
+
+/// @brief check a buffer of density scattering from the op
+inline void checkDensityScatterBuffer(at::Tensor buffer)
+{
+    AT_ASSERTM(!buffer.is_cuda() && buffer.is_contiguous(), "scatter_buffer must be a contiguous tensor on CPU");
+    AT_ASSERTM(buffer.scalar_type() == at::kLong, "scatter_buffer must be an int64 tensor");
+}
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
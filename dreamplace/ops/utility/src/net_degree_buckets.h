@@ -0,0 +1,135 @@
+/**
+ * @file   net_degree_buckets.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Group nets by degree so that small nets can use kernels specialized at compile time
+ */
+
+#ifndef _DREAMPLACE_UTILITY_NET_DEGREE_BUCKETS_H
+#define _DREAMPLACE_UTILITY_NET_DEGREE_BUCKETS_H
+
+#include <omp.h>
+#include <vector>
+#include "utility/src/Namespace.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Bucket k holds nets of degree k+2 for k < kMaxSpecializedNetDegree-1,
+/// the next bucket holds the other nets below kHighFanoutNetDegree,
+/// and the last bucket holds the high-fanout nets.
+enum { kNumNetDegreeBuckets = 5 };
+
+/// @brief The largest degree with a specialized kernel
+enum { kMaxSpecializedNetDegree = 4 };
+
+/// @brief Nets with at least this degree are computed with all threads one at a time,
+/// so that a clock net does not keep a single thread busy while the others wait
+enum { kHighFanoutNetDegree = 1024 };
+
+/// @brief Number of pins of a high-fanout net processed by one thread at a time
+enum { kHighFanoutNetChunkSize = 256 };
+
+inline int netDegreeBucket(int degree)
+{
+    if (degree >= 2 && degree <= kMaxSpecializedNetDegree)
+    {
+        return degree-2;
+    }
+    return (degree < kHighFanoutNetDegree)? kNumNetDegreeBuckets-2 : kNumNetDegreeBuckets-1;
+}
+
+/// @brief Group nets into degree buckets with a counting sort.
+/// Nets ignored by net_mask are dropped.
+/// @param netpin_start similar to the IA array in CSR format, the length is number of nets + 1
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @param num_nets number of nets
+/// @return kNumNetDegreeBuckets+1 offsets of the buckets, followed by the net indices of all buckets;
+/// the offsets are relative to the beginning of the net indices
+inline std::vector<int> buildNetDegreeBuckets(
+        const int* netpin_start,
+        const unsigned char* net_mask,
+        int num_nets
+        )
+{
+    std::vector<int> bucket_start (kNumNetDegreeBuckets+1, 0);
+    for (int i = 0; i < num_nets; ++i)
+    {
+        if (net_mask[i])
+        {
+            bucket_start[netDegreeBucket(netpin_start[i+1]-netpin_start[i])+1] += 1;
+        }
+    }
+    for (int k = 0; k < kNumNetDegreeBuckets; ++k)
+    {
+        bucket_start[k+1] += bucket_start[k];
+    }
+
+    std::vector<int> buckets (bucket_start);
+    buckets.resize(kNumNetDegreeBuckets+1+bucket_start.back());
+    int* nets = buckets.data()+kNumNetDegreeBuckets+1;
+    for (int i = 0; i < num_nets; ++i)
+    {
+        if (net_mask[i])
+        {
+            nets[bucket_start[netDegreeBucket(netpin_start[i+1]-netpin_start[i])]++] = i;
+        }
+    }
+    return buckets;
+}
+
+/// @brief Run a kernel on all nets in the buckets.
+/// The kernel is copied once per thread, so it may keep thread-local buffers,
+/// and it provides template <int Degree> void run(int net_id).
+/// Degree is the net degree for the specialized buckets and 0 for the generic bucket,
+/// where the kernel must read the degree from the CSR arrays.
+/// Specialized buckets have uniform work and are statically scheduled,
+/// the generic bucket is dynamically scheduled.
+/// Threads move on to the next bucket without a barrier,
+/// so the kernel must only write to entries owned by its net.
+/// High-fanout nets are computed afterwards one at a time by
+/// void runHighFanout(int net_id, int num_threads), which parallelizes within the net.
+/// @param net_degree_buckets output of buildNetDegreeBuckets
+/// @param num_threads number of threads
+/// @param kernel the kernel for one net
+template <typename Kernel>
+void forEachNetByDegree(const int* net_degree_buckets, int num_threads, const Kernel& kernel)
+{
+    const int* bucket_start = net_degree_buckets;
+    const int* nets = net_degree_buckets+kNumNetDegreeBuckets+1;
+#pragma omp parallel num_threads(num_threads)
+    {
+        Kernel k (kernel);
+#pragma omp for schedule(static) nowait
+        for (int i = bucket_start[0]; i < bucket_start[1]; ++i)
+        {
+            k.template run<2>(nets[i]);
+        }
+#pragma omp for schedule(static) nowait
+        for (int i = bucket_start[1]; i < bucket_start[2]; ++i)
+        {
+            k.template run<3>(nets[i]);
+        }
+#pragma omp for schedule(static) nowait
+        for (int i = bucket_start[2]; i < bucket_start[3]; ++i)
+        {
+            k.template run<4>(nets[i]);
+        }
+#pragma omp for schedule(dynamic, 16) nowait
+        for (int i = bucket_start[3]; i < bucket_start[4]; ++i)
+        {
+            k.template run<0>(nets[i]);
+        }
+    }
+    if (bucket_start[4] < bucket_start[5])
+    {
+        Kernel k (kernel);
+        for (int i = bucket_start[4]; i < bucket_start[5]; ++i)
+        {
+            k.runHighFanout(nets[i], num_threads);
+        }
+    }
+}
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
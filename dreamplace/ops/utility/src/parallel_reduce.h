@@ -0,0 +1,230 @@
+/**
+ * @file   parallel_reduce.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  OpenMP reductions from pins to nets without atomic operations
+ */
+
+#ifndef _DREAMPLACE_UTILITY_PARALLEL_REDUCE_H
+#define _DREAMPLACE_UTILITY_PARALLEL_REDUCE_H
+
+#include <omp.h>
+#include <vector>
+#include <algorithm>
+#include "utility/src/Namespace.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Segmented reduction over a CSR net-to-pin map.
+/// Entries of flat_netpin are evenly split among threads regardless of net degrees,
+/// so a high-degree net does not stall one thread.
+/// Nets cut by a thread boundary are kept as thread-local carries
+/// and merged sequentially afterwards, so no atomic operation is needed.
+/// The split points move with the number of threads, so floating-point sums of cut nets
+/// may differ in the last bits when the number of threads changes.
+///
+/// @param flat_netpin similar to the JA array in CSR format
+/// @param netpin_start similar to the IA array in CSR format, the length is number of nets + 1
+/// @param num_nets number of nets
+/// @param num_threads number of threads
+/// @param init functor returning the identity of the reduction
+/// @param reduce functor (int net_id, int pin_id, V& acc) to accumulate a pin
+/// @param merge functor (V& acc, const V& other) to merge two partial results of the same net
+/// @param write functor (int net_id, const V& acc) to save the final result of a net
+template <typename V, typename Init, typename Reduce, typename Merge, typename Write>
+void segmentedReduceNetPins(
+        const int* flat_netpin,
+        const int* netpin_start,
+        int num_nets,
+        int num_threads,
+        Init init,
+        Reduce reduce,
+        Merge merge,
+        Write write
+        )
+{
+    int num_pins = netpin_start[num_nets];
+    num_threads = std::max(std::min(num_threads, num_pins), 1);
+
+    // at most two nets per thread are cut by the boundaries, the first and the last one
+    std::vector<V> carry_head (num_threads, init());
+    std::vector<V> carry_tail (num_threads, init());
+    std::vector<int> head_net (num_threads, -1);
+    std::vector<int> tail_net (num_threads, -1);
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        for (int t = tid; t < num_threads; t += nt)
+        {
+            int pin_begin = (long)num_pins*t/num_threads;
+            int pin_end = (long)num_pins*(t+1)/num_threads;
+            if (pin_begin == pin_end)
+            {
+                continue;
+            }
+            // the net containing entry pin_begin
+            int net_id = std::upper_bound(netpin_start, netpin_start+num_nets+1, pin_begin)-netpin_start-1;
+            for (int j = pin_begin; j < pin_end; ++net_id)
+            {
+                int seg_end = std::min(netpin_start[net_id+1], pin_end);
+                V acc = init();
+                for (; j < seg_end; ++j)
+                {
+                    reduce(net_id, flat_netpin[j], acc);
+                }
+                if (netpin_start[net_id] < pin_begin)
+                {
+                    head_net[t] = net_id;
+                    carry_head[t] = acc;
+                }
+                else if (netpin_start[net_id+1] > pin_end)
+                {
+                    tail_net[t] = net_id;
+                    carry_tail[t] = acc;
+                }
+                else
+                {
+                    write(net_id, acc);
+                }
+            }
+        }
+    }
+
+    // carries appear in increasing order of nets
+    int cur_net = -1;
+    V cur = init();
+    for (int t = 0; t < num_threads; ++t)
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            int net_id = (k)? tail_net[t] : head_net[t];
+            const V& acc = (k)? carry_tail[t] : carry_head[t];
+            if (net_id < 0)
+            {
+                continue;
+            }
+            if (net_id == cur_net)
+            {
+                merge(cur, acc);
+            }
+            else
+            {
+                if (cur_net >= 0)
+                {
+                    write(cur_net, cur);
+                }
+                cur_net = net_id;
+                cur = acc;
+            }
+        }
+    }
+    if (cur_net >= 0)
+    {
+        write(cur_net, cur);
+    }
+}
+
+/// @brief Pins grouped by contiguous ranges of nets,
+/// so that all pins of a net are visited by the thread owning its range and no atomic operation is needed
+struct NetRangePins
+{
+    std::vector<int> net_start; ///< first net of each range, the length is number of ranges + 1
+    std::vector<int> pin_start; ///< start of each range in pins, the length is number of ranges + 1
+    std::vector<int> pins; ///< pins grouped by ranges, in increasing order within each range
+    std::vector<int> count; ///< number of pins of each thread in each range
+
+    int numRanges() const {return (int)net_start.size()-1;}
+    /// @return the range containing a net
+    int range(int net_id) const
+    {
+        return std::upper_bound(net_start.begin(), net_start.end(), net_id)-net_start.begin()-1;
+    }
+};
+
+/// @brief Group the pins of nets to compute by contiguous ranges of nets with a parallel counting sort.
+/// Range boundaries are taken from the prefix sums of pins per net,
+/// so that ranges hold similar numbers of pins even if nets are sorted by degree.
+/// A net with more pins than a range still lies in a single range.
+/// Scratch takes O(#pins) plus O(#threads*#ranges), independent of the number of nets per thread.
+/// @param pin2net_map net of each pin, negative for pins without net
+/// @param net_mask whether to compute a net
+/// @param netpin_start similar to the IA array in CSR format, the length is number of nets + 1
+/// @param num_nets number of nets
+/// @param num_pins number of pins
+/// @param num_ranges number of ranges, more ranges than threads balance the work with dynamic scheduling
+/// @param num_threads number of threads
+/// @param result pins grouped by ranges, its buffers are reused across calls
+inline void groupPinsByNetRanges(
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        const int* netpin_start,
+        int num_nets,
+        int num_pins,
+        int num_ranges,
+        int num_threads,
+        NetRangePins& result
+        )
+{
+    num_ranges = std::max(std::min(num_ranges, num_nets), 1);
+    result.net_start.resize(num_ranges+1);
+    result.pin_start.resize(num_ranges+1);
+    result.pins.resize(num_pins);
+    for (int r = 0; r < num_ranges; ++r)
+    {
+        result.net_start[r] = std::lower_bound(netpin_start, netpin_start+num_nets+1, (long)netpin_start[num_nets]*r/num_ranges)-netpin_start;
+    }
+    result.net_start[num_ranges] = num_nets;
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+#pragma omp single
+        result.count.assign(nt*num_ranges, 0);
+
+        // each thread counts its block of pins
+        int begin = (long)num_pins*tid/nt;
+        int end = (long)num_pins*(tid+1)/nt;
+        int* count = result.count.data()+tid*num_ranges;
+        for (int i = begin; i < end; ++i)
+        {
+            int net_id = pin2net_map[i];
+            if (net_id >= 0 && net_mask[net_id])
+            {
+                count[result.range(net_id)] += 1;
+            }
+        }
+#pragma omp barrier
+#pragma omp single
+        {
+            int offset = 0;
+            for (int r = 0; r < num_ranges; ++r)
+            {
+                result.pin_start[r] = offset;
+                for (int t = 0; t < nt; ++t)
+                {
+                    int c = result.count[t*num_ranges+r];
+                    result.count[t*num_ranges+r] = offset;
+                    offset += c;
+                }
+            }
+            result.pin_start[num_ranges] = offset;
+        }
+
+        // each thread scatters its block of pins to its own slots in the ranges
+        for (int i = begin; i < end; ++i)
+        {
+            int net_id = pin2net_map[i];
+            if (net_id >= 0 && net_mask[net_id])
+            {
+                result.pins[count[result.range(net_id)]++] = i;
+            }
+        }
+    }
+}
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
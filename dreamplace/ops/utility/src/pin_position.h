@@ -0,0 +1,96 @@
+/**
+ * @file   pin_position.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Access pin locations either from pin arrays or from cell locations and pin offsets
+ */
+
+#ifndef _DREAMPLACE_UTILITY_PIN_POSITION_H
+#define _DREAMPLACE_UTILITY_PIN_POSITION_H
+
+#include "utility/src/Namespace.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Pin locations stored in arrays
+template <typename T>
+struct PinPositionFromPins
+{
+    const T* x; ///< x locations of pins
+    const T* y; ///< y locations of pins
+
+    T getX(int pin_id) const
+    {
+        return x[pin_id];
+    }
+    T getY(int pin_id) const
+    {
+        return y[pin_id];
+    }
+};
+
+/// @brief Pin locations computed on the fly from cell locations and pin offsets,
+/// so that no pin-sized location arrays need to be built
+template <typename T>
+struct PinPositionFromNodes
+{
+    const T* x; ///< x locations of cells
+    const T* y; ///< y locations of cells
+    const T* pin_offset_x; ///< offset of a pin to the lower left corner of its cell
+    const T* pin_offset_y; ///< offset of a pin to the lower left corner of its cell
+    const int* pin2node_map; ///< cell of each pin
+
+    T getX(int pin_id) const
+    {
+        return x[pin2node_map[pin_id]] + pin_offset_x[pin_id];
+    }
+    T getY(int pin_id) const
+    {
+        return y[pin2node_map[pin_id]] + pin_offset_y[pin_id];
+    }
+};
+
+/// @brief Sum up the gradients of pins to their cells.
+/// Each cell gathers from its own pins, so no atomic operation is needed.
+/// @param grad_pin_x gradient of pins in x direction
+/// @param grad_pin_y gradient of pins in y direction
+/// @param flat_node2pin similar to the JA array in CSR format, which is flattened from the node2pin map
+/// @param flat_node2pin_start similar to the IA array in CSR format, the length is number of physical nodes + 1
+/// @param pin_mask pins whose gradients are ignored, e.g., pins of fixed macros, can be nullptr
+/// @param num_nodes number of physical nodes
+/// @param num_threads number of threads
+/// @param grad_x gradient of cells in x direction
+/// @param grad_y gradient of cells in y direction
+template <typename T>
+void sumPinGradToNodes(
+        const T* grad_pin_x, const T* grad_pin_y,
+        const int* flat_node2pin,
+        const int* flat_node2pin_start,
+        const unsigned char* pin_mask,
+        int num_nodes,
+        int num_threads,
+        T* grad_x, T* grad_y
+        )
+{
+#pragma omp parallel for num_threads(num_threads) schedule(static, 256)
+    for (int i = 0; i < num_nodes; ++i)
+    {
+        T gx = 0;
+        T gy = 0;
+        for (int j = flat_node2pin_start[i]; j < flat_node2pin_start[i+1]; ++j)
+        {
+            int pin_id = flat_node2pin[j];
+            if (!pin_mask || !pin_mask[pin_id])
+            {
+                gx += grad_pin_x[pin_id];
+                gy += grad_pin_y[pin_id];
+            }
+        }
+        grad_x[i] = gx;
+        grad_y[i] = gy;
+    }
+}
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
@@ -0,0 +1,250 @@
+/**
+ * @file   vector_exp.h
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Vectorized exponential for CPU with the instruction set selected at runtime
+ */
+
+#ifndef _DREAMPLACE_UTILITY_VECTOR_EXP_H
+#define _DREAMPLACE_UTILITY_VECTOR_EXP_H
+
+#include <cmath>
+#include <cstring>
+#include "utility/src/Namespace.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DREAMPLACE_VECTOR_EXP_X86 1
+#include <immintrin.h>
+#else
+#define DREAMPLACE_VECTOR_EXP_X86 0
+#endif
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Instruction sets for the vectorized exponential
+enum class VectorExpISA
+{
+    SCALAR,
+    AVX2,
+    AVX512
+};
+
+/// @brief Compute exp in place for an array, one element at a time
+template <typename T>
+inline void vectorExpScalar(T* x, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] = std::exp(x[i]);
+    }
+}
+
+#if DREAMPLACE_VECTOR_EXP_X86
+
+/// @brief Apply a vector kernel to an array of n elements in place.
+/// The tail is padded to a full vector, so each element gets the same result wherever it is.
+#define DREAMPLACE_VECTOR_EXP_LOOP(T, lanes, load, store, kernel) \
+    int i = 0; \
+    for (; i+lanes <= n; i += lanes) \
+    { \
+        store(x+i, kernel(load(x+i))); \
+    } \
+    if (i < n) \
+    { \
+        T tail[lanes] = {0}; \
+        std::memcpy(tail, x+i, sizeof(T)*(n-i)); \
+        store(tail, kernel(load(tail))); \
+        std::memcpy(x+i, tail, sizeof(T)*(n-i)); \
+    }
+
+// The argument is split as x = k*ln2 + r with |r| <= ln2/2 and exp(x) = 2^k * exp(r).
+// exp(r) is a degree-13 Taylor polynomial for double (error below 1 ulp)
+// and the Cephes polynomial for float.
+// Arguments are clamped just beyond the points where exp underflows to zero and overflows to infinity,
+// and 2^k is applied in two factors, so subnormal results, zero and infinity come out as in std::exp.
+// The clamps put x second in max and min, which return the second operand for NaN, so NaN propagates.
+
+/// @brief 2^k for integral k in [-1022, 1023] from the exponent bits
+__attribute__((target("avx2,fma")))
+inline __m256d pow2256d(__m256d k)
+{
+    __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52));
+}
+
+/// @brief 2^k for integral k in [-126, 127] from the exponent bits
+__attribute__((target("avx2,fma")))
+inline __m256 pow2256f(__m256 k)
+{
+    __m256i e = _mm256_cvtps_epi32(k);
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e, _mm256_set1_epi32(127)), 23));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d exp256d(__m256d x)
+{
+    x = _mm256_min_pd(_mm256_set1_pd(710.0), _mm256_max_pd(_mm256_set1_pd(-746.0), x));
+    __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(6.93145751953125e-1), x);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(1.42860682030941723212e-6), r);
+
+    __m256d p = _mm256_set1_pd(1.6059043836821613e-10);
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(2.08767569878681e-9));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(2.505210838544172e-8));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(2.755731922398589e-7));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(2.7557319223985893e-6));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(2.48015873015873e-5));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.984126984126984e-4));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.3888888888888889e-3));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(8.333333333333333e-3));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(4.1666666666666664e-2));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.6666666666666666e-1));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(0.5));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+
+    // k in [-1076, 1025] is split into two halves within the range of normal numbers
+    __m256d k1 = _mm256_floor_pd(_mm256_mul_pd(k, _mm256_set1_pd(0.5)));
+    return _mm256_mul_pd(_mm256_mul_pd(p, pow2256d(k1)), pow2256d(_mm256_sub_pd(k, k1)));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256 exp256f(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_set1_ps(89.0f), _mm256_max_ps(_mm256_set1_ps(-104.0f), x));
+    __m256 k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(k, _mm256_set1_ps(-2.12194440e-4f), r);
+
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    // k in [-150, 128] is split into two halves within the range of normal numbers
+    __m256 k1 = _mm256_floor_ps(_mm256_mul_ps(k, _mm256_set1_ps(0.5f)));
+    return _mm256_mul_ps(_mm256_mul_ps(p, pow2256f(k1)), pow2256f(_mm256_sub_ps(k, k1)));
+}
+
+__attribute__((target("avx512f")))
+inline __m512d exp512d(__m512d x)
+{
+    x = _mm512_min_pd(_mm512_set1_pd(710.0), _mm512_max_pd(_mm512_set1_pd(-746.0), x));
+    __m512d k = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(1.4426950408889634)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(6.93145751953125e-1), x);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(1.42860682030941723212e-6), r);
+
+    __m512d p = _mm512_set1_pd(1.6059043836821613e-10);
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(2.08767569878681e-9));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(2.505210838544172e-8));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(2.755731922398589e-7));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(2.7557319223985893e-6));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(2.48015873015873e-5));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.984126984126984e-4));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.3888888888888889e-3));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(8.333333333333333e-3));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(4.1666666666666664e-2));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.6666666666666666e-1));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(0.5));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+
+    return _mm512_scalef_pd(p, k);
+}
+
+__attribute__((target("avx512f")))
+inline __m512 exp512f(__m512 x)
+{
+    x = _mm512_min_ps(_mm512_set1_ps(89.0f), _mm512_max_ps(_mm512_set1_ps(-104.0f), x));
+    __m512 k = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(k, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(k, _mm512_set1_ps(-2.12194440e-4f), r);
+
+    __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+    return _mm512_scalef_ps(p, k);
+}
+
+__attribute__((target("avx2,fma")))
+inline void vectorExpAVX2(double* x, int n)
+{
+    DREAMPLACE_VECTOR_EXP_LOOP(double, 4, _mm256_loadu_pd, _mm256_storeu_pd, exp256d)
+}
+
+__attribute__((target("avx2,fma")))
+inline void vectorExpAVX2(float* x, int n)
+{
+    DREAMPLACE_VECTOR_EXP_LOOP(float, 8, _mm256_loadu_ps, _mm256_storeu_ps, exp256f)
+}
+
+__attribute__((target("avx512f")))
+inline void vectorExpAVX512(double* x, int n)
+{
+    DREAMPLACE_VECTOR_EXP_LOOP(double, 8, _mm512_loadu_pd, _mm512_storeu_pd, exp512d)
+}
+
+__attribute__((target("avx512f")))
+inline void vectorExpAVX512(float* x, int n)
+{
+    DREAMPLACE_VECTOR_EXP_LOOP(float, 16, _mm512_loadu_ps, _mm512_storeu_ps, exp512f)
+}
+
+#undef DREAMPLACE_VECTOR_EXP_LOOP
+
+#endif
+
+/// @brief The widest instruction set supported by the host CPU
+inline VectorExpISA detectVectorExpISA()
+{
+#if DREAMPLACE_VECTOR_EXP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return VectorExpISA::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return VectorExpISA::AVX2;
+    }
+#endif
+    return VectorExpISA::SCALAR;
+}
+
+/// @brief Implementation of the vectorized exponential for an instruction set
+template <typename T>
+inline void (*vectorExpFunction(VectorExpISA isa))(T*, int)
+{
+    switch (isa)
+    {
+#if DREAMPLACE_VECTOR_EXP_X86
+        case VectorExpISA::AVX512:
+            return static_cast<void (*)(T*, int)>(vectorExpAVX512);
+        case VectorExpISA::AVX2:
+            return static_cast<void (*)(T*, int)>(vectorExpAVX2);
+#endif
+        default:
+            return vectorExpScalar<T>;
+    }
+}
+
+/// @brief Compute exp in place for an array of n elements.
+/// The instruction set is detected at the first call, so one binary runs on all x86 hosts.
+template <typename T>
+inline void vectorExp(T* x, int n)
+{
+    static void (*const func)(T*, int) = vectorExpFunction<T>(detectVectorExpISA());
+    func(x, n);
+}
+
+DREAMPLACE_END_NAMESPACE
+
+#endif
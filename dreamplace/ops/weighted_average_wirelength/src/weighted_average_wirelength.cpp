@@ -6,6 +6,9 @@
  */
 #include "utility/src/torch.h"
 #include "utility/src/Msg.h"
+#include "utility/src/net_degree_buckets.h"
+#include "utility/src/vector_exp.h"
+#include "utility/src/pin_position.h"
 
 DREAMPLACE_BEGIN_NAMESPACE
 
@@ -23,6 +26,18 @@ int computeWeightedAverageWirelengthLauncher(
         T* grad_x_tensor, T* grad_y_tensor
         );
 
+template <typename T, typename PinPos>
+int computeWeightedAverageWirelengthFusedLauncher(
+        const PinPos& pin_pos,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* net_degree_buckets,
+        const T* gamma,
+        T* wl,
+        int num_threads,
+        T* grad_intermediate_x, T* grad_intermediate_y
+        );
+
 #define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x " must be a flat tensor on CPU")
 #define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x " must have even number of elements")
 #define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x " must be contiguous")
@@ -71,6 +86,171 @@ at::Tensor weighted_average_wirelength_forward(
     return wl.sum();
 }
 
+/// @brief Compute weighted-average wirelength and the gradient of each pin in one pass.
+/// The gradient is computed for a unit output gradient, so backward only needs to scale it by grad_pos.
+/// @param pos cell locations, array of x locations and then y locations
+/// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_degree_buckets nets to compute grouped by degree, from degree_buckets
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @return the total wirelength and the intermediate gradient with the same layout as pos
+std::vector<at::Tensor> weighted_average_wirelength_fused_forward(
+        at::Tensor pos,
+        at::Tensor flat_netpin,
+        at::Tensor netpin_start,
+        at::Tensor net_degree_buckets,
+        at::Tensor gamma,
+        int num_threads
+        )
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(flat_netpin);
+    CHECK_CONTIGUOUS(flat_netpin);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_degree_buckets);
+    CHECK_CONTIGUOUS(net_degree_buckets);
+
+    int num_nets = netpin_start.numel()-1;
+    at::Tensor wl = at::zeros({num_nets}, pos.options());
+    at::Tensor grad_intermediate = at::zeros_like(pos);
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeWeightedAverageWirelengthFusedLauncher", [&] {
+            PinPositionFromPins<scalar_t> pin_pos = {pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2};
+            computeWeightedAverageWirelengthFusedLauncher<scalar_t>(
+                    pin_pos,
+                    flat_netpin.data<int>(),
+                    netpin_start.data<int>(),
+                    net_degree_buckets.data<int>(),
+                    gamma.data<scalar_t>(),
+                    wl.data<scalar_t>(),
+                    num_threads,
+                    grad_intermediate.data<scalar_t>(), grad_intermediate.data<scalar_t>()+pos.numel()/2
+                    );
+            });
+    return {wl.sum(), grad_intermediate};
+}
+
+/// @brief Compute weighted-average wirelength from cell locations and the gradient of each cell in one pass.
+/// Pin locations are computed on the fly from pin offsets, and the gradients of pins are summed up to cells.
+/// The gradient is computed for a unit output gradient, so backward only needs to scale it by grad_pos.
+/// @param pos cell locations, array of x locations and then y locations
+/// @param pin_offset_x pin offset x to its cell
+/// @param pin_offset_y pin offset y to its cell
+/// @param pin2node_map cell of each pin
+/// @param flat_node2pin similar to the JA array in CSR format, which is flattened from the node2pin map (array of array)
+/// @param flat_node2pin_start similar to the IA array in CSR format, the length is number of physical cells + 1
+/// @param pin_mask whether to ignore the gradient of a pin, 1 means to ignore, 0 means to compute; empty to compute all pins
+/// @param flat_netpin similar to the JA array in CSR format, which is flattened from the net2pin map (array of array)
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_degree_buckets nets to compute grouped by degree, from degree_buckets
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param grad_pin gradient buffer of pins owned by the caller with 2*num_pins elements,
+/// zero-initialized once; pins of ignored nets are never written, so they keep zero gradient
+/// @return the total wirelength and the intermediate gradient with the same layout as pos
+std::vector<at::Tensor> weighted_average_wirelength_fused_node_forward(
+        at::Tensor pos,
+        at::Tensor pin_offset_x,
+        at::Tensor pin_offset_y,
+        at::Tensor pin2node_map,
+        at::Tensor flat_node2pin,
+        at::Tensor flat_node2pin_start,
+        at::Tensor pin_mask,
+        at::Tensor flat_netpin,
+        at::Tensor netpin_start,
+        at::Tensor net_degree_buckets,
+        at::Tensor gamma,
+        at::Tensor grad_pin,
+        int num_threads
+        )
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(pin_offset_x);
+    CHECK_CONTIGUOUS(pin_offset_x);
+    CHECK_FLAT(pin_offset_y);
+    CHECK_CONTIGUOUS(pin_offset_y);
+    CHECK_FLAT(pin2node_map);
+    CHECK_CONTIGUOUS(pin2node_map);
+    CHECK_FLAT(flat_node2pin);
+    CHECK_CONTIGUOUS(flat_node2pin);
+    CHECK_FLAT(flat_node2pin_start);
+    CHECK_CONTIGUOUS(flat_node2pin_start);
+    CHECK_FLAT(pin_mask);
+    CHECK_CONTIGUOUS(pin_mask);
+    CHECK_FLAT(flat_netpin);
+    CHECK_CONTIGUOUS(flat_netpin);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_degree_buckets);
+    CHECK_CONTIGUOUS(net_degree_buckets);
+    CHECK_FLAT(grad_pin);
+    CHECK_CONTIGUOUS(grad_pin);
+
+    int num_nets = netpin_start.numel()-1;
+    int num_pins = pin2node_map.numel();
+    AT_ASSERTM(grad_pin.scalar_type() == pos.scalar_type(), "grad_pin must have the type of pos");
+    AT_ASSERTM(grad_pin.numel() == 2*num_pins, "grad_pin must hold 2*num_pins elements");
+    at::Tensor wl = at::zeros({num_nets}, pos.options());
+    // cells without pins, e.g., fillers, have zero gradient
+    at::Tensor grad_intermediate = at::zeros_like(pos);
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeWeightedAverageWirelengthFusedLauncher", [&] {
+            PinPositionFromNodes<scalar_t> pin_pos = {
+                pos.data<scalar_t>(), pos.data<scalar_t>()+pos.numel()/2,
+                pin_offset_x.data<scalar_t>(), pin_offset_y.data<scalar_t>(),
+                pin2node_map.data<int>()
+            };
+            computeWeightedAverageWirelengthFusedLauncher<scalar_t>(
+                    pin_pos,
+                    flat_netpin.data<int>(),
+                    netpin_start.data<int>(),
+                    net_degree_buckets.data<int>(),
+                    gamma.data<scalar_t>(),
+                    wl.data<scalar_t>(),
+                    num_threads,
+                    grad_pin.data<scalar_t>(), grad_pin.data<scalar_t>()+num_pins
+                    );
+            sumPinGradToNodes<scalar_t>(
+                    grad_pin.data<scalar_t>(), grad_pin.data<scalar_t>()+num_pins,
+                    flat_node2pin.data<int>(),
+                    flat_node2pin_start.data<int>(),
+                    (pin_mask.numel())? pin_mask.data<unsigned char>() : nullptr,
+                    flat_node2pin_start.numel()-1,
+                    num_threads,
+                    grad_intermediate.data<scalar_t>(), grad_intermediate.data<scalar_t>()+pos.numel()/2
+                    );
+            });
+    return {wl.sum(), grad_intermediate};
+}
+
+/// @brief Group nets by degree, which only needs to be done once for a netlist
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @return offsets of the degree buckets followed by the net indices, see buildNetDegreeBuckets
+at::Tensor weighted_average_wirelength_degree_buckets(
+        at::Tensor netpin_start,
+        at::Tensor net_mask
+        )
+{
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+
+    std::vector<int> buckets = buildNetDegreeBuckets(
+            netpin_start.data<int>(),
+            net_mask.data<unsigned char>(),
+            netpin_start.numel()-1
+            );
+    at::Tensor net_degree_buckets = at::empty({(int64_t)buckets.size()}, netpin_start.options());
+    std::copy(buckets.begin(), buckets.end(), net_degree_buckets.data<int>());
+    return net_degree_buckets;
+}
+
 /// @brief Compute gradient
 /// @param grad_pos input gradient from backward propagation
 /// @param pos locations of pins
@@ -225,9 +405,257 @@ int computeWeightedAverageWirelengthLauncher(
     return 0;
 }
 
+/// @brief Weighted-average wirelength and unit gradient of one net
+/// @tparam PinPos accessor of pin locations, see pin_position.h
+template <typename T, typename PinPos>
+struct WeightedAverageWirelengthNetKernel
+{
+    PinPos pin_pos;
+    const int* flat_netpin;
+    const int* netpin_start;
+    T gamma;
+    T* wl;
+    T* grad_intermediate_x;
+    T* grad_intermediate_y;
+    /// thread-local buffer for nets larger than the specialized degrees
+    std::vector<T> buf;
+
+    /// @tparam Degree degree of the net, 0 for any degree
+    template <int Degree>
+    void run(int i)
+    {
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = (Degree)? Degree : netpin_start[i+1]-netpin_start[i];
+
+        // pin locations are gathered once and the exponentials are computed once;
+        // small nets keep them in fixed-size arrays
+        T local[(Degree)? 6*Degree : 1];
+        T* xs = local;
+        if (!Degree)
+        {
+            if (buf.size() < (size_t)(6*degree))
+            {
+                buf.resize(6*degree);
+            }
+            xs = buf.data();
+        }
+        T* ys = xs+degree;
+        T* exp_x_buf = ys+degree;
+        T* exp_nx_buf = exp_x_buf+degree;
+        T* exp_y_buf = exp_nx_buf+degree;
+        T* exp_ny_buf = exp_y_buf+degree;
+
+        T x_max = -std::numeric_limits<T>::max();
+        T x_min = std::numeric_limits<T>::max();
+        T y_max = -std::numeric_limits<T>::max();
+        T y_min = std::numeric_limits<T>::max();
+        for (int j = 0; j < degree; ++j)
+        {
+            T xx = pin_pos.getX(pins[j]);
+            T yy = pin_pos.getY(pins[j]);
+            xs[j] = xx;
+            ys[j] = yy;
+            x_max = std::max(xx, x_max);
+            x_min = std::min(xx, x_min);
+            y_max = std::max(yy, y_max);
+            y_min = std::min(yy, y_min);
+        }
+
+        // the four exponentials of all pins are contiguous in the buffer
+        // and evaluated with one call to the vectorized exponential
+        for (int j = 0; j < degree; ++j)
+        {
+            exp_x_buf[j] = (xs[j]-x_max)/gamma;
+            exp_nx_buf[j] = -(xs[j]-x_min)/gamma;
+            exp_y_buf[j] = (ys[j]-y_max)/gamma;
+            exp_ny_buf[j] = -(ys[j]-y_min)/gamma;
+        }
+        vectorExp(exp_x_buf, degree<<2);
+
+        T xexp_x_sum = 0;
+        T xexp_nx_sum = 0;
+        T exp_x_sum = 0;
+        T exp_nx_sum = 0;
+
+        T yexp_y_sum = 0;
+        T yexp_ny_sum = 0;
+        T exp_y_sum = 0;
+        T exp_ny_sum = 0;
+        for (int j = 0; j < degree; ++j)
+        {
+            // for x
+            T xx = xs[j];
+            xexp_x_sum += xx*exp_x_buf[j];
+            xexp_nx_sum += xx*exp_nx_buf[j];
+            exp_x_sum += exp_x_buf[j];
+            exp_nx_sum += exp_nx_buf[j];
+
+            // for y
+            T yy = ys[j];
+            yexp_y_sum += yy*exp_y_buf[j];
+            yexp_ny_sum += yy*exp_ny_buf[j];
+            exp_y_sum += exp_y_buf[j];
+            exp_ny_sum += exp_ny_buf[j];
+        }
+
+        // wirelength
+        T wl_x = xexp_x_sum/exp_x_sum - xexp_nx_sum/exp_nx_sum;
+        T wl_y = yexp_y_sum/exp_y_sum - yexp_ny_sum/exp_ny_sum;
+        wl[i] = wl_x + wl_y;
+
+        // gradient
+        T b_x = 1.0/(gamma*exp_x_sum);
+        T a_x = (1.0 - b_x*xexp_x_sum)/exp_x_sum;
+        T b_nx = -1.0/(gamma*exp_nx_sum);
+        T a_nx = (1.0 - b_nx*xexp_nx_sum)/exp_nx_sum;
+
+        T b_y = 1.0/(gamma*exp_y_sum);
+        T a_y = (1.0 - b_y*yexp_y_sum)/exp_y_sum;
+        T b_ny = -1.0/(gamma*exp_ny_sum);
+        T a_ny = (1.0 - b_ny*yexp_ny_sum)/exp_ny_sum;
+        for (int j = 0; j < degree; ++j)
+        {
+            int pin_id = pins[j];
+            grad_intermediate_x[pin_id] = (a_x + b_x*xs[j])*exp_x_buf[j] - (a_nx + b_nx*xs[j])*exp_nx_buf[j];
+            grad_intermediate_y[pin_id] = (a_y + b_y*ys[j])*exp_y_buf[j] - (a_ny + b_ny*ys[j])*exp_ny_buf[j];
+        }
+    }
+
+    /// @brief same as run, but the min/max, the exponentials, the sums and the gradient
+    /// of a high-fanout net are computed with all threads
+    void runHighFanout(int i, int num_threads)
+    {
+        const int* pins = flat_netpin+netpin_start[i];
+        int degree = netpin_start[i+1]-netpin_start[i];
+        int num_chunks = (degree+kHighFanoutNetChunkSize-1)/kHighFanoutNetChunkSize;
+
+        if (buf.size() < (size_t)(6*degree))
+        {
+            buf.resize(6*degree);
+        }
+        T* xs = buf.data();
+        T* ys = xs+degree;
+        T* exp_x_buf = ys+degree;
+        T* exp_nx_buf = exp_x_buf+degree;
+        T* exp_y_buf = exp_nx_buf+degree;
+        T* exp_ny_buf = exp_y_buf+degree;
+
+        T x_max = -std::numeric_limits<T>::max();
+        T x_min = std::numeric_limits<T>::max();
+        T y_max = -std::numeric_limits<T>::max();
+        T y_min = std::numeric_limits<T>::max();
+#pragma omp parallel for num_threads(num_threads) schedule(static, kHighFanoutNetChunkSize) reduction(min:x_min,y_min) reduction(max:x_max,y_max)
+        for (int j = 0; j < degree; ++j)
+        {
+            T xx = pin_pos.getX(pins[j]);
+            T yy = pin_pos.getY(pins[j]);
+            xs[j] = xx;
+            ys[j] = yy;
+            x_max = std::max(xx, x_max);
+            x_min = std::min(xx, x_min);
+            y_max = std::max(yy, y_max);
+            y_min = std::min(yy, y_min);
+        }
+
+        T xexp_x_sum = 0;
+        T xexp_nx_sum = 0;
+        T exp_x_sum = 0;
+        T exp_nx_sum = 0;
+
+        T yexp_y_sum = 0;
+        T yexp_ny_sum = 0;
+        T exp_y_sum = 0;
+        T exp_ny_sum = 0;
+        // each chunk evaluates its exponentials with the vectorized exponential
+#pragma omp parallel for num_threads(num_threads) schedule(static) \
+        reduction(+:xexp_x_sum,xexp_nx_sum,exp_x_sum,exp_nx_sum,yexp_y_sum,yexp_ny_sum,exp_y_sum,exp_ny_sum)
+        for (int c = 0; c < num_chunks; ++c)
+        {
+            int begin = c*kHighFanoutNetChunkSize;
+            int end = std::min(begin+(int)kHighFanoutNetChunkSize, degree);
+            for (int j = begin; j < end; ++j)
+            {
+                exp_x_buf[j] = (xs[j]-x_max)/gamma;
+                exp_nx_buf[j] = -(xs[j]-x_min)/gamma;
+                exp_y_buf[j] = (ys[j]-y_max)/gamma;
+                exp_ny_buf[j] = -(ys[j]-y_min)/gamma;
+            }
+            vectorExp(exp_x_buf+begin, end-begin);
+            vectorExp(exp_nx_buf+begin, end-begin);
+            vectorExp(exp_y_buf+begin, end-begin);
+            vectorExp(exp_ny_buf+begin, end-begin);
+            for (int j = begin; j < end; ++j)
+            {
+                T xx = xs[j];
+                xexp_x_sum += xx*exp_x_buf[j];
+                xexp_nx_sum += xx*exp_nx_buf[j];
+                exp_x_sum += exp_x_buf[j];
+                exp_nx_sum += exp_nx_buf[j];
+
+                T yy = ys[j];
+                yexp_y_sum += yy*exp_y_buf[j];
+                yexp_ny_sum += yy*exp_ny_buf[j];
+                exp_y_sum += exp_y_buf[j];
+                exp_ny_sum += exp_ny_buf[j];
+            }
+        }
+
+        // wirelength
+        T wl_x = xexp_x_sum/exp_x_sum - xexp_nx_sum/exp_nx_sum;
+        T wl_y = yexp_y_sum/exp_y_sum - yexp_ny_sum/exp_ny_sum;
+        wl[i] = wl_x + wl_y;
+
+        // gradient
+        T b_x = 1.0/(gamma*exp_x_sum);
+        T a_x = (1.0 - b_x*xexp_x_sum)/exp_x_sum;
+        T b_nx = -1.0/(gamma*exp_nx_sum);
+        T a_nx = (1.0 - b_nx*xexp_nx_sum)/exp_nx_sum;
+
+        T b_y = 1.0/(gamma*exp_y_sum);
+        T a_y = (1.0 - b_y*yexp_y_sum)/exp_y_sum;
+        T b_ny = -1.0/(gamma*exp_ny_sum);
+        T a_ny = (1.0 - b_ny*yexp_ny_sum)/exp_ny_sum;
+#pragma omp parallel for num_threads(num_threads) schedule(static, kHighFanoutNetChunkSize)
+        for (int j = 0; j < degree; ++j)
+        {
+            int pin_id = pins[j];
+            grad_intermediate_x[pin_id] = (a_x + b_x*xs[j])*exp_x_buf[j] - (a_nx + b_nx*xs[j])*exp_nx_buf[j];
+            grad_intermediate_y[pin_id] = (a_y + b_y*ys[j])*exp_y_buf[j] - (a_ny + b_ny*ys[j])*exp_ny_buf[j];
+        }
+    }
+};
+
+template <typename T, typename PinPos>
+int computeWeightedAverageWirelengthFusedLauncher(
+        const PinPos& pin_pos,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* net_degree_buckets,
+        const T* gamma,
+        T* wl,
+        int num_threads,
+        T* grad_intermediate_x, T* grad_intermediate_y
+        )
+{
+    WeightedAverageWirelengthNetKernel<T, PinPos> kernel;
+    kernel.pin_pos = pin_pos;
+    kernel.flat_netpin = flat_netpin;
+    kernel.netpin_start = netpin_start;
+    kernel.gamma = *gamma;
+    kernel.wl = wl;
+    kernel.grad_intermediate_x = grad_intermediate_x;
+    kernel.grad_intermediate_y = grad_intermediate_y;
+    forEachNetByDegree(net_degree_buckets, num_threads, kernel);
+
+    return 0;
+}
+
 DREAMPLACE_END_NAMESPACE
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  m.def("degree_buckets", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_degree_buckets, "Group nets by degree");
   m.def("forward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_forward, "WeightedAverageWirelength forward");
   m.def("backward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_backward, "WeightedAverageWirelength backward");
+  m.def("fused_forward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_fused_forward, "WeightedAverageWirelength forward with gradient");
+  m.def("fused_node_forward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_fused_node_forward, "WeightedAverageWirelength forward with gradient from cell locations");
 }
@@ -0,0 +1,323 @@
+/**
+ * @file   weighted_average_wirelength_atomic.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Compute weighted-average wirelength and gradient in parallel over pins on CPU
+ */
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+#include "utility/src/parallel_reduce.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+template <typename T>
+int computeWeightedAverageWirelengthAtomicLauncher(
+        const T* x, const T* y,
+        const int* pin2net_map,
+        const int* netpin_start,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xyexp_xy_sum, T* xyexp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl, // wirelength of each net
+        int num_threads
+        );
+
+template <typename T>
+int computeWeightedAverageWirelengthGradAtomicLauncher(
+        const T* x, const T* y,
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const T* xyexp_xy_sum, const T* xyexp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        );
+
+#define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x " must be a flat tensor on CPU")
+#define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x " must have even number of elements")
+#define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x " must be contiguous")
+
+/// @brief Compute weighted average wirelength with parallelization over pins.
+/// Pins are grouped by contiguous ranges of nets, and each thread accumulates the pins of the ranges it owns,
+/// so no atomic operation or thread-local copy of the net arrays is needed.
+/// Scratch takes O(#pins), and the pins of a net are summed in index order
+/// regardless of the number of threads.
+///
+/// @param pos location of pins, x array followed by y array.
+/// @param pin2net_map map pin to net
+/// @param netpin_start similar to the IA array in CSR format, IA[i+1]-IA[i] is the number of pins in each net, the length of IA is number of nets + 1
+/// @param net_mask whether compute the wirelength for a net or not
+/// @param gamma gamma coefficient in weighted average wirelength.
+/// @param num_threads number of threads
+/// @return total wirelength cost with auxiliary tensors for backward propagation.
+std::vector<at::Tensor> weighted_average_wirelength_atomic_forward(
+        at::Tensor pos,
+        at::Tensor pin2net_map,
+        at::Tensor netpin_start,
+        at::Tensor net_mask,
+        at::Tensor gamma,
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+    AT_ASSERTM(netpin_start.numel() == net_mask.numel()+1, "netpin_start must have number of nets + 1 elements");
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    at::Tensor wl = at::zeros({num_nets}, pos.options());
+    at::Tensor exp_xy = at::zeros_like(pos);
+    at::Tensor exp_nxy = at::zeros_like(pos);
+    at::Tensor exp_xy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor exp_nxy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor xyexp_xy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor xyexp_nxy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor xy_max = at::empty({2, num_nets}, pos.options());
+    at::Tensor xy_min = at::empty({2, num_nets}, pos.options());
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeWeightedAverageWirelengthAtomicLauncher", [&] {
+            computeWeightedAverageWirelengthAtomicLauncher<scalar_t>(
+                    pos.data<scalar_t>(), pos.data<scalar_t>()+num_pins,
+                    pin2net_map.data<int>(),
+                    netpin_start.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    gamma.data<scalar_t>(),
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    xyexp_xy_sum.data<scalar_t>(), xyexp_nxy_sum.data<scalar_t>(),
+                    xy_max.data<scalar_t>(), xy_min.data<scalar_t>(),
+                    wl.data<scalar_t>(),
+                    num_threads
+                    );
+            });
+
+    return {wl.sum(), exp_xy, exp_nxy, exp_xy_sum, exp_nxy_sum, xyexp_xy_sum, xyexp_nxy_sum};
+}
+
+/// @brief Compute gradient
+/// @param grad_pos input gradient from backward propagation
+/// @param pos locations of pins
+/// @param exp_xy array of exp(x/gamma) and then exp(y/gamma)
+/// @param exp_nxy array of exp(-x/gamma) and then exp(-y/gamma)
+/// @param exp_xy_sum array of \sum(exp(x/gamma)) for each net and then \sum(exp(y/gamma))
+/// @param exp_nxy_sum array of \sum(exp(-x/gamma)) for each net and then \sum(exp(-y/gamma))
+/// @param xyexp_xy_sum array of \sum(x*exp(x/gamma)) for each net and then \sum(y*exp(y/gamma))
+/// @param xyexp_nxy_sum array of \sum(x*exp(-x/gamma)) for each net and then \sum(y*exp(-y/gamma))
+/// @param pin2net_map map pin to net
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param num_threads number of threads
+at::Tensor weighted_average_wirelength_atomic_backward(
+        at::Tensor grad_pos,
+        at::Tensor pos,
+        at::Tensor exp_xy, at::Tensor exp_nxy,
+        at::Tensor exp_xy_sum, at::Tensor exp_nxy_sum,
+        at::Tensor xyexp_xy_sum, at::Tensor xyexp_nxy_sum,
+        at::Tensor pin2net_map,
+        at::Tensor net_mask,
+        at::Tensor gamma,
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(exp_xy);
+    CHECK_EVEN(exp_xy);
+    CHECK_CONTIGUOUS(exp_xy);
+    CHECK_FLAT(exp_nxy);
+    CHECK_EVEN(exp_nxy);
+    CHECK_CONTIGUOUS(exp_nxy);
+    CHECK_FLAT(exp_xy_sum);
+    CHECK_EVEN(exp_xy_sum);
+    CHECK_CONTIGUOUS(exp_xy_sum);
+    CHECK_FLAT(exp_nxy_sum);
+    CHECK_EVEN(exp_nxy_sum);
+    CHECK_CONTIGUOUS(exp_nxy_sum);
+    CHECK_FLAT(xyexp_xy_sum);
+    CHECK_EVEN(xyexp_xy_sum);
+    CHECK_CONTIGUOUS(xyexp_xy_sum);
+    CHECK_FLAT(xyexp_nxy_sum);
+    CHECK_EVEN(xyexp_nxy_sum);
+    CHECK_CONTIGUOUS(xyexp_nxy_sum);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+    at::Tensor grad_out = at::zeros_like(pos);
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeWeightedAverageWirelengthGradAtomicLauncher", [&] {
+            computeWeightedAverageWirelengthGradAtomicLauncher<scalar_t>(
+                    pos.data<scalar_t>(), pos.data<scalar_t>()+num_pins,
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    xyexp_xy_sum.data<scalar_t>(), xyexp_nxy_sum.data<scalar_t>(),
+                    pin2net_map.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    gamma.data<scalar_t>(),
+                    grad_pos.data<scalar_t>(),
+                    num_threads,
+                    grad_out.data<scalar_t>(), grad_out.data<scalar_t>()+num_pins
+                    );
+            });
+    return grad_out;
+}
+
+template <typename T>
+int computeWeightedAverageWirelengthAtomicLauncher(
+        const T* x, const T* y,
+        const int* pin2net_map,
+        const int* netpin_start,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xyexp_xy_sum, T* xyexp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl,
+        int num_threads
+        )
+{
+    if (num_nets == 0)
+    {
+        return 0;
+    }
+
+    // pins are grouped by ranges of nets with similar numbers of pins,
+    // so that each net is updated by only one thread without atomic operations;
+    // more ranges than threads balance the work
+    NetRangePins range_pins;
+    groupPinsByNetRanges(pin2net_map, net_mask, netpin_start, num_nets, num_pins, num_threads*4, num_threads, range_pins);
+    int num_ranges = range_pins.numRanges();
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+    for (int r = 0; r < num_ranges; ++r)
+    {
+        const int* pins = range_pins.pins.data();
+        int pin_begin = range_pins.pin_start[r];
+        int pin_end = range_pins.pin_start[r+1];
+        int net_begin = range_pins.net_start[r];
+        int net_end = range_pins.net_start[r+1];
+
+        // max/min of x and y for each net of the range
+        for (int i = net_begin; i < net_end; ++i)
+        {
+            xy_max[i] = xy_max[num_nets+i] = -std::numeric_limits<T>::max();
+            xy_min[i] = xy_min[num_nets+i] = std::numeric_limits<T>::max();
+        }
+        for (int j = pin_begin; j < pin_end; ++j)
+        {
+            int i = pins[j];
+            int net_id = pin2net_map[i];
+            xy_max[net_id] = std::max(xy_max[net_id], x[i]);
+            xy_max[num_nets+net_id] = std::max(xy_max[num_nets+net_id], y[i]);
+            xy_min[net_id] = std::min(xy_min[net_id], x[i]);
+            xy_min[num_nets+net_id] = std::min(xy_min[num_nets+net_id], y[i]);
+        }
+
+        // exponentials and their sums
+        for (int j = pin_begin; j < pin_end; ++j)
+        {
+            int i = pins[j];
+            int net_id = pin2net_map[i];
+            for (int k = 0; k < 2; ++k)
+            {
+                T xx = (k)? y[i] : x[i];
+                int pin_offset = k*num_pins+i;
+                int net_offset = k*num_nets+net_id;
+
+                exp_xy[pin_offset] = exp((xx-xy_max[net_offset])/(*gamma));
+                exp_nxy[pin_offset] = exp(-(xx-xy_min[net_offset])/(*gamma));
+                exp_xy_sum[net_offset] += exp_xy[pin_offset];
+                exp_nxy_sum[net_offset] += exp_nxy[pin_offset];
+                xyexp_xy_sum[net_offset] += xx*exp_xy[pin_offset];
+                xyexp_nxy_sum[net_offset] += xx*exp_nxy[pin_offset];
+            }
+        }
+
+        for (int i = net_begin; i < net_end; ++i)
+        {
+            if (net_mask[i])
+            {
+                wl[i] = xyexp_xy_sum[i]/exp_xy_sum[i] - xyexp_nxy_sum[i]/exp_nxy_sum[i]
+                    + xyexp_xy_sum[num_nets+i]/exp_xy_sum[num_nets+i] - xyexp_nxy_sum[num_nets+i]/exp_nxy_sum[num_nets+i];
+            }
+        }
+    }
+
+    return 0;
+}
+
+template <typename T>
+int computeWeightedAverageWirelengthGradAtomicLauncher(
+        const T* x, const T* y,
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const T* xyexp_xy_sum, const T* xyexp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        )
+{
+    T gamma_inv = 1.0/(*gamma);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < num_pins; ++i)
+    {
+        int net_id = pin2net_map[i];
+        if (net_id >= 0 && net_mask[net_id])
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                T xx = (k)? y[i] : x[i];
+                T* grad = (k)? grad_y_tensor : grad_x_tensor;
+                int pin_offset = k*num_pins;
+                int net_offset = k*num_nets+net_id;
+
+                T exp_sum = exp_xy_sum[net_offset];
+                T nexp_sum = exp_nxy_sum[net_offset];
+                grad[i] = (
+                        ((1+gamma_inv*xx)*exp_sum - gamma_inv*xyexp_xy_sum[net_offset]) / (exp_sum*exp_sum) * exp_xy[pin_offset+i]
+                        - ((1-gamma_inv*xx)*nexp_sum + gamma_inv*xyexp_nxy_sum[net_offset]) / (nexp_sum*nexp_sum) * exp_nxy[pin_offset+i]
+                        ) * (*grad_tensor);
+            }
+        }
+    }
+
+    return 0;
+}
+
+DREAMPLACE_END_NAMESPACE
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  m.def("forward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_atomic_forward, "WeightedAverageWirelength forward (CPU atomic)");
+  m.def("backward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_atomic_backward, "WeightedAverageWirelength backward (CPU atomic)");
+}
@@ -0,0 +1,373 @@
+/**
+ * @file   weighted_average_wirelength_sparse.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Compute weighted-average wirelength and gradient with CSR net-to-pin map on CPU
+ */
+#include "utility/src/torch.h"
+#include "utility/src/Msg.h"
+#include "utility/src/parallel_reduce.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+template <typename T>
+int computeWeightedAverageWirelengthSparseLauncher(
+        const T* x, const T* y,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xyexp_xy_sum, T* xyexp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl, // wirelength of each net
+        int num_threads
+        );
+
+template <typename T>
+int computeWeightedAverageWirelengthGradSparseLauncher(
+        const T* x, const T* y,
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const T* xyexp_xy_sum, const T* xyexp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        );
+
+#define CHECK_FLAT(x) AT_ASSERTM(!x.is_cuda() && x.ndimension() == 1, #x " must be a flat tensor on CPU")
+#define CHECK_EVEN(x) AT_ASSERTM((x.numel()&1) == 0, #x " must have even number of elements")
+#define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x " must be contiguous")
+
+/// @brief Compute weighted average wirelength with the CSR net-to-pin map.
+/// The pins are evenly split among threads regardless of net degrees,
+/// and nets cut by thread boundaries are merged without atomic operations.
+///
+/// In the parameters, (flat_netpin, netpin_start) forms the CSR sparse matrix (JA, IA) of #nets x #pins.
+///
+/// @param pos location of pins, x array followed by y array.
+/// @param flat_netpin consists pins of each net, pins belonging to the same net are abutting to each other.
+/// @param netpin_start bookmark for the starting index of each net in flat_netpin. The length is number of nets + 1. The last entry equals to the number of pins.
+/// @param pin2net_map an array mapping a pin to its net.
+/// @param net_mask a boolean mask to mask the nets that need to be computed. The value is 0 if a net should be ignored.
+/// @param gamma gamma coefficient in weighted average wirelength.
+/// @param num_threads number of threads
+/// @return total wirelength cost with auxiliary tensors for backward propagation.
+std::vector<at::Tensor> weighted_average_wirelength_sparse_forward(
+        at::Tensor pos,
+        at::Tensor flat_netpin,
+        at::Tensor netpin_start,
+        at::Tensor pin2net_map,
+        at::Tensor net_mask,
+        at::Tensor gamma,
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(flat_netpin);
+    CHECK_CONTIGUOUS(flat_netpin);
+    CHECK_FLAT(netpin_start);
+    CHECK_CONTIGUOUS(netpin_start);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    at::Tensor wl = at::zeros({num_nets}, pos.options());
+    at::Tensor exp_xy = at::zeros_like(pos);
+    at::Tensor exp_nxy = at::zeros_like(pos);
+    at::Tensor exp_xy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor exp_nxy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor xyexp_xy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor xyexp_nxy_sum = at::zeros({2, num_nets}, pos.options());
+    at::Tensor xy_max = at::zeros({2, num_nets}, pos.options());
+    at::Tensor xy_min = at::zeros({2, num_nets}, pos.options());
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeWeightedAverageWirelengthSparseLauncher", [&] {
+            computeWeightedAverageWirelengthSparseLauncher<scalar_t>(
+                    pos.data<scalar_t>(), pos.data<scalar_t>()+num_pins,
+                    flat_netpin.data<int>(),
+                    netpin_start.data<int>(),
+                    pin2net_map.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    gamma.data<scalar_t>(),
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    xyexp_xy_sum.data<scalar_t>(), xyexp_nxy_sum.data<scalar_t>(),
+                    xy_max.data<scalar_t>(), xy_min.data<scalar_t>(),
+                    wl.data<scalar_t>(),
+                    num_threads
+                    );
+            });
+
+    return {wl.sum(), exp_xy, exp_nxy, exp_xy_sum, exp_nxy_sum, xyexp_xy_sum, xyexp_nxy_sum};
+}
+
+/// @brief Compute gradient
+/// @param grad_pos input gradient from backward propagation
+/// @param pos locations of pins
+/// @param exp_xy array of exp(x/gamma) and then exp(y/gamma)
+/// @param exp_nxy array of exp(-x/gamma) and then exp(-y/gamma)
+/// @param exp_xy_sum array of \sum(exp(x/gamma)) for each net and then \sum(exp(y/gamma))
+/// @param exp_nxy_sum array of \sum(exp(-x/gamma)) for each net and then \sum(exp(-y/gamma))
+/// @param xyexp_xy_sum array of \sum(x*exp(x/gamma)) for each net and then \sum(y*exp(y/gamma))
+/// @param xyexp_nxy_sum array of \sum(x*exp(-x/gamma)) for each net and then \sum(y*exp(-y/gamma))
+/// @param pin2net_map map pin to net
+/// @param net_mask an array to record whether compute the where for a net or not
+/// @param gamma a scalar tensor for the parameter in the equation
+/// @param num_threads number of threads
+at::Tensor weighted_average_wirelength_sparse_backward(
+        at::Tensor grad_pos,
+        at::Tensor pos,
+        at::Tensor exp_xy, at::Tensor exp_nxy,
+        at::Tensor exp_xy_sum, at::Tensor exp_nxy_sum,
+        at::Tensor xyexp_xy_sum, at::Tensor xyexp_nxy_sum,
+        at::Tensor pin2net_map,
+        at::Tensor net_mask,
+        at::Tensor gamma,
+        int num_threads)
+{
+    CHECK_FLAT(pos);
+    CHECK_EVEN(pos);
+    CHECK_CONTIGUOUS(pos);
+    CHECK_FLAT(exp_xy);
+    CHECK_EVEN(exp_xy);
+    CHECK_CONTIGUOUS(exp_xy);
+    CHECK_FLAT(exp_nxy);
+    CHECK_EVEN(exp_nxy);
+    CHECK_CONTIGUOUS(exp_nxy);
+    CHECK_FLAT(exp_xy_sum);
+    CHECK_EVEN(exp_xy_sum);
+    CHECK_CONTIGUOUS(exp_xy_sum);
+    CHECK_FLAT(exp_nxy_sum);
+    CHECK_EVEN(exp_nxy_sum);
+    CHECK_CONTIGUOUS(exp_nxy_sum);
+    CHECK_FLAT(xyexp_xy_sum);
+    CHECK_EVEN(xyexp_xy_sum);
+    CHECK_CONTIGUOUS(xyexp_xy_sum);
+    CHECK_FLAT(xyexp_nxy_sum);
+    CHECK_EVEN(xyexp_nxy_sum);
+    CHECK_CONTIGUOUS(xyexp_nxy_sum);
+    CHECK_FLAT(pin2net_map);
+    CHECK_CONTIGUOUS(pin2net_map);
+    CHECK_FLAT(net_mask);
+    CHECK_CONTIGUOUS(net_mask);
+    at::Tensor grad_out = at::zeros_like(pos);
+
+    int num_nets = net_mask.numel();
+    int num_pins = pin2net_map.numel();
+
+    AT_DISPATCH_FLOATING_TYPES(pos.type(), "computeWeightedAverageWirelengthGradSparseLauncher", [&] {
+            computeWeightedAverageWirelengthGradSparseLauncher<scalar_t>(
+                    pos.data<scalar_t>(), pos.data<scalar_t>()+num_pins,
+                    exp_xy.data<scalar_t>(), exp_nxy.data<scalar_t>(),
+                    exp_xy_sum.data<scalar_t>(), exp_nxy_sum.data<scalar_t>(),
+                    xyexp_xy_sum.data<scalar_t>(), xyexp_nxy_sum.data<scalar_t>(),
+                    pin2net_map.data<int>(),
+                    net_mask.data<unsigned char>(),
+                    num_nets,
+                    num_pins,
+                    gamma.data<scalar_t>(),
+                    grad_pos.data<scalar_t>(),
+                    num_threads,
+                    grad_out.data<scalar_t>(), grad_out.data<scalar_t>()+num_pins
+                    );
+            });
+    return grad_out;
+}
+
+/// @brief bounding box of a net
+template <typename T>
+struct WeightedAverageNetBox
+{
+    T x_max;
+    T y_max;
+    T x_min;
+    T y_min;
+};
+
+/// @brief sums of exponentials of a net, indexed by direction
+template <typename T>
+struct WeightedAverageNetSum
+{
+    T exp_sum[2];
+    T nexp_sum[2];
+    T xyexp_sum[2];
+    T xynexp_sum[2];
+};
+
+template <typename T>
+int computeWeightedAverageWirelengthSparseLauncher(
+        const T* x, const T* y,
+        const int* flat_netpin,
+        const int* netpin_start,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        T* exp_xy, T* exp_nxy,
+        T* exp_xy_sum, T* exp_nxy_sum,
+        T* xyexp_xy_sum, T* xyexp_nxy_sum,
+        T* xy_max, T* xy_min,
+        T* wl,
+        int num_threads
+        )
+{
+    typedef WeightedAverageNetBox<T> Box;
+    typedef WeightedAverageNetSum<T> Sum;
+
+    // max/min of x and y for each net
+    segmentedReduceNetPins<Box>(flat_netpin, netpin_start, num_nets, num_threads,
+            []() {
+                T inf = std::numeric_limits<T>::max();
+                return Box {-inf, -inf, inf, inf};
+            },
+            [&](int net_id, int pin_id, Box& box) {
+                if (net_mask[net_id])
+                {
+                    box.x_max = std::max(box.x_max, x[pin_id]);
+                    box.y_max = std::max(box.y_max, y[pin_id]);
+                    box.x_min = std::min(box.x_min, x[pin_id]);
+                    box.y_min = std::min(box.y_min, y[pin_id]);
+                }
+            },
+            [](Box& box, const Box& other) {
+                box.x_max = std::max(box.x_max, other.x_max);
+                box.y_max = std::max(box.y_max, other.y_max);
+                box.x_min = std::min(box.x_min, other.x_min);
+                box.y_min = std::min(box.y_min, other.y_min);
+            },
+            [&](int net_id, const Box& box) {
+                xy_max[net_id] = box.x_max;
+                xy_max[num_nets+net_id] = box.y_max;
+                xy_min[net_id] = box.x_min;
+                xy_min[num_nets+net_id] = box.y_min;
+            }
+            );
+
+    // exponentials are independent for each pin
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < num_pins; ++i)
+    {
+        int net_id = pin2net_map[i];
+        if (net_id >= 0 && net_mask[net_id])
+        {
+            exp_xy[i] = exp((x[i]-xy_max[net_id])/(*gamma));
+            exp_nxy[i] = exp(-(x[i]-xy_min[net_id])/(*gamma));
+            exp_xy[num_pins+i] = exp((y[i]-xy_max[num_nets+net_id])/(*gamma));
+            exp_nxy[num_pins+i] = exp(-(y[i]-xy_min[num_nets+net_id])/(*gamma));
+        }
+    }
+
+    // sums of exponentials and wirelength for each net
+    segmentedReduceNetPins<Sum>(flat_netpin, netpin_start, num_nets, num_threads,
+            []() {
+                return Sum {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+            },
+            [&](int net_id, int pin_id, Sum& sum) {
+                for (int k = 0; k < 2; ++k)
+                {
+                    T xx = (k)? y[pin_id] : x[pin_id];
+                    T exp_v = exp_xy[k*num_pins+pin_id];
+                    T exp_nv = exp_nxy[k*num_pins+pin_id];
+                    sum.exp_sum[k] += exp_v;
+                    sum.nexp_sum[k] += exp_nv;
+                    sum.xyexp_sum[k] += xx*exp_v;
+                    sum.xynexp_sum[k] += xx*exp_nv;
+                }
+            },
+            [](Sum& sum, const Sum& other) {
+                for (int k = 0; k < 2; ++k)
+                {
+                    sum.exp_sum[k] += other.exp_sum[k];
+                    sum.nexp_sum[k] += other.nexp_sum[k];
+                    sum.xyexp_sum[k] += other.xyexp_sum[k];
+                    sum.xynexp_sum[k] += other.xynexp_sum[k];
+                }
+            },
+            [&](int net_id, const Sum& sum) {
+                if (!net_mask[net_id])
+                {
+                    return;
+                }
+                T wl_xy = 0;
+                for (int k = 0; k < 2; ++k)
+                {
+                    exp_xy_sum[k*num_nets+net_id] = sum.exp_sum[k];
+                    exp_nxy_sum[k*num_nets+net_id] = sum.nexp_sum[k];
+                    xyexp_xy_sum[k*num_nets+net_id] = sum.xyexp_sum[k];
+                    xyexp_nxy_sum[k*num_nets+net_id] = sum.xynexp_sum[k];
+                    wl_xy += sum.xyexp_sum[k]/sum.exp_sum[k] - sum.xynexp_sum[k]/sum.nexp_sum[k];
+                }
+                wl[net_id] = wl_xy;
+            }
+            );
+
+    return 0;
+}
+
+template <typename T>
+int computeWeightedAverageWirelengthGradSparseLauncher(
+        const T* x, const T* y,
+        const T* exp_xy, const T* exp_nxy,
+        const T* exp_xy_sum, const T* exp_nxy_sum,
+        const T* xyexp_xy_sum, const T* xyexp_nxy_sum,
+        const int* pin2net_map,
+        const unsigned char* net_mask,
+        int num_nets,
+        int num_pins,
+        const T* gamma,
+        const T* grad_tensor,
+        int num_threads,
+        T* grad_x_tensor, T* grad_y_tensor
+        )
+{
+    T gamma_inv = 1.0/(*gamma);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < num_pins; ++i)
+    {
+        int net_id = pin2net_map[i];
+        if (net_id >= 0 && net_mask[net_id])
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                T xx = (k)? y[i] : x[i];
+                T* grad = (k)? grad_y_tensor : grad_x_tensor;
+                int pin_offset = k*num_pins;
+                int net_offset = k*num_nets+net_id;
+
+                T exp_sum = exp_xy_sum[net_offset];
+                T nexp_sum = exp_nxy_sum[net_offset];
+                grad[i] = (
+                        ((1+gamma_inv*xx)*exp_sum - gamma_inv*xyexp_xy_sum[net_offset]) / (exp_sum*exp_sum) * exp_xy[pin_offset+i]
+                        - ((1-gamma_inv*xx)*nexp_sum + gamma_inv*xyexp_nxy_sum[net_offset]) / (nexp_sum*nexp_sum) * exp_nxy[pin_offset+i]
+                        ) * (*grad_tensor);
+            }
+        }
+    }
+
+    return 0;
+}
+
+DREAMPLACE_END_NAMESPACE
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
+  m.def("forward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_sparse_forward, "WeightedAverageWirelength forward (CPU sparse)");
+  m.def("backward", &DREAMPLACE_NAMESPACE::weighted_average_wirelength_sparse_backward, "WeightedAverageWirelength backward (CPU sparse)");
+}
@@ -11,6 +11,8 @@ from torch import nn
 from torch.autograd import Function
 
 import dreamplace.ops.weighted_average_wirelength.weighted_average_wirelength_cpp as weighted_average_wirelength_cpp
+import dreamplace.ops.weighted_average_wirelength.weighted_average_wirelength_cpp_atomic as weighted_average_wirelength_cpp_atomic
+import dreamplace.ops.weighted_average_wirelength.weighted_average_wirelength_cpp_sparse as weighted_average_wirelength_cpp_sparse
 try:
     import dreamplace.ops.weighted_average_wirelength.weighted_average_wirelength_hip as weighted_average_wirelength_hip
     import dreamplace.ops.weighted_average_wirelength.weighted_average_wirelength_hip_atomic as weighted_average_wirelength_hip_atomic
@@ -24,19 +26,24 @@ class WeightedAverageWirelengthFunction(Function):
     @brief compute weighted average wirelength.
     """
     @staticmethod
-    def forward(ctx, pos, flat_netpin, netpin_start, net_mask, pin_mask, gamma, num_threads):
+    def forward(ctx, pos, flat_netpin, netpin_start, net_mask, net_degree_buckets, pin_mask, gamma, num_threads):
         """
         @param pos pin location (x array, y array), not cell location
         @param flat_netpin flat netpin map, length of #pins
         @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
         @param net_mask whether to compute wirelength, 1 means to compute, 0 means to ignore
+        @param net_degree_buckets nets grouped by degree for CPU, from weighted_average_wirelength_cpp.degree_buckets
         @param pin_mask whether compute gradient for a pin, 1 means to fill with zero, 0 means to compute
         @param gamma the smaller, the closer to HPWL
+        @param num_threads number of threads for CPU
         """
         if pos.is_cuda:
             output = weighted_average_wirelength_hip.forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_mask, gamma)
         else:
-            output = weighted_average_wirelength_cpp.forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_mask, gamma, num_threads)
+            # compute the gradient together with wirelength to avoid recomputing exponentials in backward
+            output = weighted_average_wirelength_cpp.fused_forward(pos.view(pos.numel()), flat_netpin, netpin_start, net_degree_buckets, gamma, num_threads)
+            ctx.grad_intermediate = output[1]
+            output = output[0]
         ctx.flat_netpin = flat_netpin
         ctx.netpin_start = netpin_start
         ctx.net_mask = net_mask
@@ -58,37 +65,74 @@ class WeightedAverageWirelengthFunction(Function):
                     ctx.gamma
                     )
         else:
-            output = weighted_average_wirelength_cpp.backward(
-                    grad_pos,
-                    ctx.pos,
-                    ctx.flat_netpin,
-                    ctx.netpin_start,
-                    ctx.net_mask,
-                    ctx.gamma,
-                    ctx.num_threads
-                    )
+            output = ctx.grad_intermediate.mul(grad_pos)
         output[:output.numel()//2].masked_fill_(ctx.pin_mask, 0.0)
         output[output.numel()//2:].masked_fill_(ctx.pin_mask, 0.0)
-        return output, None, None, None, None, None, None
+        return output, None, None, None, None, None, None, None
+
+class WeightedAverageWirelengthNodeFunction(Function):
+    """
+    @brief compute weighted average wirelength from cell locations on CPU.
+    Pin locations are computed on the fly and the gradient is summed up to cells directly.
+    """
+    @staticmethod
+    def forward(ctx, pos, pin_offset_x, pin_offset_y, pin2node_map, flat_node2pin, flat_node2pin_start, pin_mask, flat_netpin, netpin_start, net_degree_buckets, gamma, grad_pin, num_threads):
+        """
+        @param pos cell location (x array, y array), not pin location
+        @param pin_offset_x pin offset x to its cell
+        @param pin_offset_y pin offset y to its cell
+        @param pin2node_map cell of each pin
+        @param flat_node2pin flat node2pin map, length of #pins
+        @param flat_node2pin_start starting index in node2pin map for each cell, length of #physical cells+1
+        @param pin_mask whether compute gradient for a pin, 1 means to fill with zero, 0 means to compute, uint8
+        @param flat_netpin flat netpin map, length of #pins
+        @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
+        @param net_degree_buckets nets grouped by degree, from weighted_average_wirelength_cpp.degree_buckets
+        @param gamma the smaller, the closer to HPWL
+        @param grad_pin gradient buffer of pins, 2*#pins elements zero-initialized once and reused
+        @param num_threads number of threads for CPU
+        """
+        output = weighted_average_wirelength_cpp.fused_node_forward(
+                pos.view(pos.numel()),
+                pin_offset_x, pin_offset_y,
+                pin2node_map,
+                flat_node2pin, flat_node2pin_start,
+                pin_mask,
+                flat_netpin, netpin_start,
+                net_degree_buckets,
+                gamma,
+                grad_pin,
+                num_threads
+                )
+        ctx.grad_intermediate = output[1]
+        return output[0]
+
+    @staticmethod
+    def backward(ctx, grad_pos):
+        output = ctx.grad_intermediate.mul(grad_pos)
+        return output, None, None, None, None, None, None, None, None, None, None, None, None
 
 class WeightedAverageWirelengthAtomicFunction(Function):
     """
     @brief compute weighted average wirelength.
     """
     @staticmethod
-    def forward(ctx, pos, pin2net_map, net_mask, pin_mask, gamma):
+    def forward(ctx, pos, pin2net_map, netpin_start, net_mask, pin_mask, gamma, num_threads):
         """
         @param pos pin location (x array, y array), not cell location
         @param pin2net_map pin2net map
+        @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins;
+        used on CPU to split nets into ranges with similar numbers of pins
         @param net_mask whether to compute wirelength
         @param pin_mask whether compute gradient for a pin, 1 means to fill with zero, 0 means to compute
         @param gamma the smaller, the closer to HPWL
+        @param num_threads number of threads for CPU
         """
         #tt = time.time()
         if pos.is_cuda:
             output = weighted_average_wirelength_hip_atomic.forward(pos.view(pos.numel()), pin2net_map, net_mask, gamma)
         else:
-            assert 0, "CPU version NOT IMPLEMENTED"
+            output = weighted_average_wirelength_cpp_atomic.forward(pos.view(pos.numel()), pin2net_map, netpin_start, net_mask, gamma, num_threads)
         ctx.pin2net_map = pin2net_map
         ctx.net_mask = net_mask
         ctx.pin_mask = pin_mask
@@ -100,9 +144,11 @@ class WeightedAverageWirelengthAtomicFunction(Function):
         ctx.xyexp_xy_sum = output[5];
         ctx.xyexp_nxy_sum = output[6];
         ctx.pos = pos
+        ctx.num_threads = num_threads
         #if torch.isnan(ctx.exp_xy).any() or torch.isnan(ctx.exp_nxy).any() or torch.isnan(ctx.exp_xy_sum).any() or torch.isnan(ctx.exp_nxy_sum).any() or torch.isnan(output[0]).any():
         #    pdb.set_trace()
-        torch.cuda.synchronize()
+        if pos.is_cuda:
+            torch.cuda.synchronize()
         #print("\t\twirelength forward kernel takes %.3f ms" % ((time.time()-tt)*1000))
         return output[0]
 
@@ -121,33 +167,48 @@ class WeightedAverageWirelengthAtomicFunction(Function):
                     ctx.gamma
                     )
         else:
-            assert 0, "CPU version NOT IMPLEMENTED"
+            output = weighted_average_wirelength_cpp_atomic.backward(
+                    grad_pos,
+                    ctx.pos,
+                    ctx.exp_xy.view([-1]), ctx.exp_nxy.view([-1]),
+                    ctx.exp_xy_sum.view([-1]), ctx.exp_nxy_sum.view([-1]),
+                    ctx.xyexp_xy_sum.view([-1]), ctx.xyexp_nxy_sum.view([-1]),
+                    ctx.pin2net_map,
+                    ctx.net_mask,
+                    ctx.gamma,
+                    ctx.num_threads
+                    )
         output[:int(output.numel()//2)].masked_fill_(ctx.pin_mask, 0.0)
         output[int(output.numel()//2):].masked_fill_(ctx.pin_mask, 0.0)
         #if torch.isnan(output).any():
         #    pdb.set_trace()
-        torch.cuda.synchronize()
+        if grad_pos.is_cuda:
+            torch.cuda.synchronize()
         #print("\t\twirelength backward kernel %.3f ms" % ((time.time()-tt)*1000))
-        return output, None, None, None, None
+        return output, None, None, None, None, None, None
 
 class WeightedAverageWirelengthSparseFunction(Function):
     """
     @brief compute weighted average wirelength.
     """
     @staticmethod
-    def forward(ctx, pos, flat_netpin, netpin_start, netpin_values, pin2net_map, net_mask, pin_mask, gamma):
+    def forward(ctx, pos, flat_netpin, netpin_start, netpin_values, pin2net_map, net_mask, pin_mask, gamma, num_threads):
         """
         @param pos pin location (x array, y array), not cell location
+        @param flat_netpin flat netpin map, length of #pins
+        @param netpin_start starting index in netpin map for each net, length of #nets+1, the last entry is #pins
+        @param netpin_values all ones, only used by GPU
         @param pin2net_map pin2net map
         @param net_mask whether to compute wirelength
         @param pin_mask whether compute gradient for a pin, 1 means to fill with zero, 0 means to compute
         @param gamma the smaller, the closer to HPWL
+        @param num_threads number of threads for CPU
         """
         #tt = time.time()
         if pos.is_cuda:
             output = weighted_average_wirelength_hip_sparse.forward(pos.view(pos.numel()), flat_netpin, netpin_start, netpin_values, pin2net_map, net_mask, gamma)
         else:
-            assert 0, "CPU version NOT IMPLEMENTED"
+            output = weighted_average_wirelength_cpp_sparse.forward(pos.view(pos.numel()), flat_netpin, netpin_start, pin2net_map, net_mask, gamma, num_threads)
         ctx.pin2net_map = pin2net_map
         ctx.net_mask = net_mask
         ctx.pin_mask = pin_mask
@@ -159,9 +220,11 @@ class WeightedAverageWirelengthSparseFunction(Function):
         ctx.xyexp_xy_sum = output[5];
         ctx.xyexp_nxy_sum = output[6];
         ctx.pos = pos
+        ctx.num_threads = num_threads
         #if torch.isnan(ctx.exp_xy).any() or torch.isnan(ctx.exp_nxy).any() or torch.isnan(ctx.exp_xy_sum).any() or torch.isnan(ctx.exp_nxy_sum).any() or torch.isnan(output[0]).any():
         #    pdb.set_trace()
-        torch.cuda.synchronize()
+        if pos.is_cuda:
+            torch.cuda.synchronize()
         #print("\t\twirelength forward kernel takes %.3f ms" % ((time.time()-tt)*1000))
         return output[0]
 
@@ -180,23 +243,36 @@ class WeightedAverageWirelengthSparseFunction(Function):
                     ctx.gamma
                     )
         else:
-            assert 0, "CPU version NOT IMPLEMENTED"
+            output = weighted_average_wirelength_cpp_sparse.backward(
+                    grad_pos,
+                    ctx.pos,
+                    ctx.exp_xy.view([-1]), ctx.exp_nxy.view([-1]),
+                    ctx.exp_xy_sum.view([-1]), ctx.exp_nxy_sum.view([-1]),
+                    ctx.xyexp_xy_sum.view([-1]), ctx.xyexp_nxy_sum.view([-1]),
+                    ctx.pin2net_map,
+                    ctx.net_mask,
+                    ctx.gamma,
+                    ctx.num_threads
+                    )
         output[:output.numel()//2].masked_fill_(ctx.pin_mask, 0.0)
         output[output.numel()//2:].masked_fill_(ctx.pin_mask, 0.0)
         #if torch.isnan(output).any():
         #    pdb.set_trace()
-        torch.cuda.synchronize()
+        if grad_pos.is_cuda:
+            torch.cuda.synchronize()
         #print("\t\twirelength backward kernel %.3f ms" % ((time.time()-tt)*1000))
         return output, None, None, None, None, None, None, None, None
 
 class WeightedAverageWirelength(nn.Module):
     """
     @brief Compute weighted average wirelength.
-    CPU only supports net-by-net algorithm.
-    GPU supports three algorithms: net-by-net, atomic, sparse.
+    Both CPU and GPU support three algorithms: net-by-net, atomic, sparse.
     Different parameters are required for different algorithms.
+    If pin2node_map, pin offsets and the node2pin map are given, the input is cell locations instead of pin locations.
+    The CPU net-by-net algorithm then computes pin locations on the fly and sums up gradients to cells without pin-sized location arrays.
     """
-    def __init__(self, flat_netpin=None, netpin_start=None, pin2net_map=None, net_mask=None, pin_mask=None, gamma=None, algorithm='atomic', num_threads=8):
+    def __init__(self, flat_netpin=None, netpin_start=None, pin2net_map=None, net_mask=None, pin_mask=None, gamma=None, algorithm='atomic', num_threads=8,
+            pin2node_map=None, pin_offset_x=None, pin_offset_y=None, flat_node2pin=None, flat_node2pin_start=None):
         """
         @brief initialization
         @param flat_netpin flat netpin map, length of #pins
@@ -206,13 +282,18 @@ class WeightedAverageWirelength(nn.Module):
         @param pin_mask whether compute gradient for a pin, 1 means to fill with zero, 0 means to compute
         @param gamma the smaller, the closer to HPWL
         @param algorithm must be net-by-net | atomic | sparse
+        @param pin2node_map cell of each pin, optional
+        @param pin_offset_x pin offset x to its cell, optional
+        @param pin_offset_y pin offset y to its cell, optional
+        @param flat_node2pin flat node2pin map, length of #pins, optional
+        @param flat_node2pin_start starting index in node2pin map for each cell, length of #physical cells+1, optional
         """
         super(WeightedAverageWirelength, self).__init__()
         assert net_mask is not None and pin_mask is not None and gamma is not None, "net_mask, pin_mask, gamma are requried parameters"
         if algorithm == 'net-by-net':
             assert flat_netpin is not None and netpin_start is not None, "flat_netpin, netpin_start are requried parameters for algorithm net-by-net"
         elif algorithm == 'atomic':
-            assert pin2net_map is not None, "pin2net_map is required for algorithm atomic"
+            assert pin2net_map is not None and netpin_start is not None, "pin2net_map, netpin_start are required for algorithm atomic"
         elif algorithm == 'sparse':
             assert flat_netpin is not None and netpin_start is not None and pin2net_map is not None, "flat_netpin, netpin_start, pin2net_map are requried parameters for algorithm sparse"
         self.flat_netpin = flat_netpin
@@ -220,44 +301,89 @@ class WeightedAverageWirelength(nn.Module):
         self.netpin_values = None
         self.pin2net_map = pin2net_map
         self.net_mask = net_mask
+        self.net_degree_buckets = None
         self.pin_mask = pin_mask
         self.gamma = gamma
         self.algorithm = algorithm
         self.num_threads = num_threads
+        self.pin2node_map = pin2node_map
+        self.pin_offset_x = pin_offset_x
+        self.pin_offset_y = pin_offset_y
+        self.flat_node2pin = flat_node2pin
+        self.flat_node2pin_start = flat_node2pin_start
+        if pin2node_map is not None:
+            assert pin_offset_x is not None and pin_offset_y is not None and flat_node2pin is not None and flat_node2pin_start is not None, "pin_offset_x, pin_offset_y, flat_node2pin, flat_node2pin_start are required with pin2node_map"
+        self.pin_mask_uint8 = None
+        self.grad_pin = None
     def forward(self, pos):
-        if pos.is_cuda:
-            if self.algorithm == 'net-by-net':
-                return WeightedAverageWirelengthFunction.apply(pos,
-                        self.flat_netpin,
-                        self.netpin_start,
-                        self.net_mask,
-                        self.pin_mask,
-                        self.gamma
-                        )
-            elif self.algorithm == 'atomic':
-                return WeightedAverageWirelengthAtomicFunction.apply(pos,
-                        self.pin2net_map,
-                        self.net_mask,
-                        self.pin_mask,
-                        self.gamma
-                        )
-            elif self.algorithm == 'sparse':
-                if self.netpin_values is None:
-                    self.netpin_values = torch.ones_like(self.flat_netpin, dtype=pos.dtype)
-                return WeightedAverageWirelengthSparseFunction.apply(pos,
-                        self.flat_netpin,
-                        self.netpin_start,
-                        self.netpin_values,
-                        self.pin2net_map,
-                        self.net_mask,
-                        self.pin_mask,
-                        self.gamma
-                        )
-        else: # only net-by-net for CPU
+        """
+        @param pos cell locations if pin2node_map is given, otherwise pin locations
+        """
+        if self.pin2node_map is None:
+            return self.forward_pin(pos)
+        if self.algorithm == 'net-by-net' and not pos.is_cuda:
+            # nets are grouped by degree only once for CPU
+            if self.net_degree_buckets is None:
+                self.net_degree_buckets = weighted_average_wirelength_cpp.degree_buckets(self.netpin_start, self.net_mask)
+            if self.pin_mask_uint8 is None:
+                self.pin_mask_uint8 = self.pin_mask.to(torch.uint8)
+            # pins of ignored nets are never written, so the buffer is only zeroed when allocated
+            if self.grad_pin is None or self.grad_pin.dtype != pos.dtype:
+                self.grad_pin = torch.zeros(2*self.pin2node_map.numel(), dtype=pos.dtype)
+            return WeightedAverageWirelengthNodeFunction.apply(pos,
+                    self.pin_offset_x,
+                    self.pin_offset_y,
+                    self.pin2node_map,
+                    self.flat_node2pin,
+                    self.flat_node2pin_start,
+                    self.pin_mask_uint8,
+                    self.flat_netpin,
+                    self.netpin_start,
+                    self.net_degree_buckets,
+                    self.gamma,
+                    self.grad_pin,
+                    self.num_threads
+                    )
+        # other algorithms work on pin locations
+        num_nodes = pos.numel()//2
+        pin_x = self.pin_offset_x.add(torch.index_select(pos[:num_nodes], dim=0, index=self.pin2node_map.long()))
+        pin_y = self.pin_offset_y.add(torch.index_select(pos[num_nodes:], dim=0, index=self.pin2node_map.long()))
+        return self.forward_pin(torch.cat([pin_x, pin_y], dim=0))
+    def forward_pin(self, pos):
+        """
+        @param pos pin locations
+        """
+        if self.algorithm == 'net-by-net':
+            # nets are grouped by degree only once for CPU
+            if not pos.is_cuda and self.net_degree_buckets is None:
+                self.net_degree_buckets = weighted_average_wirelength_cpp.degree_buckets(self.netpin_start, self.net_mask)
             return WeightedAverageWirelengthFunction.apply(pos,
                     self.flat_netpin,
                     self.netpin_start,
                     self.net_mask,
+                    self.net_degree_buckets,
+                    self.pin_mask,
+                    self.gamma,
+                    self.num_threads
+                    )
+        elif self.algorithm == 'atomic':
+            return WeightedAverageWirelengthAtomicFunction.apply(pos,
+                    self.pin2net_map,
+                    self.netpin_start,
+                    self.net_mask,
+                    self.pin_mask,
+                    self.gamma,
+                    self.num_threads
+                    )
+        elif self.algorithm == 'sparse':
+            if self.netpin_values is None:
+                self.netpin_values = torch.ones_like(self.flat_netpin, dtype=pos.dtype)
+            return WeightedAverageWirelengthSparseFunction.apply(pos,
+                    self.flat_netpin,
+                    self.netpin_start,
+                    self.netpin_values,
+                    self.pin2net_map,
+                    self.net_mask,
                     self.pin_mask,
                     self.gamma,
                     self.num_threads
@@ -199,6 +199,14 @@ class DCTOpTest(unittest.TestCase):
 
         np.testing.assert_allclose(dct_value.data.numpy(), golden_value, rtol=1e-6, atol=1e-5)
 
+        # test cpu using real-to-real transforms with a cached plan
+        custom = dct.DCT2(algorithm='plan')
+        dct_value = custom.forward(x)
+        print("2D dct_value plan")
+        print(dct_value.data.numpy())
+
+        np.testing.assert_allclose(dct_value.data.numpy(), golden_value, rtol=1e-6, atol=1e-5)
+
         # test gpu 
         custom = dct.DCT2(algorithm='N')
         dct_value = custom.forward(x.cuda()).cpu()
@@ -264,6 +272,14 @@ class DCTOpTest(unittest.TestCase):
 
         np.testing.assert_allclose(dct_value.data.numpy(), golden_value, rtol=1e-6, atol=1e-5)
 
+        # test cpu using real-to-real transforms with a cached plan
+        custom = dct.IDCT2(algorithm='plan')
+        dct_value = custom.forward(y)
+        print("2D dct_value plan")
+        print(dct_value.data.numpy())
+
+        np.testing.assert_allclose(dct_value.data.numpy(), golden_value, rtol=1e-6, atol=1e-5)
+
         # test gpu 
         custom = dct.IDCT2(algorithm='N')
         dct_value = custom.forward(y.cuda()).cpu()
@@ -511,6 +527,14 @@ class DXTOpTest(unittest.TestCase):
 
         np.testing.assert_allclose(dst_value.data.numpy(), golden_value, atol=1e-14)
 
+        # test cpu using real-to-real transforms with a cached plan
+        custom = dct.IDCCT2(algorithm='plan')
+        dst_value = custom.forward(x)
+        print("dxt_value plan")
+        print(dst_value.data.numpy())
+
+        np.testing.assert_allclose(dst_value.data.numpy(), golden_value, atol=1e-12)
+
         # test gpu 
         custom = dct.IDCCT2()
         dst_value = custom.forward(x.cuda()).cpu()
@@ -557,6 +581,14 @@ class DXTOpTest(unittest.TestCase):
 
         np.testing.assert_allclose(dst_value.data.numpy(), golden_value, atol=1e-14)
 
+        # test cpu using real-to-real transforms with a cached plan
+        custom = dct.IDCST2(algorithm='plan')
+        dst_value = custom.forward(x)
+        print("dxt_value plan")
+        print(dst_value.data.numpy())
+
+        np.testing.assert_allclose(dst_value.data.numpy(), golden_value, atol=1e-12)
+
         # test gpu 
         custom = dct.IDCST2()
         dst_value = custom.forward(x.cuda()).cpu()
@@ -603,6 +635,14 @@ class DXTOpTest(unittest.TestCase):
 
         np.testing.assert_allclose(dst_value.data.numpy(), golden_value, atol=1e-14)
 
+        # test cpu using real-to-real transforms with a cached plan
+        custom = dct.IDSCT2(algorithm='plan')
+        dst_value = custom.forward(x)
+        print("dxt_value plan")
+        print(dst_value.data.numpy())
+
+        np.testing.assert_allclose(dst_value.data.numpy(), golden_value, atol=1e-12)
+
         # test gpu 
         custom = dct.IDSCT2()
         dst_value = custom.forward(x.cuda()).cpu()
@@ -619,6 +659,50 @@ class DXTOpTest(unittest.TestCase):
 
         np.testing.assert_allclose(dst_value.data.numpy(), golden_value, atol=1e-14)
 
+    def test_planRandom(self):
+        torch.manual_seed(10)
+        # sizes of powers of 2 go through the plan, others through the FFT-based transforms
+        for M, N in [(16, 32), (12, 20)]:
+            x = torch.empty(M, N, dtype=torch.float64).uniform_(0, 10.0)
+            # the same map stored transposed, so the input is not contiguous
+            x_t = x.t().contiguous().t()
+            for op in [dct.DCT2, dct.IDCT2, dct.IDCCT2, dct.IDCST2, dct.IDSCT2]:
+                golden_value = op(algorithm='N').forward(x).data.numpy()
+
+                custom = op(algorithm='plan')
+                value = custom.forward(x)
+                print("%s %dx%d plan" % (op.__name__, M, N))
+                print(value.data.numpy())
+                np.testing.assert_allclose(value.data.numpy(), golden_value, rtol=1e-9, atol=1e-9)
+
+                # the result of an earlier call is not overwritten by the next one
+                value_t = custom.forward(x_t)
+                self.assertNotEqual(value.data_ptr(), value_t.data_ptr())
+                np.testing.assert_allclose(value.data.numpy(), golden_value, rtol=1e-9, atol=1e-9)
+                np.testing.assert_allclose(value_t.data.numpy(), golden_value, rtol=1e-9, atol=1e-9)
+
+    def test_leeBatchRandom(self):
+        torch.manual_seed(10)
+        # rows are transformed in batches of 16, 40 rows end with a partial batch
+        x = torch.empty(40, 64, dtype=torch.float64).uniform_(0, 10.0)
+        for op, lee_op in [(dct.DCT, dct_lee.DCT), (dct.IDCT, dct_lee.IDCT), (dct.DST, dct_lee.DST),
+                (dct.IDST, dct_lee.IDST), (dct.IDXCT, dct_lee.IDXCT), (dct.IDXST, dct_lee.IDXST)]:
+            golden_value = op().forward(x).data.numpy()
+            for num_threads in [1, 3]:
+                value = lee_op(num_threads=num_threads).forward(x)
+                print("%s 40x64 dct_lee with %d threads" % (op.__name__, num_threads))
+                np.testing.assert_allclose(value.data.numpy(), golden_value, rtol=1e-9, atol=1e-9)
+
+        # 2D transforms need powers of 2, so 8 rows make a partial batch in the first pass
+        x = torch.empty(8, 64, dtype=torch.float64).uniform_(0, 10.0)
+        for op, lee_op in [(dct.DCT2, dct_lee.DCT2), (dct.IDCT2, dct_lee.IDCT2), (dct.IDCCT2, dct_lee.IDCCT2),
+                (dct.IDCST2, dct_lee.IDCST2), (dct.IDSCT2, dct_lee.IDSCT2)]:
+            golden_value = op().forward(x).data.numpy()
+            for num_threads in [1, 3]:
+                value = lee_op(num_threads=num_threads).forward(x)
+                print("%s 8x64 dct_lee with %d threads" % (op.__name__, num_threads))
+                np.testing.assert_allclose(value.data.numpy(), golden_value, rtol=1e-9, atol=1e-9)
+
 def eval_runtime():
     #x = torch.tensor([1, 2, 7, 9, 20, 31], dtype=torch.float64)
     #print(dct_N(x))
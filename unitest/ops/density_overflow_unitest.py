@@ -141,6 +141,126 @@ class DensityOverflowOpTest(unittest.TestCase):
             np.testing.assert_allclose(result, result_hip.data.cpu())
             np.testing.assert_allclose(max_density, max_density_hip.data.cpu())
 
+    def test_densityOverflowLargeMacro(self):
+        dtype = np.float64
+        # one macro spanning hundreds of bins and two standard cells
+        xx = np.array([3.3, 20.5, 31.0]).astype(dtype)
+        yy = np.array([4.7, 30.2, 7.5]).astype(dtype)
+        node_size_x = np.array([21.4, 1.5, 0.75]).astype(dtype)
+        node_size_y = np.array([17.9, 1.0, 1.0]).astype(dtype)
+        num_nodes = len(xx)
+
+        xl = 0.0
+        yl = 0.0
+        xh = 40.0
+        yh = 40.0
+        bin_size_x = 1.0
+        bin_size_y = 1.0
+        target_density = 0.5
+        num_bins_x = int(np.ceil((xh-xl)/bin_size_x))
+        num_bins_y = int(np.ceil((yh-yl)/bin_size_y))
+
+        bin_center_x = np.zeros(num_bins_x, dtype=dtype)
+        for id_x in range(num_bins_x):
+            bin_center_x[id_x] = (bin_xl(id_x, xl, bin_size_x)+bin_xh(id_x, xl, xh, bin_size_x))/2
+
+        bin_center_y = np.zeros(num_bins_y, dtype=dtype)
+        for id_y in range(num_bins_y):
+            bin_center_y[id_y] = (bin_yl(id_y, yl, bin_size_y)+bin_yh(id_y, yl, yh, bin_size_y))/2
+
+        # exact overlap of every cell with every bin
+        density_map = np.zeros([num_bins_x, num_bins_y], dtype=dtype)
+        for i in range(num_nodes):
+            px = np.maximum(np.minimum(xx[i]+node_size_x[i], bin_center_x+bin_size_x/2) - np.maximum(xx[i], bin_center_x-bin_size_x/2), 0)
+            py = np.maximum(np.minimum(yy[i]+node_size_y[i], bin_center_y+bin_size_y/2) - np.maximum(yy[i], bin_center_y-bin_size_y/2), 0)
+            density_map += np.outer(px, py)
+        golden_overflow = np.maximum(density_map-target_density*bin_size_x*bin_size_y, 0).sum()
+        golden_max_density = density_map.max()/(bin_size_x*bin_size_y)
+
+        custom = density_overflow.DensityOverflow(
+                    torch.from_numpy(node_size_x), torch.from_numpy(node_size_y),
+                    torch.from_numpy(bin_center_x), torch.from_numpy(bin_center_y),
+                    target_density=target_density,
+                    xl=xl, yl=yl, xh=xh, yh=yh,
+                    bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                    num_movable_nodes=num_nodes,
+                    num_terminals=0,
+                    num_filler_nodes=0)
+
+        pos = Variable(torch.from_numpy(np.concatenate([xx, yy])))
+        result, max_density = custom.forward(pos)
+        print("large macro custom_result = ", result)
+        print("large macro golden_result = ", golden_overflow)
+
+        np.testing.assert_allclose(result.numpy(), golden_overflow, rtol=1e-6)
+        np.testing.assert_allclose(max_density.numpy(), golden_max_density, rtol=1e-6)
+
+    def test_densityOverflowUpdate(self):
+        dtype = np.float64
+        np.random.seed(1)
+        num_nodes = 64
+        xl = 0.0
+        yl = 0.0
+        xh = 32.0
+        yh = 32.0
+        bin_size_x = 1.0
+        bin_size_y = 1.0
+        target_density = 0.5
+        num_bins_x = int(np.ceil((xh-xl)/bin_size_x))
+        num_bins_y = int(np.ceil((yh-yl)/bin_size_y))
+        node_size_x = np.random.uniform(0.5, 3.0, num_nodes).astype(dtype)
+        node_size_y = np.random.uniform(0.5, 3.0, num_nodes).astype(dtype)
+        # one macro spanning hundreds of bins
+        node_size_x[0] = 18.3
+        node_size_y[0] = 16.1
+        xx = np.random.uniform(xl, xh-node_size_x)
+        yy = np.random.uniform(yl, yh-node_size_y)
+
+        bin_center_x = np.zeros(num_bins_x, dtype=dtype)
+        for id_x in range(num_bins_x):
+            bin_center_x[id_x] = (bin_xl(id_x, xl, bin_size_x)+bin_xh(id_x, xl, xh, bin_size_x))/2
+
+        bin_center_y = np.zeros(num_bins_y, dtype=dtype)
+        for id_y in range(num_bins_y):
+            bin_center_y[id_y] = (bin_yl(id_y, yl, bin_size_y)+bin_yh(id_y, yl, yh, bin_size_y))/2
+
+        def build():
+            return density_overflow.DensityOverflow(
+                    torch.from_numpy(node_size_x), torch.from_numpy(node_size_y),
+                    torch.from_numpy(bin_center_x), torch.from_numpy(bin_center_y),
+                    target_density=target_density,
+                    xl=xl, yl=yl, xh=xh, yh=yh,
+                    bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                    num_movable_nodes=num_nodes,
+                    num_terminals=0,
+                    num_filler_nodes=0)
+
+        custom = build()
+        custom.forward(torch.from_numpy(np.concatenate([xx, yy])))
+
+        # move the macro and a few standard cells, then compare with scattering all cells again
+        moved_nodes = np.array([0, 5, 17, 40])
+        new_xx = xx.copy()
+        new_yy = yy.copy()
+        new_xx[moved_nodes] = np.random.uniform(xl, xh-node_size_x[moved_nodes])
+        new_yy[moved_nodes] = np.random.uniform(yl, yh-node_size_y[moved_nodes])
+        result = custom.update(torch.from_numpy(moved_nodes),
+                torch.from_numpy(np.concatenate([xx[moved_nodes], yy[moved_nodes]])),
+                torch.from_numpy(np.concatenate([new_xx[moved_nodes], new_yy[moved_nodes]])))
+
+        golden = build()
+        golden_result, golden_max_density = golden.forward(torch.from_numpy(np.concatenate([new_xx, new_yy])))
+        print("update custom_result = ", result)
+        print("update golden_result = ", golden_result)
+
+        np.testing.assert_allclose(custom.density_map.numpy(), golden.density_map.numpy(), atol=1e-9)
+        np.testing.assert_allclose(result.numpy(), golden_result.numpy().reshape(result.numpy().shape), rtol=1e-9, atol=1e-9)
+
+        # only movable cells or fillers can be moved
+        with self.assertRaises(AssertionError):
+            custom.update(torch.tensor([num_nodes]),
+                    torch.from_numpy(np.array([xx[0], yy[0]])), torch.from_numpy(np.array([xx[0], yy[0]])))
+
 def eval_runtime(design):
     with gzip.open("../../../../benchmarks/ispd2005/density/%s_density.pklz" % (design), "rb") as f:
         node_size_x, node_size_y, bin_center_x, bin_center_y, target_density, xl, yl, xh, yh, bin_size_x, bin_size_y, num_movable_nodes, num_terminals, num_filler_nodes = pickle.load(f)
@@ -141,8 +141,6 @@ class DensityPotentialOpTest(unittest.TestCase):
         # test cpu 
         custom = density_potential.DensityPotential(
                     torch.tensor(node_size_x, requires_grad=False), torch.tensor(node_size_y, requires_grad=False), 
-                    torch.tensor(ax, requires_grad=False), torch.tensor(bx, requires_grad=False), torch.tensor(cx, requires_grad=False), 
-                    torch.tensor(ay, requires_grad=False), torch.tensor(by, requires_grad=False), torch.tensor(cy, requires_grad=False), 
                     torch.tensor(bin_center_x, requires_grad=False), torch.tensor(bin_center_y, requires_grad=False), 
                     target_density=torch.tensor(target_density, requires_grad=False), 
                     xl=torch.tensor(xl, requires_grad=False), yl=torch.tensor(yl, requires_grad=False), xh=torch.tensor(xh, requires_grad=False), yh=torch.tensor(yh, requires_grad=False), 
@@ -153,6 +151,10 @@ class DensityPotentialOpTest(unittest.TestCase):
                     padding=torch.tensor(0, dtype=torch.int32, requires_grad=False), 
                     sigma=sigma, delta=delta)
 
+        # coefficients are derived from cell sizes in the op
+        for coef, golden in zip(custom.coefficients(), [ax, bx, cx, ay, by, cy]):
+            np.testing.assert_allclose(coef.numpy(), golden.ravel(), rtol=1e-6)
+
         pos = Variable(torch.from_numpy(np.concatenate([xx, yy])), requires_grad=True)
         result = custom.forward(pos)
         print("custom_result = ", result)
@@ -164,8 +166,6 @@ class DensityPotentialOpTest(unittest.TestCase):
         if torch.cuda.device_count(): 
             custom_hip = density_potential.DensityPotential(
                         torch.tensor(node_size_x, requires_grad=False).cuda(), torch.tensor(node_size_y, requires_grad=False).cuda(), 
-                        torch.tensor(ax, requires_grad=False).cuda(), torch.tensor(bx, requires_grad=False).cuda(), torch.tensor(cx, requires_grad=False).cuda(), 
-                        torch.tensor(ay, requires_grad=False).cuda(), torch.tensor(by, requires_grad=False).cuda(), torch.tensor(cy, requires_grad=False).cuda(), 
                         torch.tensor(bin_center_x, requires_grad=False).cuda(), torch.tensor(bin_center_y, requires_grad=False).cuda(), 
                         target_density=torch.tensor(target_density, requires_grad=False).cuda(), 
                         xl=torch.tensor(xl, requires_grad=False).cuda(), yl=torch.tensor(yl, requires_grad=False).cuda(), xh=torch.tensor(xh, requires_grad=False).cuda(), yh=torch.tensor(yh, requires_grad=False).cuda(), 
@@ -498,6 +498,217 @@ class ElectricPotentialOpTest(unittest.TestCase):
         grad = pos.grad.clone()
         print("custom_grad = ", grad)
 
+        # fillers of the same size go through specialized kernels, which should match the generic ones
+        filler_xx = np.array([0.3, 3.2, 4.6]).astype(xx.dtype)
+        filler_yy = np.array([4.1, 0.7, 2.2]).astype(yy.dtype)
+        all_node_size_x = torch.tensor(np.concatenate([node_size_x, np.full(3, 0.7)]), dtype=dtype)
+        all_node_size_y = torch.tensor(np.concatenate([node_size_y, np.full(3, 1.0)]), dtype=dtype)
+        all_pos = np.concatenate([xx, filler_xx, yy, filler_yy])
+        filler_grads = []
+        for num_filler_nodes in [3, 0]:
+            custom_filler = electric_potential.ElectricPotential(
+                        all_node_size_x, all_node_size_y,
+                        torch.tensor(bin_center_x, requires_grad=False, dtype=dtype), torch.tensor(bin_center_y, requires_grad=False, dtype=dtype),
+                        target_density=torch.tensor(target_density, requires_grad=False, dtype=dtype),
+                        xl=xl, yl=yl, xh=xh, yh=yh,
+                        bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                        num_movable_nodes=num_nodes+3-num_filler_nodes,
+                        num_terminals=0,
+                        num_filler_nodes=num_filler_nodes,
+                        padding=0
+                        )
+            filler_pos = Variable(torch.from_numpy(all_pos), requires_grad=True)
+            custom_filler.forward(filler_pos).backward()
+            filler_grads.append(filler_pos.grad.clone())
+        print("custom_grad with fillers = ", filler_grads[0])
+        np.testing.assert_allclose(filler_grads[0].numpy(), filler_grads[1].numpy(), rtol=1e-6, atol=1e-9)
+
+        # the native engine on CPU should match the transforms in python
+        custom_energy = electric_potential.ElectricPotential(
+                    all_node_size_x, all_node_size_y,
+                    torch.tensor(bin_center_x, requires_grad=False, dtype=dtype), torch.tensor(bin_center_y, requires_grad=False, dtype=dtype),
+                    target_density=torch.tensor(target_density, requires_grad=False, dtype=dtype),
+                    xl=xl, yl=yl, xh=xh, yh=yh,
+                    bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                    num_movable_nodes=num_nodes,
+                    num_terminals=0,
+                    num_filler_nodes=3,
+                    padding=0,
+                    fast_mode=False
+                    )
+        engine_pos = Variable(torch.from_numpy(all_pos), requires_grad=True)
+        engine_result = custom_energy.forward(engine_pos)
+        engine_result.backward()
+        python_pos = Variable(torch.from_numpy(all_pos), requires_grad=True)
+        python_result = electric_potential.ElectricPotentialFunction.apply(
+                python_pos,
+                custom_energy.node_size_x, custom_energy.node_size_y,
+                custom_energy.bin_center_x, custom_energy.bin_center_y,
+                custom_energy.initial_density_map,
+                custom_energy.target_density,
+                xl, yl, xh, yh,
+                bin_size_x, bin_size_y,
+                custom_energy.num_movable_nodes, custom_energy.num_filler_nodes,
+                custom_energy.padding,
+                custom_energy.padding_mask,
+                custom_energy.num_bins_x, custom_energy.num_bins_y,
+                custom_energy.num_movable_impacted_bins_x, custom_energy.num_movable_impacted_bins_y,
+                custom_energy.num_filler_impacted_bins_x, custom_energy.num_filler_impacted_bins_y,
+                custom_energy.perm_M, custom_energy.perm_N,
+                custom_energy.expk_M, custom_energy.expk_N,
+                custom_energy.inv_wu2_plus_wv2_2X,
+                custom_energy.wu_by_wu2_plus_wv2_2X, custom_energy.wv_by_wu2_plus_wv2_2X,
+                False,
+                False,
+                custom_energy.uniform_filler_size,
+                custom_energy.deterministic_flag,
+                custom_energy.num_threads
+                )
+        python_result.backward()
+        print("engine_result = ", engine_result, "python_result = ", python_result)
+        np.testing.assert_allclose(engine_result.detach().numpy(), python_result.detach().numpy(), rtol=1e-6)
+        np.testing.assert_allclose(engine_pos.grad.numpy(), python_pos.grad.numpy(), rtol=1e-6, atol=1e-9)
+
+        # energy from the spectral coefficients in python should match the one from the potential map
+        python_spectral_pos = Variable(torch.from_numpy(all_pos), requires_grad=True)
+        python_spectral_result = electric_potential.ElectricPotentialFunction.apply(
+                python_spectral_pos,
+                custom_energy.node_size_x, custom_energy.node_size_y,
+                custom_energy.bin_center_x, custom_energy.bin_center_y,
+                custom_energy.initial_density_map,
+                custom_energy.target_density,
+                xl, yl, xh, yh,
+                bin_size_x, bin_size_y,
+                custom_energy.num_movable_nodes, custom_energy.num_filler_nodes,
+                custom_energy.padding,
+                custom_energy.padding_mask,
+                custom_energy.num_bins_x, custom_energy.num_bins_y,
+                custom_energy.num_movable_impacted_bins_x, custom_energy.num_movable_impacted_bins_y,
+                custom_energy.num_filler_impacted_bins_x, custom_energy.num_filler_impacted_bins_y,
+                custom_energy.perm_M, custom_energy.perm_N,
+                custom_energy.expk_M, custom_energy.expk_N,
+                custom_energy.inv_wu2_plus_wv2_2X,
+                custom_energy.wu_by_wu2_plus_wv2_2X, custom_energy.wv_by_wu2_plus_wv2_2X,
+                True,
+                True,
+                custom_energy.uniform_filler_size,
+                custom_energy.deterministic_flag,
+                custom_energy.num_threads
+                )
+        python_spectral_result.backward()
+        print("python_spectral_result = ", python_spectral_result)
+        np.testing.assert_allclose(python_spectral_result.detach().numpy(), python_result.detach().numpy(), rtol=1e-6)
+        np.testing.assert_allclose(python_spectral_pos.grad.numpy(), python_pos.grad.numpy(), rtol=1e-6, atol=1e-9)
+
+        # energy from the spectral coefficients should match the one from the potential map, also in fast mode
+        custom_spectral = electric_potential.ElectricPotential(
+                    all_node_size_x, all_node_size_y,
+                    torch.tensor(bin_center_x, requires_grad=False, dtype=dtype), torch.tensor(bin_center_y, requires_grad=False, dtype=dtype),
+                    target_density=torch.tensor(target_density, requires_grad=False, dtype=dtype),
+                    xl=xl, yl=yl, xh=xh, yh=yh,
+                    bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                    num_movable_nodes=num_nodes,
+                    num_terminals=0,
+                    num_filler_nodes=3,
+                    padding=0,
+                    fast_mode=True,
+                    spectral_energy=True
+                    )
+        spectral_result = custom_spectral.forward(torch.from_numpy(all_pos))
+        print("spectral_result = ", spectral_result)
+        np.testing.assert_allclose(spectral_result.numpy(), python_result.detach().numpy(), rtol=1e-6)
+
+        # overflow from the density map of the engine should match the one scattering cells again
+        custom_overflow = electric_overflow.ElectricOverflow(
+                    all_node_size_x, all_node_size_y,
+                    torch.tensor(bin_center_x, requires_grad=False, dtype=dtype), torch.tensor(bin_center_y, requires_grad=False, dtype=dtype),
+                    target_density=torch.tensor(target_density, requires_grad=False, dtype=dtype),
+                    xl=xl, yl=yl, xh=xh, yh=yh,
+                    bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                    num_movable_nodes=num_nodes,
+                    num_terminals=0,
+                    num_filler_nodes=0,
+                    padding=0
+                    )
+        overflow, max_density = custom_overflow.forward(torch.from_numpy(all_pos))
+        custom_overflow.density_map_source = custom_spectral
+        shared_overflow, shared_max_density = custom_overflow.forward(torch.from_numpy(all_pos))
+        print("overflow = ", overflow, "shared_overflow = ", shared_overflow)
+        np.testing.assert_allclose(shared_overflow.numpy(), overflow.numpy(), rtol=1e-12)
+        np.testing.assert_allclose(shared_max_density.numpy(), max_density.numpy(), rtol=1e-12)
+        self.assertIsNone(custom_spectral.movable_density_map(torch.from_numpy(all_pos)+1))
+
+        # fixed-point density maps should give the same results bit for bit with any number of threads
+        deterministic_results = []
+        for num_threads in [1, 3, 8]:
+            custom_deterministic = electric_potential.ElectricPotential(
+                        all_node_size_x, all_node_size_y,
+                        torch.tensor(bin_center_x, requires_grad=False, dtype=dtype), torch.tensor(bin_center_y, requires_grad=False, dtype=dtype),
+                        target_density=torch.tensor(target_density, requires_grad=False, dtype=dtype),
+                        xl=xl, yl=yl, xh=xh, yh=yh,
+                        bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                        num_movable_nodes=num_nodes,
+                        num_terminals=0,
+                        num_filler_nodes=3,
+                        padding=0,
+                        fast_mode=False,
+                        deterministic_flag=True,
+                        num_threads=num_threads
+                        )
+            deterministic_pos = Variable(torch.from_numpy(all_pos), requires_grad=True)
+            deterministic_result = custom_deterministic.forward(deterministic_pos)
+            deterministic_result.backward()
+            deterministic_results.append((deterministic_result.detach().clone(), deterministic_pos.grad.clone()))
+        for deterministic_result, deterministic_grad in deterministic_results[1:]:
+            self.assertTrue(torch.equal(deterministic_result, deterministic_results[0][0]))
+            self.assertTrue(torch.equal(deterministic_grad, deterministic_results[0][1]))
+        np.testing.assert_allclose(deterministic_results[0][0].numpy(), python_result.detach().numpy(), rtol=1e-6)
+
+        # the fused field solver should match the separate transforms in python, with sizes of powers of 2 or not
+        for M, N in [(16, 32), (12, 20)]:
+            density_map = torch.rand(M, N, dtype=torch.float64)
+            wu = torch.arange(M, dtype=torch.float64).mul(2 * np.pi / M).view([M, 1])
+            wv = torch.arange(N, dtype=torch.float64).mul(2 * np.pi / N).view([1, N]).mul_(1.5)
+            wu2_plus_wv2 = wu.pow(2) + wv.pow(2)
+            wu2_plus_wv2[0, 0] = 1.0
+            inv_wu2_plus_wv2_2X = 2.0 / wu2_plus_wv2
+            inv_wu2_plus_wv2_2X[0, 0] = 0.0
+            auv = torch.empty_like(density_map)
+            field_map_x = torch.empty_like(density_map)
+            field_map_y = torch.empty_like(density_map)
+            potential_map = torch.empty_like(density_map)
+            plan = electric_potential.electric_potential_cpp.ElectricFieldPlan(density_map, 2)
+            fused_energy = plan.forward(
+                    density_map, inv_wu2_plus_wv2_2X, wu.view(M), wv.view(N),
+                    auv, field_map_x, field_map_y, potential_map)
+
+            expk_M = discrete_spectral_transform.get_expk(M, dtype=torch.float64, device=density_map.device)
+            expk_N = discrete_spectral_transform.get_expk(N, dtype=torch.float64, device=density_map.device)
+            golden_auv = dct.dct2(density_map, expk_M, expk_N)
+            golden_auv[0, :].mul_(0.5)
+            golden_auv[:, 0].mul_(0.5)
+            golden_field_map_x = dct.idsct2(golden_auv.mul(wu.mul(inv_wu2_plus_wv2_2X)), expk_M, expk_N)
+            golden_field_map_y = dct.idcst2(golden_auv.mul(wv.mul(inv_wu2_plus_wv2_2X)), expk_M, expk_N)
+            golden_potential_map = dct.idcct2(golden_auv.mul(inv_wu2_plus_wv2_2X).mul_(2), expk_M, expk_N)
+            np.testing.assert_allclose(auv.numpy(), golden_auv.numpy(), rtol=1e-9, atol=1e-12)
+            np.testing.assert_allclose(field_map_x.numpy(), golden_field_map_x.numpy(), rtol=1e-9, atol=1e-12)
+            np.testing.assert_allclose(field_map_y.numpy(), golden_field_map_y.numpy(), rtol=1e-9, atol=1e-12)
+            np.testing.assert_allclose(potential_map.numpy(), golden_potential_map.numpy(), rtol=1e-9, atol=1e-12)
+            np.testing.assert_allclose(fused_energy.numpy(), golden_potential_map.mul(density_map).sum().view([1]).numpy(), rtol=1e-9)
+
+            # fields only, with the tables and buffers of the plan reused
+            fast_energy = plan.forward(
+                    density_map, inv_wu2_plus_wv2_2X, wu.view(M), wv.view(N),
+                    auv, field_map_x, field_map_y, torch.empty(0, dtype=torch.float64))
+            self.assertEqual(fast_energy.item(), 0)
+            np.testing.assert_allclose(field_map_x.numpy(), golden_field_map_x.numpy(), rtol=1e-9, atol=1e-12)
+
+            # frequency weights of another type are rejected
+            with self.assertRaises(RuntimeError):
+                plan.forward(
+                        density_map, inv_wu2_plus_wv2_2X, wu.view(M).float(), wv.view(N),
+                        auv, field_map_x, field_map_y, potential_map)
+
         # test dcu
         if torch.cuda.device_count(): 
             custom_hip = electric_potential.ElectricPotential(
@@ -523,6 +734,224 @@ class ElectricPotentialOpTest(unittest.TestCase):
 
             #np.testing.assert_allclose(result.detach().numpy(), result_hip.data.cpu().detach().numpy())
 
+    def test_electricOverflowUpdate(self):
+        dtype = torch.float64
+        np.random.seed(1)
+        num_movable_nodes = 24
+        num_filler_nodes = 4
+        num_nodes = num_movable_nodes + 2 + num_filler_nodes
+        xl = 0.0
+        yl = 0.0
+        xh = 10.0
+        yh = 10.0
+        bin_size_x = 1.0
+        bin_size_y = 1.0
+        target_density = 0.5
+        num_bins_x = int(np.ceil((xh-xl)/bin_size_x))
+        num_bins_y = int(np.ceil((yh-yl)/bin_size_y))
+        bin_center_x = xl + (np.arange(num_bins_x) + 0.5) * bin_size_x
+        bin_center_y = yl + (np.arange(num_bins_y) + 0.5) * bin_size_y
+        node_size_x = np.random.uniform(0.3, 2.0, num_nodes)
+        node_size_y = np.random.uniform(0.3, 2.0, num_nodes)
+        # two fixed macros, then fillers of the same size
+        node_size_x[num_movable_nodes:num_movable_nodes+2] = [3.2, 2.5]
+        node_size_y[num_movable_nodes:num_movable_nodes+2] = [2.1, 4.0]
+        node_size_x[-num_filler_nodes:] = 0.8
+        node_size_y[-num_filler_nodes:] = 1.0
+        xx = np.random.uniform(xl, xh-node_size_x)
+        yy = np.random.uniform(yl, yh-node_size_y)
+
+        def build(padding, deterministic_flag, num_threads):
+            return electric_overflow.ElectricOverflow(
+                        torch.tensor(node_size_x, dtype=dtype), torch.tensor(node_size_y, dtype=dtype),
+                        torch.tensor(bin_center_x, dtype=dtype), torch.tensor(bin_center_y, dtype=dtype),
+                        target_density=torch.tensor(target_density, dtype=dtype),
+                        xl=xl, yl=yl, xh=xh, yh=yh,
+                        bin_size_x=bin_size_x, bin_size_y=bin_size_y,
+                        num_movable_nodes=num_movable_nodes,
+                        num_terminals=2,
+                        num_filler_nodes=num_filler_nodes,
+                        padding=padding,
+                        deterministic_flag=deterministic_flag,
+                        num_threads=num_threads
+                        )
+
+        # move a few movable cells and a filler, then compare with scattering all cells again
+        moved_nodes = np.array([0, 7, 19, num_nodes-2])
+        new_xx = xx.copy()
+        new_yy = yy.copy()
+        new_xx[moved_nodes] = np.random.uniform(xl, xh-node_size_x[moved_nodes])
+        new_yy[moved_nodes] = np.random.uniform(yl, yh-node_size_y[moved_nodes])
+        old_pos = torch.from_numpy(np.concatenate([xx[moved_nodes], yy[moved_nodes]]))
+        new_pos = torch.from_numpy(np.concatenate([new_xx[moved_nodes], new_yy[moved_nodes]]))
+        for padding in [0, 1]:
+            for deterministic_flag in [False, True]:
+                updated_maps = []
+                for num_threads in [1, 3]:
+                    custom = build(padding, deterministic_flag, num_threads)
+                    custom.forward(torch.from_numpy(np.concatenate([xx, yy])))
+                    result = custom.update(torch.from_numpy(moved_nodes), old_pos, new_pos)
+                    updated_maps.append(custom.density_map.clone())
+
+                    golden = build(padding, deterministic_flag, num_threads)
+                    golden_result, golden_max_density = golden.forward(torch.from_numpy(np.concatenate([new_xx, new_yy])))
+                    print("padding = %d, deterministic_flag = %d, update result = %g, golden_result = %g"
+                            % (padding, deterministic_flag, result.item(), golden_result.item()))
+                    # fixed-point rounding of the update differs from the one of forward by a few units of 2^-32
+                    np.testing.assert_allclose(custom.density_map.numpy(), golden.density_map.numpy(), atol=1e-8)
+                    np.testing.assert_allclose(result.numpy(), golden_result.numpy().reshape(result.numpy().shape), rtol=1e-8, atol=1e-8)
+                if deterministic_flag:
+                    self.assertTrue(torch.equal(updated_maps[0], updated_maps[1]))
+
+        # fixed cells cannot be moved incrementally
+        custom = build(0, False, 1)
+        custom.forward(torch.from_numpy(np.concatenate([xx, yy])))
+        with self.assertRaises(AssertionError):
+            custom.update(torch.tensor([num_movable_nodes]), old_pos[[0, 4]], new_pos[[0, 4]])
+
+    def test_densityScatterModes(self):
+        dtype = torch.float64
+        np.random.seed(2)
+        num_movable_nodes = 300
+        num_filler_nodes = 20
+        num_nodes = num_movable_nodes + num_filler_nodes
+        xl = 0.0
+        yl = 0.0
+        xh = 32.0
+        yh = 32.0
+        bin_size_x = 1.0
+        bin_size_y = 1.0
+        target_density = 1.0
+        num_bins_x = int(np.ceil((xh-xl)/bin_size_x))
+        num_bins_y = int(np.ceil((yh-yl)/bin_size_y))
+        bin_center_x = xl + (np.arange(num_bins_x) + 0.5) * bin_size_x
+        bin_center_y = yl + (np.arange(num_bins_y) + 0.5) * bin_size_y
+        node_size_x = np.random.uniform(0.3, 2.0, num_nodes)
+        node_size_y = np.random.uniform(0.3, 2.0, num_nodes)
+        node_size_x[-num_filler_nodes:] = 0.8
+        node_size_y[-num_filler_nodes:] = 1.0
+        xx = np.random.uniform(xl, xh-node_size_x)
+        yy = np.random.uniform(yl, yh-node_size_y)
+        pos = torch.from_numpy(np.concatenate([xx, yy]))
+        padding_mask = torch.zeros(num_bins_x, num_bins_y, dtype=torch.uint8)
+        # one buffer for all calls, like the one kept by the ops
+        scatter_buffer = torch.empty(0, dtype=torch.int64)
+
+        def scatter(deterministic_flag, num_threads, scatter_mode):
+            return electric_potential.electric_potential_cpp.density_map(
+                    pos,
+                    torch.tensor(node_size_x, dtype=dtype), torch.tensor(node_size_y, dtype=dtype),
+                    torch.tensor(bin_center_x, dtype=dtype), torch.tensor(bin_center_y, dtype=dtype),
+                    torch.zeros(num_bins_x, num_bins_y, dtype=dtype),
+                    target_density,
+                    xl, yl, xh, yh,
+                    bin_size_x, bin_size_y,
+                    num_movable_nodes,
+                    num_filler_nodes,
+                    0,
+                    padding_mask,
+                    num_bins_x, num_bins_y,
+                    3, 3,
+                    2, 2,
+                    True,
+                    deterministic_flag,
+                    num_threads,
+                    scatter_mode,
+                    scatter_buffer
+                    )
+
+        # 0 for atomic additions, 1 for private maps, 2 for stripes, -1 for the automatic choice
+        for deterministic_flag in [False, True]:
+            golden = scatter(deterministic_flag, 1, 0)
+            for scatter_mode in [-1, 0, 1, 2]:
+                for num_threads in [1, 3]:
+                    # twice to reuse the private maps in the buffer
+                    for i in range(2):
+                        result = scatter(deterministic_flag, num_threads, scatter_mode)
+                        print("deterministic_flag = %d, scatter_mode = %d, num_threads = %d, max error = %g"
+                                % (deterministic_flag, scatter_mode, num_threads, (result-golden).abs().max().item()))
+                        if deterministic_flag:
+                            self.assertTrue(torch.equal(result, golden))
+                        else:
+                            np.testing.assert_allclose(result.numpy(), golden.numpy(), rtol=1e-12, atol=1e-12)
+
+    def test_exactDensityMapLargeMacro(self):
+        dtype = np.float64
+        # macros crossing each side of the region, one inside, and small cells, two crossing the boundary
+        xx = np.array([-4.3, 25.5, 8.2, 3.3, 20.5, 31.0, -0.4, 39.6], dtype=dtype)
+        yy = np.array([10.1, 27.7, -3.4, 4.7, 30.2, 7.5, 12.2, 39.3], dtype=dtype)
+        node_size_x = np.array([14.6, 18.9, 22.1, 21.4, 1.5, 0.75, 1.0, 1.2], dtype=dtype)
+        node_size_y = np.array([19.3, 16.4, 13.0, 17.9, 1.0, 1.0, 1.0, 1.0], dtype=dtype)
+        num_nodes = len(xx)
+        xl = 0.0
+        yl = 0.0
+        xh = 40.0
+        yh = 40.0
+        bin_size_x = 1.0
+        bin_size_y = 1.0
+        num_bins_x = int(np.ceil((xh-xl)/bin_size_x))
+        num_bins_y = int(np.ceil((yh-yl)/bin_size_y))
+        bin_center_x = xl + (np.arange(num_bins_x) + 0.5) * bin_size_x
+        bin_center_y = yl + (np.arange(num_bins_y) + 0.5) * bin_size_y
+        pos = torch.from_numpy(np.concatenate([xx, yy]))
+        scatter_buffer = torch.empty(0, dtype=torch.int64)
+
+        def overlap(x, node_size, bin_center, bin_size, l, h, fixed_node_flag):
+            bin_xl = bin_center-bin_size/2
+            bin_xh = bin_center+bin_size/2
+            if not fixed_node_flag:
+                # movable cells out of the region count in the boundary bins
+                bin_xl = np.where(bin_xl <= l, np.minimum(bin_xl, x), bin_xl)
+                bin_xh = np.where(bin_xh >= h, np.maximum(bin_xh, x+node_size), bin_xh)
+            return np.maximum(np.minimum(x+node_size, bin_xh) - np.maximum(x, bin_xl), 0)
+
+        for fixed_node_flag in [True, False]:
+            # overlap of every cell with every bin
+            golden = np.zeros([num_bins_x, num_bins_y], dtype=dtype)
+            for i in range(num_nodes):
+                golden += np.outer(overlap(xx[i], node_size_x[i], bin_center_x, bin_size_x, xl, xh, fixed_node_flag),
+                        overlap(yy[i], node_size_y[i], bin_center_y, bin_size_y, yl, yh, fixed_node_flag))
+            for deterministic_flag in [False, True]:
+                for scatter_mode in [-1, 0, 1, 2]:
+                    for num_threads in [1, 3]:
+                        result = electric_potential.electric_potential_cpp.exact_density_map(
+                                pos,
+                                torch.from_numpy(node_size_x), torch.from_numpy(node_size_y),
+                                torch.from_numpy(bin_center_x), torch.from_numpy(bin_center_y),
+                                xl, yl, xh, yh,
+                                bin_size_x, bin_size_y,
+                                0, num_nodes,
+                                num_bins_x, num_bins_y,
+                                fixed_node_flag,
+                                deterministic_flag,
+                                num_threads,
+                                scatter_mode,
+                                scatter_buffer
+                                )
+                        print("fixed_node_flag = %d, deterministic_flag = %d, scatter_mode = %d, num_threads = %d, max error = %g"
+                                % (fixed_node_flag, deterministic_flag, scatter_mode, num_threads, np.abs(result.numpy()-golden).max()))
+                        # fixed-point rounding of a few units of 2^-32 per cell in the deterministic mode
+                        np.testing.assert_allclose(result.numpy(), golden, rtol=1e-9, atol=1e-8)
+
+        # fixed macros of the placement, cells 2 to 5
+        result = electric_potential.electric_potential_cpp.fixed_density_map(
+                pos,
+                torch.from_numpy(node_size_x), torch.from_numpy(node_size_y),
+                torch.from_numpy(bin_center_x), torch.from_numpy(bin_center_y),
+                xl, yl, xh, yh,
+                bin_size_x, bin_size_y,
+                2, 4,
+                num_bins_x, num_bins_y,
+                num_bins_x, num_bins_y,
+                False,
+                3
+                )
+        golden = np.zeros([num_bins_x, num_bins_y], dtype=dtype)
+        for i in range(2, 6):
+            golden += np.outer(overlap(xx[i], node_size_x[i], bin_center_x, bin_size_x, xl, xh, True),
+                    overlap(yy[i], node_size_y[i], bin_center_y, bin_size_y, yl, yh, True))
+        np.testing.assert_allclose(result.numpy(), golden, rtol=1e-9, atol=1e-12)
+
 def plot(plot_count, density_map, padding, name):
     """
     density map contour and heat map 
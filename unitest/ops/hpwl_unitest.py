@@ -91,6 +91,64 @@ class HPWLOpTest(unittest.TestCase):
         print("hpwl_value = ", hpwl_value.data.numpy())
         np.testing.assert_allclose(hpwl_value.data.numpy(), golden_value)
 
+        # nets are grouped by degree: bucket offsets first, then net indices
+        net_degree_buckets = custom.net_degree_buckets.numpy()
+        print("net_degree_buckets = ", net_degree_buckets)
+        np.testing.assert_array_equal(net_degree_buckets[:6], [0, 1, 2, 2, 2, 2])
+        np.testing.assert_array_equal(net_degree_buckets[6:], [0, 1])
+
+        # test incremental cpu with cell locations, the last cell is a filler without pins
+        pin2node_map = np.array([0, 0, 1, 2, 2], dtype=np.int32)
+        node_pos = np.array([[0.2, 0.1], [1.0, 0.0], [0.4, 1.0], [2.0, 2.0]], dtype=np.float32)
+        pin_offset = pin_pos - node_pos[pin2node_map]
+        node2pin_map = [np.where(pin2node_map == i)[0] for i in range(3)]
+        flat_node2pin_map = np.concatenate(node2pin_map).astype(np.int32)
+        flat_node2pin_start_map = np.cumsum([0] + [len(pins) for pins in node2pin_map]).astype(np.int32)
+        custom_incremental = hpwl.IncrementalHPWL(
+                flat_netpin=torch.from_numpy(flat_net2pin_map), 
+                netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                pin2net_map=torch.from_numpy(pin2net_map), 
+                pin2node_map=torch.from_numpy(pin2node_map), 
+                pin_offset_x=torch.from_numpy(pin_offset[:, 0].copy()), 
+                pin_offset_y=torch.from_numpy(pin_offset[:, 1].copy()), 
+                flat_node2pin=torch.from_numpy(flat_node2pin_map), 
+                flat_node2pin_start=torch.from_numpy(flat_node2pin_start_map), 
+                net_mask=torch.from_numpy(net_mask)
+                )
+        node_pos_var = torch.from_numpy(np.transpose(node_pos).copy()).reshape([-1])
+        hpwl_value = custom_incremental.forward(node_pos_var)
+        print("hpwl_value incremental = ", hpwl_value.data.numpy())
+        np.testing.assert_allclose(hpwl_value.data.numpy(), golden_value, rtol=1e-6)
+
+        # move cell 1, only net 1 is recomputed
+        node_pos[1] += [0.5, -0.3]
+        node_pos_var = torch.from_numpy(np.transpose(node_pos).copy()).reshape([-1])
+        moved_golden_value = all_hpwl(node_pos[pin2node_map, 0]+pin_offset[:, 0], node_pos[pin2node_map, 1]+pin_offset[:, 1], net2pin_map)
+        hpwl_value = custom_incremental.forward(node_pos_var)
+        print("hpwl_value incremental after move = ", hpwl_value.data.numpy())
+        np.testing.assert_allclose(hpwl_value.data.numpy(), moved_golden_value, rtol=1e-6)
+        np.testing.assert_allclose(custom_incremental.delta.data.numpy(), moved_golden_value-golden_value, rtol=1e-5, atol=1e-6)
+
+        # move cell 0 and report it explicitly
+        node_pos[0] += [-0.1, 0.4]
+        node_pos_var = torch.from_numpy(np.transpose(node_pos).copy()).reshape([-1])
+        moved_golden_value2 = all_hpwl(node_pos[pin2node_map, 0]+pin_offset[:, 0], node_pos[pin2node_map, 1]+pin_offset[:, 1], net2pin_map)
+        hpwl_value, hpwl_delta = custom_incremental.update(node_pos_var, torch.tensor([0], dtype=torch.int32))
+        np.testing.assert_allclose(hpwl_value.data.numpy(), moved_golden_value2, rtol=1e-6)
+        np.testing.assert_allclose(hpwl_delta.data.numpy(), moved_golden_value2-moved_golden_value, rtol=1e-5, atol=1e-6)
+
+        # move all cells, all nets are recomputed
+        node_pos += [[0.3, -0.2], [-0.4, 0.1], [0.2, 0.6], [1.0, 1.0]]
+        node_pos_var = torch.from_numpy(np.transpose(node_pos).copy()).reshape([-1])
+        moved_golden_value3 = all_hpwl(node_pos[pin2node_map, 0]+pin_offset[:, 0], node_pos[pin2node_map, 1]+pin_offset[:, 1], net2pin_map)
+        hpwl_value = custom_incremental.forward(node_pos_var)
+        np.testing.assert_allclose(hpwl_value.data.numpy(), moved_golden_value3, rtol=1e-6)
+        np.testing.assert_allclose(custom_incremental.delta.data.numpy(), moved_golden_value3-moved_golden_value2, rtol=1e-5, atol=1e-6)
+
+        # indices out of range are rejected
+        with self.assertRaises(RuntimeError):
+            custom_incremental.update(node_pos_var, torch.tensor([-1], dtype=torch.int32))
+
         # test gpu 
         if torch.cuda.device_count(): 
             custom_hip = hpwl.HPWL(
@@ -129,5 +187,129 @@ class HPWLOpTest(unittest.TestCase):
             print("hpwl_value hip atomic = ", hpwl_value.data.cpu().numpy())
             np.testing.assert_allclose(hpwl_value.data.cpu().numpy(), golden_value)
 
+    def test_hpwlHighFanout(self):
+        # one net above the high-fanout degree of 1024, parallelized within the net, and small nets
+        np.random.seed(3)
+        net_degrees = [1500, 2, 3, 5, 2, 4]
+        num_pins = sum(net_degrees)
+        pin2net_map = np.repeat(np.arange(len(net_degrees)), net_degrees).astype(np.int32)
+        np.random.shuffle(pin2net_map)
+        flat_net2pin_map = np.argsort(pin2net_map, kind='stable').astype(np.int32)
+        flat_net2pin_start_map = np.concatenate([[0], np.cumsum(net_degrees)]).astype(np.int32)
+        net2pin_map = np.split(flat_net2pin_map, flat_net2pin_start_map[1:-1])
+        # ignore_net_degree raised above the high-fanout net, so it is not masked out
+        net_mask = np.ones(len(net_degrees), dtype=np.uint8)
+        pin_x = np.random.uniform(0, 20, num_pins)
+        pin_y = np.random.uniform(0, 20, num_pins)
+        golden_value = all_hpwl(pin_x, pin_y, net2pin_map)
+
+        for num_threads in [1, 3]:
+            custom = hpwl.HPWL(
+                    flat_netpin=torch.from_numpy(flat_net2pin_map),
+                    netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                    pin2net_map=torch.from_numpy(pin2net_map),
+                    net_mask=torch.from_numpy(net_mask),
+                    algorithm='net-by-net',
+                    num_threads=num_threads
+                    )
+            hpwl_value = custom.forward(torch.from_numpy(np.concatenate([pin_x, pin_y])))
+            print("hpwl_value high fanout %d threads = " % (num_threads), hpwl_value.data.numpy())
+            np.testing.assert_allclose(hpwl_value.data.numpy(), golden_value, rtol=1e-12)
+            # the net of 1500 pins is alone in the last bucket, the one of high-fanout nets
+            np.testing.assert_array_equal(custom.net_degree_buckets.numpy()[4:6], [5, 6])
+            self.assertEqual(custom.net_degree_buckets.numpy()[6+5], 0)
+
+    def test_hpwlAtomicThreads(self):
+        # nets sorted by degree as placement orders them, with empty nets and masked-out nets
+        np.random.seed(11)
+        num_nets = 300
+        net_degrees = np.sort(np.random.randint(2, 40, num_nets))[::-1]
+        net_degrees[::37] = 0
+        # nets with more pins than a range of nets on 8 threads
+        net_degrees[2:5] = [900, 500, 300]
+        num_pins = net_degrees.sum()
+        pin2net_map = np.repeat(np.arange(num_nets), net_degrees).astype(np.int32)
+        np.random.shuffle(pin2net_map)
+        flat_net2pin_map = np.argsort(pin2net_map, kind='stable').astype(np.int32)
+        flat_net2pin_start_map = np.concatenate([[0], np.cumsum(net_degrees)]).astype(np.int32)
+        net2pin_map = np.split(flat_net2pin_map, flat_net2pin_start_map[1:-1])
+        net_mask = np.ones(num_nets, dtype=np.uint8)
+        net_mask[1::5] = 0
+        pin_x = np.random.uniform(0, 50, num_pins)
+        pin_y = np.random.uniform(0, 50, num_pins)
+        golden_value = sum(net_hpwl(pin_x, pin_y, net2pin_map, net_id) for net_id in range(num_nets) if net_mask[net_id] and net_degrees[net_id])
+
+        for num_threads in [1, 3, 8]:
+            custom_atomic = hpwl.HPWL(
+                    flat_netpin=torch.from_numpy(flat_net2pin_map),
+                    netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                    pin2net_map=torch.from_numpy(pin2net_map),
+                    net_mask=torch.from_numpy(net_mask),
+                    algorithm='atomic',
+                    num_threads=num_threads
+                    )
+            hpwl_value = custom_atomic.forward(torch.from_numpy(np.concatenate([pin_x, pin_y])))
+            print("hpwl_value atomic %d threads = " % (num_threads), hpwl_value.data.numpy())
+            np.testing.assert_allclose(hpwl_value.data.numpy(), golden_value, rtol=1e-12)
+
+    def test_hpwlIncrementalRandom(self):
+        # enough cells to mark nets with multiple threads, small moves mostly stay inside the bounding boxes
+        np.random.seed(7)
+        num_nodes = 2000
+        num_filler_nodes = 10
+        num_nets = 1500
+        num_pins = 6000
+        pin2node_map = np.random.randint(0, num_nodes, num_pins).astype(np.int32)
+        pin2net_map = np.concatenate([np.arange(num_nets).repeat(2), np.random.randint(0, num_nets, num_pins-2*num_nets)]).astype(np.int32)
+        flat_net2pin_map = np.argsort(pin2net_map, kind='stable').astype(np.int32)
+        flat_net2pin_start_map = np.concatenate([[0], np.cumsum(np.bincount(pin2net_map, minlength=num_nets))]).astype(np.int32)
+        net2pin_map = np.split(flat_net2pin_map, flat_net2pin_start_map[1:-1])
+        flat_node2pin_map = np.argsort(pin2node_map, kind='stable').astype(np.int32)
+        flat_node2pin_start_map = np.concatenate([[0], np.cumsum(np.bincount(pin2node_map, minlength=num_nodes))]).astype(np.int32)
+        net_mask = np.ones(num_nets, dtype=np.uint8)
+        net_mask[::7] = 0
+        pin_offset_x = np.random.uniform(0, 2, num_pins)
+        pin_offset_y = np.random.uniform(0, 2, num_pins)
+        node_pos = np.random.uniform(0, 100, 2*(num_nodes+num_filler_nodes))
+
+        def golden(node_pos):
+            pin_x = node_pos[pin2node_map]+pin_offset_x
+            pin_y = node_pos[num_nodes+num_filler_nodes+pin2node_map]+pin_offset_y
+            return sum(net_hpwl(pin_x, pin_y, net2pin_map, net_id) for net_id in range(num_nets) if net_mask[net_id])
+
+        for num_threads in [1, 3]:
+            custom = hpwl.IncrementalHPWL(
+                    flat_netpin=torch.from_numpy(flat_net2pin_map),
+                    netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                    pin2net_map=torch.from_numpy(pin2net_map),
+                    pin2node_map=torch.from_numpy(pin2node_map),
+                    pin_offset_x=torch.from_numpy(pin_offset_x),
+                    pin_offset_y=torch.from_numpy(pin_offset_y),
+                    flat_node2pin=torch.from_numpy(flat_node2pin_map),
+                    flat_node2pin_start=torch.from_numpy(flat_node2pin_start_map),
+                    net_mask=torch.from_numpy(net_mask),
+                    num_threads=num_threads
+                    )
+            cur_pos = node_pos.copy()
+            prev_value = golden(cur_pos)
+            np.testing.assert_allclose(custom.reset(torch.from_numpy(cur_pos)).numpy(), prev_value, rtol=1e-12)
+            for step in range(6):
+                # tiny and large moves of a few cells, many cells, and all cells, with duplicated indices
+                num_moved = [5, 600, num_nodes][step%3]
+                scale = [0.01, 3.0][step%2]
+                moved_nodes = np.random.choice(num_nodes, num_moved, replace=False)
+                cur_pos[moved_nodes] += np.random.normal(0, scale, num_moved)
+                cur_pos[num_nodes+num_filler_nodes+moved_nodes] += np.random.normal(0, scale, num_moved)
+                value = golden(cur_pos)
+                if step < 3:
+                    hpwl_value = custom.forward(torch.from_numpy(cur_pos))
+                    hpwl_delta = custom.delta
+                else:
+                    hpwl_value, hpwl_delta = custom.update(torch.from_numpy(cur_pos), torch.from_numpy(np.concatenate([moved_nodes, moved_nodes[:3]])))
+                print("hpwl_value incremental %d threads step %d = " % (num_threads, step), hpwl_value.data.numpy())
+                np.testing.assert_allclose(hpwl_value.data.numpy(), value, rtol=1e-12)
+                np.testing.assert_allclose(hpwl_delta.data.numpy(), value-prev_value, rtol=1e-9, atol=1e-9)
+                prev_value = value
+
 if __name__ == '__main__':
     unittest.main()
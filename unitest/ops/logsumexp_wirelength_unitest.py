@@ -126,6 +126,61 @@ class LogSumExpWirelengthOpTest(unittest.TestCase):
         np.testing.assert_allclose(result.data.numpy(), golden.data.detach().numpy())
         np.testing.assert_allclose(grad.data.numpy(), golden_grad.data.numpy())
 
+        # test cpu net-by-net and atomic
+        for algorithm in ['net-by-net', 'atomic']:
+            pin_pos_var.grad.zero_()
+            custom_cpu = logsumexp_wirelength.LogSumExpWirelength(
+                    torch.from_numpy(flat_net2pin_map), 
+                    torch.from_numpy(flat_net2pin_start_map),
+                    torch.from_numpy(pin2net_map), 
+                    torch.from_numpy(net_mask), 
+                    torch.tensor(gamma), 
+                    algorithm=algorithm
+                    )
+            result_cpu = custom_cpu.forward(pin_pos_var)
+            print("custom_cpu_result %s = " % (algorithm), result_cpu)
+            result_cpu.backward()
+            grad_cpu = pin_pos_var.grad.clone()
+            print("custom_grad_cpu %s = " % (algorithm), grad_cpu)
+
+            np.testing.assert_allclose(result_cpu.data.numpy(), golden.data.detach().numpy(), rtol=1e-6)
+            np.testing.assert_allclose(grad_cpu.data.numpy(), grad.data.numpy(), rtol=1e-6, atol=1e-7)
+
+        # test cpu with cell locations, the last cell is a filler without pins
+        pin2node_map = np.array([0, 0, 1, 2, 2], dtype=np.int32)
+        node_pos = np.array([[0.2, 0.1], [1.0, 0.0], [0.4, 1.0], [2.0, 2.0]], dtype=np.float32)*10
+        pin_offset = pin_pos - node_pos[pin2node_map]
+        node2pin_map = [np.where(pin2node_map == i)[0] for i in range(3)]
+        flat_node2pin_map = np.concatenate(node2pin_map).astype(np.int32)
+        flat_node2pin_start_map = np.cumsum([0] + [len(pins) for pins in node2pin_map]).astype(np.int32)
+        for num_threads in [1, 3]:
+            node_pos_var = Variable(torch.from_numpy(np.transpose(node_pos)).reshape([-1]), requires_grad=True)
+            custom_node = logsumexp_wirelength.LogSumExpWirelength(
+                    flat_netpin=torch.from_numpy(flat_net2pin_map),
+                    netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                    pin2net_map=torch.from_numpy(pin2net_map),
+                    net_mask=torch.from_numpy(net_mask),
+                    gamma=torch.tensor(gamma),
+                    algorithm='net-by-net',
+                    num_threads=num_threads,
+                    pin2node_map=torch.from_numpy(pin2node_map),
+                    pin_offset_x=torch.tensor(pin_offset[:, 0]),
+                    pin_offset_y=torch.tensor(pin_offset[:, 1]),
+                    flat_node2pin=torch.from_numpy(flat_node2pin_map),
+                    flat_node2pin_start=torch.from_numpy(flat_node2pin_start_map)
+                    )
+            result_node = custom_node.forward(node_pos_var)
+            print("custom_node %d threads = " % (num_threads), result_node)
+            result_node.backward()
+            grad_node = node_pos_var.grad.clone()
+            print("custom_grad_node %d threads = " % (num_threads), grad_node)
+            grad_node_ref = np.zeros(node_pos.size, dtype=np.float32)
+            np.add.at(grad_node_ref, pin2node_map, grad.numpy()[:len(pin2node_map)])
+            np.add.at(grad_node_ref, pin2node_map+len(node_pos), grad.numpy()[len(pin2node_map):])
+
+            np.testing.assert_allclose(result_node.data.numpy(), golden.data.detach().numpy(), rtol=1e-6, atol=1e-5)
+            np.testing.assert_allclose(grad_node.data.numpy(), grad_node_ref, rtol=1e-6, atol=1e-6)
+
         # test gpu 
         if torch.cuda.device_count(): 
             pin_pos_var.grad.zero_()
@@ -166,6 +221,90 @@ class LogSumExpWirelengthOpTest(unittest.TestCase):
             np.testing.assert_allclose(result_hip.data.cpu().numpy(), golden.data.detach().numpy())
             np.testing.assert_allclose(grad_hip.data.cpu().numpy(), grad.data.numpy(), rtol=1e-7, atol=1e-15)
 
+    def test_logsumexp_wirelength_sparse_cpu(self):
+        # nets of different degrees so that thread boundaries cut nets
+        np.random.seed(1)
+        net_degrees = [2, 7, 3, 13, 2, 5, 9, 4, 2, 6, 3, 8]
+        num_pins = sum(net_degrees)
+        pin2net_map = np.repeat(np.arange(len(net_degrees)), net_degrees).astype(np.int32)
+        np.random.shuffle(pin2net_map)
+        flat_net2pin_map = np.argsort(pin2net_map, kind='stable').astype(np.int32)
+        flat_net2pin_start_map = np.concatenate([[0], np.cumsum(net_degrees)]).astype(np.int32)
+        net_mask = np.ones(len(net_degrees), dtype=np.uint8)
+        net_mask[3] = 0
+        pin_pos = np.random.uniform(0, 20, size=2*num_pins).astype(np.float64)
+        gamma = torch.tensor(0.5, dtype=torch.float64)
+
+        def run(algorithm, num_threads):
+            pin_pos_var = Variable(torch.from_numpy(pin_pos), requires_grad=True)
+            custom = logsumexp_wirelength.LogSumExpWirelength(
+                    torch.from_numpy(flat_net2pin_map),
+                    torch.from_numpy(flat_net2pin_start_map),
+                    torch.from_numpy(pin2net_map),
+                    torch.from_numpy(net_mask),
+                    gamma,
+                    algorithm=algorithm,
+                    num_threads=num_threads
+                    )
+            result = custom.forward(pin_pos_var)
+            result.backward()
+            return custom, result.data.numpy(), pin_pos_var.grad.data.numpy()
+
+        # existing net-by-net result as reference
+        _, golden, golden_grad = run('net-by-net', 1)
+        for num_threads in [1, 3, 8]:
+            _, result, grad = run('sparse', num_threads)
+            print("custom_cpu_result sparse %d threads = " % (num_threads), result)
+            np.testing.assert_allclose(result, golden, rtol=1e-12)
+            np.testing.assert_allclose(grad, golden_grad, rtol=1e-12, atol=1e-15)
+
+        # each net of the atomic algorithm is summed by one thread in pin order,
+        # so the result does not change with the number of threads
+        _, golden_atomic, golden_atomic_grad = run('atomic', 1)
+        for num_threads in [1, 3, 8]:
+            _, result, grad = run('atomic', num_threads)
+            print("custom_cpu_result atomic %d threads = " % (num_threads), result)
+            np.testing.assert_allclose(result, golden, rtol=1e-12)
+            np.testing.assert_allclose(grad, golden_grad, rtol=1e-12, atol=1e-15)
+            np.testing.assert_array_equal(result, golden_atomic)
+            np.testing.assert_array_equal(grad, golden_atomic_grad)
+
+    def test_logsumexp_wirelength_high_fanout(self):
+        # one net above the high-fanout degree of 1024, parallelized within the net, and small nets
+        np.random.seed(3)
+        net_degrees = [1500, 2, 3, 5, 2, 4]
+        num_pins = sum(net_degrees)
+        pin2net_map = np.repeat(np.arange(len(net_degrees)), net_degrees).astype(np.int32)
+        np.random.shuffle(pin2net_map)
+        flat_net2pin_map = np.argsort(pin2net_map, kind='stable').astype(np.int32)
+        flat_net2pin_start_map = np.concatenate([[0], np.cumsum(net_degrees)]).astype(np.int32)
+        net2pin_map = np.split(flat_net2pin_map, flat_net2pin_start_map[1:-1])
+        # ignore_net_degree raised above the high-fanout net, so it is not masked out
+        net_mask = np.ones(len(net_degrees), dtype=np.uint8)
+        pin_pos = np.random.uniform(0, 20, size=2*num_pins).astype(np.float64)
+        gamma = torch.tensor(2.0, dtype=torch.float64)
+
+        pin_pos_var = Variable(torch.from_numpy(pin_pos), requires_grad=True)
+        golden = build_wirelength(pin_pos_var[:num_pins], pin_pos_var[num_pins:], pin2net_map, net2pin_map, gamma, 2000)
+        golden.backward()
+        golden_grad = pin_pos_var.grad.data.numpy()
+
+        for num_threads in [1, 3]:
+            pin_pos_var = Variable(torch.from_numpy(pin_pos), requires_grad=True)
+            custom = logsumexp_wirelength.LogSumExpWirelength(
+                    torch.from_numpy(flat_net2pin_map),
+                    torch.from_numpy(flat_net2pin_start_map),
+                    torch.from_numpy(pin2net_map),
+                    torch.from_numpy(net_mask),
+                    gamma,
+                    algorithm='net-by-net',
+                    num_threads=num_threads
+                    )
+            result = custom.forward(pin_pos_var)
+            result.backward()
+            print("custom_cpu_result high fanout %d threads = " % (num_threads), result)
+            np.testing.assert_allclose(result.data.numpy(), golden.data.numpy(), rtol=1e-9)
+            np.testing.assert_allclose(pin_pos_var.grad.data.numpy(), golden_grad, rtol=1e-9, atol=1e-12)
 
 if __name__ == '__main__':
     unittest.main()
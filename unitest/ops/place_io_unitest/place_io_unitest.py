@@ -8,14 +8,22 @@ import os
 import sys
 import numpy as np
 import unittest
+import tempfile
 
-sys.path.append(os.path.dirname(os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))))
+root_dir = os.path.dirname(os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__)))))
+sys.path.append(root_dir)
+sys.path.append(os.path.join(root_dir, "dreamplace"))
 from dreamplace.ops.place_io import place_io
+import dreamplace.PlaceDB as PlaceDB
+sys.path.pop()
 sys.path.pop()
 
 class Params (object):
     def __init__(self):
         self.aux_file = None
+        self.dtype = "float32"
+        self.scale_factor = 1.0
+        self.ignore_net_degree = 100
 
 def name2id_map2str(m):
     id2name_map = [None]*len(m)
@@ -36,6 +44,24 @@ def array2str(a):
         content += "%s" % (v)
     return "[%s]" % (content)
 
+def read_names(filename, keyword):
+    """
+    @brief read node or net names in the order of a Bookshelf file
+    @param filename .nodes, .pl or .nets file
+    @param keyword None to take the first token of each entry, otherwise the leading token of net entries
+    """
+    names = []
+    with open(filename, "r") as f:
+        for line in f.readlines()[1:]:
+            tokens = line.split()
+            if not tokens or tokens[0].startswith("#") or tokens[0].startswith("Num"):
+                continue
+            if keyword is None:
+                names.append(tokens[0])
+            elif tokens[0] == keyword:
+                names.append(tokens[-1])
+    return names
+
 class PlaceIOOpTest(unittest.TestCase):
     def test_simple(self):
         params = Params()
@@ -82,5 +108,37 @@ class PlaceIOOpTest(unittest.TestCase):
 
         np.testing.assert_array_equal(content.strip(), golden.strip())
 
+    def test_old2new_maps(self):
+        params = Params()
+        design = os.path.dirname(os.path.realpath(__file__))
+        params.aux_file = os.path.join(design, "simple/simple.aux")
+
+        db = place_io.PlaceIOFunction.forward(params)
+        node_names = np.array([str(name) for name in db.node_names])
+        net_names = np.array([str(name) for name in db.net_names])
+        node_old2new_map = np.array(db.node_old2new_map)
+        net_old2new_map = np.array(db.net_old2new_map)
+
+        # the maps are permutations that recover the order of input files
+        np.testing.assert_array_equal(np.sort(node_old2new_map), np.arange(db.num_nodes))
+        np.testing.assert_array_equal(np.sort(net_old2new_map), np.arange(len(net_names)))
+        input_node_names = read_names(os.path.join(design, "simple/simple.nodes"), None)
+        input_net_names = read_names(os.path.join(design, "simple/simple.nets"), "NetDegree")
+        np.testing.assert_array_equal(node_names[node_old2new_map], input_node_names)
+        np.testing.assert_array_equal(net_names[net_old2new_map], input_net_names)
+        for name, new_id in db.node_name2id_map.items():
+            self.assertEqual(node_names[new_id], str(name))
+
+        # writers emit nodes and nets in the order of input files
+        placedb = PlaceDB.PlaceDB()
+        placedb.read(params)
+        output_dir = tempfile.mkdtemp()
+        pl_file = os.path.join(output_dir, "simple.pl")
+        net_file = os.path.join(output_dir, "simple.nets")
+        placedb.write_pl(params, pl_file)
+        placedb.write_nets(params, net_file)
+        np.testing.assert_array_equal(read_names(pl_file, None), input_node_names)
+        np.testing.assert_array_equal(read_names(net_file, "NetDegree"), input_net_names)
+
 if __name__ == "__main__":
     unittest.main()
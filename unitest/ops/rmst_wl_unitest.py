@@ -59,11 +59,79 @@ class RMSTWLOpTest(unittest.TestCase):
                 POWVFILE=POWVFILE, 
                 POSTFILE=POSTFILE
                 )
-        rmst_wl_value = custom.forward(pin_pos_var, read_lut_flag=True)
-        print("rmst_wl_value = ", rmst_wl_value.data.numpy())
-        rmst_wl_value = custom.forward(pin_pos_var, read_lut_flag=False)
+        rmst_wl_value = custom.forward(pin_pos_var)
         print("rmst_wl_value = ", rmst_wl_value.data.numpy())
+        # look-up tables are only loaded once, so the op can be called repeatedly
+        rmst_wl_value_again = custom.forward(pin_pos_var)
+        print("rmst_wl_value = ", rmst_wl_value_again.data.numpy())
+        np.testing.assert_allclose(rmst_wl_value_again.data.numpy(), rmst_wl_value.data.numpy())
+
+        # test cpu with cached topologies
+        custom_cache = rmst_wl.RMSTWL(
+                torch.from_numpy(flat_net2pin_map), 
+                torch.from_numpy(flat_net2pin_start_map),
+                torch.tensor(len(flat_net2pin_map)), 
+                POWVFILE=POWVFILE, 
+                POSTFILE=POSTFILE, 
+                cache_topology=True
+                )
+        rmst_wl_value = custom_cache.forward(pin_pos_var)
+        print("rmst_wl_value cache = ", rmst_wl_value.data.numpy())
+        np.testing.assert_allclose(rmst_wl_value.data.numpy(), rmst_wl_value_again.data.numpy())
+        # move pin 2 without changing the order of pins, the cached topology is evaluated
+        moved_pin_pos = pin_pos.copy()
+        moved_pin_pos[2] += [0.1, 0.05]
+        moved_pin_pos_var = torch.from_numpy(np.transpose(moved_pin_pos).copy())
+        rmst_wl_value = custom_cache.forward(moved_pin_pos_var)
+        print("rmst_wl_value cache after move = ", rmst_wl_value.data.numpy())
+        self.assertEqual(custom_cache.cache.num_rebuilt_nets(), 0)
+        np.testing.assert_allclose(rmst_wl_value.data.numpy(), custom.forward(moved_pin_pos_var).data.numpy())
         #np.testing.assert_allclose(rmst_wl_value.data.numpy(), golden_value)
 
+    def test_rmst_wl_cache_large_moves(self):
+        # random nets within the degree flute solves optimally
+        np.random.seed(2)
+        net_degrees = np.random.randint(2, 10, size=200)
+        num_pins = int(net_degrees.sum())
+        flat_net2pin_map = np.random.permutation(num_pins).astype(np.int32)
+        flat_net2pin_start_map = np.concatenate([[0], np.cumsum(net_degrees)]).astype(np.int32)
+        pin_pos = np.random.uniform(1, 100, size=2*num_pins)
+
+        project_path = os.path.abspath(os.path.dirname(os.path.dirname(os.path.dirname(__file__))))
+        POWVFILE = os.path.join(project_path, "thirdparty/flute/POWV9.dat")
+        POSTFILE = os.path.join(project_path, "thirdparty/flute/POST9.dat")
+        rebuild_interval = 2
+        custom = rmst_wl.RMSTWL(
+                torch.from_numpy(flat_net2pin_map), 
+                torch.from_numpy(flat_net2pin_start_map),
+                POWVFILE=POWVFILE, 
+                POSTFILE=POSTFILE
+                )
+        custom_cache = rmst_wl.RMSTWL(
+                torch.from_numpy(flat_net2pin_map), 
+                torch.from_numpy(flat_net2pin_start_map),
+                POWVFILE=POWVFILE, 
+                POSTFILE=POSTFILE, 
+                cache_topology=True, 
+                rebuild_interval=rebuild_interval
+                )
+        pos = torch.from_numpy(pin_pos)
+        np.testing.assert_allclose(custom_cache.forward(pos).data.numpy(), custom.forward(pos).data.numpy())
+
+        # stretch x and shrink y, pins keep their order but the distances change a lot
+        moved_pin_pos = pin_pos.copy()
+        moved_pin_pos[:num_pins] = moved_pin_pos[:num_pins]**2/10
+        moved_pin_pos[num_pins:] = np.sqrt(moved_pin_pos[num_pins:])*10
+        pos = torch.from_numpy(moved_pin_pos)
+        golden = custom.forward(pos).data.numpy()
+        # cached topologies are valid trees, but may be longer than fresh ones until rebuilt
+        for i in range(rebuild_interval+1):
+            rmst_wl_value = custom_cache.forward(pos).data.numpy()
+            print("rmst_wl_value cache after large move = ", rmst_wl_value.sum(), " flute = ", golden.sum())
+            self.assertTrue((rmst_wl_value >= golden-1e-6).all())
+        # every topology has been rebuilt after rebuild_interval reuses
+        rmst_wl_value = custom_cache.forward(pos).data.numpy()
+        np.testing.assert_allclose(rmst_wl_value, golden)
+
 if __name__ == '__main__':
   unittest.main()
@@ -0,0 +1,152 @@
+##
+# @file   spatial_sort_unitest.py
+# @author Xu Li
+# @date   10 2024
+#
+
+import os
+import sys
+import numpy as np
+import unittest
+
+import torch
+from torch import nn
+sys.path.append(os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__)))))
+sys.path.append(os.path.join(os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__)))), "dreamplace"))
+from dreamplace.ops.hpwl import hpwl
+from dreamplace.ops.weighted_average_wirelength import weighted_average_wirelength
+import BasicPlace
+import NonLinearPlace
+sys.path.pop()
+sys.path.pop()
+
+class Holder(object):
+    """
+    @brief minimal placement database, data collection and placer for the sorting ops
+    """
+    pass
+
+class SpatialSortOpTest(unittest.TestCase):
+    def test_sortAndRestore(self):
+        np.random.seed(100)
+        dtype = np.float64
+        num_movable_nodes = 60
+        num_terminals = 4
+        num_filler_nodes = 20
+        num_physical_nodes = num_movable_nodes+num_terminals
+        num_nodes = num_physical_nodes+num_filler_nodes
+        num_pins = 200
+        num_nets = 30
+        num_bins_x = 8
+        num_bins_y = 8
+
+        placedb = Holder()
+        placedb.num_nodes = num_nodes
+        placedb.num_movable_nodes = num_movable_nodes
+        placedb.num_physical_nodes = num_physical_nodes
+        placedb.xl = 0.0
+        placedb.yl = 0.0
+        placedb.xh = 100.0
+        placedb.yh = 100.0
+
+        node_size_x = np.random.uniform(1, 4, num_nodes).astype(dtype)
+        node_size_y = np.random.uniform(1, 4, num_nodes).astype(dtype)
+        init_pos = np.concatenate([np.random.uniform(0, 90, num_nodes), np.random.uniform(0, 90, num_nodes)]).astype(dtype)
+
+        # pins of physical cells, nets with at least two pins
+        pin2node_map = np.random.randint(0, num_physical_nodes, num_pins).astype(np.int32)
+        pin_offset_x = (np.random.uniform(0, 1, num_pins)*node_size_x[pin2node_map]).astype(dtype)
+        pin_offset_y = (np.random.uniform(0, 1, num_pins)*node_size_y[pin2node_map]).astype(dtype)
+        pin2net_map = np.concatenate([np.arange(num_nets).repeat(2), np.random.randint(0, num_nets, num_pins-2*num_nets)]).astype(np.int32)
+        np.random.shuffle(pin2net_map)
+        flat_net2pin_map = np.argsort(pin2net_map, kind='stable').astype(np.int32)
+        flat_net2pin_start_map = np.concatenate([[0], np.cumsum(np.bincount(pin2net_map, minlength=num_nets))]).astype(np.int32)
+        flat_node2pin_map = np.argsort(pin2node_map, kind='stable').astype(np.int32)
+        flat_node2pin_start_map = np.concatenate([[0], np.cumsum(np.bincount(pin2node_map, minlength=num_physical_nodes))]).astype(np.int32)
+        net_mask = np.ones(num_nets, dtype=np.uint8)
+        pin_mask = (pin2node_map >= num_movable_nodes).astype(np.uint8)
+
+        hpwl_op = hpwl.HPWL(
+                flat_netpin=torch.from_numpy(flat_net2pin_map),
+                netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                pin2net_map=torch.from_numpy(pin2net_map),
+                net_mask=torch.from_numpy(net_mask),
+                algorithm='net-by-net'
+                )
+
+        def run(sort_step):
+            """
+            @brief take two Adam steps of wirelength from cell locations, optionally sorting cells before the second one
+            @return cell locations, hpwl and cell order before restoring, data collection after restoring
+            """
+            placer = Holder()
+            placer.pos = nn.ParameterList([nn.Parameter(torch.from_numpy(init_pos.copy()))])
+            data_collections = Holder()
+            data_collections.pos = placer.pos
+            data_collections.node_size_x = torch.from_numpy(node_size_x.copy())
+            data_collections.node_size_y = torch.from_numpy(node_size_y.copy())
+            data_collections.pin2node_map = torch.from_numpy(pin2node_map.copy())
+            data_collections.flat_node2pin_map = torch.from_numpy(flat_node2pin_map.copy())
+            data_collections.flat_node2pin_start_map = torch.from_numpy(flat_node2pin_start_map.copy())
+            data_collections.node_order = torch.arange(num_nodes, dtype=torch.int64)
+            spatial_sort_op, restore_node_order_op = BasicPlace.BasicPlace.build_spatial_sort(None, None, placedb, data_collections, torch.device("cpu"))
+
+            # ops keep references to the tensors permuted in place
+            wirelength_op = weighted_average_wirelength.WeightedAverageWirelength(
+                    flat_netpin=torch.from_numpy(flat_net2pin_map),
+                    netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                    pin2net_map=torch.from_numpy(pin2net_map),
+                    net_mask=torch.from_numpy(net_mask),
+                    pin_mask=torch.from_numpy(pin_mask),
+                    gamma=torch.tensor(4.0, dtype=torch.float64),
+                    algorithm='net-by-net',
+                    num_threads=1,
+                    pin2node_map=data_collections.pin2node_map,
+                    pin_offset_x=torch.from_numpy(pin_offset_x),
+                    pin_offset_y=torch.from_numpy(pin_offset_y),
+                    flat_node2pin=data_collections.flat_node2pin_map,
+                    flat_node2pin_start=data_collections.flat_node2pin_start_map
+                    )
+            # a cell-indexed buffer the placer permutes together with cells
+            node_areas = data_collections.node_size_x*data_collections.node_size_y
+            optimizer = torch.optim.Adam(placer.pos.parameters(), lr=1.0)
+            for step in range(2):
+                if step == sort_step:
+                    spatial_sort_op(placer.pos[0], num_bins_x, num_bins_y, NonLinearPlace.NonLinearPlace.node_states(placer, optimizer) + [node_areas])
+                optimizer.zero_grad()
+                wirelength = wirelength_op(placer.pos[0])
+                wirelength.backward()
+                optimizer.step()
+
+            pos = placer.pos[0].data
+            pin_x = pos[:num_nodes].index_select(0, data_collections.pin2node_map.long()) + torch.from_numpy(pin_offset_x)
+            pin_y = pos[num_nodes:].index_select(0, data_collections.pin2node_map.long()) + torch.from_numpy(pin_offset_y)
+            result_hpwl = hpwl_op(torch.cat([pin_x, pin_y]))
+            result_pos = pos.clone()
+            result_node_order = data_collections.node_order.clone()
+            np.testing.assert_allclose(node_areas.numpy(), (data_collections.node_size_x*data_collections.node_size_y).numpy())
+            restore_node_order_op(placer.pos[0], NonLinearPlace.NonLinearPlace.node_states(placer, optimizer) + [node_areas])
+            np.testing.assert_allclose(node_areas.numpy(), node_size_x*node_size_y)
+            return result_pos, result_hpwl, result_node_order, data_collections
+
+        golden_pos, golden_hpwl, _, _ = run(None)
+        sorted_pos, sorted_hpwl, sorted_node_order, sorted_data = run(1)
+
+        # cells are permuted while sorted, fixed cells keep their indices
+        sorted_node_order = sorted_node_order.numpy()
+        self.assertFalse(np.array_equal(sorted_node_order, np.arange(num_nodes)))
+        np.testing.assert_array_equal(sorted_node_order[num_movable_nodes:num_physical_nodes], np.arange(num_movable_nodes, num_physical_nodes))
+        np.testing.assert_allclose(sorted_pos.numpy(), golden_pos.numpy()[np.concatenate([sorted_node_order, sorted_node_order+num_nodes])], rtol=1e-12, atol=1e-12)
+        np.testing.assert_allclose(sorted_hpwl.numpy(), golden_hpwl.numpy(), rtol=1e-12)
+
+        # restored order equals the unsorted run
+        np.testing.assert_array_equal(sorted_data.node_order.numpy(), np.arange(num_nodes))
+        np.testing.assert_allclose(sorted_data.pos[0].data.numpy(), golden_pos.numpy(), rtol=1e-12, atol=1e-12)
+        np.testing.assert_array_equal(sorted_data.node_size_x.numpy(), node_size_x)
+        np.testing.assert_array_equal(sorted_data.node_size_y.numpy(), node_size_y)
+        np.testing.assert_array_equal(sorted_data.pin2node_map.numpy(), pin2node_map)
+        np.testing.assert_array_equal(sorted_data.flat_node2pin_map.numpy(), flat_node2pin_map)
+        np.testing.assert_array_equal(sorted_data.flat_node2pin_start_map.numpy(), flat_node2pin_start_map)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,167 @@
+/**
+ * @file   vector_exp_unitest.cpp
+ * @author Xu Li
+ * @date   10 2024
+ * @brief  Compare the vectorized exponential with std::exp for each instruction set supported by the host
+ */
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "utility/src/vector_exp.h"
+
+DREAMPLACE_BEGIN_NAMESPACE
+
+/// @brief Integer type of the same size as T
+template <typename T>
+struct VectorExpBits;
+
+template <>
+struct VectorExpBits<float>
+{
+    typedef int32_t type;
+};
+
+template <>
+struct VectorExpBits<double>
+{
+    typedef int64_t type;
+};
+
+/// @brief Distance in units in the last place between two non-NaN values,
+/// counting through subnormal numbers and up to infinity
+template <typename T>
+int64_t ulpDistance(T a, T b)
+{
+    typedef typename VectorExpBits<T>::type I;
+    I ia, ib;
+    std::memcpy(&ia, &a, sizeof(T));
+    std::memcpy(&ib, &b, sizeof(T));
+    // map negative values below positive ones, so that integers are ordered as floating point values
+    if (ia < 0)
+    {
+        ia = std::numeric_limits<I>::min()-ia;
+    }
+    if (ib < 0)
+    {
+        ib = std::numeric_limits<I>::min()-ib;
+    }
+    return (ia > ib)? int64_t(ia)-int64_t(ib) : int64_t(ib)-int64_t(ia);
+}
+
+/// @brief Compare one implementation with std::exp
+/// @param func implementation
+/// @param name name for printing
+/// @param lo, hi range of arguments covering underflow to zero and overflow to infinity
+/// @param boundaries arguments around which results become subnormal, zero or infinity
+/// @param max_ulp allowed distance to std::exp in units in the last place
+/// @return number of failures
+template <typename T>
+int testVectorExp(void (*func)(T*, int), const char* name, T lo, T hi, const std::vector<T>& boundaries, int64_t max_ulp)
+{
+    std::vector<T> x;
+    // dense sweep, 100003 is not a multiple of any vector width, so tails are covered
+    const int num_samples = 100003;
+    for (int i = 0; i < num_samples; ++i)
+    {
+        x.push_back(lo+(hi-lo)*i/(num_samples-1));
+    }
+    // arguments around the boundaries, a few ulps apart
+    for (T b : boundaries)
+    {
+        T v = b;
+        for (int i = 0; i < 8; ++i)
+        {
+            v = std::nextafter(v, -std::numeric_limits<T>::infinity());
+        }
+        for (int i = 0; i < 17; ++i)
+        {
+            x.push_back(v);
+            v = std::nextafter(v, std::numeric_limits<T>::infinity());
+        }
+    }
+    // special values
+    x.push_back(T(0));
+    x.push_back(-T(0));
+    x.push_back(std::numeric_limits<T>::infinity());
+    x.push_back(-std::numeric_limits<T>::infinity());
+    x.push_back(std::numeric_limits<T>::max());
+    x.push_back(std::numeric_limits<T>::lowest());
+    x.push_back(std::numeric_limits<T>::denorm_min());
+    x.push_back(std::numeric_limits<T>::quiet_NaN());
+    x.push_back(-std::numeric_limits<T>::quiet_NaN());
+
+    std::vector<T> y (x);
+    func(y.data(), y.size());
+
+    int num_failures = 0;
+    int64_t worst_ulp = 0;
+    for (unsigned int i = 0; i < x.size(); ++i)
+    {
+        T golden = std::exp(x[i]);
+        bool pass;
+        if (std::isnan(golden))
+        {
+            pass = std::isnan(y[i]);
+        }
+        else if (std::isnan(y[i]))
+        {
+            pass = false;
+        }
+        else
+        {
+            int64_t ulp = ulpDistance(y[i], golden);
+            worst_ulp = std::max(worst_ulp, ulp);
+            pass = (ulp <= max_ulp);
+        }
+        if (!pass)
+        {
+            if (num_failures < 10)
+            {
+                printf("[E] %s exp(%.17g) = %.17g, expected %.17g\n", name, (double)x[i], (double)y[i], (double)golden);
+            }
+            ++num_failures;
+        }
+    }
+    printf("[I] %s %u arguments, worst error %ld ulp, %d failures\n", name, (unsigned int)x.size(), (long)worst_ulp, num_failures);
+    return num_failures;
+}
+
+/// @brief Test the scalar fallback and every vector implementation the host can run
+template <typename T>
+int testVectorExpISAs(const char* type_name, T lo, T hi, const std::vector<T>& boundaries, int64_t max_ulp)
+{
+    const VectorExpISA host_isa = detectVectorExpISA();
+    const VectorExpISA isas[] = {VectorExpISA::SCALAR, VectorExpISA::AVX2, VectorExpISA::AVX512};
+    const char* isa_names[] = {"scalar", "avx2", "avx512"};
+    int num_failures = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (isas[i] > host_isa)
+        {
+            printf("[I] %s %s not supported by the host, skipped\n", type_name, isa_names[i]);
+            continue;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "%s %s", type_name, isa_names[i]);
+        num_failures += testVectorExp<T>(vectorExpFunction<T>(isas[i]), name, lo, hi, boundaries, max_ulp);
+    }
+    return num_failures;
+}
+
+DREAMPLACE_END_NAMESPACE
+
+int main()
+{
+    int num_failures = 0;
+    // boundaries: subnormal results, underflow to zero, overflow to infinity
+    num_failures += DREAMPLACE_NAMESPACE::testVectorExpISAs<double>("double", -746.0, 710.0,
+            {std::log(std::numeric_limits<double>::min()), -745.13321910194111, std::log(std::numeric_limits<double>::max())}, 2);
+    num_failures += DREAMPLACE_NAMESPACE::testVectorExpISAs<float>("float", -104.0f, 89.0f,
+            {std::log(std::numeric_limits<float>::min()), -103.972077f, std::log(std::numeric_limits<float>::max())}, 2);
+    printf("%s\n", (num_failures)? "FAILED" : "PASSED");
+    return (num_failures)? 1 : 0;
+}
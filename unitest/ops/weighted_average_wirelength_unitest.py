@@ -133,6 +133,74 @@ class WeightedAverageWirelengthOpTest(unittest.TestCase):
 
         np.testing.assert_allclose(result.data.numpy(), golden_value, atol=1e-6)
 
+        # fused forward should match the separate backward pass 
+        grad_ref = weighted_average_wirelength.weighted_average_wirelength_cpp.backward(
+                torch.tensor(1.0, dtype=dtype), 
+                pin_pos_var.data, 
+                torch.from_numpy(flat_net2pin_map), 
+                torch.from_numpy(flat_net2pin_start_map), 
+                torch.from_numpy(net_mask), 
+                torch.tensor(gamma, dtype=dtype), 
+                custom.num_threads
+                )
+        print("custom_grad_ref = ", grad_ref)
+        np.testing.assert_allclose(grad.data.numpy(), grad_ref.numpy(), rtol=1e-6, atol=1e-7)
+
+        # test cpu with cell locations, the last cell is a filler without pins
+        pin2node_map = np.array([0, 0, 1, 2, 2], dtype=np.int32)
+        node_pos = np.array([[0.2, 0.1], [1.0, 0.0], [0.4, 1.0], [2.0, 2.0]], dtype=np.float32)
+        pin_offset = pin_pos - node_pos[pin2node_map]
+        node2pin_map = [np.where(pin2node_map == i)[0] for i in range(3)]
+        flat_node2pin_map = np.concatenate(node2pin_map).astype(np.int32)
+        flat_node2pin_start_map = np.cumsum([0] + [len(pins) for pins in node2pin_map]).astype(np.int32)
+        node_pos_var = Variable(torch.tensor(np.transpose(node_pos), dtype=dtype).reshape([-1]), requires_grad=True)
+        custom_node = weighted_average_wirelength.WeightedAverageWirelength(
+                flat_netpin=torch.from_numpy(flat_net2pin_map), 
+                netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                pin2net_map=torch.from_numpy(pin2net_map), 
+                net_mask=torch.from_numpy(net_mask), 
+                pin_mask=torch.from_numpy(pin_mask), 
+                gamma=torch.tensor(gamma, dtype=dtype), 
+                algorithm='net-by-net', 
+                pin2node_map=torch.from_numpy(pin2node_map), 
+                pin_offset_x=torch.tensor(pin_offset[:, 0], dtype=dtype), 
+                pin_offset_y=torch.tensor(pin_offset[:, 1], dtype=dtype), 
+                flat_node2pin=torch.from_numpy(flat_node2pin_map), 
+                flat_node2pin_start=torch.from_numpy(flat_node2pin_start_map)
+                )
+        result_node = custom_node.forward(node_pos_var)
+        print("custom_node = ", result_node)
+        result_node.backward()
+        grad_node = node_pos_var.grad.clone()
+        print("custom_grad_node = ", grad_node)
+        grad_node_ref = np.zeros(node_pos.size, dtype=np.float32)
+        np.add.at(grad_node_ref, pin2node_map, grad.numpy()[:len(pin2node_map)])
+        np.add.at(grad_node_ref, pin2node_map+len(node_pos), grad.numpy()[len(pin2node_map):])
+
+        np.testing.assert_allclose(result_node.data.numpy(), golden_value, atol=1e-6)
+        np.testing.assert_allclose(grad_node.data.numpy(), grad_node_ref, rtol=1e-6, atol=1e-6)
+
+        # test cpu atomic and sparse
+        for algorithm in ['atomic', 'sparse']:
+            pin_pos_var.grad.zero_()
+            custom_cpu = weighted_average_wirelength.WeightedAverageWirelength(
+                    flat_netpin=torch.from_numpy(flat_net2pin_map), 
+                    netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                    pin2net_map=torch.from_numpy(pin2net_map), 
+                    net_mask=torch.from_numpy(net_mask), 
+                    pin_mask=torch.from_numpy(pin_mask), 
+                    gamma=torch.tensor(gamma, dtype=dtype), 
+                    algorithm=algorithm
+                    )
+            result_cpu = custom_cpu.forward(pin_pos_var)
+            print("custom_cpu_result %s = " % (algorithm), result_cpu)
+            result_cpu.backward()
+            grad_cpu = pin_pos_var.grad.clone()
+            print("custom_grad_cpu %s = " % (algorithm), grad_cpu)
+
+            np.testing.assert_allclose(result_cpu.data.numpy(), golden_value, atol=1e-6)
+            np.testing.assert_allclose(grad_cpu.data.numpy(), grad.data.numpy(), rtol=1e-6, atol=1e-7)
+
         # test gpu 
         if torch.cuda.device_count(): 
             pin_pos_var.grad.zero_()
@@ -196,6 +264,58 @@ class WeightedAverageWirelengthOpTest(unittest.TestCase):
             np.testing.assert_allclose(result_hip.data.cpu().numpy(), golden_value, atol=1e-6)
             np.testing.assert_allclose(grad_hip.data.cpu().numpy(), grad.data.numpy(), rtol=1e-6, atol=1e-7)
 
+    def test_weighted_average_wirelength_high_fanout(self):
+        dtype = torch.float64
+        np.random.seed(3)
+        # one net above the high-fanout degree of 1024, parallelized within the net, and small nets
+        net_degrees = [1500, 2, 3, 5, 2, 4]
+        num_pins = sum(net_degrees)
+        net2pin_map = np.array(np.split(np.random.permutation(num_pins).astype(np.int32), np.cumsum(net_degrees)[:-1]), dtype=object)
+        pin2net_map = np.zeros(num_pins, dtype=np.int32)
+        for net_id, pins in enumerate(net2pin_map):
+            pin2net_map[pins] = net_id
+        pin_pos = np.random.uniform(0, 20, [num_pins, 2])
+        gamma = 2.0
+        # ignore_net_degree raised above the high-fanout net, so it is not masked out
+        ignore_net_degree = 2000
+        pin_mask = np.zeros(num_pins, dtype=np.uint8)
+        net_mask = np.array([len(pins) < ignore_net_degree for pins in net2pin_map], dtype=np.uint8)
+        flat_net2pin_map = np.concatenate(net2pin_map).astype(np.int32)
+        flat_net2pin_start_map = np.cumsum([0] + net_degrees).astype(np.int32)
+
+        golden_value = np.array([build_wirelength(pin_pos[:, 0], pin_pos[:, 1], pin2net_map, net2pin_map, gamma, ignore_net_degree)])
+        print("golden_value high fanout = ", golden_value)
+
+        # the net of 1500 pins is alone in the last bucket, the one of high-fanout nets
+        net_degree_buckets = weighted_average_wirelength.weighted_average_wirelength_cpp.degree_buckets(
+                torch.from_numpy(flat_net2pin_start_map), torch.from_numpy(net_mask)).numpy()
+        np.testing.assert_array_equal(net_degree_buckets[4:6], [5, 6])
+        self.assertEqual(net_degree_buckets[6+5], 0)
+
+        def run(algorithm, num_threads):
+            pin_pos_var = Variable(torch.tensor(np.transpose(pin_pos), dtype=dtype).reshape([-1]), requires_grad=True)
+            custom = weighted_average_wirelength.WeightedAverageWirelength(
+                    flat_netpin=torch.from_numpy(flat_net2pin_map),
+                    netpin_start=torch.from_numpy(flat_net2pin_start_map),
+                    pin2net_map=torch.from_numpy(pin2net_map),
+                    net_mask=torch.from_numpy(net_mask),
+                    pin_mask=torch.from_numpy(pin_mask),
+                    gamma=torch.tensor(gamma, dtype=dtype),
+                    algorithm=algorithm,
+                    num_threads=num_threads
+                    )
+            result = custom.forward(pin_pos_var)
+            result.backward()
+            return result, pin_pos_var.grad.clone()
+
+        # per-pin atomic additions do not group nets by degree
+        result_atomic, grad_atomic = run('atomic', 1)
+        for num_threads in [1, 3]:
+            result, grad = run('net-by-net', num_threads)
+            print("custom high fanout with %d threads = " % (num_threads), result)
+            np.testing.assert_allclose(result.data.numpy(), golden_value, rtol=1e-9)
+            np.testing.assert_allclose(grad.numpy(), grad_atomic.numpy(), rtol=1e-9, atol=1e-12)
+
 def eval_runtime(design):
     with gzip.open("../../../../benchmarks/ispd2005/wirelength/%s_wirelength.pklz" % (design), "rb") as f:
         flat_net2pin_map, flat_net2pin_start_map, pin2net_map, net_mask, pin_mask, gamma = pickle.load(f)